@@ -0,0 +1,347 @@
+// Headless Physics::update benchmark. Sweeps body count, thread count, solver and integrator over a Plummer
+// sphere and reports step times, steps per second, ns per pair-equivalent interaction and energy drift.
+//
+//   photon_bench --bodies 1000,4000,16000 --threads 1,4 --solver direct,simd,bh --integrator leapfrog
+//                --steps 50 --warmup 5 --reps 5 --json out.json --csv out.csv
+
+#include "physics.hpp"
+#include "InitialConditions.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+    inline double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    struct NamedSolver { const char* name; GravitySolver solver; };
+    struct NamedIntegrator { const char* name; Integrator integrator; uint32_t forceEvaluations; };
+
+    constexpr NamedSolver SOLVERS[] = {
+        {"direct", GravitySolver::Direct},
+        {"simd", GravitySolver::DirectSIMD},
+        {"bh", GravitySolver::BarnesHut},
+        {"fmm", GravitySolver::FMM},
+        {"pm", GravitySolver::ParticleMesh},
+    };
+    // force evaluations per step once the previous step's forces are reused, Hermite counts its own
+    constexpr NamedIntegrator INTEGRATORS[] = {
+        {"euler", Integrator::SemiImplicitEuler, 1},
+        {"leapfrog", Integrator::LeapfrogKDK, 1},
+        {"verlet", Integrator::VelocityVerlet, 1},
+        {"yoshida", Integrator::Yoshida4, 3},
+        {"hermite", Integrator::HermiteBlock, 0},
+    };
+
+    struct Options {
+        std::vector<size_t> bodies{1000, 4000, 16000};
+        std::vector<size_t> threads{0};
+        std::vector<NamedSolver> solvers{SOLVERS[1]};
+        std::vector<NamedIntegrator> integrators{INTEGRATORS[1]};
+        Precision precision = Precision::Single;
+        uint32_t steps = 50;
+        uint32_t warmup = 5;
+        uint32_t reps = 5;
+        float dt = 0.01f;
+        uint64_t seed = 1;
+        size_t energyMaxBodies = 65536; // the energy is an O(N^2) double sum, skipped above this
+        std::string jsonPath;
+        std::string csvPath;
+    };
+
+    struct Result {
+        size_t bodies = 0;
+        size_t threads = 0;
+        const char* solver = "";
+        const char* integrator = "";
+        uint32_t reps = 0;
+        uint32_t steps = 0;
+
+        // per-step wall time over the repetitions, each repetition contributes its mean
+        double medianMs = 0.0;
+        double meanMs = 0.0;
+        double stddevMs = 0.0;
+        double minMs = 0.0;
+        double maxMs = 0.0;
+        double stepsPerSecond = 0.0;
+        double nsPerInteraction = 0.0;
+
+        // relative |E_end - E_0| / |E_0| over warmup and timed steps, worst repetition; NaN when skipped
+        double energyDrift = std::nan("");
+    };
+
+    void usage() {
+        std::printf(
+            "usage: photon_bench [options]\n"
+            "  --bodies N,N,...        body counts (default 1000,4000,16000)\n"
+            "  --threads N,N,...       thread counts, 0 = hardware concurrency (default 0)\n"
+            "  --solver S,S,...        direct simd bh fmm pm (default simd)\n"
+            "  --integrator I,I,...    euler leapfrog verlet yoshida hermite (default leapfrog)\n"
+            "  --precision single|mixed\n"
+            "  --steps N               timed steps per repetition (default 50)\n"
+            "  --warmup N              untimed steps before timing (default 5)\n"
+            "  --reps N                repetitions per configuration (default 5)\n"
+            "  --dt DT                 step size (default 0.01)\n"
+            "  --seed N                initial condition seed (default 1)\n"
+            "  --energy-max N          largest body count that gets an energy drift (default 65536)\n"
+            "  --json PATH             write results as JSON\n"
+            "  --csv PATH              write results as CSV\n");
+    }
+
+    std::vector<std::string> splitList(const char* arg) {
+        std::vector<std::string> out;
+        std::string item;
+        for (const char* c = arg; ; ++c) {
+            if (*c == ',' || *c == '\0') {
+                if (!item.empty()) out.push_back(item);
+                item.clear();
+                if (*c == '\0') break;
+            } else {
+                item += *c;
+            }
+        }
+        return out;
+    }
+
+    std::optional<Options> parseOptions(int argc, char** argv) {
+        Options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string flag = argv[i];
+            if (flag == "--help" || flag == "-h") return std::nullopt;
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "missing value for %s\n", flag.c_str());
+                return std::nullopt;
+            }
+            const char* value = argv[++i];
+
+            if (flag == "--bodies" || flag == "--threads") {
+                std::vector<size_t> counts;
+                for (const std::string& item : splitList(value)) counts.push_back(std::strtoull(item.c_str(), nullptr, 10));
+                (flag == "--bodies" ? options.bodies : options.threads) = counts;
+            } else if (flag == "--solver") {
+                options.solvers.clear();
+                for (const std::string& item : splitList(value)) {
+                    auto it = std::find_if(std::begin(SOLVERS), std::end(SOLVERS), [&](const NamedSolver& s) { return item == s.name; });
+                    if (it == std::end(SOLVERS)) {
+                        std::fprintf(stderr, "unknown solver %s\n", item.c_str());
+                        return std::nullopt;
+                    }
+                    options.solvers.push_back(*it);
+                }
+            } else if (flag == "--integrator") {
+                options.integrators.clear();
+                for (const std::string& item : splitList(value)) {
+                    auto it = std::find_if(std::begin(INTEGRATORS), std::end(INTEGRATORS), [&](const NamedIntegrator& s) { return item == s.name; });
+                    if (it == std::end(INTEGRATORS)) {
+                        std::fprintf(stderr, "unknown integrator %s\n", item.c_str());
+                        return std::nullopt;
+                    }
+                    options.integrators.push_back(*it);
+                }
+            } else if (flag == "--precision") {
+                options.precision = std::strcmp(value, "mixed") == 0 ? Precision::Mixed : Precision::Single;
+            } else if (flag == "--steps") {
+                options.steps = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            } else if (flag == "--warmup") {
+                options.warmup = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            } else if (flag == "--reps") {
+                options.reps = std::max<uint32_t>(1, static_cast<uint32_t>(std::strtoul(value, nullptr, 10)));
+            } else if (flag == "--dt") {
+                options.dt = std::strtof(value, nullptr);
+            } else if (flag == "--seed") {
+                options.seed = std::strtoull(value, nullptr, 10);
+            } else if (flag == "--energy-max") {
+                options.energyMaxBodies = std::strtoull(value, nullptr, 10);
+            } else if (flag == "--json") {
+                options.jsonPath = value;
+            } else if (flag == "--csv") {
+                options.csvPath = value;
+            } else {
+                std::fprintf(stderr, "unknown option %s\n", flag.c_str());
+                return std::nullopt;
+            }
+        }
+        if (options.steps == 0) options.steps = 1;
+        return options;
+    }
+
+    // Kinetic plus pairwise potential energy in double, same unsoftened 1/r potential as the force kernels
+    double totalEnergy(const BodyStore& bodies, ThreadPool& pool) {
+        const size_t n = bodies.size();
+        std::vector<double> partial(pool.getThreadCount(), 0.0);
+        pool.parallelFor(n, 64, [&](size_t begin, size_t end, size_t thread) {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; ++i) {
+                const glm::dvec3 pi = bodies.posD(i);
+                const glm::dvec3 vi = bodies.velD(i);
+                const double mi = bodies.mass[i];
+                sum += 0.5 * mi * glm::dot(vi, vi);
+                double potential = 0.0;
+                for (size_t j = i + 1; j < n; ++j) {
+                    const double r = glm::length(bodies.posD(j) - pi);
+                    if (r > 0.0) potential -= double(bodies.mass[j]) / r;
+                }
+                sum += double(Physics::G) * mi * potential;
+            }
+            partial[thread] += sum;
+        });
+        double total = 0.0;
+        for (double p : partial) total += p;
+        return total;
+    }
+
+    Result runConfiguration(const Options& options, const BodyBatch& batch, size_t threads,
+                            const NamedSolver& solver, const NamedIntegrator& integrator) {
+        Result result;
+        result.bodies = batch.size();
+        result.solver = solver.name;
+        result.integrator = integrator.name;
+        result.reps = options.reps;
+        result.steps = options.steps;
+
+        const bool measureEnergy = batch.size() <= options.energyMaxBodies;
+        std::vector<double> repMs;
+        double pairEvaluations = 0.0;
+        double worstDrift = 0.0;
+
+        for (uint32_t rep = 0; rep < options.reps; ++rep) {
+            // a fresh instance per repetition, so every one starts from the same state with cold caches in the solvers
+            Physics physics(threads);
+            physics.setSolver(solver.solver);
+            physics.setIntegrator(integrator.integrator);
+            physics.setPrecision(options.precision);
+            physics.addPlanets(batch.pos, batch.vel, batch.mass, batch.radius);
+            result.threads = physics.getThreadCount();
+
+            ThreadPool energyPool(threads);
+            const double e0 = measureEnergy ? totalEnergy(physics.getBodies(), energyPool) : 0.0;
+
+            for (uint32_t i = 0; i < options.warmup; ++i) physics.update(options.dt);
+
+            double hermitePairs = 0.0;
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < options.steps; ++i) {
+                physics.update(options.dt);
+                if (integrator.integrator == Integrator::HermiteBlock) hermitePairs += double(physics.getHermite().getStats().pairEvaluations);
+            }
+            repMs.push_back(elapsedMs(start) / options.steps);
+
+            const double n = double(physics.getPlanetCount());
+            pairEvaluations += integrator.integrator == Integrator::HermiteBlock
+                ? 0.5 * hermitePairs / options.steps // Hermite counts each direction of a pair
+                : 0.5 * n * (n - 1.0) * integrator.forceEvaluations;
+
+            if (measureEnergy && e0 != 0.0) {
+                const double e1 = totalEnergy(physics.getBodies(), energyPool);
+                worstDrift = std::max(worstDrift, std::abs((e1 - e0) / e0));
+            }
+        }
+
+        std::vector<double> sorted = repMs;
+        std::sort(sorted.begin(), sorted.end());
+        const size_t reps = sorted.size();
+        result.medianMs = reps % 2 ? sorted[reps / 2] : 0.5 * (sorted[reps / 2 - 1] + sorted[reps / 2]);
+        result.minMs = sorted.front();
+        result.maxMs = sorted.back();
+        for (double ms : repMs) result.meanMs += ms;
+        result.meanMs /= reps;
+        for (double ms : repMs) result.stddevMs += (ms - result.meanMs) * (ms - result.meanMs);
+        result.stddevMs = reps > 1 ? std::sqrt(result.stddevMs / (reps - 1)) : 0.0;
+
+        result.stepsPerSecond = result.medianMs > 0.0 ? 1000.0 / result.medianMs : 0.0;
+        const double pairsPerStep = pairEvaluations / reps;
+        result.nsPerInteraction = pairsPerStep > 0.0 ? result.medianMs * 1e6 / pairsPerStep : 0.0;
+        if (measureEnergy) result.energyDrift = worstDrift;
+        return result;
+    }
+
+    void writeJson(const std::string& path, const Options& options, const std::vector<Result>& results) {
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file) {
+            std::fprintf(stderr, "cannot write %s\n", path.c_str());
+            return;
+        }
+        std::fprintf(file, "{\n  \"dt\": %g,\n  \"steps\": %u,\n  \"warmup\": %u,\n  \"reps\": %u,\n  \"seed\": %llu,\n",
+                     options.dt, options.steps, options.warmup, options.reps, static_cast<unsigned long long>(options.seed));
+        std::fprintf(file, "  \"precision\": \"%s\",\n  \"simd\": \"%s\",\n  \"results\": [\n",
+                     options.precision == Precision::Mixed ? "mixed" : "single", simdLevelName(detectSimdLevel()));
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            std::fprintf(file,
+                         "    {\"bodies\": %zu, \"threads\": %zu, \"solver\": \"%s\", \"integrator\": \"%s\", "
+                         "\"median_ms\": %.6f, \"mean_ms\": %.6f, \"stddev_ms\": %.6f, \"min_ms\": %.6f, \"max_ms\": %.6f, "
+                         "\"steps_per_second\": %.3f, \"ns_per_interaction\": %.4f, ",
+                         r.bodies, r.threads, r.solver, r.integrator, r.medianMs, r.meanMs, r.stddevMs, r.minMs, r.maxMs,
+                         r.stepsPerSecond, r.nsPerInteraction);
+            if (std::isnan(r.energyDrift)) std::fprintf(file, "\"energy_drift\": null}");
+            else std::fprintf(file, "\"energy_drift\": %.6e}", r.energyDrift);
+            std::fprintf(file, "%s\n", i + 1 < results.size() ? "," : "");
+        }
+        std::fprintf(file, "  ]\n}\n");
+        std::fclose(file);
+    }
+
+    void writeCsv(const std::string& path, const std::vector<Result>& results) {
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file) {
+            std::fprintf(stderr, "cannot write %s\n", path.c_str());
+            return;
+        }
+        std::fprintf(file, "bodies,threads,solver,integrator,reps,steps,median_ms,mean_ms,stddev_ms,min_ms,max_ms,"
+                           "steps_per_second,ns_per_interaction,energy_drift\n");
+        for (const Result& r : results) {
+            std::fprintf(file, "%zu,%zu,%s,%s,%u,%u,%.6f,%.6f,%.6f,%.6f,%.6f,%.3f,%.4f,",
+                         r.bodies, r.threads, r.solver, r.integrator, r.reps, r.steps, r.medianMs, r.meanMs, r.stddevMs,
+                         r.minMs, r.maxMs, r.stepsPerSecond, r.nsPerInteraction);
+            if (!std::isnan(r.energyDrift)) std::fprintf(file, "%.6e", r.energyDrift);
+            std::fprintf(file, "\n");
+        }
+        std::fclose(file);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::optional<Options> parsed = parseOptions(argc, argv);
+    if (!parsed) {
+        usage();
+        return 1;
+    }
+    const Options& options = *parsed;
+
+    std::printf("%8s %4s %-8s %-9s %11s %9s %9s %12s %11s\n",
+                "bodies", "thr", "solver", "integr", "median ms", "+- ms", "steps/s", "ns/interact", "dE/E");
+
+    std::vector<Result> results;
+    ThreadPool generatorPool;
+    for (size_t bodies : options.bodies) {
+        PlummerParams params;
+        params.count = bodies;
+        params.placement.seed = options.seed;
+        const BodyBatch batch = generatePlummer(params, Physics::G, generatorPool);
+
+        for (size_t threads : options.threads) {
+            for (const NamedSolver& solver : options.solvers) {
+                for (const NamedIntegrator& integrator : options.integrators) {
+                    const Result r = runConfiguration(options, batch, threads, solver, integrator);
+                    std::printf("%8zu %4zu %-8s %-9s %11.3f %9.3f %9.1f %12.3f %11.3e\n",
+                                r.bodies, r.threads, r.solver, r.integrator, r.medianMs, r.stddevMs,
+                                r.stepsPerSecond, r.nsPerInteraction, r.energyDrift);
+                    std::fflush(stdout);
+                    results.push_back(r);
+                }
+            }
+        }
+    }
+
+    if (!options.jsonPath.empty()) writeJson(options.jsonPath, options, results);
+    if (!options.csvPath.empty()) writeCsv(options.csvPath, results);
+    return 0;
+}
@@ -0,0 +1,490 @@
+// Headless ensemble runner for sensitivity studies. Expands a sweep spec into independent runs, each on its own
+// Physics instance, and spreads them over the cores: workers pull the next run from a shared counter, most
+// expensive first, so short and long runs even out. Writes one CSV of diagnostics per run and a summary table.
+//
+//   photon_ensemble sweep.txt --jobs 64 --output runs/
+//
+// The spec has one "key = value" per line, '#' starts a comment. A value is a single item, a comma list or a
+// range lo:hi:count (count evenly spaced values, both ends included); the runs are every combination of them.
+//
+//   scene = plummer          plummer king disk belt
+//   bodies = 256
+//   steps = 2000
+//   dt = 0.01
+//   solver = direct          direct simd bh fmm pm
+//   integrator = leapfrog    euler leapfrog verlet yoshida hermite
+//   seed = 1:8:8
+//   restitution = 0.2, 0.5, 0.8
+//   mass_scale = 0.5:2:4     multiplies every mass after generation
+//   velocity_scale = 1       multiplies every velocity after generation
+//   body_radius = 0.05
+//   sample_every = 10        steps between rows of a run's CSV, 0 for none
+
+#include "physics.hpp"
+#include "InitialConditions.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+    inline double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    struct NamedSolver { const char* name; GravitySolver solver; };
+    struct NamedIntegrator { const char* name; Integrator integrator; };
+
+    constexpr NamedSolver SOLVERS[] = {
+        {"direct", GravitySolver::Direct},
+        {"simd", GravitySolver::DirectSIMD},
+        {"bh", GravitySolver::BarnesHut},
+        {"fmm", GravitySolver::FMM},
+        {"pm", GravitySolver::ParticleMesh},
+    };
+    constexpr NamedIntegrator INTEGRATORS[] = {
+        {"euler", Integrator::SemiImplicitEuler},
+        {"leapfrog", Integrator::LeapfrogKDK},
+        {"verlet", Integrator::VelocityVerlet},
+        {"yoshida", Integrator::Yoshida4},
+        {"hermite", Integrator::HermiteBlock},
+    };
+    constexpr const char* SCENES[] = {"plummer", "king", "disk", "belt"};
+
+    // One run, every key of the spec resolved
+    struct RunSpec {
+        size_t id = 0;
+        std::string scene = "plummer";
+        size_t bodies = 256;
+        uint32_t steps = 1000;
+        float dt = 0.01f;
+        NamedSolver solver = SOLVERS[0];
+        NamedIntegrator integrator = INTEGRATORS[1];
+        uint64_t seed = 1;
+        float restitution = 0.8f;
+        float massScale = 1.0f;
+        float velocityScale = 1.0f;
+        float bodyRadius = 0.05f;
+        uint32_t sampleEvery = 10;
+    };
+
+    // A spec key with the values it takes, in the order they were given
+    struct Axis {
+        std::string key;
+        std::vector<std::string> values;
+    };
+
+    struct Options {
+        std::string specPath;
+        std::string outputDir;
+        size_t jobs = 0;          // concurrent runs, 0 = hardware concurrency
+        size_t threadsPerRun = 1; // Physics threads inside a run, 1 keeps runs from competing for cores
+        bool dryRun = false;
+    };
+
+    struct RunResult {
+        double wallMs = 0.0;
+        double energyDrift = std::nan("");
+        double angularMomentumDrift = std::nan("");
+        double momentumDrift = std::nan("");
+        double kinetic = 0.0;
+        double rmsRadius = 0.0; // about the centre of mass, how far the system has spread
+    };
+
+    void usage() {
+        std::printf(
+            "usage: photon_ensemble SPEC [options]\n"
+            "  --jobs N                concurrent runs, 0 = hardware concurrency (default 0)\n"
+            "  --threads-per-run N     Physics threads inside each run (default 1)\n"
+            "  --output DIR            write run_NNNN.csv per run and summary.csv here\n"
+            "  --dry-run               list the runs without simulating\n");
+    }
+
+    std::string trim(const std::string& s) {
+        const size_t begin = s.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) return "";
+        return s.substr(begin, s.find_last_not_of(" \t\r") - begin + 1);
+    }
+
+    // "a, b, c" or "lo:hi:count"
+    bool expandValues(const std::string& text, std::vector<std::string>& out) {
+        out.clear();
+        if (text.find(':') != std::string::npos) {
+            double lo, hi;
+            unsigned count;
+            if (std::sscanf(text.c_str(), "%lf:%lf:%u", &lo, &hi, &count) != 3 || count == 0) return false;
+            char buffer[64];
+            for (unsigned k = 0; k < count; ++k) {
+                std::snprintf(buffer, sizeof(buffer), "%g", count == 1 ? lo : lo + (hi - lo) * k / (count - 1));
+                out.push_back(buffer);
+            }
+            return true;
+        }
+        size_t begin = 0;
+        while (begin <= text.size()) {
+            size_t end = text.find(',', begin);
+            if (end == std::string::npos) end = text.size();
+            const std::string item = trim(text.substr(begin, end - begin));
+            if (!item.empty()) out.push_back(item);
+            begin = end + 1;
+        }
+        return !out.empty();
+    }
+
+    // False for an unknown key or a value that doesn't parse
+    bool setField(RunSpec& spec, const std::string& key, const std::string& value) {
+        char* end = nullptr;
+        const double number = std::strtod(value.c_str(), &end);
+        const bool numeric = end != value.c_str() && *end == '\0';
+
+        if (key == "scene") {
+            if (std::find_if(std::begin(SCENES), std::end(SCENES), [&](const char* s) { return value == s; }) == std::end(SCENES)) return false;
+            spec.scene = value;
+            return true;
+        }
+        if (key == "solver") {
+            auto it = std::find_if(std::begin(SOLVERS), std::end(SOLVERS), [&](const NamedSolver& s) { return value == s.name; });
+            if (it == std::end(SOLVERS)) return false;
+            spec.solver = *it;
+            return true;
+        }
+        if (key == "integrator") {
+            auto it = std::find_if(std::begin(INTEGRATORS), std::end(INTEGRATORS), [&](const NamedIntegrator& s) { return value == s.name; });
+            if (it == std::end(INTEGRATORS)) return false;
+            spec.integrator = *it;
+            return true;
+        }
+        if (!numeric || number < 0.0) return false;
+        if (key == "bodies") spec.bodies = static_cast<size_t>(std::llround(number));
+        else if (key == "steps") spec.steps = static_cast<uint32_t>(std::llround(number));
+        else if (key == "dt") spec.dt = static_cast<float>(number);
+        else if (key == "seed") spec.seed = static_cast<uint64_t>(std::llround(number));
+        else if (key == "restitution") spec.restitution = static_cast<float>(number);
+        else if (key == "mass_scale") spec.massScale = static_cast<float>(number);
+        else if (key == "velocity_scale") spec.velocityScale = static_cast<float>(number);
+        else if (key == "body_radius") spec.bodyRadius = static_cast<float>(number);
+        else if (key == "sample_every") spec.sampleEvery = static_cast<uint32_t>(std::llround(number));
+        else return false;
+        return true;
+    }
+
+    std::optional<std::vector<Axis>> readSpec(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) {
+            std::fprintf(stderr, "cannot read %s\n", path.c_str());
+            return std::nullopt;
+        }
+        std::vector<Axis> axes;
+        std::string line;
+        for (size_t number = 1; std::getline(file, line); ++number) {
+            line = trim(line.substr(0, line.find('#')));
+            if (line.empty()) continue;
+            const size_t equals = line.find('=');
+            Axis axis;
+            axis.key = trim(line.substr(0, equals));
+            RunSpec probe;
+            bool valid = equals != std::string::npos && expandValues(trim(line.substr(equals + 1)), axis.values);
+            for (size_t k = 0; valid && k < axis.values.size(); ++k) valid = setField(probe, axis.key, axis.values[k]);
+            if (!valid) {
+                std::fprintf(stderr, "%s:%zu: bad line: %s\n", path.c_str(), number, line.c_str());
+                return std::nullopt;
+            }
+            // a repeated key replaces the earlier one
+            auto it = std::find_if(axes.begin(), axes.end(), [&](const Axis& a) { return a.key == axis.key; });
+            if (it != axes.end()) *it = std::move(axis);
+            else axes.push_back(std::move(axis));
+        }
+        return axes;
+    }
+
+    // Every combination, the last axis varying fastest
+    std::vector<RunSpec> expandRuns(const std::vector<Axis>& axes) {
+        size_t total = 1;
+        for (const Axis& axis : axes) total *= axis.values.size();
+        std::vector<RunSpec> runs(total);
+        for (size_t id = 0; id < total; ++id) {
+            RunSpec& spec = runs[id];
+            spec.id = id;
+            size_t rest = id;
+            for (size_t a = axes.size(); a > 0; --a) {
+                const Axis& axis = axes[a - 1];
+                setField(spec, axis.key, axis.values[rest % axis.values.size()]);
+                rest /= axis.values.size();
+            }
+        }
+        return runs;
+    }
+
+    std::optional<Options> parseOptions(int argc, char** argv) {
+        Options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string flag = argv[i];
+            if (flag == "--help" || flag == "-h") return std::nullopt;
+            if (flag == "--dry-run") {
+                options.dryRun = true;
+                continue;
+            }
+            if (flag.rfind("--", 0) != 0) {
+                options.specPath = flag;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "missing value for %s\n", flag.c_str());
+                return std::nullopt;
+            }
+            const char* value = argv[++i];
+            if (flag == "--jobs") {
+                options.jobs = std::strtoull(value, nullptr, 10);
+            } else if (flag == "--threads-per-run") {
+                options.threadsPerRun = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+            } else if (flag == "--output") {
+                options.outputDir = value;
+            } else {
+                std::fprintf(stderr, "unknown option %s\n", flag.c_str());
+                return std::nullopt;
+            }
+        }
+        if (options.specPath.empty()) return std::nullopt;
+        if (options.jobs == 0) options.jobs = std::max(1u, std::thread::hardware_concurrency());
+        return options;
+    }
+
+    // Relative cost for the schedule, pairs per step for the direct sums and N log N for the rest
+    double estimateCost(const RunSpec& spec) {
+        const double n = double(spec.bodies);
+        const bool direct = spec.solver.solver == GravitySolver::Direct || spec.solver.solver == GravitySolver::DirectSIMD
+                            || spec.integrator.integrator == Integrator::HermiteBlock;
+        return double(spec.steps) * (direct ? n * n : n * std::log2(n + 2.0) * 64.0);
+    }
+
+    BodyBatch generateScene(const RunSpec& spec, ThreadPool& pool) {
+        SystemPlacement placement;
+        placement.seed = spec.seed;
+        placement.bodyRadius = spec.bodyRadius;
+        BodyBatch batch;
+        if (spec.scene == "king") {
+            KingParams params;
+            params.count = spec.bodies;
+            params.placement = placement;
+            batch = generateKing(params, Physics::G, pool);
+        } else if (spec.scene == "disk") {
+            KeplerianDiskParams params;
+            params.count = spec.bodies;
+            params.placement = placement;
+            batch = generateKeplerianDisk(params, Physics::G, pool);
+        } else if (spec.scene == "belt") {
+            AsteroidBeltParams params;
+            params.count = spec.bodies;
+            params.placement = placement;
+            batch = generateAsteroidBelt(params, Physics::G, pool);
+        } else {
+            PlummerParams params;
+            params.count = spec.bodies;
+            params.placement = placement;
+            batch = generatePlummer(params, Physics::G, pool);
+        }
+        for (float& mass : batch.mass) mass *= spec.massScale;
+        for (glm::vec3& vel : batch.vel) vel *= spec.velocityScale;
+        return batch;
+    }
+
+    double rmsRadius(const BodyStore& bodies) {
+        glm::dvec3 center(0.0);
+        double mass = 0.0;
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            center += double(bodies.mass[i]) * bodies.posD(i);
+            mass += bodies.mass[i];
+        }
+        if (mass > 0.0) center /= mass;
+        double sum = 0.0;
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            const glm::dvec3 d = bodies.posD(i) - center;
+            sum += glm::dot(d, d);
+        }
+        return bodies.empty() ? 0.0 : std::sqrt(sum / double(bodies.size()));
+    }
+
+    RunResult simulate(const RunSpec& spec, const Options& options) {
+        const auto start = std::chrono::steady_clock::now();
+        RunResult result;
+        ThreadPool generatorPool(1);
+        const BodyBatch batch = generateScene(spec, generatorPool);
+
+        // sized up front, a default pool would start a thread per core only to stop them again
+        Physics physics(options.threadsPerRun);
+        physics.setSolver(spec.solver.solver);
+        physics.setIntegrator(spec.integrator.integrator);
+        physics.setRestitution(spec.restitution);
+        physics.setDiagnosticsEnabled(true);
+        physics.addPlanets(batch.pos, batch.vel, batch.mass, batch.radius);
+
+        FILE* file = nullptr;
+        if (!options.outputDir.empty() && spec.sampleEvery > 0) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "run_%04zu.csv", spec.id);
+            const std::string path = (std::filesystem::path(options.outputDir) / name).string();
+            file = std::fopen(path.c_str(), "w");
+            if (!file) std::fprintf(stderr, "cannot write %s\n", path.c_str());
+            else std::fprintf(file, "step,time,kinetic,potential,total,energy_drift,momentum_drift,angular_momentum_drift\n");
+        }
+
+        for (uint32_t step = 1; step <= spec.steps; ++step) {
+            physics.update(spec.dt);
+            if (file && step % spec.sampleEvery == 0) {
+                const Diagnostics& d = physics.getDiagnostics();
+                std::fprintf(file, "%u,%.6f,%.9e,%.9e,%.9e,%.6e,%.6e,%.6e\n", step, double(step) * spec.dt, d.kinetic,
+                             d.potential, d.total, d.energyDrift, d.momentumDrift, d.angularMomentumDrift);
+            }
+        }
+        if (file) std::fclose(file);
+
+        const Diagnostics& d = physics.getDiagnostics();
+        if (d.valid) {
+            // without a potential the energy is kinetic only, its drift says nothing about the integration
+            if (d.hasPotential) result.energyDrift = d.energyDrift;
+            result.angularMomentumDrift = d.angularMomentumDrift;
+            result.momentumDrift = d.momentumDrift;
+            result.kinetic = d.kinetic;
+        }
+        result.rmsRadius = rmsRadius(physics.getBodies());
+        result.wallMs = elapsedMs(start);
+        return result;
+    }
+
+    // Swept keys are the ones with more than one value, the rest is the same for every run
+    std::vector<const Axis*> sweptAxes(const std::vector<Axis>& axes) {
+        std::vector<const Axis*> swept;
+        for (const Axis& axis : axes) {
+            if (axis.values.size() > 1) swept.push_back(&axis);
+        }
+        return swept;
+    }
+
+    // The value of axis for run id, same order as expandRuns
+    const std::string& axisValue(const std::vector<Axis>& axes, const Axis& axis, size_t id) {
+        size_t rest = id;
+        for (size_t a = axes.size(); a > 0; --a) {
+            if (&axes[a - 1] == &axis) break;
+            rest /= axes[a - 1].values.size();
+        }
+        return axis.values[rest % axis.values.size()];
+    }
+
+    void writeSummary(const std::string& path, const std::vector<RunSpec>& runs,
+                      const std::vector<RunResult>& results) {
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file) {
+            std::fprintf(stderr, "cannot write %s\n", path.c_str());
+            return;
+        }
+        std::fprintf(file, "id,scene,bodies,steps,dt,solver,integrator,seed,restitution,mass_scale,velocity_scale,body_radius,"
+                           "wall_ms,energy_drift,angular_momentum_drift,momentum_drift,kinetic,rms_radius\n");
+        for (const RunSpec& spec : runs) {
+            const RunResult& r = results[spec.id];
+            std::fprintf(file, "%zu,%s,%zu,%u,%g,%s,%s,%llu,%g,%g,%g,%g,%.3f,", spec.id, spec.scene.c_str(), spec.bodies,
+                         spec.steps, spec.dt, spec.solver.name, spec.integrator.name, static_cast<unsigned long long>(spec.seed),
+                         spec.restitution, spec.massScale, spec.velocityScale, spec.bodyRadius, r.wallMs);
+            if (!std::isnan(r.energyDrift)) std::fprintf(file, "%.6e", r.energyDrift);
+            std::fprintf(file, ",%.6e,%.6e,%.9e,%.6e\n", r.angularMomentumDrift, r.momentumDrift, r.kinetic, r.rmsRadius);
+        }
+        std::fclose(file);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::optional<Options> parsed = parseOptions(argc, argv);
+    if (!parsed) {
+        usage();
+        return 1;
+    }
+    const Options& options = *parsed;
+    std::optional<std::vector<Axis>> axes = readSpec(options.specPath);
+    if (!axes) return 1;
+    const std::vector<RunSpec> runs = expandRuns(*axes);
+    const std::vector<const Axis*> swept = sweptAxes(*axes);
+
+    if (!options.outputDir.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(options.outputDir, error);
+        if (error) {
+            std::fprintf(stderr, "cannot create %s: %s\n", options.outputDir.c_str(), error.message().c_str());
+            return 1;
+        }
+    }
+
+    // longest first, so the last runs to start are short ones and the workers finish together
+    std::vector<size_t> order(runs.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return estimateCost(runs[a]) > estimateCost(runs[b]); });
+
+    const size_t jobs = std::min(options.jobs, std::max<size_t>(runs.size(), 1));
+    std::printf("%zu runs on %zu workers, %zu physics thread(s) each\n", runs.size(), jobs, options.threadsPerRun);
+    if (options.dryRun) {
+        for (const RunSpec& spec : runs) {
+            std::printf("run %4zu:", spec.id);
+            for (const Axis* axis : swept) std::printf(" %s=%s", axis->key.c_str(), axisValue(*axes, *axis, spec.id).c_str());
+            std::printf("\n");
+        }
+        return 0;
+    }
+
+    std::vector<RunResult> results(runs.size());
+    std::atomic<size_t> next{0};
+    std::mutex printMutex;
+    size_t finished = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&] {
+        while (true) {
+            const size_t k = next.fetch_add(1, std::memory_order_relaxed);
+            if (k >= order.size()) return;
+            const RunSpec& spec = runs[order[k]];
+            results[spec.id] = simulate(spec, options);
+
+            std::lock_guard<std::mutex> lock(printMutex);
+            finished++;
+            std::fprintf(stderr, "\r[%zu/%zu] run %zu took %.2f s   ", finished, runs.size(), spec.id, results[spec.id].wallMs / 1000.0);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t j = 1; j < jobs; ++j) workers.emplace_back(worker);
+    worker();
+    for (std::thread& thread : workers) thread.join();
+    const double wallMs = elapsedMs(start);
+    std::fprintf(stderr, "\n");
+
+    std::printf("%5s", "id");
+    for (const Axis* axis : swept) std::printf(" %14s", axis->key.c_str());
+    std::printf(" %9s %11s %11s %12s %10s\n", "wall s", "dE/E", "dL/L", "kinetic", "rms r");
+    double runMs = 0.0;
+    for (const RunSpec& spec : runs) {
+        const RunResult& r = results[spec.id];
+        runMs += r.wallMs;
+        std::printf("%5zu", spec.id);
+        for (const Axis* axis : swept) std::printf(" %14s", axisValue(*axes, *axis, spec.id).c_str());
+        std::printf(" %9.2f %11.3e %11.3e %12.5e %10.4f\n", r.wallMs / 1000.0, r.energyDrift, r.angularMomentumDrift,
+                    r.kinetic, r.rmsRadius);
+    }
+    // share of the wall time the workers spent in runs, below 1 for an uneven tail. Contention for cores or
+    // memory bandwidth shows up as longer runs instead, compare run-seconds with a --jobs 1 sweep for that.
+    const double occupancy = wallMs > 0.0 ? runMs / (wallMs * double(jobs)) : 0.0;
+    std::printf("%zu runs in %.2f s, %.1f run-seconds, worker occupancy %.1f%%\n", runs.size(), wallMs / 1000.0,
+                runMs / 1000.0, 100.0 * occupancy);
+
+    if (!options.outputDir.empty()) {
+        writeSummary((std::filesystem::path(options.outputDir) / "summary.csv").string(), runs, results);
+    }
+    return 0;
+}
@@ -19,22 +19,30 @@ Engine::Engine() {
     m_ui.setOnShaderReloadCallback([this](size_t idx) {
         m_shaderPrograms[idx].reload();
         m_renderer.initPBRShaders(m_shaderPrograms[0].getProgramId());
+        m_renderer.initCubeMapShaders(m_shaderPrograms[1].getProgramId());
+        m_renderer.initParticleShaders(m_shaderPrograms[2].getProgramId());
     });
     Shader pbrShader{std::string(SHADER_DIR) + "pbr.vert", std::string(SHADER_DIR) + "pbr.frag"};
     Shader skyboxShader{std::string(SHADER_DIR) + "skybox.vert", std::string(SHADER_DIR) + "skybox.frag"};
     Shader lightShader{std::string(SHADER_DIR) + "light.vert", std::string(SHADER_DIR) + "light.frag"};
+    Shader particleShader{std::string(SHADER_DIR) + "particle.vert", std::string(SHADER_DIR) + "particle.frag"};
     pbrShader.init();
     skyboxShader.init();
     lightShader.init();
+    particleShader.init();
     m_shaderPrograms.push_back(pbrShader);
     m_shaderPrograms.push_back(skyboxShader);
+    m_shaderPrograms.push_back(particleShader);
     m_renderer.initPBRShaders(pbrShader.getProgramId());
     m_renderer.initCubeMapShaders(skyboxShader.getProgramId());
+    m_renderer.initParticleShaders(particleShader.getProgramId());
     m_renderer.setLightShaderProgram(lightShader.getProgramId());
     m_renderer.setPBRRenderables(m_scene.getPBRRenderables());
     m_renderer.setSkyBox(m_scene.getSkyBox());
+    m_renderer.setParticles(m_scene.getPointPositions());
 
     m_scene.initExample();
+    m_simulation.start();
 
     std::cout <<sizeof(float) << std::endl;
 
@@ -48,6 +56,7 @@ Engine::Engine() {
 }
 
 Engine::~Engine() {
+    m_simulation.stop();
     m_scene.cleanup();
     m_ui.cleanup();
 
@@ -95,7 +104,7 @@ void Engine::run() {
         m_renderer.renderToScreen(m_window.width, m_window.height);
         #endif
 
-        m_scene.update(0.016f);
+        m_scene.update();
         
         glfwSwapBuffers(m_window.handle);
         glfwPollEvents();
@@ -10,6 +10,7 @@
 #include "imguiUI.hpp"
 #include "Scene.hpp"
 #include "physics.hpp"
+#include "SimulationThread.hpp"
 
 #include <vector>
 
@@ -30,7 +31,8 @@ private:
     Renderer m_renderer{};
     ImguiUI m_ui{};
     Physics m_physics{};
-    Scene m_scene{m_physics};
+    SimulationThread m_simulation{m_physics};
+    Scene m_scene{m_simulation};
 
 
     UI_Struct m_uiStruct{};
@@ -1,5 +1,37 @@
 #include "Scene.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    // Checkpoint and recording metadata: uint32 object count, then per object its handle, color, roughness, metallic and
+    // a length-prefixed name
+    struct ObjectRecord {
+        Handle handle;
+        glm::vec3 color;
+        float roughness;
+        float metallic;
+        uint32_t nameLength;
+    };
+
+    template<typename T>
+    void append(std::vector<std::byte>& out, const T& value) {
+        const std::byte* bytes = reinterpret_cast<const std::byte*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    // Reads sizeof(T) bytes at offset, false when the metadata ends first
+    template<typename T>
+    bool read(std::span<const std::byte> in, size_t& offset, T& value) {
+        if (in.size() - offset < sizeof(T)) return false;
+        std::memcpy(&value, in.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+}
+
 //Scene::Scene() {}
 Scene::~Scene() {}
 
@@ -18,23 +50,120 @@ void Scene::clear() {
     for (size_t i = m_pbrCount; i > 0; --i) {
         deleteObj(i - 1);
     }
+    clearPointBodies();
 }
 
 void Scene::cleanup() {
-    for (auto& renderable : m_pbrRenderables) {
-        renderable.meshBuffer.cleanup();
-    }
-    m_models.clear();
+    // the renderables only hold copies of the shared sphere mesh
+    m_sphereMesh.cleanup();
+    m_pbrRenderables.clear();
     m_objNames.clear();
 }
 
-void Scene::update(float dt) {
-    if (!m_paused) m_physics.update(dt);
+void Scene::update() {
+    const SimSnapshot& snapshot = m_simulation.acquireSnapshot();
+    m_snapshot = &snapshot;
+    if (m_loadBackup) finishCheckpointLoad(snapshot.checkpoint);
+    const auto now = std::chrono::steady_clock::now();
+    const double wallDt = std::chrono::duration<double>(now - m_lastUpdate).count();
+    m_lastUpdate = now;
+
+    if (m_replay) {
+        if (m_replayPlaying) {
+            m_replayTime += wallDt * m_replaySpeed;
+            if (m_replayTime >= m_replay->getEndTime()) m_replayPlaying = false;
+        }
+        m_replayTime = std::clamp(m_replayTime, m_replay->getStartTime(), m_replay->getEndTime());
+        // blocks outside the view aren't decoded
+        m_replay->seek(m_replayTime, m_renderInfo.projectionMatrix * m_renderInfo.viewMatrix);
+        m_replayFrame = &m_replay->acquireFrame();
+        updateTransforms(m_replayFrame->snapshot, 1.0f, true);
+        return;
+    }
 
-    for (size_t i = 0; i < m_pbrCount; ++i) {
-        m_pbrRenderables[i].transform.setPos(m_physics.getPlanets()->at(i).pos);
-        m_pbrRenderables[i].transform.setRot((m_physics.getPlanets()->at(i).rot));
-        m_pbrRenderables[i].transform.calcMatrix();
+    // the snapshot is one step behind the simulation, so blend towards its newest state over one step period
+    float alpha = 1.0f;
+    if (!snapshot.paused && snapshot.stepPeriod > 0.0) {
+        const double sincePublish = std::chrono::duration<double>(std::chrono::steady_clock::now() - snapshot.published).count();
+        alpha = static_cast<float>(std::clamp(sincePublish / snapshot.stepPeriod, 0.0, 1.0));
+    }
+    updateTransforms(snapshot, alpha);
+}
+
+void Scene::pause() {
+    if (m_replay) {
+        // from the end, play starts over
+        if (!m_replayPlaying && m_replayTime >= m_replay->getEndTime()) m_replayTime = m_replay->getStartTime();
+        m_replayPlaying = !m_replayPlaying;
+        return;
+    }
+    m_simulation.setPaused(!isPaused());
+}
+
+bool Scene::startReplay(const std::string& path, std::string* error) {
+    std::unique_ptr<TrajectoryPlayer> player;
+    try {
+        player = std::make_unique<TrajectoryPlayer>(path);
+    } catch (const std::runtime_error& e) {
+        if (error) *error = e.what();
+        return false;
+    }
+    if (!m_replay) {
+        m_resumeAfterReplay = !isPaused();
+        m_simulation.setPaused(true);
+    }
+    m_replay = std::move(player);
+    m_replayFrame = &m_replay->acquireFrame();
+    m_replayTime = m_replay->getStartTime();
+    m_replayPlaying = false;
+    return true;
+}
+
+void Scene::stopReplay() {
+    if (!m_replay) return;
+    m_replay.reset();
+    m_replayFrame = nullptr;
+    if (m_resumeAfterReplay) m_simulation.setPaused(false);
+}
+
+void Scene::updateTransforms(const SimSnapshot& snapshot, float alpha, bool replay) {
+    const bool blend = snapshot.prevPos.size() == snapshot.pos.size();
+    // objects added since the snapshot keep their transform until the simulation has run the command
+    m_snapshotIndex.assign(m_pbrCount, Handle::INVALID);
+    m_pointPositions.clear();
+
+    for (size_t i = 0; i < snapshot.handles.size(); ++i) {
+        const uint32_t entity = m_entities.indexOf(snapshot.handles[i]);
+        if (entity == Handle::INVALID) {
+            // recorded but deleted since
+            if (replay) m_pointPositions.push_back(snapshot.pos[i]);
+            continue; // removed here, not yet in the simulation
+        }
+
+        glm::vec3 pos = snapshot.pos[i];
+        bool blended = false;
+        if (blend) {
+            // a body wrapped through the periodic box jumps, blending would sweep it across the scene
+            const glm::vec3 move = pos - snapshot.prevPos[i];
+            if (std::abs(move.x) < snapshot.maxJump && std::abs(move.y) < snapshot.maxJump && std::abs(move.z) < snapshot.maxJump) {
+                pos = snapshot.prevPos[i] + alpha * move;
+                blended = true;
+            }
+        }
+
+        const uint32_t obj = m_entityObject[entity];
+        if (obj == Handle::INVALID) {
+            m_pointPositions.push_back(pos);
+            continue;
+        }
+        m_pbrRenderables[obj].transform.pos = pos;
+        if (!replay) {
+            glm::vec3 rot = snapshot.rot[i];
+            if (blended) rot = snapshot.prevRot[i] + alpha * (rot - snapshot.prevRot[i]);
+            m_snapshotIndex[obj] = static_cast<uint32_t>(i);
+            m_pbrRenderables[obj].transform.rot = rot;
+        }
+        m_pbrRenderables[obj].transform.calcMatrix();
     }
 }
 
@@ -43,48 +172,192 @@ void Scene::initExample() {
     AddSkyBox();
     AddLight();
     AddSphereObj();
-    m_physics.addPlanet(m_pbrRenderables.back().transform.pos, glm::vec3(0.05f), 1.0f, 1.0f);
+    addBody(m_objectHandles.back(), m_pbrRenderables.back().transform.pos, glm::vec3(0.05f));
     AddSphereObj();
     m_pbrRenderables.back().transform.setPos(glm::vec3(-3.0f, 0.0f, 0.0f));
-    m_physics.addPlanet(m_pbrRenderables.back().transform.pos, glm::vec3(-0.05f), 1.0f, 1.0f);
+    addBody(m_objectHandles.back(), m_pbrRenderables.back().transform.pos, glm::vec3(-0.05f));
 }
 
 void Scene::deleteObj(size_t idx) {
-    m_pbrRenderables[idx].meshBuffer.cleanup();
-    m_pbrRenderables.erase(m_pbrRenderables.begin() + idx);
+    const Handle handle = m_objectHandles[idx];
+    m_simulation.removeBody(handle);
+
+    // swap-and-pop, the entity arrays in the same order as the slot map
+    const uint32_t entity = m_entities.erase(handle);
+    m_entityObject[entity] = m_entityObject.back();
+    m_entityObject.pop_back();
+
+    const size_t last = m_pbrCount - 1;
+    if (idx != last) {
+        m_pbrRenderables[idx] = std::move(m_pbrRenderables[last]);
+        m_objNames[idx] = std::move(m_objNames[last]);
+        m_objectHandles[idx] = m_objectHandles[last];
+        m_entityObject[m_entities.indexOf(m_objectHandles[idx])] = static_cast<uint32_t>(idx);
+    }
+    m_pbrRenderables.pop_back();
+    m_objNames.pop_back();
+    m_objectHandles.pop_back();
     m_pbrCount--;
-    // delete the model
-    m_models.erase(m_models.begin() + idx);
-    // delete the object name
-    m_objNames.erase(m_objNames.begin() + idx);
-    // update physics planets
-    m_physics.getPlanets()->erase(m_physics.getPlanets()->begin() + idx);
+}
+
+std::vector<Handle> Scene::addBodies(BodyBatch batch) {
+    std::vector<Handle> handles(batch.size());
+    m_entities.reserve(m_entities.size() + batch.size());
+    for (Handle& handle : handles) handle = m_entities.create();
+    m_entityObject.resize(m_entities.size(), Handle::INVALID);
+    m_simulation.addBodies(handles, std::move(batch));
+    return handles;
+}
+
+void Scene::clearPointBodies() {
+    std::vector<Handle> removed;
+    // from the back, so whatever swap-and-pop moves into the hole has already been looked at
+    for (size_t e = m_entities.size(); e > 0; --e) {
+        if (m_entityObject[e - 1] != Handle::INVALID) continue;
+        const Handle handle = m_entities.handleAt(static_cast<uint32_t>(e - 1));
+        removed.push_back(handle);
+        m_entities.erase(handle);
+        m_entityObject[e - 1] = m_entityObject.back();
+        m_entityObject.pop_back();
+    }
+    if (!removed.empty()) m_simulation.removeBodies(std::move(removed));
+}
+
+void Scene::dropObjects() {
+    m_pbrRenderables.clear();
+    m_objNames.clear();
+    m_objectHandles.clear();
+    m_snapshotIndex.clear();
+    m_pointPositions.clear();
+    m_pbrCount = 0;
+}
+
+std::vector<std::byte> Scene::objectMetadata() const {
+    std::vector<std::byte> metadata;
+    append(metadata, static_cast<uint32_t>(m_pbrCount));
+    for (size_t i = 0; i < m_pbrCount; ++i) {
+        const auto& ubo = m_pbrRenderables[i].material.ubo;
+        append(metadata, ObjectRecord{m_objectHandles[i], ubo.color, ubo.roughness, ubo.metallic,
+                                      static_cast<uint32_t>(m_objNames[i].size())});
+        const std::byte* name = reinterpret_cast<const std::byte*>(m_objNames[i].data());
+        metadata.insert(metadata.end(), name, name + m_objNames[i].size());
+    }
+    return metadata;
+}
+
+void Scene::saveCheckpoint(const std::string& path, bool fork) {
+    m_simulation.saveCheckpoint(path, objectMetadata(), fork);
+}
+
+void Scene::startRecording(RecordingSettings settings) {
+    m_simulation.startRecording(std::move(settings), objectMetadata());
+}
+
+bool Scene::loadCheckpoint(const std::string& path, bool verify, std::string* error) {
+    // one backup only, and the outcome of a second load couldn't be told from the first's
+    if (m_loadBackup) {
+        if (error) *error = "Checkpoint: the previous load hasn't finished yet";
+        return false;
+    }
+    std::shared_ptr<const MappedCheckpoint> checkpoint;
+    try {
+        checkpoint = std::make_shared<const MappedCheckpoint>(path);
+    } catch (const std::runtime_error& e) {
+        if (error) *error = e.what();
+        return false;
+    }
+
+    // The header, settings and columns are checked by MappedCheckpoint and the handles here, before the scene
+    // changes. The checksum reads the whole file, it is verified on the simulation thread, which leaves the
+    // bodies alone on a mismatch and finishCheckpointLoad puts the objects back.
+    std::span<const Handle> column = checkpoint->column<Handle>(CheckpointSection::Handles);
+    std::vector<Handle> handles(column.begin(), column.end());
+    SlotMap entities;
+    if (handles.size() != checkpoint->bodyCount() || !entities.assign(handles)) {
+        if (error) *error = "Checkpoint: invalid body handles: " + path;
+        return false;
+    }
+
+    m_loadBackup = LoadBackup{m_snapshot->checkpoint.loads, std::move(m_entities), std::move(m_entityObject),
+                              std::move(m_objectHandles), std::move(m_pbrRenderables), std::move(m_objNames), m_pbrCount};
+    m_entities = std::move(entities);
+    m_entityObject.assign(handles.size(), Handle::INVALID);
+    dropObjects();
+
+    std::span<const std::byte> metadata = checkpoint->section(CheckpointSection::Metadata);
+    size_t offset = 0;
+    uint32_t objectCount = 0;
+    read(metadata, offset, objectCount);
+    for (uint32_t k = 0; k < objectCount; ++k) {
+        ObjectRecord record;
+        if (!read(metadata, offset, record) || metadata.size() - offset < record.nameLength) break;
+        std::string name(reinterpret_cast<const char*>(metadata.data() + offset), record.nameLength);
+        offset += record.nameLength;
+
+        const uint32_t entity = m_entities.indexOf(record.handle);
+        if (entity == Handle::INVALID || m_entityObject[entity] != Handle::INVALID) continue;
+        m_entityObject[entity] = static_cast<uint32_t>(m_pbrCount);
+        addSphereObject(record.handle);
+        m_objNames.back() = std::move(name);
+        auto& ubo = m_pbrRenderables.back().material.ubo;
+        ubo.color = record.color;
+        ubo.roughness = record.roughness;
+        ubo.metallic = record.metallic;
+    }
+
+    m_simulation.loadCheckpoint(std::move(checkpoint), verify);
+    return true;
+}
+
+void Scene::finishCheckpointLoad(const CheckpointStatus& status) {
+    if (status.loads == m_loadBackup->loads) return;
+    if (!status.loadOk) {
+        LoadBackup& backup = *m_loadBackup;
+        m_entities = std::move(backup.entities);
+        m_entityObject = std::move(backup.entityObject);
+        m_objectHandles = std::move(backup.objectHandles);
+        m_pbrRenderables = std::move(backup.pbrRenderables);
+        m_objNames = std::move(backup.objNames);
+        m_pbrCount = backup.pbrCount;
+    }
+    m_loadBackup.reset();
 }
 
 void Scene::AddPlanetObj() {
     AddSphereObj();
-    m_physics.addPlanet(m_pbrRenderables.back().transform.pos, glm::vec3(0.05f), 1.0f, 1.0f);
+    addBody(m_objectHandles.back(), m_pbrRenderables.back().transform.pos, glm::vec3(0.05f));
+}
+
+void Scene::addBody(Handle entity, const glm::vec3& pos, const glm::vec3& vel) {
+    m_simulation.addBody(entity, pos, vel, 1.0f, 1.0f);
 }
 
 void Scene::AddSphereObj() {
+    m_entityObject.push_back(static_cast<uint32_t>(m_pbrCount));
+    addSphereObject(m_entities.create());
+}
+
+void Scene::addSphereObject(Handle entity) {
     if (m_pbrRenderables.size() <= m_pbrCount) {
         m_pbrRenderables.resize(m_pbrCount + 1);
     }
 
     m_pbrCount++;
+    m_objectHandles.push_back(entity);
     m_objNames.push_back("Sphere " + std::to_string(m_pbrCount));
 
-    Model sphereModel;
-    sphereModel.SphereModel();
-    m_models.push_back(sphereModel);
-
-    std::vector<DummyVert> vertData = getDummyVerts(m_models[m_pbrCount - 1].getVertices());
-    VAOConfig config = createPBRConfig(m_pbrCount - 1);
-    m_pbrRenderables[m_pbrCount - 1].meshBuffer = Buffer::createMeshBuffer(
-        config,
-        vertData.data(),
-        nullptr
-    );
+    // one sphere mesh for all of them
+    if (m_sphereMesh.vao == 0) {
+        m_sphereModel.SphereModel();
+        std::vector<DummyVert> vertData = getDummyVerts(m_sphereModel.getVertices());
+        VAOConfig config = createPBRConfig(m_sphereModel);
+        m_sphereMesh = Buffer::createMeshBuffer(
+            config,
+            vertData.data(),
+            nullptr
+        );
+    }
+    m_pbrRenderables[m_pbrCount - 1].meshBuffer = m_sphereMesh;
 
     int flags = m_textures[EARTH_TEXTURE].flags;
     m_pbrRenderables[m_pbrCount - 1].material.ubo = {
@@ -145,7 +418,7 @@ void Scene::AddLight() {
     m_renderInfo.lights.push_back(mainLight);
 }
 
-VAOConfig Scene::createPBRConfig(size_t idx) {
+VAOConfig Scene::createPBRConfig(Model& model) {
     VAOConfig config;
 
     config.attributes.push_back({0, 3, GL_FLOAT, false, sizeof(DummyVert), offsetof(DummyVert, pos)});
@@ -155,7 +428,7 @@ VAOConfig Scene::createPBRConfig(size_t idx) {
     config.attributes.push_back({4, 3, GL_FLOAT, false, sizeof(DummyVert), offsetof(DummyVert, bitangent)}); 
 
     config.size_vertex = sizeof(DummyVert);
-    config.num_vertices = m_models[idx].getVertices().size();
+    config.num_vertices = model.getVertices().size();
     config.index_count = UINT32_MAX;
     config.draw_mode = GL_TRIANGLES;
     config.usage = GL_DYNAMIC_DRAW;
@@ -164,7 +437,7 @@ VAOConfig Scene::createPBRConfig(size_t idx) {
 }
 
 
-VAOConfig Scene::createConfig(size_t idx) {
+VAOConfig Scene::createConfig(Model& model) {
     VAOConfig config;
     
     config.attributes.push_back({0, 3, GL_FLOAT, false, sizeof(Vertex), offsetof(Vertex, pos)});
@@ -172,8 +445,8 @@ VAOConfig Scene::createConfig(size_t idx) {
     config.attributes.push_back({2, 2, GL_FLOAT, false, sizeof(Vertex), offsetof(Vertex, texCoords)});
 
     config.size_vertex = sizeof(Vertex);
-    config.num_vertices = m_models[idx].getVertices().size();
-    config.index_count = m_models[idx].getIndices().size();
+    config.num_vertices = model.getVertices().size();
+    config.index_count = model.getIndices().size();
     config.draw_mode = GL_TRIANGLES;
     config.usage = GL_DYNAMIC_DRAW;
 
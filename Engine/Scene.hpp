@@ -4,6 +4,12 @@
 #include "Shader.hpp"
 #include "Model.hpp"
 #include "physics.hpp"
+#include "SimulationThread.hpp"
+#include "TrajectoryPlayer.hpp"
+
+#include <chrono>
+#include <memory>
+#include <optional>
 
 struct DummyVert {
     glm::vec3 pos;
@@ -15,30 +21,62 @@ struct DummyVert {
 
 class Scene {
 private:
-    Physics& m_physics;
-
-    bool m_paused = false;
+    SimulationThread& m_simulation;
+    const SimSnapshot* m_snapshot = nullptr; // latest state taken from the simulation thread
 
     size_t m_pbrCount = 0;
+    // Every body the scene created has a handle here, shared with physics. Objects (a mesh, a name) are a dense
+    // subset; the rest are point bodies from addBodies. All per-entity and per-object vectors are dense and
+    // follow swap-and-pop on removal.
+    SlotMap m_entities;
+    std::vector<uint32_t> m_entityObject;  // per entity, its object index or INVALID for a point body
+    std::vector<Handle> m_objectHandles;   // per object
+    std::vector<uint32_t> m_snapshotIndex; // per object, its index in the latest snapshot or INVALID
+    std::vector<glm::vec3> m_pointPositions; // point bodies as of the latest update, for the particle pass
+
+    ThreadPool m_generatorPool; // initial condition generators, physics' own pool belongs to its thread
 
     std::vector<Shader> m_shaderPrograms;
     std::vector<PBR_Renderable> m_pbrRenderables;
-    std::vector<Model> m_models;
+    Model m_sphereModel;       // shared by every sphere object
+    MeshBuffer m_sphereMesh;
     std::vector<PBR_Texture> m_textures;
     std::vector<std::string> m_objNames;
     SkyBox m_skyBox;
     RenderInfo m_renderInfo;
+
+    // What loadCheckpoint replaced, put back if the simulation thread rejects the file
+    struct LoadBackup {
+        uint32_t loads; // finished loads when this one was sent, its result comes with the next
+        SlotMap entities;
+        std::vector<uint32_t> entityObject;
+        std::vector<Handle> objectHandles;
+        std::vector<PBR_Renderable> pbrRenderables;
+        std::vector<std::string> objNames;
+        size_t pbrCount;
+    };
+    std::optional<LoadBackup> m_loadBackup;
+
+    // trajectory replay, the simulation stays paused underneath
+    std::unique_ptr<TrajectoryPlayer> m_replay;
+    const ReplayFrame* m_replayFrame = nullptr; // latest taken from the player
+    double m_replayTime = 0.0;
+    float m_replaySpeed = 1.0f;
+    bool m_replayPlaying = false;
+    bool m_resumeAfterReplay = false; // the simulation was running when the replay started
+    std::chrono::steady_clock::time_point m_lastUpdate = std::chrono::steady_clock::now();
     
 public:
     static inline uint32_t EARTH_TEXTURE = 0;
 
-    Scene(Physics& physics) : m_physics(physics) {}
+    Scene(SimulationThread& simulation) : m_simulation(simulation), m_snapshot(&simulation.acquireSnapshot()) {}
     ~Scene();
 
     void cleanup();
 
-    void pause() { m_paused = !m_paused; }
-    bool isPaused() const { return m_paused; }
+    // While replaying these play and pause the replay
+    void pause();
+    bool isPaused() const { return m_replay ? !m_replayPlaying : m_snapshot->paused; }
 
     void setViewMatrix(const glm::mat4& view) { m_renderInfo.viewMatrix = view; }
     void setProjectionMatrix(const glm::mat4& projection) { m_renderInfo.projectionMatrix = projection; }
@@ -47,8 +85,15 @@ public:
     std::vector<std::string>* getObjNames() { return &m_objNames; }
     std::vector<PBR_Renderable>* getPBRRenderables() { return &m_pbrRenderables; }
     SkyBox* getSkyBox() { return &m_skyBox; }
-    Physics* getPhysics() { return &m_physics; }
+    SimulationThread* getSimulation() { return &m_simulation; }
+    const SimSnapshot& getSnapshot() const { return *m_snapshot; }
+    Handle getHandle(size_t idx) const { return m_objectHandles[idx]; }
+    // Index of object idx in getSnapshot(), INVALID while the simulation hasn't caught up with it
+    uint32_t getSnapshotIndex(size_t idx) const { return idx < m_snapshotIndex.size() ? m_snapshotIndex[idx] : Handle::INVALID; }
     size_t getObjCount() const { return m_pbrCount; }
+    size_t getPointBodyCount() const { return m_entities.size() - m_pbrCount; }
+    const std::vector<glm::vec3>* getPointPositions() const { return &m_pointPositions; }
+    ThreadPool& getGeneratorPool() { return m_generatorPool; }
 
     void initExample();
     void AddLight();
@@ -56,14 +101,53 @@ public:
     void AddPlanetObj();
     void AddSkyBox();
     void deleteObj(size_t idx);
+    // Bulk bodies without an object, drawn as points. One command to the simulation for the whole batch.
+    std::vector<Handle> addBodies(BodyBatch batch);
+    void clearPointBodies();
     void clear();
-    void update(float dt);
+    // The simulation writes the file between two steps, with the objects (names, materials) as its metadata.
+    // With fork it only stops for the fork and a child process writes the file (see CheckpointFork).
+    void saveCheckpoint(const std::string& path, bool fork = false);
+    // Replaces every body and object with the file's. The header, columns and handles are checked here; the
+    // checksum, which reads all of it, and the bodies are left to the simulation thread, which reports in
+    // getSnapshot().checkpoint. Should it reject the file the scene goes back to what it was. False, with the
+    // reason in error and the scene untouched, when the file can't be used or another load is still running.
+    bool loadCheckpoint(const std::string& path, bool verify, std::string* error = nullptr);
+    // Trajectory of the bodies present now, written in the background; progress in getSnapshot().recording
+    void startRecording(RecordingSettings settings);
+    void stopRecording() { m_simulation.stopRecording(); }
+    // Shows a recording instead of the simulation, which is paused until stopReplay(). Bodies of the recording
+    // the scene no longer has are drawn as points. False, with the reason in error, when the file can't be used.
+    bool startReplay(const std::string& path, std::string* error = nullptr);
+    void stopReplay();
+    bool isReplaying() const { return m_replay != nullptr; }
+    const TrajectoryPlayer* getReplay() const { return m_replay.get(); }
+    // The frame shown, only while replaying
+    const ReplayFrame& getReplayFrame() const { return *m_replayFrame; }
+    double getReplayTime() const { return m_replayTime; }
+    void setReplayTime(double time) { m_replayTime = time; }
+    bool isReplayPlaying() const { return m_replayPlaying; }
+    void setReplayPlaying(bool playing) { m_replayPlaying = playing; }
+    float getReplaySpeed() const { return m_replaySpeed; }
+    void setReplaySpeed(float speed) { m_replaySpeed = speed; }
+    // Takes the newest simulation state, or replay frame, and rebuilds the transforms, blending between its last two steps
+    void update();
     
     private:
-    VAOConfig createConfig(size_t idx);
-    VAOConfig createPBRConfig(size_t idx);
+    VAOConfig createConfig(Model& model);
+    VAOConfig createPBRConfig(Model& model);
 
     void loadTextures();
+    void addBody(Handle entity, const glm::vec3& pos, const glm::vec3& vel);
+    // A sphere object for an entity that already exists, m_entityObject is up to the caller
+    void addSphereObject(Handle entity);
+    void dropObjects();
+    // Drops the load backup once the simulation reported on the load, restoring it if the load failed
+    void finishCheckpointLoad(const CheckpointStatus& status);
+    // Names and materials of the objects, stored with checkpoints and recordings
+    std::vector<std::byte> objectMetadata() const;
+    // A replay snapshot has positions only: objects keep their rotation and the snapshot indices stay INVALID
+    void updateTransforms(const SimSnapshot& snapshot, float alpha, bool replay = false);
     
     std::vector<DummyVert> getDummyVerts(std::vector<Vertex>& vertices);
 };
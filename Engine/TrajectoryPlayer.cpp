@@ -0,0 +1,162 @@
+#include "TrajectoryPlayer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    constexpr uint8_t BLOCK_EMPTY = 0;
+    constexpr uint8_t BLOCK_DECODED = 1;
+    constexpr uint8_t BLOCK_FAILED = 2;
+
+    // Whether the box lies at least partly inside all six clip planes of viewProjection (Gribb & Hartmann)
+    bool boxInView(const glm::mat4& m, const glm::vec3& lo, const glm::vec3& hi) {
+        const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        const glm::vec4 planes[6] = {row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2};
+        for (const glm::vec4& plane : planes) {
+            // the corner furthest along the plane normal
+            const glm::vec3 corner(plane.x >= 0.0f ? hi.x : lo.x, plane.y >= 0.0f ? hi.y : lo.y, plane.z >= 0.0f ? hi.z : lo.z);
+            if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0.0f) return false;
+        }
+        return true;
+    }
+}
+
+TrajectoryPlayer::TrajectoryPlayer(const std::string& path, size_t threadCount)
+    : m_reader(path), m_pool(threadCount) {
+    if (m_reader.chunks().empty()) throw std::runtime_error("Trajectory: no frames recorded: " + path);
+    m_scratch.resize(m_pool.getThreadCount());
+    const size_t blockCount = m_reader.chunks().front().blockCount;
+    m_blocks.resize(blockCount);
+    m_blockState.assign(blockCount, BLOCK_EMPTY);
+    m_request.time = getStartTime();
+    m_thread = std::thread(&TrajectoryPlayer::workerLoop, this);
+}
+
+TrajectoryPlayer::~TrajectoryPlayer() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void TrajectoryPlayer::seek(double time, const glm::mat4& viewProjection) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // a paused replay asks for the same frame every render frame
+        if (m_requestSerial > 0 && m_request.time == time && m_request.viewProjection == viewProjection) return;
+        m_request = {time, viewProjection};
+        m_requestSerial++;
+    }
+    m_wake.notify_one();
+}
+
+void TrajectoryPlayer::workerLoop() {
+    uint64_t served = 0;
+    while (true) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_requestSerial != served; });
+            if (m_stop) return;
+            request = m_request;
+            served = m_requestSerial;
+        }
+        decodeFrame(request, m_frames.back());
+        m_frames.publish();
+    }
+}
+
+void TrajectoryPlayer::decodeFrame(const Request& request, ReplayFrame& frame) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto [chunk, index] = m_reader.findFrame(request.time);
+    std::span<const TrajectoryFrame> frames = m_reader.frames(chunk);
+    std::span<const TrajectoryBlock> blocks = m_reader.blocks(chunk);
+    const uint32_t frameCount = static_cast<uint32_t>(frames.size());
+
+    // blend towards the next frame of the same chunk, the last frame of a chunk is shown as is
+    float alpha = 0.0f;
+    if (index + 1 < frameCount && frames[index + 1].time > frames[index].time) {
+        alpha = static_cast<float>(std::clamp((request.time - frames[index].time) / (frames[index + 1].time - frames[index].time), 0.0, 1.0));
+    }
+
+    if (chunk != m_cachedChunk) {
+        // clear() keeps the memory for the next chunk's blocks
+        for (std::vector<float>& block : m_blocks) block.clear();
+        std::fill(m_blockState.begin(), m_blockState.end(), BLOCK_EMPTY);
+        m_cachedChunk = chunk;
+    }
+
+    // the top level marks absent bodies, the grid ends one below
+    const uint32_t maxLevel = (1u << m_reader.header().quantizationBits) - 2;
+    m_decode.clear();
+    frame.blocksCulled = 0;
+    m_visible.assign(blocks.size(), 0);
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        const glm::vec3 lo(blocks[b].origin[0], blocks[b].origin[1], blocks[b].origin[2]);
+        const glm::vec3 hi = lo + glm::vec3(blocks[b].quantum * float(maxLevel));
+        if (!boxInView(request.viewProjection, lo, hi)) {
+            frame.blocksCulled++;
+            continue;
+        }
+        m_visible[b] = 1;
+        if (m_blockState[b] == BLOCK_EMPTY) m_decode.push_back(static_cast<uint32_t>(b));
+    }
+
+    m_pool.run(m_decode.size(), [&](size_t task, size_t thread) {
+        const uint32_t b = m_decode[task];
+        m_blocks[b].resize(size_t(3) * frameCount * m_reader.blockSize(b));
+        const bool ok = m_reader.decodeBlock(chunk, b, m_blocks[b].data(), m_scratch[thread], true);
+        m_blockState[b] = ok ? BLOCK_DECODED : BLOCK_FAILED;
+    });
+    frame.blocksDecoded = static_cast<uint32_t>(m_decode.size());
+
+    SimSnapshot& snapshot = frame.snapshot;
+    snapshot.handles.clear();
+    snapshot.pos.clear();
+    snapshot.prevPos.clear();
+    snapshot.rot.clear();
+    snapshot.prevRot.clear();
+    snapshot.vel.clear();
+    snapshot.mass.clear();
+    frame.ok = true;
+
+    std::span<const Handle> handles = m_reader.handles();
+    const uint32_t next = std::min(index + 1, frameCount - 1);
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (!m_visible[b]) continue;
+        if (m_blockState[b] != BLOCK_DECODED) {
+            frame.ok = false;
+            continue;
+        }
+        const uint32_t count = m_reader.blockSize(b);
+        const size_t first = m_reader.blockBegin(b);
+        const float* axes[3] = {m_blocks[b].data(), m_blocks[b].data() + size_t(frameCount) * count,
+                                m_blocks[b].data() + size_t(2) * frameCount * count};
+        for (uint32_t k = 0; k < count; ++k) {
+            glm::vec3 a, c;
+            for (int axis = 0; axis < 3; ++axis) {
+                a[axis] = axes[axis][size_t(index) * count + k];
+                c[axis] = axes[axis][size_t(next) * count + k];
+            }
+            if (std::isnan(a.x)) continue; // absent from this frame
+            snapshot.handles.push_back(handles[first + k]);
+            snapshot.pos.push_back(std::isnan(c.x) ? a : a + alpha * (c - a));
+        }
+    }
+
+    snapshot.maxJump = std::numeric_limits<float>::infinity();
+    snapshot.paused = true;
+    snapshot.fixedDt = m_reader.header().dt;
+    snapshot.step = frames[index].step;
+    snapshot.simTime = frames[index].time + alpha * (frames[next].time - frames[index].time);
+    snapshot.published = std::chrono::steady_clock::now();
+    frame.decodeMs = std::chrono::duration<double, std::milli>(snapshot.published - start).count();
+}
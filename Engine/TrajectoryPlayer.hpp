@@ -0,0 +1,79 @@
+#pragma once
+
+#include "SimulationThread.hpp"
+#include "ThreadPool.hpp"
+#include "TrajectoryReader.hpp"
+#include "TripleBuffer.hpp"
+
+#include "glm/glm.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One decoded moment of a recording, in the shape the scene already draws from the simulation
+struct ReplayFrame {
+    SimSnapshot snapshot; // recorded bodies in view, positions blended between the two nearest frames
+    bool ok = true;       // every block in view decoded
+    double decodeMs = 0.0;
+    uint32_t blocksDecoded = 0; // for this frame, the rest came from the cache
+    uint32_t blocksCulled = 0;  // outside the view
+};
+
+// Plays a trajectory recording back from a memory mapping. The render thread asks for a time with seek() and
+// picks up frames with acquireFrame(), never waiting. A worker finds the chunk through the index, skips the
+// blocks whose bounds lie outside the view and decodes the rest in parallel; decoded blocks of the current
+// chunk are kept, so playing through a chunk only blends. Throws std::runtime_error when the file is unusable.
+class TrajectoryPlayer {
+private:
+    TrajectoryReader m_reader;
+    ThreadPool m_pool;
+    std::vector<TrajectoryScratch> m_scratch; // per pool thread
+
+    // worker thread
+    size_t m_cachedChunk = SIZE_MAX;
+    std::vector<std::vector<float>> m_blocks; // per block, its decoded chunk
+    std::vector<uint8_t> m_blockState;        // per block, BLOCK_EMPTY, BLOCK_DECODED or BLOCK_FAILED
+    std::vector<uint8_t> m_visible;           // per block, inside the view of the current request
+    std::vector<uint32_t> m_decode;
+
+    struct Request {
+        double time = 0.0;
+        glm::mat4 viewProjection{1.0f};
+    };
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    Request m_request;
+    uint64_t m_requestSerial = 0;
+    bool m_stop = false;
+
+    TripleBuffer<ReplayFrame> m_frames;
+    std::thread m_thread;
+
+public:
+    // 0 threads picks std::thread::hardware_concurrency() for decoding
+    explicit TrajectoryPlayer(const std::string& path, size_t threadCount = 0);
+    ~TrajectoryPlayer();
+
+    TrajectoryPlayer(const TrajectoryPlayer&) = delete;
+    TrajectoryPlayer& operator=(const TrajectoryPlayer&) = delete;
+
+    // Render thread: the frame to show next. Only the latest request is served.
+    void seek(double time, const glm::mat4& viewProjection);
+    // Render thread: newest decoded frame, stays valid until the next call
+    const ReplayFrame& acquireFrame() {
+        m_frames.acquire();
+        return m_frames.front();
+    }
+
+    const TrajectoryReader& getReader() const { return m_reader; }
+    double getStartTime() const { return m_reader.header().firstTime; }
+    double getEndTime() const { return m_reader.header().lastTime; }
+
+private:
+    void workerLoop();
+    void decodeFrame(const Request& request, ReplayFrame& frame);
+};
@@ -3,6 +3,8 @@
 #include "ImFileDialog.h"
 
 #include <algorithm>
+#include <cfloat>
+#include <cstdio>
 #include <iostream>
 
 ImguiUI::ImguiUI() {}
@@ -175,11 +177,27 @@ void ImguiUI::settings() {
 void ImguiUI::sceneSettings(Scene* scene, std::vector<Light>* lights) {
     if (ImGui::CollapsingHeader("Scene Settings")) {
         if (ImGui::Button(scene->isPaused() ? "Play" : "Pause")) scene->pause();
+        rewindTimeline(scene);
+        SimulationThread* simulation = scene->getSimulation();
+        const SimSnapshot& snapshot = scene->getSnapshot();
+        float fixedDt = snapshot.fixedDt;
+        if (ImGui::SliderFloat("Physics Step", &fixedDt, 0.001f, 0.05f, "%.3f s")) simulation->setFixedTimestep(fixedDt);
+        float timeScale = snapshot.timeScale;
+        if (ImGui::SliderFloat("Time Scale", &timeScale, 0.1f, 10.0f, "%.1fx")) simulation->setTimeScale(timeScale);
+        int maxSubsteps = static_cast<int>(simulation->getMaxSubsteps());
+        if (ImGui::SliderInt("Max Substeps", &maxSubsteps, 1, 32)) simulation->setMaxSubsteps(static_cast<uint32_t>(maxSubsteps));
+        ImGui::Text("Step %llu, t = %.2f s, last step %.2f ms", static_cast<unsigned long long>(snapshot.step), snapshot.simTime, snapshot.stepMs);
         if (ImGui::Button("Add Planet")) scene->AddPlanetObj();
         if (ImGui::Button("Reset")) {
             m_selectedObjIdx = UINT32_MAX;
             scene->clear();
         };
+        diagnostics(scene);
+        rewindSettings(scene);
+        checkpoints(scene);
+        recording(scene);
+        replay(scene);
+        spawnSettings(scene);
         if (ImGui::TreeNode("Objects")) {
             for (size_t i = 0; i < scene->getObjCount(); ++i) {
                 if (ImGui::Selectable(scene->getObjNames()->at(i).c_str(), m_selectedObjIdx == i)) {
@@ -203,6 +221,258 @@ void ImguiUI::sceneSettings(Scene* scene, std::vector<Light>* lights) {
     }
 }
 
+void ImguiUI::diagnostics(Scene* scene) {
+    if (!ImGui::TreeNode("Diagnostics")) return;
+
+    const SimSnapshot& snapshot = scene->getSnapshot();
+    const Diagnostics& d = snapshot.diagnostics;
+    bool enabled = snapshot.diagnosticsEnabled;
+    if (ImGui::Checkbox("Measure Conservation", &enabled)) scene->getSimulation()->setDiagnosticsEnabled(enabled);
+
+    if (enabled && d.valid && snapshot.step != m_historyStep) {
+        // a new reference starts a new plot
+        if (d.steps == 0) m_historyCount = m_historyOffset = 0;
+        if (m_historyCount < DIAGNOSTICS_HISTORY) {
+            m_energyHistory[m_historyCount] = float(d.energyDrift);
+            m_angularMomentumHistory[m_historyCount] = float(d.angularMomentumDrift);
+            m_historyCount++;
+        } else {
+            m_energyHistory[m_historyOffset] = float(d.energyDrift);
+            m_angularMomentumHistory[m_historyOffset] = float(d.angularMomentumDrift);
+            m_historyOffset = (m_historyOffset + 1) % DIAGNOSTICS_HISTORY;
+        }
+        m_historyStep = snapshot.step;
+    }
+
+    if (enabled && d.valid) {
+        if (d.hasPotential) ImGui::Text("E = %.6e (K %.4e, U %.4e)", d.total, d.kinetic, d.potential);
+        else ImGui::Text("E = %.6e (kinetic only)", d.total);
+        ImGui::Text("|P| = %.4e, |L| = %.4e", glm::length(d.momentum), glm::length(d.angularMomentum));
+        ImGui::Text("Steps since reference: %llu", static_cast<unsigned long long>(d.steps));
+
+        char overlay[64];
+        std::snprintf(overlay, sizeof(overlay), "dE/E %.3e", d.energyDrift);
+        ImGui::PlotLines("Energy", m_energyHistory, m_historyCount, m_historyOffset, overlay, FLT_MAX, FLT_MAX, ImVec2(0.0f, 80.0f));
+        std::snprintf(overlay, sizeof(overlay), "dL/L %.3e", d.angularMomentumDrift);
+        ImGui::PlotLines("Ang. Momentum", m_angularMomentumHistory, m_historyCount, m_historyOffset, overlay, FLT_MAX, FLT_MAX, ImVec2(0.0f, 80.0f));
+        ImGui::Text("|P - P0| = %.3e", d.momentumDrift);
+        if (ImGui::Button("Clear History")) m_historyCount = m_historyOffset = 0;
+    }
+    ImGui::TreePop();
+}
+
+void ImguiUI::rewindTimeline(Scene* scene) {
+    const RewindStats& stats = scene->getSnapshot().rewind;
+    if (scene->isReplaying() || stats.entries < 2) return;
+    // dragging pauses the simulation and puts it back to the step under the handle
+    ImGui::SameLine();
+    uint64_t step = std::clamp(scene->getSnapshot().step, stats.firstStep, stats.lastStep);
+    if (ImGui::SliderScalar("##Rewind", ImGuiDataType_U64, &step, &stats.firstStep, &stats.lastStep, "step %llu")) {
+        scene->getSimulation()->rewindTo(step);
+    }
+}
+
+void ImguiUI::rewindSettings(Scene* scene) {
+    if (!ImGui::TreeNode("Rewind")) return;
+
+    bool changed = ImGui::Checkbox("Keep History", &m_rewindEnabled);
+    changed |= ImGui::SliderInt("Budget", &m_rewindBudgetMB, 16, 4096, "%d MB", ImGuiSliderFlags_Logarithmic);
+    changed |= ImGui::SliderInt("Keyframe Every", &m_rewindKeyframeInterval, 1, 256, "%d steps");
+    if (changed) {
+        scene->getSimulation()->setRewind({
+            .budgetBytes = m_rewindEnabled ? size_t(m_rewindBudgetMB) << 20 : 0,
+            .keyframeInterval = static_cast<uint32_t>(m_rewindKeyframeInterval)
+        });
+    }
+
+    const RewindStats& stats = scene->getSnapshot().rewind;
+    if (stats.enabled && stats.entries > 0) {
+        ImGui::Text("Steps %llu to %llu (%.2f s), %zu keyframes", static_cast<unsigned long long>(stats.firstStep),
+                    static_cast<unsigned long long>(stats.lastStep), stats.lastTime - stats.firstTime, stats.keyframes);
+        char overlay[64];
+        std::snprintf(overlay, sizeof(overlay), "%.1f / %.0f MB", stats.bytes / 1e6, stats.budgetBytes / 1e6);
+        ImGui::ProgressBar(stats.budgetBytes > 0 ? float(double(stats.bytes) / double(stats.budgetBytes)) : 0.0f, ImVec2(0.0f, 0.0f), overlay);
+        ImGui::Text("Capture %.2f ms per step", stats.captureMs);
+    }
+    ImGui::TreePop();
+}
+
+void ImguiUI::checkpoints(Scene* scene) {
+    if (!ImGui::TreeNode("Checkpoint")) return;
+
+    const char* filter = "checkpoints (*.phck){.phck},.*";
+    if (ImGui::Button("Save")) ifd::FileDialog::Instance().Save("SaveCheckpoint", "Save checkpoint", filter);
+    ImGui::SameLine();
+    if (ImGui::Button("Load")) ifd::FileDialog::Instance().Open("LoadCheckpoint", "Load checkpoint", filter);
+    ImGui::SameLine();
+    ImGui::Checkbox("Verify Checksum", &m_checkpointVerify);
+    if (CheckpointFork::supported()) {
+        ImGui::Checkbox("Save in Background", &m_checkpointFork);
+        if (ImGui::IsItemHovered()) ImGui::SetTooltip("A forked process writes the file while the simulation keeps running");
+    }
+
+    if (ifd::FileDialog::Instance().IsDone("SaveCheckpoint")) {
+        if (ifd::FileDialog::Instance().HasResult()) {
+            m_checkpointError.clear();
+            scene->saveCheckpoint(ifd::FileDialog::Instance().GetResult().string(), m_checkpointFork);
+        }
+        ifd::FileDialog::Instance().Close();
+    }
+    if (ifd::FileDialog::Instance().IsDone("LoadCheckpoint")) {
+        if (ifd::FileDialog::Instance().HasResult()) {
+            m_checkpointError.clear();
+            if (scene->loadCheckpoint(ifd::FileDialog::Instance().GetResult().string(), m_checkpointVerify, &m_checkpointError)) {
+                m_selectedObjIdx = UINT32_MAX;
+            }
+        }
+        ifd::FileDialog::Instance().Close();
+    }
+
+    const CheckpointStatus& status = scene->getSnapshot().checkpoint;
+    if (!m_checkpointError.empty()) {
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", m_checkpointError.c_str());
+    } else if (status.pending) {
+        ImGui::TextColored(ImVec4(1.0f, 0.9f, 0.4f, 1.0f), "%s (paused %.1f ms)", status.message.c_str(), status.ms);
+    } else if (status.serial > 0) {
+        const ImVec4 color = status.ok ? ImVec4(0.6f, 1.0f, 0.6f, 1.0f) : ImVec4(1.0f, 0.4f, 0.4f, 1.0f);
+        ImGui::TextColored(color, "%s (%.1f ms)", status.message.c_str(), status.ms);
+    }
+    ImGui::TreePop();
+}
+
+void ImguiUI::recording(Scene* scene) {
+    if (!ImGui::TreeNode("Recording")) return;
+
+    const RecordingStats& stats = scene->getSnapshot().recording;
+    if (!stats.active) {
+        ImGui::SliderInt("Every N Steps", &m_recordEvery, 1, 100);
+        ImGui::SliderInt("Body Stride", &m_recordStride, 1, 1000, "%d", ImGuiSliderFlags_Logarithmic);
+        ImGui::InputInt("Max Bodies (0 = all)", &m_recordMaxBodies);
+        ImGui::SliderInt("Quantization Bits", &m_recordBits, int(TRAJECTORY_MIN_BITS), int(TRAJECTORY_MAX_BITS));
+        ImGui::SliderInt("Frames per Chunk", &m_recordChunkFrames, 1, 256);
+        m_recordMaxBodies = std::max(m_recordMaxBodies, 0);
+        if (ImGui::Button("Record...")) {
+            ifd::FileDialog::Instance().Save("RecordTrajectory", "Record trajectory", "trajectories (*.phtr){.phtr},.*");
+        }
+    } else if (ImGui::Button("Stop Recording")) {
+        scene->stopRecording();
+    }
+
+    if (ifd::FileDialog::Instance().IsDone("RecordTrajectory")) {
+        if (ifd::FileDialog::Instance().HasResult()) {
+            scene->startRecording({
+                .path = ifd::FileDialog::Instance().GetResult().string(),
+                .sampleEvery = static_cast<uint32_t>(m_recordEvery),
+                .bodyStride = static_cast<uint32_t>(m_recordStride),
+                .maxBodies = static_cast<uint32_t>(m_recordMaxBodies),
+                .quantizationBits = static_cast<uint32_t>(m_recordBits),
+                .framesPerChunk = static_cast<uint32_t>(m_recordChunkFrames)
+            });
+        }
+        ifd::FileDialog::Instance().Close();
+    }
+
+    if (stats.failed) {
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", stats.error.c_str());
+    } else if (stats.framesCaptured > 0) {
+        ImGui::Text("%s%s", stats.active ? "Recording " : "Recorded ", stats.path.c_str());
+        ImGui::Text("%llu bodies, %llu frames written", static_cast<unsigned long long>(stats.bodyCount),
+                    static_cast<unsigned long long>(stats.framesWritten));
+        const float fill = stats.ringCapacity > 0 ? float(stats.ringUsed) / float(stats.ringCapacity) : 0.0f;
+        char overlay[64];
+        std::snprintf(overlay, sizeof(overlay), "%u / %u frames", stats.ringUsed, stats.ringCapacity);
+        ImGui::ProgressBar(fill, ImVec2(0.0f, 0.0f), overlay);
+        ImGui::SameLine();
+        ImGui::TextUnformatted("Buffer");
+        ImGui::Text("Writer busy %.0f%%, %.1f MB on disk (%.1fx)", 100.0 * stats.writerBusy, stats.writtenBytes / 1e6,
+                    stats.writtenBytes > 0 ? double(stats.rawBytes) / double(stats.writtenBytes) : 0.0);
+        if (stats.framesDropped > 0) {
+            ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "%llu frames dropped, the writer can't keep up",
+                               static_cast<unsigned long long>(stats.framesDropped));
+        }
+    }
+    ImGui::TreePop();
+}
+
+void ImguiUI::replay(Scene* scene) {
+    if (!ImGui::TreeNode("Replay")) return;
+
+    if (ImGui::Button("Open...")) ifd::FileDialog::Instance().Open("OpenTrajectory", "Open trajectory", "trajectories (*.phtr){.phtr},.*");
+    if (ifd::FileDialog::Instance().IsDone("OpenTrajectory")) {
+        if (ifd::FileDialog::Instance().HasResult()) {
+            m_replayError.clear();
+            if (scene->startReplay(ifd::FileDialog::Instance().GetResult().string(), &m_replayError)) {
+                m_selectedObjIdx = UINT32_MAX;
+            }
+        }
+        ifd::FileDialog::Instance().Close();
+    }
+
+    if (scene->isReplaying()) {
+        ImGui::SameLine();
+        if (ImGui::Button("Stop Replay")) scene->stopReplay();
+    }
+    // stopReplay() above may have dropped it
+    if (const TrajectoryPlayer* player = scene->getReplay()) {
+        // the scrubbed time is decoded on the player's thread, the viewport shows the newest finished frame
+        double time = scene->getReplayTime();
+        const double start = player->getStartTime();
+        const double end = player->getEndTime();
+        if (ImGui::SliderScalar("Time", ImGuiDataType_Double, &time, &start, &end, "%.3f s")) scene->setReplayTime(time);
+        if (ImGui::Button(scene->isReplayPlaying() ? "Pause" : "Play")) scene->pause();
+        ImGui::SameLine();
+        float speed = scene->getReplaySpeed();
+        if (ImGui::SliderFloat("Speed", &speed, 0.1f, 100.0f, "%.1fx", ImGuiSliderFlags_Logarithmic)) scene->setReplaySpeed(speed);
+
+        const TrajectoryHeader& header = player->getReader().header();
+        ImGui::Text("%llu bodies, %llu frames in %llu chunks", static_cast<unsigned long long>(header.bodyCount),
+                    static_cast<unsigned long long>(header.frameCount), static_cast<unsigned long long>(header.chunkCount));
+        const ReplayFrame& frame = scene->getReplayFrame();
+        ImGui::Text("Step %llu, %zu bodies in view", static_cast<unsigned long long>(frame.snapshot.step), frame.snapshot.handles.size());
+        ImGui::Text("Decoded %u blocks (%u culled) in %.1f ms", frame.blocksDecoded, frame.blocksCulled, frame.decodeMs);
+        if (!frame.ok) ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "Some blocks are corrupt and not shown");
+    }
+    if (!m_replayError.empty()) ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", m_replayError.c_str());
+    ImGui::TreePop();
+}
+
+void ImguiUI::spawnSettings(Scene* scene) {
+    if (!ImGui::TreeNode("Spawn Bodies")) return;
+
+    const char* generators[] = {"Plummer Sphere", "King Model", "Keplerian Disk", "Asteroid Belt"};
+    ImGui::Combo("Generator", &m_spawnGenerator, generators, IM_ARRAYSIZE(generators));
+    ImGui::SliderInt("Count", &m_spawnCount, 100, 1000000, "%d", ImGuiSliderFlags_Logarithmic);
+    ImGui::SliderFloat("Size", &m_spawnSize, 1.0f, 500.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+    ImGui::SliderFloat("Mass", &m_spawnMass, 1.0f, 1e6f, "%.0f", ImGuiSliderFlags_Logarithmic);
+    ImGui::InputInt("Seed", &m_spawnSeed);
+
+    if (ImGui::Button("Spawn")) {
+        ThreadPool& pool = scene->getGeneratorPool();
+        const size_t count = static_cast<size_t>(m_spawnCount);
+        const SystemPlacement placement{.seed = static_cast<uint64_t>(m_spawnSeed)};
+        switch (m_spawnGenerator) {
+            case 0:
+                scene->addBodies(generatePlummer({.count = count, .totalMass = m_spawnMass, .scaleRadius = m_spawnSize, .placement = placement}, Physics::G, pool));
+                break;
+            case 1:
+                scene->addBodies(generateKing({.count = count, .totalMass = m_spawnMass, .coreRadius = m_spawnSize, .placement = placement}, Physics::G, pool));
+                break;
+            case 2:
+                scene->addBodies(generateKeplerianDisk({.count = count, .centralMass = m_spawnMass, .diskMass = 0.01f * m_spawnMass,
+                    .innerRadius = 0.1f * m_spawnSize, .outerRadius = m_spawnSize, .placement = placement}, Physics::G, pool));
+                break;
+            default:
+                scene->addBodies(generateAsteroidBelt({.count = count, .centralMass = m_spawnMass,
+                    .innerRadius = 0.8f * m_spawnSize, .outerRadius = m_spawnSize, .placement = placement}, Physics::G, pool));
+                break;
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear")) scene->clearPointBodies();
+    ImGui::Text("Point bodies: %zu", scene->getPointBodyCount());
+    ImGui::TreePop();
+}
+
 void ImguiUI::shaders(std::vector<Shader>* shaders) {
     if (ImGui::CollapsingHeader("Shaders")) {
         for (size_t i = 0; i < shaders->size(); ++i) {
@@ -378,9 +648,20 @@ void ImguiUI::textureTypeSelect(PBR_Renderable& renderable, TextureType type) {
 
 void ImguiUI::physicsPropertiesEdit(Scene* scene) {
     if (ImGui::CollapsingHeader("Physics Properties")) {
-        Physics* physics = scene->getPhysics();
-        Planet& planet = physics->getPlanets()->at(m_selectedObjIdx);
-        ImGui::SliderFloat("Mass", &planet.mass, 1.0f, 10000.0f);
-        ImGui::Text("Position: (%.2f, %.2f, %.2f)", planet.pos.x, planet.pos.y, planet.pos.z);
+        const SimSnapshot& snapshot = scene->getSnapshot();
+        const uint32_t body = scene->getSnapshotIndex(m_selectedObjIdx);
+        if (body == Handle::INVALID) return;
+        // edits go through the simulation thread and land between two steps
+        const Handle handle = scene->getHandle(m_selectedObjIdx);
+        float mass = snapshot.mass[body];
+        if (ImGui::SliderFloat("Mass", &mass, 1.0f, 10000.0f)) {
+            scene->getSimulation()->setMass(handle, mass);
+        }
+        glm::vec3 vel = snapshot.vel[body];
+        if (ImGui::DragFloat3("Velocity", glm::value_ptr(vel), 0.001f)) {
+            scene->getSimulation()->setVelocity(handle, vel);
+        }
+        glm::vec3 pos = snapshot.pos[body];
+        ImGui::Text("Position: (%.2f, %.2f, %.2f)", pos.x, pos.y, pos.z);
     }
 }
@@ -46,6 +46,37 @@ private:
 
     size_t m_selectedObjIdx = UINT32_MAX;
 
+    // body generator settings
+    int m_spawnGenerator = 0;
+    int m_spawnCount = 10000;
+    int m_spawnSeed = 1;
+    float m_spawnSize = 20.0f;
+    float m_spawnMass = 1000.0f;
+
+    // conservation history, one sample per published step
+    static constexpr int DIAGNOSTICS_HISTORY = 512;
+    float m_energyHistory[DIAGNOSTICS_HISTORY] = {};
+    float m_angularMomentumHistory[DIAGNOSTICS_HISTORY] = {};
+    int m_historyCount = 0;
+    int m_historyOffset = 0;
+    uint64_t m_historyStep = UINT64_MAX;
+
+    bool m_checkpointVerify = false;
+    bool m_checkpointFork = CheckpointFork::supported();
+
+    // trajectory recording settings
+    int m_recordEvery = 1;
+    int m_recordStride = 1;
+    int m_recordMaxBodies = 0;
+    int m_recordBits = 20;
+    int m_recordChunkFrames = 64;
+    // rewind history settings
+    bool m_rewindEnabled = false;
+    int m_rewindBudgetMB = 256;
+    int m_rewindKeyframeInterval = 64;
+    std::string m_checkpointError; // from opening a file, the simulation reports the rest
+    std::string m_replayError;
+
     double last_updated_time = 0;
     double current_time = 0;
     float fps = 0.0f;
@@ -74,6 +105,13 @@ private:
     void info();
     void settings();
     void sceneSettings(Scene* scene, std::vector<Light>* lights);
+    void spawnSettings(Scene* scene);
+    void diagnostics(Scene* scene);
+    void checkpoints(Scene* scene);
+    void recording(Scene* scene);
+    void rewindTimeline(Scene* scene);
+    void rewindSettings(Scene* scene);
+    void replay(Scene* scene);
     void shaders(std::vector<Shader>* shaders);
 
     void textureEdit(Scene* scene);
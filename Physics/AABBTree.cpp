@@ -0,0 +1,352 @@
+#include "AABBTree.hpp"
+
+#include "BodyStore.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    // the tree stays balanced, so 64 levels of pending siblings is plenty
+    constexpr uint32_t QUERY_STACK_SIZE = 256;
+
+    inline AABB sphereBox(const BodyStore& bodies, size_t i) {
+        glm::vec3 p = bodies.pos(i);
+        glm::vec3 r(bodies.radius[i]);
+        return {p - r, p + r};
+    }
+
+    inline double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+uint32_t AABBTree::allocateNode() {
+    if (m_freeList == NULL_NODE) {
+        m_nodes.emplace_back();
+        return static_cast<uint32_t>(m_nodes.size() - 1);
+    }
+    uint32_t node = m_freeList;
+    m_freeList = m_nodes[node].parent;
+    m_nodes[node] = Node{};
+    return node;
+}
+
+void AABBTree::freeNode(uint32_t node) {
+    m_nodes[node].parent = m_freeList;
+    m_nodes[node].height = -1;
+    m_freeList = node;
+}
+
+AABB AABBTree::fatBox(const BodyStore& bodies, size_t i, float dt) const {
+    AABB box = sphereBox(bodies, i);
+    glm::vec3 margin(m_fatRadius * bodies.radius[i]);
+    box.lo -= margin;
+    box.hi += margin;
+
+    // stretch towards where the body is heading so steady motion stays inside for a few steps
+    glm::vec3 d = bodies.vel(i) * (dt * m_velocityScale);
+    box.lo += glm::min(d, glm::vec3(0.0f));
+    box.hi += glm::max(d, glm::vec3(0.0f));
+    return box;
+}
+
+void AABBTree::insertLeaf(uint32_t leaf) {
+    if (m_root == NULL_NODE) {
+        m_root = leaf;
+        m_nodes[leaf].parent = NULL_NODE;
+        return;
+    }
+
+    // descend towards the sibling that adds the least area to the tree
+    const AABB leafBox = m_nodes[leaf].box;
+    uint32_t index = m_root;
+    while (!m_nodes[index].isLeaf()) {
+        const Node& node = m_nodes[index];
+        const float area = node.box.area();
+        const float combinedArea = AABB::merge(node.box, leafBox).area();
+
+        // pairing with this node creates a parent of combinedArea, pushing down costs the growth of this node
+        const float cost = 2.0f * combinedArea;
+        const float inheritanceCost = 2.0f * (combinedArea - area);
+
+        auto descendCost = [&](uint32_t child) {
+            const Node& c = m_nodes[child];
+            float merged = AABB::merge(leafBox, c.box).area();
+            return (c.isLeaf() ? merged : merged - c.box.area()) + inheritanceCost;
+        };
+        const float cost1 = descendCost(node.child1);
+        const float cost2 = descendCost(node.child2);
+
+        if (cost < cost1 && cost < cost2) break;
+        index = cost1 < cost2 ? node.child1 : node.child2;
+    }
+
+    const uint32_t sibling = index;
+    const uint32_t oldParent = m_nodes[sibling].parent;
+    const uint32_t newParent = allocateNode();
+    m_nodes[newParent].parent = oldParent;
+    m_nodes[newParent].box = AABB::merge(leafBox, m_nodes[sibling].box);
+    m_nodes[newParent].height = m_nodes[sibling].height + 1;
+    m_nodes[newParent].child1 = sibling;
+    m_nodes[newParent].child2 = leaf;
+    m_nodes[sibling].parent = newParent;
+    m_nodes[leaf].parent = newParent;
+
+    if (oldParent == NULL_NODE) {
+        m_root = newParent;
+    } else if (m_nodes[oldParent].child1 == sibling) {
+        m_nodes[oldParent].child1 = newParent;
+    } else {
+        m_nodes[oldParent].child2 = newParent;
+    }
+
+    // refit and rebalance up to the root
+    index = m_nodes[leaf].parent;
+    while (index != NULL_NODE) {
+        index = balance(index);
+        Node& node = m_nodes[index];
+        node.height = 1 + std::max(m_nodes[node.child1].height, m_nodes[node.child2].height);
+        node.box = AABB::merge(m_nodes[node.child1].box, m_nodes[node.child2].box);
+        index = node.parent;
+    }
+}
+
+void AABBTree::removeLeaf(uint32_t leaf) {
+    if (leaf == m_root) {
+        m_root = NULL_NODE;
+        return;
+    }
+
+    const uint32_t parent = m_nodes[leaf].parent;
+    const uint32_t grandParent = m_nodes[parent].parent;
+    const uint32_t sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+    if (grandParent == NULL_NODE) {
+        m_root = sibling;
+        m_nodes[sibling].parent = NULL_NODE;
+        freeNode(parent);
+        return;
+    }
+
+    if (m_nodes[grandParent].child1 == parent) {
+        m_nodes[grandParent].child1 = sibling;
+    } else {
+        m_nodes[grandParent].child2 = sibling;
+    }
+    m_nodes[sibling].parent = grandParent;
+    freeNode(parent);
+
+    uint32_t index = grandParent;
+    while (index != NULL_NODE) {
+        index = balance(index);
+        Node& node = m_nodes[index];
+        node.height = 1 + std::max(m_nodes[node.child1].height, m_nodes[node.child2].height);
+        node.box = AABB::merge(m_nodes[node.child1].box, m_nodes[node.child2].box);
+        index = node.parent;
+    }
+}
+
+// Rotates the taller grandchild up when the children of a differ in height by more than one.
+// Returns the node now at a's position.
+uint32_t AABBTree::balance(uint32_t a) {
+    Node& A = m_nodes[a];
+    if (A.isLeaf() || A.height < 2) return a;
+
+    const uint32_t b = A.child1;
+    const uint32_t c = A.child2;
+    const int32_t diff = m_nodes[c].height - m_nodes[b].height;
+    if (diff >= -1 && diff <= 1) return a;
+
+    // lift the taller child "up", the lower of its children moves under a
+    const bool liftC = diff > 1;
+    const uint32_t up = liftC ? c : b;
+    const uint32_t stay = liftC ? b : c;
+    Node& U = m_nodes[up];
+    const uint32_t f = U.child1;
+    const uint32_t g = U.child2;
+
+    U.child1 = a;
+    U.parent = A.parent;
+    A.parent = up;
+    if (U.parent == NULL_NODE) {
+        m_root = up;
+    } else if (m_nodes[U.parent].child1 == a) {
+        m_nodes[U.parent].child1 = up;
+    } else {
+        m_nodes[U.parent].child2 = up;
+    }
+
+    const bool keepF = m_nodes[f].height > m_nodes[g].height;
+    const uint32_t kept = keepF ? f : g;
+    const uint32_t moved = keepF ? g : f;
+    U.child2 = kept;
+    if (liftC) {
+        A.child2 = moved;
+    } else {
+        A.child1 = moved;
+    }
+    m_nodes[moved].parent = a;
+
+    A.box = AABB::merge(m_nodes[stay].box, m_nodes[moved].box);
+    A.height = 1 + std::max(m_nodes[stay].height, m_nodes[moved].height);
+    U.box = AABB::merge(A.box, m_nodes[kept].box);
+    U.height = 1 + std::max(A.height, m_nodes[kept].height);
+    return up;
+}
+
+uint32_t AABBTree::buildTopDown(uint32_t* leaves, uint32_t count, uint32_t parent) {
+    if (count == 1) {
+        m_nodes[leaves[0]].parent = parent;
+        return leaves[0];
+    }
+
+    // median split along the widest axis of the leaf centers
+    glm::vec3 lo(INFINITY), hi(-INFINITY);
+    for (uint32_t k = 0; k < count; ++k) {
+        const AABB& box = m_nodes[leaves[k]].box;
+        glm::vec3 center = 0.5f * (box.lo + box.hi);
+        lo = glm::min(lo, center);
+        hi = glm::max(hi, center);
+    }
+    glm::vec3 extent = hi - lo;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+    const uint32_t half = count / 2;
+    std::nth_element(leaves, leaves + half, leaves + count, [&](uint32_t l, uint32_t r) {
+        return m_nodes[l].box.lo[axis] + m_nodes[l].box.hi[axis] < m_nodes[r].box.lo[axis] + m_nodes[r].box.hi[axis];
+    });
+
+    const uint32_t node = allocateNode();
+    const uint32_t child1 = buildTopDown(leaves, half, node);
+    const uint32_t child2 = buildTopDown(leaves + half, count - half, node);
+    Node& n = m_nodes[node];
+    n.parent = parent;
+    n.child1 = child1;
+    n.child2 = child2;
+    n.box = AABB::merge(m_nodes[child1].box, m_nodes[child2].box);
+    n.height = 1 + std::max(m_nodes[child1].height, m_nodes[child2].height);
+    return node;
+}
+
+void AABBTree::rebuild(const BodyStore& bodies, float dt) {
+    auto start = std::chrono::steady_clock::now();
+    const uint32_t n = static_cast<uint32_t>(bodies.size());
+
+    m_nodes.clear();
+    m_nodes.reserve(2 * static_cast<size_t>(n));
+    m_freeList = NULL_NODE;
+    m_root = NULL_NODE;
+    m_leafOf.resize(n);
+
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t leaf = allocateNode();
+        m_nodes[leaf].box = fatBox(bodies, i, dt);
+        m_nodes[leaf].body = i;
+        m_leafOf[i] = leaf;
+    }
+    if (n > 0) {
+        std::vector<uint32_t> leaves(m_leafOf);
+        m_root = buildTopDown(leaves.data(), n, NULL_NODE);
+    }
+
+    measure();
+    m_rebuiltCost = m_stats.sahCost;
+    m_stats.rebuildCount++;
+    m_stats.rebuildMs = elapsedMs(start);
+}
+
+void AABBTree::measure() {
+    m_stats.leafCount = 0;
+    m_stats.sahCost = 0.0f;
+    m_stats.height = m_root == NULL_NODE ? 0 : static_cast<uint32_t>(m_nodes[m_root].height);
+    if (m_root == NULL_NODE) return;
+
+    double internalArea = 0.0;
+    for (const Node& node : m_nodes) {
+        if (node.height < 0) continue;
+        if (node.isLeaf()) {
+            m_stats.leafCount++;
+        } else {
+            internalArea += node.box.area();
+        }
+    }
+    const float rootArea = m_nodes[m_root].box.area();
+    m_stats.sahCost = rootArea > 0.0f ? float(internalArea / rootArea) : 0.0f;
+}
+
+template <typename Fn>
+void AABBTree::visit(const AABB& box, Fn&& fn) const {
+    if (m_root == NULL_NODE) return;
+    uint32_t stack[QUERY_STACK_SIZE];
+    uint32_t top = 0;
+    stack[top++] = m_root;
+    while (top > 0) {
+        const Node& node = m_nodes[stack[--top]];
+        if (!node.box.overlaps(box)) continue;
+        if (node.isLeaf()) {
+            fn(node.body);
+        } else if (top + 2 <= QUERY_STACK_SIZE) {
+            stack[top++] = node.child1;
+            stack[top++] = node.child2;
+        }
+    }
+}
+
+void AABBTree::query(const AABB& box, std::vector<uint32_t>& out) const {
+    out.clear();
+    visit(box, [&](uint32_t body) { out.push_back(body); });
+}
+
+void AABBTree::findOverlaps(const BodyStore& bodies, float dt, std::vector<std::pair<uint32_t, uint32_t>>& pairs, ThreadPool& pool) {
+    pairs.clear();
+    m_stats.reinserted = 0;
+    m_stats.pairCount = 0;
+    const size_t n = bodies.size();
+
+    auto start = std::chrono::steady_clock::now();
+    if (m_leafOf.size() != n) {
+        // indices shift on erase, start over rather than chase them
+        rebuild(bodies, dt);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            const uint32_t leaf = m_leafOf[i];
+            if (m_nodes[leaf].box.contains(sphereBox(bodies, i))) continue;
+            removeLeaf(leaf);
+            m_nodes[leaf].box = fatBox(bodies, i, dt);
+            insertLeaf(leaf);
+            m_stats.reinserted++;
+        }
+        measure();
+        if (m_stats.sahCost > m_rebuildRatio * m_rebuiltCost) rebuild(bodies, dt);
+    }
+    m_stats.refitMs = elapsedMs(start);
+    if (n < 2) return;
+
+    start = std::chrono::steady_clock::now();
+    m_threadPairs.resize(pool.getThreadCount());
+    for (auto& local : m_threadPairs) local.clear();
+
+    // the tree is read-only here, every body queries its own tight box
+    pool.parallelFor(n, 512, [&](size_t begin, size_t end, size_t thread) {
+        std::vector<std::pair<uint32_t, uint32_t>>& local = m_threadPairs[thread];
+        for (size_t bi = begin; bi < end; ++bi) {
+            const uint32_t i = static_cast<uint32_t>(bi);
+            visit(sphereBox(bodies, i), [&](uint32_t j) {
+                if (j <= i) return;
+                float dx = bodies.px[j] - bodies.px[i];
+                float dy = bodies.py[j] - bodies.py[i];
+                float dz = bodies.pz[j] - bodies.pz[i];
+                float rSum = bodies.radius[i] + bodies.radius[j];
+                if (dx * dx + dy * dy + dz * dz < rSum * rSum) local.emplace_back(i, j);
+            });
+        }
+    });
+
+    for (const auto& local : m_threadPairs) pairs.insert(pairs.end(), local.begin(), local.end());
+    // resolve in index order, like the direct loop does
+    std::sort(pairs.begin(), pairs.end());
+    m_stats.pairCount = pairs.size();
+    m_stats.queryMs = elapsedMs(start);
+}
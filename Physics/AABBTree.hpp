@@ -0,0 +1,111 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct BodyStore;
+class ThreadPool;
+
+struct AABB {
+    glm::vec3 lo{0.0f};
+    glm::vec3 hi{0.0f};
+
+    // half the surface area, enough for cost ratios
+    float area() const {
+        glm::vec3 d = hi - lo;
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+    bool contains(const AABB& o) const {
+        return lo.x <= o.lo.x && lo.y <= o.lo.y && lo.z <= o.lo.z && o.hi.x <= hi.x && o.hi.y <= hi.y && o.hi.z <= hi.z;
+    }
+    bool overlaps(const AABB& o) const {
+        return lo.x <= o.hi.x && o.lo.x <= hi.x && lo.y <= o.hi.y && o.lo.y <= hi.y && lo.z <= o.hi.z && o.lo.z <= hi.z;
+    }
+    static AABB merge(const AABB& a, const AABB& b) { return {glm::min(a.lo, b.lo), glm::max(a.hi, b.hi)}; }
+};
+
+struct AABBTreeStats {
+    size_t leafCount = 0;
+    uint32_t height = 0;
+    // sum of internal node areas over the root area, lower is better
+    float sahCost = 0.0f;
+    size_t reinserted = 0; // leaves that left their fat bounds this step
+    size_t rebuildCount = 0;
+    size_t pairCount = 0;
+
+    double refitMs = 0.0;
+    double queryMs = 0.0;
+    double rebuildMs = 0.0; // last full rebuild
+};
+
+// Dynamic bounding volume hierarchy over body bounding spheres. Leaves store fattened boxes, so a body
+// only gets reinserted once it leaves its margin; insertions pick the sibling with the least area
+// growth and rotations keep the tree balanced. Unlike a uniform grid, a few huge bodies among many small
+// ones do not blow up the cost.
+class AABBTree {
+private:
+    static constexpr uint32_t NULL_NODE = 0xffffffffu;
+
+    struct Node {
+        AABB box;
+        uint32_t parent = NULL_NODE; // next free node while on the free list
+        uint32_t child1 = NULL_NODE;
+        uint32_t child2 = NULL_NODE;
+        int32_t height = 0;          // 0 for leaves, -1 for free nodes
+        uint32_t body = NULL_NODE;
+
+        bool isLeaf() const { return child1 == NULL_NODE; }
+    };
+
+    std::vector<Node> m_nodes;
+    uint32_t m_root = NULL_NODE;
+    uint32_t m_freeList = NULL_NODE;
+    std::vector<uint32_t> m_leafOf; // body -> leaf node
+
+    float m_fatRadius = 0.1f;     // margin as a fraction of the body radius
+    float m_velocityScale = 2.0f; // steps of motion the fat box stretches ahead
+    float m_rebuildRatio = 2.0f;  // full rebuild once sahCost grows past this times the rebuilt cost
+    float m_rebuiltCost = 0.0f;
+
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> m_threadPairs;
+    AABBTreeStats m_stats;
+
+public:
+    AABBTree() = default;
+    ~AABBTree() = default;
+
+    // Refits the tree to the current positions (velocities set the fat margin) and returns every pair
+    // (i < j) whose bounding spheres overlap, sorted
+    void findOverlaps(const BodyStore& bodies, float dt, std::vector<std::pair<uint32_t, uint32_t>>& pairs, ThreadPool& pool);
+
+    // Bodies whose fat box overlaps box. Valid for the positions of the last findOverlaps or rebuild.
+    void query(const AABB& box, std::vector<uint32_t>& out) const;
+
+    // Top-down rebuild from scratch, also done automatically when the body count changes
+    void rebuild(const BodyStore& bodies, float dt);
+
+    void setFatRadius(float fraction) { m_fatRadius = fraction > 0.0f ? fraction : 0.0f; }
+    float getFatRadius() const { return m_fatRadius; }
+    void setRebuildRatio(float ratio) { m_rebuildRatio = ratio; }
+    float getRebuildRatio() const { return m_rebuildRatio; }
+
+    const AABBTreeStats& getStats() const { return m_stats; }
+
+private:
+    uint32_t allocateNode();
+    void freeNode(uint32_t node);
+    AABB fatBox(const BodyStore& bodies, size_t i, float dt) const;
+
+    void insertLeaf(uint32_t leaf);
+    void removeLeaf(uint32_t leaf);
+    uint32_t balance(uint32_t a);
+    uint32_t buildTopDown(uint32_t* leaves, uint32_t count, uint32_t parent);
+    void measure();
+
+    // calls fn(body) for every leaf overlapping box
+    template <typename Fn>
+    void visit(const AABB& box, Fn&& fn) const;
+};
@@ -0,0 +1,122 @@
+#include "AlignedFileWriter.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <stdexcept>
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+    // Pushes the file's data to the device, fflush only hands it to the OS
+    bool syncFile(std::FILE* file) {
+        if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+        return _commit(_fileno(file)) == 0;
+#else
+        return fsync(fileno(file)) == 0;
+#endif
+    }
+
+    // Makes a rename in directory durable. Windows has no directory handles to sync, NTFS journals the rename.
+    void syncDirectory(const std::filesystem::path& directory) {
+#ifndef _WIN32
+        const int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0) return;
+        fsync(fd);
+        ::close(fd);
+#else
+        (void)directory;
+#endif
+    }
+}
+
+AlignedFileWriter::AlignedFileWriter(const std::string& path, size_t bufferSize)
+    : m_path(path), m_tempPath(path + ".tmp") {
+    m_capacity = (std::max(bufferSize, BLOCK_ALIGNMENT) + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+    m_buffer.reset(static_cast<std::byte*>(::operator new(m_capacity, std::align_val_t(BLOCK_ALIGNMENT))));
+
+    m_file = std::fopen(m_tempPath.c_str(), "wb");
+    if (!m_file) throw std::runtime_error("Failed to create " + m_tempPath);
+    // the buffer above is the only one
+    std::setvbuf(m_file, nullptr, _IONBF, 0);
+}
+
+AlignedFileWriter::~AlignedFileWriter() {
+    // not finished: an exception is unwinding, drop the partial file
+    if (m_file) {
+        std::fclose(m_file);
+        std::remove(m_tempPath.c_str());
+    }
+}
+
+void AlignedFileWriter::write(const void* data, size_t size) {
+    const std::byte* src = static_cast<const std::byte*>(data);
+    m_offset += size;
+    while (size > 0) {
+        const size_t take = std::min(size, m_capacity - m_used);
+        std::memcpy(m_buffer.get() + m_used, src, take);
+        m_used += take;
+        src += take;
+        size -= take;
+        if (m_used == m_capacity) flush();
+    }
+}
+
+void AlignedFileWriter::pad(size_t alignment) {
+    static const std::byte zeros[BLOCK_ALIGNMENT] = {};
+    size_t left = (alignment - m_offset % alignment) % alignment;
+    while (left > 0) {
+        const size_t take = std::min(left, sizeof(zeros));
+        write(zeros, take);
+        left -= take;
+    }
+}
+
+void AlignedFileWriter::flush() {
+    if (m_used == 0) return;
+    m_checksum.update(m_buffer.get(), m_used);
+    if (std::fwrite(m_buffer.get(), 1, m_used, m_file) != m_used) {
+        throw std::runtime_error("Failed to write " + m_tempPath);
+    }
+    m_used = 0;
+}
+
+uint64_t AlignedFileWriter::checksum() {
+    flush();
+    return m_checksum.digest();
+}
+
+void AlignedFileWriter::patch(uint64_t offset, const void* data, size_t size) {
+    flush();
+    if (std::fseek(m_file, static_cast<long>(offset), SEEK_SET) != 0 ||
+        std::fwrite(data, 1, size, m_file) != size ||
+        std::fseek(m_file, 0, SEEK_END) != 0) {
+        throw std::runtime_error("Failed to write " + m_tempPath);
+    }
+}
+
+void AlignedFileWriter::finish() {
+    flush();
+    // the data has to be on disk before the rename can be, or a power loss may leave the new name on old blocks
+    const bool synced = syncFile(m_file);
+    const bool closed = std::fclose(m_file) == 0 && synced;
+    m_file = nullptr;
+    if (!closed) {
+        std::remove(m_tempPath.c_str());
+        throw std::runtime_error("Failed to write " + m_tempPath);
+    }
+    std::error_code error;
+    std::filesystem::rename(m_tempPath, m_path, error);
+    if (error) {
+        std::remove(m_tempPath.c_str());
+        throw std::runtime_error("Failed to rename " + m_tempPath + " to " + m_path + ": " + error.message());
+    }
+    syncDirectory(std::filesystem::path(m_path).parent_path());
+}
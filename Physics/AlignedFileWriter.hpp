@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Checksum.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+// Buffered binary writer that hands the OS whole, page aligned blocks and checksums everything it writes.
+// Output goes to path + ".tmp" and is synced to disk, renamed over path and the directory synced by finish(),
+// so neither a crash nor a power loss leaves a torn file under the final name. Throws std::runtime_error on
+// I/O errors.
+class AlignedFileWriter {
+public:
+    static constexpr size_t BLOCK_ALIGNMENT = 4096;
+
+private:
+    struct AlignedDelete {
+        void operator()(std::byte* p) const { ::operator delete(p, std::align_val_t(BLOCK_ALIGNMENT)); }
+    };
+
+    std::string m_path;
+    std::string m_tempPath;
+    std::FILE* m_file = nullptr;
+    std::unique_ptr<std::byte, AlignedDelete> m_buffer;
+    size_t m_capacity = 0;
+    size_t m_used = 0;
+    uint64_t m_offset = 0;  // bytes handed to write() so far
+    uint64_t m_checksumStart = 0;
+    Checksum64 m_checksum;
+
+public:
+    // bufferSize is rounded up to a multiple of BLOCK_ALIGNMENT
+    explicit AlignedFileWriter(const std::string& path, size_t bufferSize = size_t(4) << 20);
+    ~AlignedFileWriter();
+
+    AlignedFileWriter(const AlignedFileWriter&) = delete;
+    AlignedFileWriter& operator=(const AlignedFileWriter&) = delete;
+
+    void write(const void* data, size_t size);
+    // Zero fill up to the next multiple of alignment
+    void pad(size_t alignment);
+    uint64_t offset() const { return m_offset; }
+
+    // Only bytes written from here on go into checksum()
+    void startChecksum() { flush(); m_checksum.reset(); m_checksumStart = m_offset; }
+    // Checksum of everything written since startChecksum, flushes first
+    uint64_t checksum();
+
+    // Overwrites bytes already written, e.g. a header whose contents are only known at the end
+    void patch(uint64_t offset, const void* data, size_t size);
+    // Flushes, syncs, closes and renames into place
+    void finish();
+
+private:
+    void flush();
+};
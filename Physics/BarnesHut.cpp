@@ -0,0 +1,347 @@
+#include "BarnesHut.hpp"
+
+#include "BodyStore.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    // enough for 8 pending children per level at the maximum depth
+    constexpr uint32_t TRAVERSAL_STACK_SIZE = 8 * 64;
+
+    inline uint32_t octant(const glm::vec3& p, const glm::vec3& center) {
+        return (p.x >= center.x ? 1u : 0u) | (p.y >= center.y ? 2u : 0u) | (p.z >= center.z ? 4u : 0u);
+    }
+
+    inline double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+void BarnesHut::computeAccelerations(BodyStore& bodies, float G, ThreadPool& pool, double* potential) {
+    m_stats = BarnesHutStats{};
+    if (bodies.size() < 2) return;
+
+    auto buildStart = std::chrono::steady_clock::now();
+    build(bodies);
+    m_stats.buildMs = elapsedMs(buildStart);
+
+    auto forceStart = std::chrono::steady_clock::now();
+    m_acc.resize(m_pos.size());
+    m_threadPotential.assign(pool.getThreadCount(), 0.0);
+    // tree order keeps neighbouring bodies (and the nodes they open) on the same thread
+    pool.parallelFor(m_pos.size(), 256, [&](size_t begin, size_t end, size_t thread) {
+        double w = 0.0;
+        for (size_t k = begin; k < end; ++k) {
+            float phi = 0.0f;
+            m_acc[k] = G * accelerationAt(m_pos[k], static_cast<uint32_t>(k), potential ? &phi : nullptr);
+            bodies.addAcc(m_order[k], m_acc[k]);
+            w += double(m_mass[k]) * phi;
+        }
+        m_threadPotential[thread] += w;
+    });
+    // every pair is seen from both ends
+    if (potential) {
+        for (double w : m_threadPotential) *potential -= 0.5 * double(G) * w;
+    }
+    m_stats.forceMs = elapsedMs(forceStart);
+
+    if (m_errorSamples > 0) measureError(G);
+}
+
+void BarnesHut::build(const BodyStore& bodies) {
+    const uint32_t n = static_cast<uint32_t>(bodies.size());
+
+    m_order.resize(n);
+    m_pos.resize(n);
+    m_mass.resize(n);
+    m_radius.resize(n);
+    m_scratchOrder.resize(n);
+    m_scratchPos.resize(n);
+    m_scratchMass.resize(n);
+    m_scratchRadius.resize(n);
+
+    glm::vec3 lo = bodies.pos(0);
+    glm::vec3 hi = bodies.pos(0);
+    for (uint32_t i = 0; i < n; ++i) {
+        m_order[i] = i;
+        m_pos[i] = bodies.pos(i);
+        m_mass[i] = bodies.mass[i];
+        m_radius[i] = bodies.radius[i];
+        lo = glm::min(lo, m_pos[i]);
+        hi = glm::max(hi, m_pos[i]);
+    }
+
+    glm::vec3 extent = hi - lo;
+    float halfSize = 0.5f * std::max(extent.x, std::max(extent.y, extent.z));
+    // pad so bodies on the upper faces still fall inside the root cube
+    halfSize = halfSize * 1.001f + 1e-6f;
+
+    m_nodes.clear();
+    m_nodes.reserve(2 * n / m_leafCapacity + 1);
+    Node root;
+    root.center = 0.5f * (lo + hi);
+    root.halfSize = halfSize;
+    root.begin = 0;
+    root.count = n;
+    m_nodes.push_back(root);
+
+    buildNode(0, 0);
+    m_stats.nodeCount = m_nodes.size();
+}
+
+void BarnesHut::buildNode(uint32_t nodeIdx, uint32_t depth) {
+    m_stats.maxDepth = std::max(m_stats.maxDepth, depth);
+
+    const uint32_t begin = m_nodes[nodeIdx].begin;
+    const uint32_t count = m_nodes[nodeIdx].count;
+    const glm::vec3 center = m_nodes[nodeIdx].center;
+    const float childHalf = 0.5f * m_nodes[nodeIdx].halfSize;
+
+    if (count <= m_leafCapacity || depth >= m_maxDepth) {
+        m_stats.leafCount++;
+        computeMoments(m_nodes[nodeIdx]);
+        return;
+    }
+
+    // counting sort of the node's range into its 8 octants
+    uint32_t counts[8] = {0};
+    for (uint32_t k = begin; k < begin + count; ++k) {
+        counts[octant(m_pos[k], center)]++;
+    }
+    uint32_t offsets[8];
+    uint32_t running = begin;
+    for (uint32_t o = 0; o < 8; ++o) {
+        offsets[o] = running;
+        running += counts[o];
+    }
+    uint32_t cursor[8];
+    std::copy(offsets, offsets + 8, cursor);
+    for (uint32_t k = begin; k < begin + count; ++k) {
+        uint32_t dst = cursor[octant(m_pos[k], center)]++;
+        m_scratchOrder[dst] = m_order[k];
+        m_scratchPos[dst] = m_pos[k];
+        m_scratchMass[dst] = m_mass[k];
+        m_scratchRadius[dst] = m_radius[k];
+    }
+    std::copy(m_scratchOrder.begin() + begin, m_scratchOrder.begin() + begin + count, m_order.begin() + begin);
+    std::copy(m_scratchPos.begin() + begin, m_scratchPos.begin() + begin + count, m_pos.begin() + begin);
+    std::copy(m_scratchMass.begin() + begin, m_scratchMass.begin() + begin + count, m_mass.begin() + begin);
+    std::copy(m_scratchRadius.begin() + begin, m_scratchRadius.begin() + begin + count, m_radius.begin() + begin);
+
+    // children of a node are stored contiguously, empty octants are skipped
+    const uint32_t firstChild = static_cast<uint32_t>(m_nodes.size());
+    uint32_t childCount = 0;
+    for (uint32_t o = 0; o < 8; ++o) {
+        if (counts[o] == 0) continue;
+        Node child;
+        child.center = center + childHalf * glm::vec3(
+            (o & 1u) ? 1.0f : -1.0f,
+            (o & 2u) ? 1.0f : -1.0f,
+            (o & 4u) ? 1.0f : -1.0f
+        );
+        child.halfSize = childHalf;
+        child.begin = offsets[o];
+        child.count = counts[o];
+        m_nodes.push_back(child);
+        childCount++;
+    }
+    m_nodes[nodeIdx].firstChild = firstChild;
+    m_nodes[nodeIdx].childCount = childCount;
+
+    for (uint32_t c = 0; c < childCount; ++c) {
+        buildNode(firstChild + c, depth + 1);
+    }
+    computeMoments(m_nodes[nodeIdx]);
+}
+
+void BarnesHut::computeMoments(Node& node) {
+    float mass = 0.0f;
+    glm::vec3 weighted(0.0f);
+    if (node.childCount == 0) {
+        for (uint32_t k = node.begin; k < node.begin + node.count; ++k) {
+            mass += m_mass[k];
+            weighted += m_mass[k] * m_pos[k];
+        }
+    } else {
+        for (uint32_t c = node.firstChild; c < node.firstChild + node.childCount; ++c) {
+            mass += m_nodes[c].mass;
+            weighted += m_nodes[c].mass * m_nodes[c].com;
+        }
+    }
+    node.mass = mass;
+    node.com = mass > 0.0f ? weighted / mass : node.center;
+    node.comOffset = glm::length(node.com - node.center);
+
+    std::fill(node.quad, node.quad + 6, 0.0f);
+    if (!m_useQuadrupole) return;
+
+    // Q = sum m (3 d d^T - |d|^2 I), children are shifted with the parallel axis theorem
+    auto addPoint = [&node](const glm::vec3& d, float m) {
+        float d2 = glm::dot(d, d);
+        node.quad[0] += m * (3.0f * d.x * d.x - d2);
+        node.quad[1] += m * (3.0f * d.x * d.y);
+        node.quad[2] += m * (3.0f * d.x * d.z);
+        node.quad[3] += m * (3.0f * d.y * d.y - d2);
+        node.quad[4] += m * (3.0f * d.y * d.z);
+        node.quad[5] += m * (3.0f * d.z * d.z - d2);
+    };
+    if (node.childCount == 0) {
+        for (uint32_t k = node.begin; k < node.begin + node.count; ++k) {
+            addPoint(m_pos[k] - node.com, m_mass[k]);
+        }
+    } else {
+        for (uint32_t c = node.firstChild; c < node.firstChild + node.childCount; ++c) {
+            const Node& child = m_nodes[c];
+            for (int q = 0; q < 6; ++q) node.quad[q] += child.quad[q];
+            addPoint(child.com - node.com, child.mass);
+        }
+    }
+}
+
+glm::vec3 BarnesHut::accelerationAt(const glm::vec3& pos, uint32_t self, float* potential) const {
+    glm::vec3 acc(0.0f);
+    float phi = 0.0f;
+    const float invTheta = 1.0f / m_theta;
+
+    uint32_t stack[TRAVERSAL_STACK_SIZE];
+    uint32_t top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = m_nodes[stack[--top]];
+        glm::vec3 d = pos - node.com;
+        float r2 = glm::dot(d, d);
+
+        // Barnes (1994) criterion: accept the node if r > size / theta + |com - center|
+        bool containsSelf = self >= node.begin && self < node.begin + node.count;
+        float openRadius = 2.0f * node.halfSize * invTheta + node.comOffset;
+        if (!containsSelf && r2 > openRadius * openRadius) {
+            float invR = 1.0f / std::sqrt(r2);
+            float invR2 = invR * invR;
+            float invR3 = invR * invR2;
+            acc -= node.mass * invR3 * d;
+            phi += node.mass * invR;
+
+            if (m_useQuadrupole) {
+                const float* q = node.quad;
+                glm::vec3 qd(
+                    q[0] * d.x + q[1] * d.y + q[2] * d.z,
+                    q[1] * d.x + q[3] * d.y + q[4] * d.z,
+                    q[2] * d.x + q[4] * d.y + q[5] * d.z
+                );
+                float dqd = glm::dot(d, qd);
+                float invR5 = invR3 * invR2;
+                acc += invR5 * qd - 2.5f * dqd * invR5 * invR2 * d;
+                phi += 0.5f * dqd * invR5;
+            }
+            continue;
+        }
+
+        if (node.childCount == 0) {
+            for (uint32_t k = node.begin; k < node.begin + node.count; ++k) {
+                if (k == self) continue;
+                glm::vec3 diff = m_pos[k] - pos;
+                float dist2 = glm::dot(diff, diff);
+                if (dist2 == 0.0f) continue; // same rule as Physics::computeGravity
+                float invDist = 1.0f / std::sqrt(dist2);
+                acc += m_mass[k] * invDist * invDist * invDist * diff;
+                phi += m_mass[k] * invDist;
+            }
+            continue;
+        }
+
+        for (uint32_t c = 0; c < node.childCount && top < TRAVERSAL_STACK_SIZE; ++c) {
+            stack[top++] = node.firstChild + c;
+        }
+    }
+    if (potential) *potential = phi;
+    return acc;
+}
+
+void BarnesHut::findOverlaps(const BodyStore& bodies, std::vector<std::pair<uint32_t, uint32_t>>& pairs, ThreadPool& pool) {
+    pairs.clear();
+    if (m_nodes.empty() || m_pos.size() != bodies.size()) return;
+
+    float maxRadius = 0.0f;
+    for (float r : m_radius) maxRadius = std::max(maxRadius, r);
+
+    m_threadPairs.resize(pool.getThreadCount());
+    for (auto& local : m_threadPairs) local.clear();
+
+    pool.parallelFor(m_pos.size(), 256, [&](size_t begin, size_t end, size_t thread) {
+        std::vector<std::pair<uint32_t, uint32_t>>& local = m_threadPairs[thread];
+        uint32_t stack[TRAVERSAL_STACK_SIZE];
+        for (size_t k = begin; k < end; ++k) {
+            const glm::vec3 p = m_pos[k];
+            const float reach = m_radius[k] + maxRadius;
+            const uint32_t i = m_order[k];
+
+            uint32_t top = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                const Node& node = m_nodes[stack[--top]];
+                // sphere vs. node cube
+                glm::vec3 excess = glm::max(glm::abs(p - node.center) - glm::vec3(node.halfSize), glm::vec3(0.0f));
+                if (glm::dot(excess, excess) > reach * reach) continue;
+
+                if (node.childCount == 0) {
+                    for (uint32_t k2 = node.begin; k2 < node.begin + node.count; ++k2) {
+                        const uint32_t j = m_order[k2];
+                        if (j <= i) continue;
+                        glm::vec3 diff = m_pos[k2] - p;
+                        float rSum = m_radius[k] + m_radius[k2];
+                        if (glm::dot(diff, diff) < rSum * rSum) local.emplace_back(i, j);
+                    }
+                    continue;
+                }
+                for (uint32_t c = 0; c < node.childCount && top < TRAVERSAL_STACK_SIZE; ++c) {
+                    stack[top++] = node.firstChild + c;
+                }
+            }
+        }
+    });
+
+    for (const auto& local : m_threadPairs) pairs.insert(pairs.end(), local.begin(), local.end());
+    // resolve in index order, like the direct loop does
+    std::sort(pairs.begin(), pairs.end());
+}
+
+void BarnesHut::measureError(float G) {
+    const size_t n = m_pos.size();
+    const size_t samples = std::min(m_errorSamples, n);
+    const size_t stride = n / samples;
+
+    double maxErr = 0.0;
+    double sumSq = 0.0;
+    for (size_t s = 0; s < samples; ++s) {
+        const size_t k = s * stride;
+        double ref[3] = {0.0, 0.0, 0.0};
+        for (size_t j = 0; j < n; ++j) {
+            if (j == k) continue;
+            double dx = double(m_pos[j].x) - m_pos[k].x;
+            double dy = double(m_pos[j].y) - m_pos[k].y;
+            double dz = double(m_pos[j].z) - m_pos[k].z;
+            double r2 = dx * dx + dy * dy + dz * dz;
+            if (r2 == 0.0) continue;
+            double f = G * m_mass[j] / (r2 * std::sqrt(r2));
+            ref[0] += f * dx;
+            ref[1] += f * dy;
+            ref[2] += f * dz;
+        }
+        double refLen = std::sqrt(ref[0] * ref[0] + ref[1] * ref[1] + ref[2] * ref[2]);
+        if (refLen == 0.0) continue;
+        double ex = m_acc[k].x - ref[0];
+        double ey = m_acc[k].y - ref[1];
+        double ez = m_acc[k].z - ref[2];
+        double err = std::sqrt(ex * ex + ey * ey + ez * ez) / refLen;
+        maxErr = std::max(maxErr, err);
+        sumSq += err * err;
+    }
+
+    m_stats.errorSamples = samples;
+    m_stats.maxRelError = static_cast<float>(maxErr);
+    m_stats.rmsRelError = static_cast<float>(std::sqrt(sumSq / samples));
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct BodyStore;
+class ThreadPool;
+
+struct BarnesHutStats {
+    size_t nodeCount = 0;
+    size_t leafCount = 0;
+    uint32_t maxDepth = 0;
+
+    double buildMs = 0.0;
+    double forceMs = 0.0;
+
+    // relative acceleration error against the direct sum, measured on a sample of bodies
+    size_t errorSamples = 0;
+    float maxRelError = 0.0f;
+    float rmsRelError = 0.0f;
+};
+
+class BarnesHut {
+private:
+    struct Node {
+        glm::vec3 center{0.0f};
+        float halfSize = 0.0f;
+
+        glm::vec3 com{0.0f};
+        float mass = 0.0f;
+
+        // traceless quadrupole about com: xx, xy, xz, yy, yz, zz
+        float quad[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+
+        // distance between com and the geometric center, used by the opening criterion
+        float comOffset = 0.0f;
+
+        uint32_t firstChild = 0;
+        uint32_t childCount = 0;
+
+        // range into the tree-ordered body arrays
+        uint32_t begin = 0;
+        uint32_t count = 0;
+    };
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_order;  // tree order -> planet index
+    std::vector<glm::vec3> m_pos;   // positions in tree order
+    std::vector<float> m_mass;      // masses in tree order
+    std::vector<float> m_radius;    // radii in tree order
+    std::vector<glm::vec3> m_acc;   // accelerations of the last step in tree order
+    std::vector<glm::vec3> m_scratchPos;
+    std::vector<float> m_scratchMass;
+    std::vector<float> m_scratchRadius;
+    std::vector<uint32_t> m_scratchOrder;
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> m_threadPairs;
+    std::vector<double> m_threadPotential;
+
+    float m_theta = 0.5f;
+    uint32_t m_leafCapacity = 8;
+    uint32_t m_maxDepth = 32;
+    bool m_useQuadrupole = true;
+    size_t m_errorSamples = 0;
+
+    BarnesHutStats m_stats;
+
+public:
+    BarnesHut() = default;
+    ~BarnesHut() = default;
+
+    // Rebuilds the octree from the current positions and adds G*m/r^2 accelerations to the body accelerations.
+    // With potential set, the potential energy of the system (same expansion as the forces) is added to it.
+    void computeAccelerations(BodyStore& bodies, float G, ThreadPool& pool, double* potential = nullptr);
+
+    // Pairs (i < j) whose bounding spheres overlap, found with the tree built by the last computeAccelerations
+    void findOverlaps(const BodyStore& bodies, std::vector<std::pair<uint32_t, uint32_t>>& pairs, ThreadPool& pool);
+
+    void setTheta(float theta) { m_theta = theta; }
+    float getTheta() const { return m_theta; }
+    void setLeafCapacity(uint32_t capacity) { m_leafCapacity = capacity > 0 ? capacity : 1; }
+    uint32_t getLeafCapacity() const { return m_leafCapacity; }
+    void setUseQuadrupole(bool enabled) { m_useQuadrupole = enabled; }
+    bool getUseQuadrupole() const { return m_useQuadrupole; }
+    // Number of bodies checked against the direct sum each step (0 disables the check)
+    void setErrorSamples(size_t samples) { m_errorSamples = samples; }
+    size_t getErrorSamples() const { return m_errorSamples; }
+
+    const BarnesHutStats& getStats() const { return m_stats; }
+
+private:
+    void build(const BodyStore& bodies);
+    void buildNode(uint32_t nodeIdx, uint32_t depth);
+    void computeMoments(Node& node);
+
+    // potential, when set, receives sum m/r (plus the quadrupole term) at pos, without the -G
+    glm::vec3 accelerationAt(const glm::vec3& pos, uint32_t self, float* potential = nullptr) const;
+    void measureError(float G);
+};
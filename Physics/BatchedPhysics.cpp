@@ -0,0 +1,169 @@
+#include "BatchedPhysics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+BatchedPhysics::BatchedPhysics(size_t bodies, size_t lanes, size_t threadCount)
+    : m_bodies(bodies),
+      m_lanes(lanes),
+      m_stride((lanes + BATCHED_LANE_BLOCK - 1) / BATCHED_LANE_BLOCK * BATCHED_LANE_BLOCK),
+      m_pool(threadCount) {
+    if (bodies == 0 || lanes == 0) throw std::runtime_error("BatchedPhysics: needs at least one body and one lane");
+    const size_t size = m_bodies * m_stride;
+    for (AlignedVector<float>* column : {&m_px, &m_py, &m_pz, &m_vx, &m_vy, &m_vz, &m_ax, &m_ay, &m_az, &m_mass, &m_radius}) {
+        column->assign(size, 0.0f);
+    }
+    m_laneDt.assign(m_stride, 0.0f);
+    m_status.assign(m_stride, {});
+    m_laneTime.assign(m_stride, 0.0);
+    for (size_t k = m_lanes; k < m_stride; ++k) m_status[k].flags = LANE_STOPPED;
+    m_activeCount = m_lanes;
+}
+
+void BatchedPhysics::setBody(size_t lane, size_t body, const glm::vec3& pos, const glm::vec3& vel, float mass, float radius) {
+    const size_t o = body * m_stride + lane;
+    m_px[o] = pos.x; m_py[o] = pos.y; m_pz[o] = pos.z;
+    m_vx[o] = vel.x; m_vy[o] = vel.y; m_vz[o] = vel.z;
+    m_mass[o] = mass;
+    m_radius[o] = radius;
+    m_forcesValid = false;
+}
+
+glm::vec3 BatchedPhysics::getPos(size_t lane, size_t body) const {
+    const size_t o = body * m_stride + lane;
+    return {m_px[o], m_py[o], m_pz[o]};
+}
+
+glm::vec3 BatchedPhysics::getVel(size_t lane, size_t body) const {
+    const size_t o = body * m_stride + lane;
+    return {m_vx[o], m_vy[o], m_vz[o]};
+}
+
+double BatchedPhysics::getLaneEnergy(size_t lane) const {
+    double kinetic = 0.0, potential = 0.0;
+    for (size_t i = 0; i < m_bodies; ++i) {
+        const size_t oi = i * m_stride + lane;
+        const double v2 = double(m_vx[oi]) * m_vx[oi] + double(m_vy[oi]) * m_vy[oi] + double(m_vz[oi]) * m_vz[oi];
+        kinetic += 0.5 * m_mass[oi] * v2;
+        for (size_t j = i + 1; j < m_bodies; ++j) {
+            const size_t oj = j * m_stride + lane;
+            const double dx = double(m_px[oj]) - m_px[oi];
+            const double dy = double(m_py[oj]) - m_py[oi];
+            const double dz = double(m_pz[oj]) - m_pz[oi];
+            const double r = std::sqrt(dx * dx + dy * dy + dz * dz);
+            if (r > 0.0) potential -= double(G) * m_mass[oi] * m_mass[oj] / r;
+        }
+    }
+    return kinetic + potential;
+}
+
+void BatchedPhysics::setSimdLevel(SimdLevel level) {
+    m_simdLevel = static_cast<SimdLevel>(std::min(static_cast<uint8_t>(level), static_cast<uint8_t>(detectSimdLevel())));
+}
+
+void BatchedPhysics::computeForces() {
+    m_contacts.resize(m_pool.getThreadCount());
+    for (std::vector<BatchedContact>& contacts : m_contacts) contacts.clear();
+
+    const BatchedGravityInput in{m_px.data(), m_py.data(), m_pz.data(), m_mass.data(), m_radius.data(), m_bodies, m_stride, G};
+    // lane blocks are independent, every body of a block is written by one thread only
+    m_pool.parallelFor(m_stride / BATCHED_LANE_BLOCK, 1, [&](size_t begin, size_t end, size_t thread) {
+        const size_t laneBegin = begin * BATCHED_LANE_BLOCK, laneEnd = end * BATCHED_LANE_BLOCK;
+        for (size_t i = 0; i < m_bodies; ++i) {
+            const size_t o = i * m_stride;
+            std::fill(m_ax.begin() + o + laneBegin, m_ax.begin() + o + laneEnd, 0.0f);
+            std::fill(m_ay.begin() + o + laneBegin, m_ay.begin() + o + laneEnd, 0.0f);
+            std::fill(m_az.begin() + o + laneBegin, m_az.begin() + o + laneEnd, 0.0f);
+        }
+        BatchedGravityOutput out{m_ax.data(), m_ay.data(), m_az.data(), &m_contacts[thread]};
+        batchedGravity(in, out, laneBegin, laneEnd, m_simdLevel);
+    });
+    m_forcesValid = true;
+}
+
+void BatchedPhysics::stopLane(size_t lane) {
+    m_status[lane].flags |= LANE_STOPPED;
+    m_activeCount--;
+}
+
+void BatchedPhysics::recordEvents() {
+    // contacts at the new positions, a lane keeps its first event
+    for (const std::vector<BatchedContact>& contacts : m_contacts) {
+        for (const BatchedContact& contact : contacts) {
+            BatchedLaneStatus& status = m_status[contact.lane];
+            if (status.flags & (LANE_STOPPED | LANE_COLLIDED)) continue;
+            if (!(status.flags & LANE_ESCAPED)) {
+                status.eventStep = m_step;
+                status.eventTime = m_laneTime[contact.lane];
+                status.i = contact.i;
+                status.j = contact.j;
+            }
+            status.flags |= LANE_COLLIDED;
+            if (m_stopOnCollision) stopLane(contact.lane);
+        }
+    }
+
+    if (m_escapeRadius > 0.0f) {
+        const float limit = m_escapeRadius * m_escapeRadius;
+        for (size_t i = 0; i < m_bodies; ++i) {
+            const size_t o = i * m_stride;
+            for (size_t k = 0; k < m_lanes; ++k) {
+                if (m_laneDt[k] == 0.0f || (m_status[k].flags & LANE_STOPPED)) continue;
+                const float r2 = m_px[o + k] * m_px[o + k] + m_py[o + k] * m_py[o + k] + m_pz[o + k] * m_pz[o + k];
+                if (r2 <= limit) continue;
+                BatchedLaneStatus& status = m_status[k];
+                if (!(status.flags & LANE_COLLIDED)) {
+                    status.eventStep = m_step;
+                    status.eventTime = m_laneTime[k];
+                    status.i = status.j = static_cast<uint32_t>(i);
+                }
+                status.flags |= LANE_ESCAPED;
+                stopLane(k);
+            }
+        }
+    }
+}
+
+void BatchedPhysics::update(float dt) {
+    if (m_activeCount == 0) return;
+    // stopped lanes get a zero step, so the loops below stay branch free and vectorize
+    for (size_t k = 0; k < m_stride; ++k) m_laneDt[k] = (m_status[k].flags & LANE_STOPPED) ? 0.0f : dt;
+    if (!m_forcesValid) computeForces();
+
+    const float* laneDt = m_laneDt.data();
+    auto kick = [&](size_t begin, size_t end) {
+        for (size_t i = 0; i < m_bodies; ++i) {
+            const size_t o = i * m_stride;
+            for (size_t k = begin; k < end; ++k) {
+                const float h = 0.5f * laneDt[k];
+                m_vx[o + k] += m_ax[o + k] * h;
+                m_vy[o + k] += m_ay[o + k] * h;
+                m_vz[o + k] += m_az[o + k] * h;
+            }
+        }
+    };
+    auto drift = [&](size_t begin, size_t end) {
+        for (size_t i = 0; i < m_bodies; ++i) {
+            const size_t o = i * m_stride;
+            for (size_t k = begin; k < end; ++k) {
+                m_px[o + k] += m_vx[o + k] * laneDt[k];
+                m_py[o + k] += m_vy[o + k] * laneDt[k];
+                m_pz[o + k] += m_vz[o + k] * laneDt[k];
+            }
+        }
+    };
+
+    m_pool.parallelFor(m_stride / BATCHED_LANE_BLOCK, 1, [&](size_t begin, size_t end, size_t) {
+        kick(begin * BATCHED_LANE_BLOCK, end * BATCHED_LANE_BLOCK);
+        drift(begin * BATCHED_LANE_BLOCK, end * BATCHED_LANE_BLOCK);
+    });
+    computeForces();
+    m_pool.parallelFor(m_stride / BATCHED_LANE_BLOCK, 1, [&](size_t begin, size_t end, size_t) {
+        kick(begin * BATCHED_LANE_BLOCK, end * BATCHED_LANE_BLOCK);
+    });
+
+    m_step++;
+    for (size_t k = 0; k < m_lanes; ++k) m_laneTime[k] += m_laneDt[k];
+    recordEvents();
+}
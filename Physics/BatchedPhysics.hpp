@@ -0,0 +1,96 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include "BodyStore.hpp"
+#include "GravityKernels.hpp"
+#include "ThreadPool.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Per-lane state bits
+enum BatchedLaneFlags : uint8_t {
+    LANE_COLLIDED = 1, // two bodies overlapped
+    LANE_ESCAPED = 2,  // a body left the escape radius
+    LANE_STOPPED = 4   // no longer stepped, set by either of the above when they terminate the lane
+};
+
+struct BatchedLaneStatus {
+    uint8_t flags = 0;
+    uint64_t eventStep = 0; // step that set the first of COLLIDED or ESCAPED
+    double eventTime = 0.0;
+    uint32_t i = 0, j = 0;  // colliding pair, or the escaping body in i
+};
+
+// Many realizations (lanes) of one small system, e.g. Monte Carlo clones of a planetary system with perturbed
+// initial conditions. Lanes are interleaved, quantity q of body i in lane k is at q[i * stride + k], so one
+// vector instruction steps a body in 8 or 16 realizations and the SIMD width is used in full even for ten
+// bodies. Leapfrog KDK with direct forces and one dt shared by every running lane; bodies never merge or
+// bounce, a contact or escape is recorded per lane and, if enabled, freezes that lane while the others carry on.
+class BatchedPhysics {
+public:
+    static constexpr float G = 6.67430e-6f; // same units as Physics
+
+private:
+    size_t m_bodies = 0;
+    size_t m_lanes = 0;
+    size_t m_stride = 0; // m_lanes rounded up to BATCHED_LANE_BLOCK, the padding lanes are stopped and massless
+
+    AlignedVector<float> m_px, m_py, m_pz;
+    AlignedVector<float> m_vx, m_vy, m_vz;
+    AlignedVector<float> m_ax, m_ay, m_az;
+    AlignedVector<float> m_mass, m_radius;
+    AlignedVector<float> m_laneDt; // the step's dt for running lanes, 0 for stopped ones, so one loop does both
+
+    std::vector<BatchedLaneStatus> m_status;
+    std::vector<double> m_laneTime;
+    uint64_t m_step = 0;
+    size_t m_activeCount = 0;
+
+    bool m_stopOnCollision = true;
+    float m_escapeRadius = 0.0f; // from the origin, 0 turns the check off
+    bool m_forcesValid = false;
+
+    SimdLevel m_simdLevel = detectSimdLevel();
+    ThreadPool m_pool;
+    std::vector<std::vector<BatchedContact>> m_contacts; // per thread
+
+public:
+    BatchedPhysics(size_t bodies, size_t lanes, size_t threadCount = 0);
+
+    size_t getBodyCount() const { return m_bodies; }
+    size_t getLaneCount() const { return m_lanes; }
+    size_t getActiveCount() const { return m_activeCount; }
+    uint64_t getStep() const { return m_step; }
+
+    void setBody(size_t lane, size_t body, const glm::vec3& pos, const glm::vec3& vel, float mass, float radius);
+    glm::vec3 getPos(size_t lane, size_t body) const;
+    glm::vec3 getVel(size_t lane, size_t body) const;
+    float getMass(size_t lane, size_t body) const { return m_mass[body * m_stride + lane]; }
+
+    const BatchedLaneStatus& getStatus(size_t lane) const { return m_status[lane]; }
+    // time the lane has been stepped for, the same for all lanes until one stops
+    double getLaneTime(size_t lane) const { return m_laneTime[lane]; }
+    // Total energy of one lane in double, for checking the integration
+    double getLaneEnergy(size_t lane) const;
+
+    void setStopOnCollision(bool stop) { m_stopOnCollision = stop; }
+    bool getStopOnCollision() const { return m_stopOnCollision; }
+    void setEscapeRadius(float radius) { m_escapeRadius = radius; }
+    float getEscapeRadius() const { return m_escapeRadius; }
+
+    void setSimdLevel(SimdLevel level);
+    SimdLevel getSimdLevel() const { return m_simdLevel; }
+    void setThreadCount(size_t threadCount) { m_pool.setThreadCount(threadCount); }
+    size_t getThreadCount() const { return m_pool.getThreadCount(); }
+
+    // One step of every running lane
+    void update(float dt);
+
+private:
+    // accelerations at the current positions, contacts go to m_contacts
+    void computeForces();
+    void recordEvents();
+    void stopLane(size_t lane);
+};
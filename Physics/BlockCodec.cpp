@@ -0,0 +1,132 @@
+#include "BlockCodec.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+    constexpr size_t MIN_MATCH = 4;
+    constexpr size_t LAST_LITERALS = 5;  // the format ends every block with at least this many literals
+    constexpr size_t MATCH_LIMIT = 12;   // no match may start closer than this to the end
+    constexpr size_t MAX_OFFSET = 65535;
+    constexpr int HASH_BITS = 14;
+
+    inline uint32_t read32(const std::byte* p) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+    inline uint32_t hash(uint32_t sequence) { return (sequence * 2654435761u) >> (32 - HASH_BITS); }
+
+    // 15 in the token nibble, then bytes of 255 and a final remainder
+    inline std::byte* writeLength(std::byte* out, size_t length) {
+        for (; length >= 255; length -= 255) *out++ = std::byte{255};
+        *out++ = static_cast<std::byte>(length);
+        return out;
+    }
+
+    inline std::byte* writeSequence(std::byte* out, const std::byte* literals, size_t literalCount,
+                                    size_t offset, size_t matchLength) {
+        std::byte* token = out++;
+        uint8_t tokenValue = static_cast<uint8_t>(std::min<size_t>(literalCount, 15) << 4);
+        if (literalCount >= 15) out = writeLength(out, literalCount - 15);
+        std::memcpy(out, literals, literalCount);
+        out += literalCount;
+        if (matchLength > 0) {
+            *out++ = static_cast<std::byte>(offset & 0xFF);
+            *out++ = static_cast<std::byte>(offset >> 8);
+            const size_t extra = matchLength - MIN_MATCH;
+            tokenValue |= static_cast<uint8_t>(std::min<size_t>(extra, 15));
+            if (extra >= 15) out = writeLength(out, extra - 15);
+        }
+        *token = static_cast<std::byte>(tokenValue);
+        return out;
+    }
+}
+
+size_t BlockCodec::compress(const std::byte* src, size_t size, std::byte* dst) {
+    std::byte* out = dst;
+    const std::byte* anchor = src;
+    if (size > MATCH_LIMIT) {
+        thread_local std::vector<uint32_t> table;
+        table.assign(size_t(1) << HASH_BITS, UINT32_MAX);
+
+        const std::byte* const matchEnd = src + size - MATCH_LIMIT; // last position a match may start
+        const std::byte* const copyEnd = src + size - LAST_LITERALS;
+        const std::byte* p = src;
+        size_t misses = 0; // since the last match, incompressible stretches are skipped over faster
+        while (p < matchEnd) {
+            const uint32_t sequence = read32(p);
+            const uint32_t slot = hash(sequence);
+            const uint32_t candidate = table[slot];
+            const size_t pos = static_cast<size_t>(p - src);
+            table[slot] = static_cast<uint32_t>(pos);
+            if (candidate == UINT32_MAX || pos - candidate > MAX_OFFSET || read32(src + candidate) != sequence) {
+                p += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            const std::byte* match = src + candidate;
+            const std::byte* q = p + MIN_MATCH;
+            const std::byte* m = match + MIN_MATCH;
+            while (q < copyEnd && *q == *m) { ++q; ++m; }
+            // extend backwards over literals that match too
+            while (p > anchor && match > src && p[-1] == match[-1]) { --p; --match; }
+
+            out = writeSequence(out, anchor, static_cast<size_t>(p - anchor), static_cast<size_t>(p - match),
+                                static_cast<size_t>(q - p));
+            p = anchor = q;
+            if (p < matchEnd) table[hash(read32(p - 2))] = static_cast<uint32_t>(p - 2 - src);
+        }
+    }
+    return static_cast<size_t>(writeSequence(out, anchor, static_cast<size_t>(src + size - anchor), 0, 0) - dst);
+}
+
+bool BlockCodec::decompress(const std::byte* src, size_t size, std::byte* dst, size_t rawSize) {
+    const std::byte* in = src;
+    const std::byte* const inEnd = src + size;
+    std::byte* out = dst;
+    std::byte* const outEnd = dst + rawSize;
+
+    auto readLength = [&](size_t& length) {
+        uint8_t b;
+        do {
+            if (in >= inEnd) return false;
+            b = static_cast<uint8_t>(*in++);
+            length += b;
+        } while (b == 255);
+        return true;
+    };
+
+    while (in < inEnd) {
+        const uint8_t token = static_cast<uint8_t>(*in++);
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(literals)) return false;
+        if (literals > static_cast<size_t>(inEnd - in) || literals > static_cast<size_t>(outEnd - out)) return false;
+        std::memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+        if (in == inEnd) break; // the last sequence has no match
+
+        if (inEnd - in < 2) return false;
+        const size_t offset = static_cast<size_t>(in[0]) | static_cast<size_t>(in[1]) << 8;
+        in += 2;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(length)) return false;
+        length += MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(out - dst) || length > static_cast<size_t>(outEnd - out))
+            return false;
+
+        const std::byte* match = out - offset;
+        if (offset >= length) {
+            std::memcpy(out, match, length);
+            out += length;
+        } else {
+            // overlapping copy repeats the last offset bytes
+            for (size_t k = 0; k < length; ++k) *out++ = match[k];
+        }
+    }
+    return out == outEnd;
+}
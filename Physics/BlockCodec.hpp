@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+// Byte-oriented LZ77 compression in the LZ4 block format: greedy matching with a small hash table, no entropy
+// stage, so both directions run at memory-copy-like speeds. Trades ratio for speed; feed it data with long
+// runs (e.g. byte planes of small integers) for it to pay off.
+namespace BlockCodec {
+    // Worst case compressed size of size bytes
+    constexpr size_t bound(size_t size) { return size + size / 255 + 16; }
+
+    // Compresses src into dst, which must hold bound(size) bytes. Returns the compressed size.
+    size_t compress(const std::byte* src, size_t size, std::byte* dst);
+
+    // Decompresses exactly rawSize bytes into dst. False when src is malformed or doesn't decode to rawSize.
+    bool decompress(const std::byte* src, size_t size, std::byte* dst, size_t rawSize);
+}
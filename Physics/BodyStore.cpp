@@ -0,0 +1,143 @@
+#include "BodyStore.hpp"
+
+void BodyStore::reserve(size_t n) {
+    px.reserve(n); py.reserve(n); pz.reserve(n);
+    vx.reserve(n); vy.reserve(n); vz.reserve(n);
+    ax.reserve(n); ay.reserve(n); az.reserve(n);
+    mass.reserve(n);
+    radius.reserve(n);
+    rotation.reserve(n);
+    if (highPrecision) {
+        dpx.reserve(n); dpy.reserve(n); dpz.reserve(n);
+        dvx.reserve(n); dvy.reserve(n); dvz.reserve(n);
+    }
+}
+
+void BodyStore::resize(size_t n) {
+    px.resize(n); py.resize(n); pz.resize(n);
+    vx.resize(n); vy.resize(n); vz.resize(n);
+    ax.resize(n); ay.resize(n); az.resize(n);
+    mass.resize(n);
+    radius.resize(n);
+    rotation.resize(n);
+    if (highPrecision) {
+        dpx.resize(n); dpy.resize(n); dpz.resize(n);
+        dvx.resize(n); dvy.resize(n); dvz.resize(n);
+    }
+}
+
+void BodyStore::clear() {
+    px.clear(); py.clear(); pz.clear();
+    vx.clear(); vy.clear(); vz.clear();
+    ax.clear(); ay.clear(); az.clear();
+    mass.clear();
+    radius.clear();
+    rotation.clear();
+    dpx.clear(); dpy.clear(); dpz.clear();
+    dvx.clear(); dvy.clear(); dvz.clear();
+}
+
+void BodyStore::push(const Planet& p) {
+    px.push_back(p.pos.x); py.push_back(p.pos.y); pz.push_back(p.pos.z);
+    vx.push_back(p.vel.x); vy.push_back(p.vel.y); vz.push_back(p.vel.z);
+    ax.push_back(p.acc.x); ay.push_back(p.acc.y); az.push_back(p.acc.z);
+    mass.push_back(p.mass);
+    radius.push_back(p.r);
+    rotation.push_back({p.torque, p.inertia, p.angVel, p.rot});
+    if (highPrecision) {
+        dpx.push_back(p.pos.x); dpy.push_back(p.pos.y); dpz.push_back(p.pos.z);
+        dvx.push_back(p.vel.x); dvy.push_back(p.vel.y); dvz.push_back(p.vel.z);
+    }
+}
+
+void BodyStore::swapRemove(size_t idx) {
+    const size_t last = size() - 1;
+    auto remove = [idx, last](auto& array) {
+        array[idx] = array[last];
+        array.pop_back();
+    };
+    remove(px); remove(py); remove(pz);
+    remove(vx); remove(vy); remove(vz);
+    remove(ax); remove(ay); remove(az);
+    remove(mass);
+    remove(radius);
+    remove(rotation);
+    if (highPrecision) {
+        remove(dpx); remove(dpy); remove(dpz);
+        remove(dvx); remove(dvy); remove(dvz);
+    }
+}
+
+void BodyStore::setHighPrecision(bool enabled) {
+    if (enabled == highPrecision) return;
+    highPrecision = enabled;
+    if (!enabled) {
+        // release the memory, clear() alone keeps it
+        AlignedVector<double>().swap(dpx); AlignedVector<double>().swap(dpy); AlignedVector<double>().swap(dpz);
+        AlignedVector<double>().swap(dvx); AlignedVector<double>().swap(dvy); AlignedVector<double>().swap(dvz);
+        return;
+    }
+    dpx.assign(px.begin(), px.end()); dpy.assign(py.begin(), py.end()); dpz.assign(pz.begin(), pz.end());
+    dvx.assign(vx.begin(), vx.end()); dvy.assign(vy.begin(), vy.end()); dvz.assign(vz.begin(), vz.end());
+}
+
+void BodyStore::syncMirror(size_t begin, size_t end) {
+    if (!highPrecision) return;
+    for (size_t i = begin; i < end; ++i) {
+        px[i] = float(dpx[i]); py[i] = float(dpy[i]); pz[i] = float(dpz[i]);
+        vx[i] = float(dvx[i]); vy[i] = float(dvy[i]); vz[i] = float(dvz[i]);
+    }
+}
+
+void BodyStore::setPosD(size_t i, const glm::dvec3& p) {
+    px[i] = float(p.x); py[i] = float(p.y); pz[i] = float(p.z);
+    if (highPrecision) { dpx[i] = p.x; dpy[i] = p.y; dpz[i] = p.z; }
+}
+
+void BodyStore::setVelD(size_t i, const glm::dvec3& v) {
+    vx[i] = float(v.x); vy[i] = float(v.y); vz[i] = float(v.z);
+    if (highPrecision) { dvx[i] = v.x; dvy[i] = v.y; dvz[i] = v.z; }
+}
+
+void BodyStore::addPos(size_t i, const glm::vec3& d) {
+    if (!highPrecision) {
+        px[i] += d.x; py[i] += d.y; pz[i] += d.z;
+        return;
+    }
+    dpx[i] += d.x; dpy[i] += d.y; dpz[i] += d.z;
+    px[i] = float(dpx[i]); py[i] = float(dpy[i]); pz[i] = float(dpz[i]);
+}
+
+void BodyStore::addVel(size_t i, const glm::vec3& d) {
+    if (!highPrecision) {
+        vx[i] += d.x; vy[i] += d.y; vz[i] += d.z;
+        return;
+    }
+    dvx[i] += d.x; dvy[i] += d.y; dvz[i] += d.z;
+    vx[i] = float(dvx[i]); vy[i] = float(dvy[i]); vz[i] = float(dvz[i]);
+}
+
+Planet BodyStore::get(size_t i) const {
+    Planet p;
+    p.pos = pos(i);
+    p.vel = vel(i);
+    p.acc = acc(i);
+    p.torque = rotation[i].torque;
+    p.inertia = rotation[i].inertia;
+    p.angVel = rotation[i].angVel;
+    p.rot = rotation[i].rot;
+    p.mass = mass[i];
+    p.r = radius[i];
+    return p;
+}
+
+void BodyStore::set(size_t i, const Planet& p) {
+    // a get, modify, set round trip in Mixed mode must not drop the double bits, so only a position or
+    // velocity that differs from the float mirror is written through
+    if (p.pos != pos(i)) setPos(i, p.pos);
+    if (p.vel != vel(i)) setVel(i, p.vel);
+    ax[i] = p.acc.x; ay[i] = p.acc.y; az[i] = p.acc.z;
+    rotation[i] = {p.torque, p.inertia, p.angVel, p.rot};
+    mass[i] = p.mass;
+    radius[i] = p.r;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Allocator that places every array on its own cache line so SIMD loads never straddle one
+template<typename T, size_t Alignment = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template<typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() noexcept = default;
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+    void deallocate(T* p, size_t) noexcept {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Value snapshot of one body, used to add bodies and as a compatibility view of the store
+struct Planet {
+    glm::vec3 pos;
+    glm::vec3 vel;
+    glm::vec3 acc;
+
+    glm::vec3 torque;
+    glm::vec3 inertia;
+    glm::vec3 angVel;
+    glm::vec3 rot;
+
+    float mass;
+    float r;
+};
+
+// Spin state, only touched by the rotation part of the integrator
+struct RotationState {
+    glm::vec3 torque;
+    glm::vec3 inertia;
+    glm::vec3 angVel;
+    glm::vec3 rot;
+};
+
+// Structure-of-arrays body storage. Every array has size() elements and index i is the same body in all of them.
+struct BodyStore {
+    // hot: read or written by every force and integration pass
+    AlignedVector<float> px, py, pz;
+    AlignedVector<float> vx, vy, vz;
+    AlignedVector<float> ax, ay, az;
+    AlignedVector<float> mass;
+
+    // cold: collisions and rotation only
+    AlignedVector<float> radius;
+    std::vector<RotationState> rotation;
+
+    // Mixed precision: position and velocity are owned by the double arrays and the float ones above mirror
+    // them for rendering, broad phases and the tree solvers. Empty unless highPrecision is set.
+    bool highPrecision = false;
+    AlignedVector<double> dpx, dpy, dpz;
+    AlignedVector<double> dvx, dvy, dvz;
+
+    size_t size() const { return px.size(); }
+    bool empty() const { return px.empty(); }
+
+    void reserve(size_t n);
+    // New bodies are value-initialised, for bulk appends that fill them in parallel
+    void resize(size_t n);
+    void clear();
+    void push(const Planet& p);
+    // O(1): the last body moves into idx, so indices are only stable through the handles in Physics
+    void swapRemove(size_t idx);
+    // Switching on seeds the doubles from the floats, switching off drops them
+    void setHighPrecision(bool enabled);
+    // float mirror of [begin, end) from the doubles
+    void syncMirror(size_t begin, size_t end);
+
+    Planet get(size_t i) const;
+    void set(size_t i, const Planet& p);
+
+    glm::vec3 pos(size_t i) const { return {px[i], py[i], pz[i]}; }
+    glm::vec3 vel(size_t i) const { return {vx[i], vy[i], vz[i]}; }
+    glm::vec3 acc(size_t i) const { return {ax[i], ay[i], az[i]}; }
+
+    glm::dvec3 posD(size_t i) const { return highPrecision ? glm::dvec3(dpx[i], dpy[i], dpz[i]) : glm::dvec3(pos(i)); }
+    glm::dvec3 velD(size_t i) const { return highPrecision ? glm::dvec3(dvx[i], dvy[i], dvz[i]) : glm::dvec3(vel(i)); }
+
+    void setPos(size_t i, const glm::vec3& p) { setPosD(i, glm::dvec3(p)); }
+    void setVel(size_t i, const glm::vec3& v) { setVelD(i, glm::dvec3(v)); }
+    void setPosD(size_t i, const glm::dvec3& p);
+    void setVelD(size_t i, const glm::dvec3& v);
+    // relative updates keep the double bits that a float round trip through setPos would lose
+    void addPos(size_t i, const glm::vec3& d);
+    void addVel(size_t i, const glm::vec3& d);
+    void addAcc(size_t i, const glm::vec3& a) { ax[i] += a.x; ay[i] += a.y; az[i] += a.z; }
+};
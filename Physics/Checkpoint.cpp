@@ -0,0 +1,285 @@
+#include "Checkpoint.hpp"
+
+#include "AlignedFileWriter.hpp"
+#include "Checksum.hpp"
+#include "ThreadPool.hpp"
+#include "physics.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    constexpr size_t COPY_GRAIN = size_t(1) << 20; // bytes per restore task
+    constexpr uint32_t MAX_LEAF_CAPACITY = 1u << 16;  // far past any useful leaf, rules out garbage
+
+    bool finiteAtLeast(double value, double min) {
+        return std::isfinite(value) && value >= min;
+    }
+
+    // every setting restoreCheckpoint applies as it is, so that a restore can't fail half way through them
+    bool validSettings(const CheckpointHeader& header) {
+        if (header.solver > static_cast<uint8_t>(GravitySolver::ParticleMesh)
+            || header.integrator > static_cast<uint8_t>(Integrator::HermiteBlock)
+            || header.precision > static_cast<uint8_t>(Precision::Mixed)
+            || header.broadPhase > static_cast<uint8_t>(BroadPhase::AABBTree)) return false;
+        const uint32_t grid = header.meshGridSize;
+        return finiteAtLeast(header.restitution, 0.0)
+            && finiteAtLeast(header.barnesHutTheta, 0.0) && finiteAtLeast(header.fmmTheta, 0.0)
+            && header.barnesHutLeafCapacity >= 1 && header.barnesHutLeafCapacity <= MAX_LEAF_CAPACITY
+            && header.fmmLeafCapacity >= 1 && header.fmmLeafCapacity <= MAX_LEAF_CAPACITY
+            && header.fmmOrder >= 1 && header.fmmOrder <= FMM::MAX_EXPANSION_ORDER
+            && grid >= ParticleMesh::MIN_GRID_SIZE && grid <= ParticleMesh::MAX_GRID_SIZE && std::has_single_bit(grid)
+            && std::isfinite(header.meshBoxMin[0]) && std::isfinite(header.meshBoxMin[1]) && std::isfinite(header.meshBoxMin[2])
+            && finiteAtLeast(header.meshBoxSize, 0.0) && std::isfinite(header.hermiteEta) && header.hermiteEta > 0.0
+            && std::isfinite(header.clock.simTime) && std::isfinite(header.clock.dt) && header.clock.dt > 0.0f
+            && finiteAtLeast(header.clock.timeScale, 0.0);
+    }
+
+    template<typename T>
+    void writeSection(AlignedFileWriter& writer, CheckpointHeader& header, CheckpointSection id,
+                      const T* data, size_t count) {
+        if (header.sectionCount == CHECKPOINT_MAX_SECTIONS) throw std::runtime_error("Checkpoint: too many sections");
+        CheckpointSectionEntry& entry = header.sections[header.sectionCount++];
+        entry.id = static_cast<uint32_t>(id);
+        entry.elementSize = sizeof(T);
+        entry.offset = writer.offset();
+        entry.count = count;
+        writer.write(data, count * sizeof(T));
+        writer.pad(CHECKPOINT_ALIGNMENT);
+    }
+
+    uint64_t headerChecksum(const CheckpointHeader& header, uint64_t sectionsChecksum) {
+        CheckpointHeader copy = header;
+        copy.checksum = 0;
+        return Checksum64::of(&copy, sizeof(copy), sectionsChecksum);
+    }
+
+    // One column to fill from the mapping
+    struct ColumnCopy {
+        std::byte* dst;
+        const std::byte* src;
+        size_t size;
+    };
+}
+
+void writeCheckpoint(const std::string& path, Physics& physics, const CheckpointClock& clock,
+                     std::span<const std::byte> metadata) {
+    const BodyStore& bodies = physics.getBodies();
+    const size_t n = bodies.size();
+
+    CheckpointHeader header{};
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.bodyCount = n;
+    header.clock = clock;
+
+    AlignedFileWriter writer(path);
+    const std::vector<std::byte> zeros(CHECKPOINT_ALIGNMENT);
+    writer.write(zeros.data(), zeros.size());
+    writer.startChecksum();
+
+    writeSection(writer, header, CheckpointSection::PosX, bodies.px.data(), n);
+    writeSection(writer, header, CheckpointSection::PosY, bodies.py.data(), n);
+    writeSection(writer, header, CheckpointSection::PosZ, bodies.pz.data(), n);
+    writeSection(writer, header, CheckpointSection::VelX, bodies.vx.data(), n);
+    writeSection(writer, header, CheckpointSection::VelY, bodies.vy.data(), n);
+    writeSection(writer, header, CheckpointSection::VelZ, bodies.vz.data(), n);
+    writeSection(writer, header, CheckpointSection::AccX, bodies.ax.data(), n);
+    writeSection(writer, header, CheckpointSection::AccY, bodies.ay.data(), n);
+    writeSection(writer, header, CheckpointSection::AccZ, bodies.az.data(), n);
+    writeSection(writer, header, CheckpointSection::Mass, bodies.mass.data(), n);
+    writeSection(writer, header, CheckpointSection::Radius, bodies.radius.data(), n);
+    writeSection(writer, header, CheckpointSection::Rotation, bodies.rotation.data(), n);
+    if (bodies.highPrecision) {
+        writeSection(writer, header, CheckpointSection::PosXD, bodies.dpx.data(), n);
+        writeSection(writer, header, CheckpointSection::PosYD, bodies.dpy.data(), n);
+        writeSection(writer, header, CheckpointSection::PosZD, bodies.dpz.data(), n);
+        writeSection(writer, header, CheckpointSection::VelXD, bodies.dvx.data(), n);
+        writeSection(writer, header, CheckpointSection::VelYD, bodies.dvy.data(), n);
+        writeSection(writer, header, CheckpointSection::VelZD, bodies.dvz.data(), n);
+    }
+    writeSection(writer, header, CheckpointSection::Handles, physics.getHandles().handles().data(), n);
+    writeSection(writer, header, CheckpointSection::Metadata, metadata.data(), metadata.size());
+
+    header.G = Physics::G;
+    header.restitution = physics.getRestitution();
+    header.integrator = static_cast<uint8_t>(physics.getIntegrator());
+    header.solver = static_cast<uint8_t>(physics.getSolver());
+    header.precision = static_cast<uint8_t>(physics.getPrecision());
+    header.broadPhase = static_cast<uint8_t>(physics.getBroadPhase());
+    header.forcesValid = physics.forcesReusable();
+
+    BarnesHut& barnesHut = physics.getBarnesHut();
+    header.barnesHutTheta = barnesHut.getTheta();
+    header.barnesHutLeafCapacity = barnesHut.getLeafCapacity();
+    header.barnesHutQuadrupole = barnesHut.getUseQuadrupole();
+    FMM& fmm = physics.getFMM();
+    header.fmmTheta = fmm.getTheta();
+    header.fmmOrder = fmm.getExpansionOrder();
+    header.fmmLeafCapacity = fmm.getLeafCapacity();
+    ParticleMesh& mesh = physics.getParticleMesh();
+    header.meshGridSize = mesh.getGridSize();
+    header.meshShortRange = mesh.getShortRange();
+    const glm::vec3 boxMin = mesh.getBoxMin();
+    header.meshBoxMin[0] = boxMin.x;
+    header.meshBoxMin[1] = boxMin.y;
+    header.meshBoxMin[2] = boxMin.z;
+    header.meshBoxSize = mesh.getBoxSize();
+    header.hermiteEta = physics.getHermite().getEta();
+
+    header.fileSize = writer.offset();
+    header.checksum = headerChecksum(header, writer.checksum());
+    writer.patch(0, &header, sizeof(header));
+    writer.finish();
+}
+
+MappedCheckpoint::MappedCheckpoint(const std::string& path)
+    : m_file(path) {
+    if (m_file.size() < CHECKPOINT_ALIGNMENT) throw std::runtime_error("Checkpoint: file too small: " + path);
+    m_header = reinterpret_cast<const CheckpointHeader*>(m_file.data());
+
+    const CheckpointHeader& header = *m_header;
+    if (std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0)
+        throw std::runtime_error("Checkpoint: not a checkpoint: " + path);
+    if (header.version != CHECKPOINT_VERSION)
+        throw std::runtime_error("Checkpoint: unsupported version " + std::to_string(header.version) + ": " + path);
+    if (header.headerSize != sizeof(CheckpointHeader) || header.fileSize < CHECKPOINT_ALIGNMENT
+        || header.fileSize > m_file.size()
+        || header.sectionCount > CHECKPOINT_MAX_SECTIONS || header.bodyCount > header.fileSize)
+        throw std::runtime_error("Checkpoint: corrupt header: " + path);
+
+    for (uint32_t s = 0; s < header.sectionCount; ++s) {
+        const CheckpointSectionEntry& entry = header.sections[s];
+        if (entry.elementSize == 0 || entry.offset < CHECKPOINT_ALIGNMENT || entry.offset > header.fileSize
+            || entry.count > (header.fileSize - entry.offset) / entry.elementSize)
+            throw std::runtime_error("Checkpoint: section " + std::to_string(entry.id) + " out of bounds: " + path);
+    }
+
+    if (!validSettings(header)) throw std::runtime_error("Checkpoint: settings out of range: " + path);
+
+    // every column restoreCheckpoint copies, with one element per body
+    const uint64_t n = header.bodyCount;
+    auto requireColumn = [&](CheckpointSection id, size_t elementSize) {
+        const std::span<const std::byte> bytes = section(id);
+        if (bytes.size() != n * elementSize)
+            throw std::runtime_error("Checkpoint: section " + std::to_string(static_cast<uint32_t>(id)) + " missing or short: " + path);
+    };
+    for (CheckpointSection id : {CheckpointSection::PosX, CheckpointSection::PosY, CheckpointSection::PosZ,
+                                 CheckpointSection::VelX, CheckpointSection::VelY, CheckpointSection::VelZ,
+                                 CheckpointSection::AccX, CheckpointSection::AccY, CheckpointSection::AccZ,
+                                 CheckpointSection::Mass, CheckpointSection::Radius}) {
+        requireColumn(id, sizeof(float));
+    }
+    requireColumn(CheckpointSection::Rotation, sizeof(RotationState));
+    if (static_cast<Precision>(header.precision) == Precision::Mixed) {
+        for (CheckpointSection id : {CheckpointSection::PosXD, CheckpointSection::PosYD, CheckpointSection::PosZD,
+                                     CheckpointSection::VelXD, CheckpointSection::VelYD, CheckpointSection::VelZD}) {
+            requireColumn(id, sizeof(double));
+        }
+    }
+    requireColumn(CheckpointSection::Handles, sizeof(Handle));
+}
+
+std::span<const std::byte> MappedCheckpoint::section(CheckpointSection id) const {
+    for (uint32_t s = 0; s < m_header->sectionCount; ++s) {
+        const CheckpointSectionEntry& entry = m_header->sections[s];
+        if (entry.id == static_cast<uint32_t>(id))
+            return {m_file.data() + entry.offset, static_cast<size_t>(entry.count) * entry.elementSize};
+    }
+    return {};
+}
+
+bool MappedCheckpoint::verifyChecksum() const {
+    const size_t begin = CHECKPOINT_ALIGNMENT;
+    const size_t end = static_cast<size_t>(m_header->fileSize);
+    m_file.sequential(begin, end - begin);
+    const uint64_t sectionsChecksum = Checksum64::of(m_file.data() + begin, end - begin);
+    return headerChecksum(*m_header, sectionsChecksum) == m_header->checksum;
+}
+
+void restoreCheckpoint(const MappedCheckpoint& checkpoint, Physics& physics) {
+    const CheckpointHeader& header = checkpoint.header();
+    const size_t n = checkpoint.bodyCount();
+    const bool highPrecision = static_cast<Precision>(header.precision) == Precision::Mixed;
+
+    // The constructor checked the settings and column sizes, the handles are the last thing that can be wrong.
+    // A scratch map catches them before physics is touched.
+    std::span<const Handle> handleColumn = checkpoint.column<Handle>(CheckpointSection::Handles);
+    std::vector<Handle> handles(handleColumn.begin(), handleColumn.end());
+    if (SlotMap probe; !probe.assign(handles)) throw std::runtime_error("Checkpoint: invalid body handles");
+
+    // Configuration first: the setters invalidate forces, restoreHandles below sets them from the file
+    physics.clearBodies();
+    physics.setSolver(static_cast<GravitySolver>(header.solver));
+    physics.setIntegrator(static_cast<Integrator>(header.integrator));
+    physics.setPrecision(static_cast<Precision>(header.precision));
+    physics.setBroadPhase(static_cast<BroadPhase>(header.broadPhase));
+    physics.setRestitution(header.restitution);
+
+    BarnesHut& barnesHut = physics.getBarnesHut();
+    barnesHut.setTheta(header.barnesHutTheta);
+    barnesHut.setLeafCapacity(header.barnesHutLeafCapacity);
+    barnesHut.setUseQuadrupole(header.barnesHutQuadrupole != 0);
+    FMM& fmm = physics.getFMM();
+    fmm.setTheta(header.fmmTheta);
+    fmm.setExpansionOrder(header.fmmOrder);
+    fmm.setLeafCapacity(header.fmmLeafCapacity);
+    ParticleMesh& mesh = physics.getParticleMesh();
+    mesh.setGridSize(header.meshGridSize);
+    mesh.setShortRange(header.meshShortRange != 0);
+    mesh.setBox(glm::vec3(header.meshBoxMin[0], header.meshBoxMin[1], header.meshBoxMin[2]), header.meshBoxSize);
+    physics.getHermite().setEta(header.hermiteEta);
+
+    BodyStore& bodies = physics.getBodies();
+    bodies.resize(n);
+
+    std::vector<ColumnCopy> columns;
+    auto addColumn = [&](CheckpointSection id, void* dst) {
+        std::span<const std::byte> src = checkpoint.section(id);
+        columns.push_back({static_cast<std::byte*>(dst), src.data(), src.size()});
+    };
+    addColumn(CheckpointSection::PosX, bodies.px.data());
+    addColumn(CheckpointSection::PosY, bodies.py.data());
+    addColumn(CheckpointSection::PosZ, bodies.pz.data());
+    addColumn(CheckpointSection::VelX, bodies.vx.data());
+    addColumn(CheckpointSection::VelY, bodies.vy.data());
+    addColumn(CheckpointSection::VelZ, bodies.vz.data());
+    addColumn(CheckpointSection::AccX, bodies.ax.data());
+    addColumn(CheckpointSection::AccY, bodies.ay.data());
+    addColumn(CheckpointSection::AccZ, bodies.az.data());
+    addColumn(CheckpointSection::Mass, bodies.mass.data());
+    addColumn(CheckpointSection::Radius, bodies.radius.data());
+    addColumn(CheckpointSection::Rotation, bodies.rotation.data());
+    if (highPrecision) {
+        addColumn(CheckpointSection::PosXD, bodies.dpx.data());
+        addColumn(CheckpointSection::PosYD, bodies.dpy.data());
+        addColumn(CheckpointSection::PosZD, bodies.dpz.data());
+        addColumn(CheckpointSection::VelXD, bodies.dvx.data());
+        addColumn(CheckpointSection::VelYD, bodies.dvy.data());
+        addColumn(CheckpointSection::VelZD, bodies.dvz.data());
+    }
+
+    // Tasks of COPY_GRAIN bytes across all columns, so a few big columns still spread over every thread
+    std::vector<size_t> firstTask(columns.size() + 1, 0);
+    for (size_t c = 0; c < columns.size(); ++c) {
+        const MappedFile& file = checkpoint.file();
+        const size_t offset = static_cast<size_t>(columns[c].src - file.data());
+        file.sequential(offset, columns[c].size);
+        file.willNeed(offset, columns[c].size);
+        firstTask[c + 1] = firstTask[c] + (columns[c].size + COPY_GRAIN - 1) / COPY_GRAIN;
+    }
+    physics.getThreadPool().parallelFor(firstTask.back(), 1, [&](size_t begin, size_t end, size_t) {
+        for (size_t task = begin; task < end; ++task) {
+            const size_t c = std::upper_bound(firstTask.begin(), firstTask.end(), task) - firstTask.begin() - 1;
+            const ColumnCopy& column = columns[c];
+            const size_t offset = (task - firstTask[c]) * COPY_GRAIN;
+            std::memcpy(column.dst + offset, column.src + offset, std::min(COPY_GRAIN, column.size - offset));
+        }
+    });
+
+    // can't fail, the same handles went into the probe
+    physics.restoreHandles(handles, header.forcesValid != 0);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "MappedFile.hpp"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+class Physics;
+
+// Binary checkpoint of the physics state. Layout, little-endian throughout:
+//
+//   CheckpointHeader, padded to CHECKPOINT_ALIGNMENT
+//   one section per body column (px, py, ..., handles), then the caller's metadata, each starting on a
+//   CHECKPOINT_ALIGNMENT boundary
+//
+// Columns are the BodyStore arrays byte for byte, so a mapped file hands them out without any parsing and a
+// restore is one memcpy per column. The checksum is XXH64 over every byte after the header, then over the
+// header itself (checksum field zeroed) seeded with that.
+static_assert(std::endian::native == std::endian::little, "checkpoints are written in native byte order");
+
+constexpr char CHECKPOINT_MAGIC[8] = {'P', 'H', 'O', 'T', 'O', 'N', 'C', 'K'};
+constexpr uint32_t CHECKPOINT_VERSION = 1;
+constexpr size_t CHECKPOINT_ALIGNMENT = 4096;
+constexpr uint32_t CHECKPOINT_MAX_SECTIONS = 32;
+
+enum class CheckpointSection : uint32_t {
+    PosX = 0, PosY, PosZ,
+    VelX, VelY, VelZ,
+    AccX, AccY, AccZ,
+    Mass,
+    Radius,
+    Rotation,  // RotationState per body
+    PosXD, PosYD, PosZD, // mixed precision only
+    VelXD, VelYD, VelZD,
+    Handles,   // Handle per body
+    Metadata   // opaque bytes from the caller (the scene)
+};
+
+struct CheckpointSectionEntry {
+    uint32_t id = 0;
+    uint32_t elementSize = 0;
+    uint64_t offset = 0;
+    uint64_t count = 0; // elements
+};
+
+// Simulation clock and settings that live outside Physics
+struct CheckpointClock {
+    uint64_t step = 0;
+    double simTime = 0.0;
+    float dt = 0.016f;
+    float timeScale = 1.0f;
+};
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version = CHECKPOINT_VERSION;
+    uint32_t headerSize = sizeof(CheckpointHeader);
+    uint64_t fileSize = 0;
+    uint64_t checksum = 0;
+    uint64_t bodyCount = 0;
+
+    CheckpointClock clock;
+
+    // Physics configuration
+    float G = 0.0f;
+    float restitution = 0.0f;
+    uint8_t integrator = 0;
+    uint8_t solver = 0;
+    uint8_t precision = 0;
+    uint8_t broadPhase = 0;
+    uint8_t forcesValid = 0; // the saved accelerations belong to the saved positions
+    uint8_t reserved0[3] = {};
+
+    float barnesHutTheta = 0.0f;
+    uint32_t barnesHutLeafCapacity = 0;
+    uint32_t barnesHutQuadrupole = 0;
+    float fmmTheta = 0.0f;
+    uint32_t fmmOrder = 0;
+    uint32_t fmmLeafCapacity = 0;
+    uint32_t meshGridSize = 0;
+    uint32_t meshShortRange = 0;
+    float meshBoxMin[3] = {};
+    float meshBoxSize = 0.0f;
+    double hermiteEta = 0.0;
+
+    uint32_t sectionCount = 0;
+    uint32_t reserved1 = 0;
+    CheckpointSectionEntry sections[CHECKPOINT_MAX_SECTIONS];
+};
+static_assert(sizeof(CheckpointHeader) <= CHECKPOINT_ALIGNMENT);
+
+// Writes physics, the clock and metadata to path (through path + ".tmp"). Call between steps.
+// Throws std::runtime_error on I/O errors.
+void writeCheckpoint(const std::string& path, Physics& physics, const CheckpointClock& clock,
+                     std::span<const std::byte> metadata);
+
+// A checkpoint mapped into memory. Opening checks the header, the range of every setting, that every section lies
+// inside the file and that each column a restore needs has one element per body, which is O(1) in the body count;
+// the checksum pass is separate. Throws std::runtime_error on a bad file.
+class MappedCheckpoint {
+private:
+    MappedFile m_file;
+    const CheckpointHeader* m_header = nullptr;
+
+public:
+    explicit MappedCheckpoint(const std::string& path);
+
+    const CheckpointHeader& header() const { return *m_header; }
+    size_t bodyCount() const { return static_cast<size_t>(m_header->bodyCount); }
+    const MappedFile& file() const { return m_file; }
+
+    // Raw bytes of a section, empty if the file has none
+    std::span<const std::byte> section(CheckpointSection id) const;
+    template<typename T>
+    std::span<const T> column(CheckpointSection id) const {
+        std::span<const std::byte> bytes = section(id);
+        return {reinterpret_cast<const T*>(bytes.data()), bytes.size() / sizeof(T)};
+    }
+
+    // Reads the whole file
+    bool verifyChecksum() const;
+};
+
+// Replaces the bodies and configuration of physics with the checkpoint's. Columns are copied in parallel
+// straight from the mapping. Throws std::runtime_error, leaving physics untouched, when the handles are invalid.
+void restoreCheckpoint(const MappedCheckpoint& checkpoint, Physics& physics);
@@ -0,0 +1,120 @@
+#include "CheckpointFork.hpp"
+
+#include "physics.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+#ifdef __linux__
+    #include <cerrno>
+    #include <climits>
+    #include <fcntl.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+CheckpointFork::~CheckpointFork() {
+    ForkedCheckpointResult result;
+    wait(result);
+}
+
+bool CheckpointFork::supported() {
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+void CheckpointFork::start(const std::string& path, Physics& physics, const CheckpointClock& clock,
+                           std::span<const std::byte> metadata) {
+#ifdef __linux__
+    if (running()) throw std::runtime_error("Checkpoint: the previous one is still being written to " + m_path);
+    int fds[2];
+    if (pipe(fds) != 0) throw std::runtime_error(std::string("Checkpoint: pipe failed: ") + std::strerror(errno));
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        const int error = errno;
+        ::close(fds[0]);
+        ::close(fds[1]);
+        throw std::runtime_error(std::string("Checkpoint: fork failed: ") + std::strerror(error));
+    }
+    if (pid == 0) {
+        // Child: only this thread exists here, so nothing may wait on the parent's other threads. writeCheckpoint
+        // runs on this one alone. _exit skips the parent's atexit handlers and static destructors.
+        ::close(fds[0]);
+        int status = 0;
+        try {
+            writeCheckpoint(path, physics, clock, metadata);
+        } catch (const std::exception& error) {
+            // a message this short goes through the pipe in one write
+            const size_t length = std::min(std::strlen(error.what()), size_t(PIPE_BUF));
+            [[maybe_unused]] const ssize_t written = ::write(fds[1], error.what(), length);
+            status = 1;
+        }
+        ::close(fds[1]);
+        _exit(status);
+    }
+
+    ::close(fds[1]);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    m_pid = pid;
+    m_pipe = fds[0];
+    m_path = path;
+    m_bodyCount = physics.getPlanetCount();
+    m_started = std::chrono::steady_clock::now();
+#else
+    (void)path; (void)physics; (void)clock; (void)metadata;
+    throw std::runtime_error("Checkpoint: writing from a forked process is only supported on Linux");
+#endif
+}
+
+bool CheckpointFork::poll(ForkedCheckpointResult& result) {
+    return reap(false, result);
+}
+
+bool CheckpointFork::wait(ForkedCheckpointResult& result) {
+    return reap(true, result);
+}
+
+bool CheckpointFork::reap(bool block, ForkedCheckpointResult& result) {
+#ifdef __linux__
+    if (!running()) return false;
+    int status = 0;
+    pid_t done;
+    do {
+        done = waitpid(m_pid, &status, block ? 0 : WNOHANG);
+    } while (done < 0 && errno == EINTR);
+    if (done == 0) return false;
+
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_started).count();
+    std::string error;
+    char buffer[256];
+    ssize_t count;
+    while ((count = ::read(m_pipe, buffer, sizeof(buffer))) > 0) error.append(buffer, static_cast<size_t>(count));
+    ::close(m_pipe);
+    m_pipe = -1;
+    m_pid = -1;
+
+    if (done < 0) {
+        result.ok = false;
+        result.message = "Checkpoint: lost track of the writer process for " + m_path;
+    } else if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        result.ok = true;
+        result.message = "Saved " + std::to_string(m_bodyCount) + " bodies to " + m_path + " in the background";
+    } else if (WIFSIGNALED(status)) {
+        result.ok = false;
+        result.message = "Checkpoint: writer process killed by signal " + std::to_string(WTERMSIG(status));
+    } else {
+        result.ok = false;
+        result.message = error.empty() ? "Checkpoint: writer process failed for " + m_path : error;
+    }
+    return true;
+#else
+    (void)block; (void)result;
+    return false;
+#endif
+}
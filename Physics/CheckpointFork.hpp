@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Checkpoint.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <string>
+
+class Physics;
+
+// Outcome of a checkpoint written by a child process
+struct ForkedCheckpointResult {
+    bool ok = false;
+    std::string message; // the child's error, or a summary
+    double ms = 0.0;     // from the fork to the child's exit
+};
+
+// Writes checkpoints from a forked child (Linux only). The child sees the parent's memory as of the fork through
+// copy-on-write pages and streams it out with writeCheckpoint while the parent carries on, so the simulation only
+// stops for the fork itself, which copies page tables rather than bodies. Pages the parent writes to afterwards
+// are duplicated, up to the size of the body state while a child runs. One child at a time.
+class CheckpointFork {
+private:
+    int m_pid = -1;
+    int m_pipe = -1; // read end, the child writes its error message here
+    std::string m_path;
+    size_t m_bodyCount = 0;
+    std::chrono::steady_clock::time_point m_started;
+
+public:
+    CheckpointFork() = default;
+    // Waits for a running child, so its file is complete before the parent goes on
+    ~CheckpointFork();
+
+    CheckpointFork(const CheckpointFork&) = delete;
+    CheckpointFork& operator=(const CheckpointFork&) = delete;
+
+    static bool supported();
+    bool running() const { return m_pid > 0; }
+
+    // Call between steps. Throws std::runtime_error when a child is still running or the fork fails.
+    void start(const std::string& path, Physics& physics, const CheckpointClock& clock, std::span<const std::byte> metadata);
+    // Never blocks: true once the child has exited, with its outcome in result
+    bool poll(ForkedCheckpointResult& result);
+    // Blocks until the child has exited, false when none was running
+    bool wait(ForkedCheckpointResult& result);
+
+private:
+    bool reap(bool block, ForkedCheckpointResult& result);
+};
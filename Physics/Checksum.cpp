@@ -0,0 +1,109 @@
+#include "Checksum.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t PRIME3 = 0x165667B19E3779F9ull;
+    constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+    constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+    inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    // little-endian loads, the checksum is defined on the byte stream
+    inline uint64_t read64(const uint8_t* p) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        return v;
+    }
+    inline uint32_t read32(const uint8_t* p) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+
+    inline uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * PRIME2;
+        return rotl(acc, 31) * PRIME1;
+    }
+    inline uint64_t mergeRound(uint64_t acc, uint64_t lane) {
+        acc ^= round(0, lane);
+        return acc * PRIME1 + PRIME4;
+    }
+}
+
+void Checksum64::reset(uint64_t seed) {
+    m_seed = seed;
+    m_lanes[0] = seed + PRIME1 + PRIME2;
+    m_lanes[1] = seed + PRIME2;
+    m_lanes[2] = seed;
+    m_lanes[3] = seed - PRIME1;
+    m_length = 0;
+    m_stashed = 0;
+}
+
+void Checksum64::update(const void* data, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    m_length += size;
+
+    if (m_stashed > 0) {
+        const size_t take = std::min(size, sizeof(m_stash) - m_stashed);
+        std::memcpy(m_stash + m_stashed, p, take);
+        m_stashed += take;
+        p += take;
+        size -= take;
+        if (m_stashed < sizeof(m_stash)) return;
+        for (int lane = 0; lane < 4; ++lane) m_lanes[lane] = round(m_lanes[lane], read64(m_stash + 8 * lane));
+        m_stashed = 0;
+    }
+
+    // four independent lanes per 32-byte stripe
+    uint64_t v0 = m_lanes[0], v1 = m_lanes[1], v2 = m_lanes[2], v3 = m_lanes[3];
+    for (; size >= 32; p += 32, size -= 32) {
+        v0 = round(v0, read64(p));
+        v1 = round(v1, read64(p + 8));
+        v2 = round(v2, read64(p + 16));
+        v3 = round(v3, read64(p + 24));
+    }
+    m_lanes[0] = v0; m_lanes[1] = v1; m_lanes[2] = v2; m_lanes[3] = v3;
+
+    std::memcpy(m_stash, p, size);
+    m_stashed = size;
+}
+
+uint64_t Checksum64::digest() const {
+    uint64_t h;
+    if (m_length >= 32) {
+        h = rotl(m_lanes[0], 1) + rotl(m_lanes[1], 7) + rotl(m_lanes[2], 12) + rotl(m_lanes[3], 18);
+        for (int lane = 0; lane < 4; ++lane) h = mergeRound(h, m_lanes[lane]);
+    } else {
+        h = m_seed + PRIME5;
+    }
+    h += m_length;
+
+    const uint8_t* p = m_stash;
+    size_t left = m_stashed;
+    for (; left >= 8; p += 8, left -= 8) {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if (left >= 4) {
+        h ^= uint64_t(read32(p)) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+        left -= 4;
+    }
+    for (; left > 0; ++p, --left) {
+        h ^= uint64_t(*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
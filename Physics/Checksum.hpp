@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Streaming XXH64. Bytes can arrive in pieces of any size, the digest is the same as over the whole buffer.
+class Checksum64 {
+private:
+    uint64_t m_lanes[4];
+    uint64_t m_seed;
+    uint64_t m_length = 0;
+    uint8_t m_stash[32];
+    size_t m_stashed = 0;
+
+public:
+    explicit Checksum64(uint64_t seed = 0) { reset(seed); }
+
+    void reset(uint64_t seed = 0);
+    void update(const void* data, size_t size);
+    uint64_t digest() const;
+
+    static uint64_t of(const void* data, size_t size, uint64_t seed = 0) {
+        Checksum64 checksum(seed);
+        checksum.update(data, size);
+        return checksum.digest();
+    }
+};
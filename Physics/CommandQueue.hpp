@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free multi producer, single consumer queue (Vyukov's array queue). Every cell carries a
+// sequence number telling producers and the consumer whose turn it is, so push and pop only ever touch the
+// cell they own plus one counter. push() fails instead of blocking when the queue is full.
+template <typename T>
+class CommandQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask;
+    alignas(64) std::atomic<size_t> m_tail{0}; // next slot producers claim
+    alignas(64) size_t m_head = 0;             // consumer only
+
+public:
+    // capacity is rounded up to a power of two
+    explicit CommandQueue(size_t capacity = 1024) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        m_cells = std::make_unique<Cell[]>(size);
+        m_mask = size - 1;
+        for (size_t i = 0; i < size; ++i) m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    // Any thread
+    bool push(const T& value) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // the consumer hasn't freed this cell yet
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only
+    bool pop(T& value) {
+        Cell* cell = &m_cells[m_head & m_mask];
+        if (cell->sequence.load(std::memory_order_acquire) != m_head + 1) return false;
+        value = std::move(cell->value);
+        cell->sequence.store(m_head + m_mask + 1, std::memory_order_release);
+        m_head++;
+        return true;
+    }
+};
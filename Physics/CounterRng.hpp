@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al. 2011). Every output block is a pure function of
+// (seed, stream, counter), so giving each body its own stream makes generated values independent of how the
+// bodies are split over threads.
+class CounterRng {
+private:
+    uint32_t m_key[2];
+    uint32_t m_stream[2];
+    uint32_t m_counter = 0;
+    uint32_t m_block[4];
+    uint32_t m_used = 4; // outputs of m_block already handed out
+
+public:
+    CounterRng(uint64_t seed, uint64_t stream)
+        : m_key{uint32_t(seed), uint32_t(seed >> 32)}, m_stream{uint32_t(stream), uint32_t(stream >> 32)} {}
+
+    uint32_t next() {
+        if (m_used == 4) {
+            generate();
+            m_used = 0;
+        }
+        return m_block[m_used++];
+    }
+
+    // [0, 1)
+    double uniform() {
+        const uint32_t hi = next() >> 5, lo = next() >> 6;
+        return (hi * 67108864.0 + lo) * (1.0 / 9007199254740992.0);
+    }
+    // (0, 1), safe for logs and negative powers
+    double uniformOpen() { return (double(next()) + 0.5) * (1.0 / 4294967296.0); }
+    double uniform(double lo, double hi) { return lo + (hi - lo) * uniform(); }
+    double normal() {
+        // Box-Muller, one of the pair is dropped to keep the stream position simple
+        const double r = std::sqrt(-2.0 * std::log(uniformOpen()));
+        return r * std::cos(6.283185307179586 * uniform());
+    }
+
+private:
+    void generate() {
+        constexpr uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+        constexpr uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+        uint32_t c[4] = {m_counter++, 0, m_stream[0], m_stream[1]};
+        uint32_t k0 = m_key[0], k1 = m_key[1];
+        for (int round = 0; round < 10; ++round) {
+            const uint64_t p0 = uint64_t(M0) * c[0];
+            const uint64_t p1 = uint64_t(M1) * c[2];
+            const uint32_t mixed[4] = {
+                uint32_t(p1 >> 32) ^ c[1] ^ k0, uint32_t(p1),
+                uint32_t(p0 >> 32) ^ c[3] ^ k1, uint32_t(p0)
+            };
+            c[0] = mixed[0]; c[1] = mixed[1]; c[2] = mixed[2]; c[3] = mixed[3];
+            k0 += W0;
+            k1 += W1;
+        }
+        m_block[0] = c[0]; m_block[1] = c[1]; m_block[2] = c[2]; m_block[3] = c[3];
+    }
+};
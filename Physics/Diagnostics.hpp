@@ -0,0 +1,30 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+
+// Conserved quantities of the state at the end of the latest step (its start for semi-implicit Euler, which
+// only evaluates forces there). The potential comes out of the force pass and the rest out of the last
+// integration pass, so keeping them up to date costs about one multiply-add per pair and one read of the
+// bodies. Collisions are inelastic, a drift across one is real energy loss.
+struct Diagnostics {
+    bool valid = false;        // a step has run with diagnostics on since the last reset
+    bool hasPotential = false; // direct sums and Barnes-Hut produce one, FMM, the mesh and Hermite don't
+    uint64_t steps = 0;        // since the reference was taken
+
+    double kinetic = 0.0;
+    double potential = 0.0;
+    double total = 0.0;
+    glm::dvec3 momentum{0.0};
+    glm::dvec3 angularMomentum{0.0}; // about the origin
+
+    // first state after a reset; adding, removing or editing bodies resets it
+    double referenceEnergy = 0.0;
+    glm::dvec3 referenceMomentum{0.0};
+    glm::dvec3 referenceAngularMomentum{0.0};
+
+    double energyDrift = 0.0;          // (E - E0) / |E0|
+    double momentumDrift = 0.0;        // |P - P0|
+    double angularMomentumDrift = 0.0; // |L - L0| / |L0|
+};
@@ -0,0 +1,547 @@
+#include "FMM.hpp"
+
+#include "BodyStore.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    constexpr uint32_t MAX_TERMS = (FMM::MAX_EXPANSION_ORDER + 1) * (FMM::MAX_EXPANSION_ORDER + 2) * (FMM::MAX_EXPANSION_ORDER + 3) / 6;
+
+    inline uint32_t octant(const glm::vec3& p, const glm::vec3& center) {
+        return (p.x >= center.x ? 1u : 0u) | (p.y >= center.y ? 2u : 0u) | (p.z >= center.z ? 4u : 0u);
+    }
+
+    inline double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+FMM::FMM() {
+    buildTables();
+}
+
+void FMM::setExpansionOrder(uint32_t order) {
+    order = std::clamp(order, 1u, MAX_EXPANSION_ORDER);
+    if (order == m_expansionOrder) return;
+    m_expansionOrder = order;
+    buildTables();
+}
+
+void FMM::buildTables() {
+    const int p = static_cast<int>(m_expansionOrder);
+
+    // terms sorted by total degree so every term comes after the ones it is derived from
+    m_terms.clear();
+    m_termIndex.assign((p + 1) * (p + 1) * (p + 1), -1);
+    for (int deg = 0; deg <= p; ++deg) {
+        for (int a = deg; a >= 0; --a) {
+            for (int b = deg - a; b >= 0; --b) {
+                int c = deg - a - b;
+                m_termIndex[(a * (p + 1) + b) * (p + 1) + c] = static_cast<int32_t>(m_terms.size());
+                m_terms.emplace_back(a, b, c);
+            }
+        }
+    }
+    m_termCount = static_cast<uint32_t>(m_terms.size());
+
+    auto indexOf = [&](int a, int b, int c) -> int32_t {
+        if (a < 0 || b < 0 || c < 0 || a + b + c > p) return -1;
+        return m_termIndex[(a * (p + 1) + b) * (p + 1) + c];
+    };
+
+    m_parent.assign(m_termCount, 0);
+    m_parentAxis.assign(m_termCount, 0);
+    m_minusOne.assign(3 * m_termCount, -1);
+    m_minusTwo.assign(3 * m_termCount, -1);
+    m_factorial.assign(m_termCount, 1.0);
+    for (uint32_t t = 0; t < m_termCount; ++t) {
+        glm::ivec3 k = m_terms[t];
+        for (int i = 0; i < 3; ++i) {
+            glm::ivec3 k1 = k;
+            k1[i] -= 1;
+            m_minusOne[3 * t + i] = indexOf(k1.x, k1.y, k1.z);
+            glm::ivec3 k2 = k;
+            k2[i] -= 2;
+            m_minusTwo[3 * t + i] = indexOf(k2.x, k2.y, k2.z);
+        }
+        for (int i = 0; i < 3; ++i) {
+            if (k[i] > 0) {
+                m_parentAxis[t] = static_cast<uint8_t>(i);
+                m_parent[t] = static_cast<uint32_t>(m_minusOne[3 * t + i]);
+                break;
+            }
+        }
+        for (int i = 0; i < 3; ++i) {
+            for (int f = 2; f <= k[i]; ++f) m_factorial[t] *= f;
+        }
+    }
+
+    m_shiftTerms.clear();
+    m_m2lTerms.clear();
+    for (uint32_t hi = 0; hi < m_termCount; ++hi) {
+        glm::ivec3 k = m_terms[hi];
+        for (uint32_t lo = 0; lo < m_termCount; ++lo) {
+            glm::ivec3 l = m_terms[lo];
+            if (l.x <= k.x && l.y <= k.y && l.z <= k.z) {
+                uint32_t power = static_cast<uint32_t>(indexOf(k.x - l.x, k.y - l.y, k.z - l.z));
+                m_shiftTerms.push_back({hi, lo, power});
+            }
+            int32_t sum = indexOf(k.x + l.x, k.y + l.y, k.z + l.z);
+            if (sum >= 0) {
+                // hi is the local index n, lo the multipole index k
+                double multipoleSign = ((l.x + l.y + l.z) & 1) ? -1.0 : 1.0;
+                double localSign = ((k.x + k.y + k.z) & 1) ? -1.0 : 1.0;
+                m_m2lTerms.push_back({hi, lo, static_cast<uint32_t>(sum), multipoleSign, localSign});
+            }
+        }
+    }
+
+    m_gradTerms.clear();
+    for (uint32_t t = 0; t < m_termCount; ++t) {
+        glm::ivec3 l = m_terms[t];
+        if (l.x + l.y + l.z >= p) break;
+        m_gradTerms.push_back(static_cast<uint32_t>(indexOf(l.x + 1, l.y, l.z)));
+        m_gradTerms.push_back(static_cast<uint32_t>(indexOf(l.x, l.y + 1, l.z)));
+        m_gradTerms.push_back(static_cast<uint32_t>(indexOf(l.x, l.y, l.z + 1)));
+    }
+}
+
+void FMM::computeAccelerations(BodyStore& bodies, float G, std::vector<std::pair<uint32_t, uint32_t>>& contacts,
+                               ThreadPool& pool) {
+    m_stats = FmmStats{};
+    contacts.clear();
+    if (bodies.size() < 2) return;
+
+    auto start = std::chrono::steady_clock::now();
+    build(bodies);
+    m_stats.buildMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    upwardPass();
+    m_stats.upwardMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    m_m2lList.clear();
+    m_p2pList.clear();
+    traverse(0, 0);
+    m_stats.m2lCount = m_m2lList.size();
+    if (pool.getThreadCount() > 1) {
+        groupByTarget(m_m2lList, m_m2lStart, m_m2lSources);
+        groupByTarget(m_p2pList, m_p2pStart, m_p2pSources);
+    }
+    m_stats.traversalMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    m2lPass(pool);
+    m_stats.m2lMs = elapsedMs(start);
+
+    m_acc.assign(m_pos.size(), glm::vec3(0.0f));
+
+    start = std::chrono::steady_clock::now();
+    downwardPass(G, pool);
+    m_stats.downwardMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    p2pPass(G, contacts, pool);
+    m_stats.p2pMs = elapsedMs(start);
+
+    pool.parallelFor(m_pos.size(), 4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t k = begin; k < end; ++k) {
+            bodies.addAcc(m_order[k], m_acc[k]);
+        }
+    });
+}
+
+void FMM::build(const BodyStore& bodies) {
+    const uint32_t n = static_cast<uint32_t>(bodies.size());
+
+    m_order.resize(n);
+    m_pos.resize(n);
+    m_mass.resize(n);
+    m_radius.resize(n);
+    m_scratchOrder.resize(n);
+    m_scratchPos.resize(n);
+    m_scratchMass.resize(n);
+    m_scratchRadius.resize(n);
+
+    glm::vec3 lo = bodies.pos(0);
+    glm::vec3 hi = bodies.pos(0);
+    for (uint32_t i = 0; i < n; ++i) {
+        m_order[i] = i;
+        m_pos[i] = bodies.pos(i);
+        m_mass[i] = bodies.mass[i];
+        m_radius[i] = bodies.radius[i];
+        lo = glm::min(lo, m_pos[i]);
+        hi = glm::max(hi, m_pos[i]);
+    }
+
+    glm::vec3 extent = hi - lo;
+    float halfSize = 0.5f * std::max(extent.x, std::max(extent.y, extent.z));
+    halfSize = halfSize * 1.001f + 1e-6f;
+
+    m_cells.clear();
+    m_cells.reserve(2 * n / m_leafCapacity + 1);
+    Cell root;
+    root.center = 0.5f * (lo + hi);
+    root.halfSize = halfSize;
+    root.begin = 0;
+    root.count = n;
+    m_cells.push_back(root);
+
+    buildCell(0, 0);
+    m_stats.cellCount = m_cells.size();
+}
+
+void FMM::buildCell(uint32_t cellIdx, uint32_t depth) {
+    const uint32_t begin = m_cells[cellIdx].begin;
+    const uint32_t count = m_cells[cellIdx].count;
+    const glm::vec3 center = m_cells[cellIdx].center;
+    const float childHalf = 0.5f * m_cells[cellIdx].halfSize;
+
+    if (count > m_leafCapacity && depth < m_maxDepth) {
+        uint32_t counts[8] = {0};
+        for (uint32_t k = begin; k < begin + count; ++k) {
+            counts[octant(m_pos[k], center)]++;
+        }
+        uint32_t offsets[8];
+        uint32_t running = begin;
+        for (uint32_t o = 0; o < 8; ++o) {
+            offsets[o] = running;
+            running += counts[o];
+        }
+        uint32_t cursor[8];
+        std::copy(offsets, offsets + 8, cursor);
+        for (uint32_t k = begin; k < begin + count; ++k) {
+            uint32_t dst = cursor[octant(m_pos[k], center)]++;
+            m_scratchOrder[dst] = m_order[k];
+            m_scratchPos[dst] = m_pos[k];
+            m_scratchMass[dst] = m_mass[k];
+            m_scratchRadius[dst] = m_radius[k];
+        }
+        std::copy(m_scratchOrder.begin() + begin, m_scratchOrder.begin() + begin + count, m_order.begin() + begin);
+        std::copy(m_scratchPos.begin() + begin, m_scratchPos.begin() + begin + count, m_pos.begin() + begin);
+        std::copy(m_scratchMass.begin() + begin, m_scratchMass.begin() + begin + count, m_mass.begin() + begin);
+        std::copy(m_scratchRadius.begin() + begin, m_scratchRadius.begin() + begin + count, m_radius.begin() + begin);
+
+        const uint32_t firstChild = static_cast<uint32_t>(m_cells.size());
+        uint32_t childCount = 0;
+        for (uint32_t o = 0; o < 8; ++o) {
+            if (counts[o] == 0) continue;
+            Cell child;
+            child.center = center + childHalf * glm::vec3(
+                (o & 1u) ? 1.0f : -1.0f,
+                (o & 2u) ? 1.0f : -1.0f,
+                (o & 4u) ? 1.0f : -1.0f
+            );
+            child.halfSize = childHalf;
+            child.begin = offsets[o];
+            child.count = counts[o];
+            m_cells.push_back(child);
+            childCount++;
+        }
+        m_cells[cellIdx].firstChild = firstChild;
+        m_cells[cellIdx].childCount = childCount;
+
+        for (uint32_t c = 0; c < childCount; ++c) {
+            buildCell(firstChild + c, depth + 1);
+        }
+    } else {
+        m_stats.leafCount++;
+    }
+
+    // center of mass and bounding radius around it
+    Cell& cell = m_cells[cellIdx];
+    float mass = 0.0f;
+    glm::vec3 weighted(0.0f);
+    for (uint32_t k = begin; k < begin + count; ++k) {
+        mass += m_mass[k];
+        weighted += m_mass[k] * m_pos[k];
+    }
+    cell.mass = mass;
+    cell.com = mass > 0.0f ? weighted / mass : center;
+
+    float radius = 0.0f;
+    float maxBodyRadius = 0.0f;
+    if (cell.childCount == 0) {
+        for (uint32_t k = begin; k < begin + count; ++k) {
+            radius = std::max(radius, glm::length(m_pos[k] - cell.com));
+            maxBodyRadius = std::max(maxBodyRadius, m_radius[k]);
+        }
+    } else {
+        for (uint32_t c = cell.firstChild; c < cell.firstChild + cell.childCount; ++c) {
+            const Cell& child = m_cells[c];
+            radius = std::max(radius, glm::length(child.com - cell.com) + child.radius);
+            maxBodyRadius = std::max(maxBodyRadius, child.maxBodyRadius);
+        }
+    }
+    cell.radius = radius;
+    cell.maxBodyRadius = maxBodyRadius;
+}
+
+void FMM::powers(const glm::vec3& d, double* out) const {
+    const double dd[3] = {d.x, d.y, d.z};
+    out[0] = 1.0;
+    for (uint32_t t = 1; t < m_termCount; ++t) {
+        uint8_t axis = m_parentAxis[t];
+        out[t] = out[m_parent[t]] * dd[axis] / m_terms[t][axis];
+    }
+}
+
+void FMM::derivatives(const glm::vec3& r, double* out) const {
+    // Taylor coefficients a_k = D^k(1/r) / k! follow
+    // |k| r^2 a_k = -(2|k| - 1) sum_i x_i a_{k-e_i} - (|k| - 1) sum_i a_{k-2e_i}
+    const double x[3] = {r.x, r.y, r.z};
+    const double r2 = x[0] * x[0] + x[1] * x[1] + x[2] * x[2];
+    const double invR2 = 1.0 / r2;
+    out[0] = 1.0 / std::sqrt(r2);
+    for (uint32_t t = 1; t < m_termCount; ++t) {
+        const glm::ivec3 k = m_terms[t];
+        const int deg = k.x + k.y + k.z;
+        double sum1 = 0.0;
+        double sum2 = 0.0;
+        for (int i = 0; i < 3; ++i) {
+            int32_t m1 = m_minusOne[3 * t + i];
+            if (m1 >= 0) sum1 += x[i] * out[m1];
+            int32_t m2 = m_minusTwo[3 * t + i];
+            if (m2 >= 0) sum2 += out[m2];
+        }
+        out[t] = -((2 * deg - 1) * sum1 + (deg - 1) * sum2) * invR2 / deg;
+    }
+    for (uint32_t t = 1; t < m_termCount; ++t) {
+        out[t] *= m_factorial[t];
+    }
+}
+
+void FMM::upwardPass() {
+    m_multipoles.assign(static_cast<size_t>(m_cells.size()) * m_termCount, 0.0);
+
+    double pw[MAX_TERMS];
+    // children are always stored after their parent, so a reverse sweep is a post-order
+    for (size_t c = m_cells.size(); c-- > 0;) {
+        const Cell& cell = m_cells[c];
+        double* M = &m_multipoles[c * m_termCount];
+
+        if (cell.childCount == 0) {
+            // P2M
+            for (uint32_t k = cell.begin; k < cell.begin + cell.count; ++k) {
+                powers(m_pos[k] - cell.com, pw);
+                for (uint32_t t = 0; t < m_termCount; ++t) M[t] += m_mass[k] * pw[t];
+            }
+            continue;
+        }
+
+        // M2M
+        for (uint32_t ch = cell.firstChild; ch < cell.firstChild + cell.childCount; ++ch) {
+            const double* Mc = &m_multipoles[static_cast<size_t>(ch) * m_termCount];
+            powers(m_cells[ch].com - cell.com, pw);
+            for (const ShiftTerm& s : m_shiftTerms) {
+                M[s.high] += Mc[s.low] * pw[s.power];
+            }
+        }
+    }
+}
+
+void FMM::traverse(uint32_t a, uint32_t b) {
+    const Cell& A = m_cells[a];
+    const Cell& B = m_cells[b];
+
+    if (a == b) {
+        if (A.childCount == 0) {
+            m_p2pList.emplace_back(a, a);
+            return;
+        }
+        for (uint32_t ci = A.firstChild; ci < A.firstChild + A.childCount; ++ci) {
+            for (uint32_t cj = ci; cj < A.firstChild + A.childCount; ++cj) {
+                traverse(ci, cj);
+            }
+        }
+        return;
+    }
+
+    float dist = glm::length(A.com - B.com);
+    // overlapping bodies must end up in the near field so the P2P pass can report them
+    float contactReach = A.radius + B.radius + A.maxBodyRadius + B.maxBodyRadius;
+    if (A.radius + B.radius < m_theta * dist && contactReach < dist) {
+        m_m2lList.emplace_back(a, b);
+        return;
+    }
+
+    if (A.childCount == 0 && B.childCount == 0) {
+        m_p2pList.emplace_back(a, b);
+        return;
+    }
+
+    bool splitA = B.childCount == 0 || (A.childCount > 0 && A.radius >= B.radius);
+    if (splitA) {
+        for (uint32_t c = A.firstChild; c < A.firstChild + A.childCount; ++c) traverse(c, b);
+    } else {
+        for (uint32_t c = B.firstChild; c < B.firstChild + B.childCount; ++c) traverse(a, c);
+    }
+}
+
+void FMM::groupByTarget(const std::vector<std::pair<uint32_t, uint32_t>>& list,
+                        std::vector<uint32_t>& start, std::vector<uint32_t>& sources) const {
+    // counting sort of the directed pairs a <- b and b <- a, a self pair is listed once
+    start.assign(m_cells.size() + 1, 0);
+    for (const auto& [a, b] : list) {
+        start[a + 1]++;
+        if (a != b) start[b + 1]++;
+    }
+    for (size_t c = 0; c < m_cells.size(); ++c) start[c + 1] += start[c];
+
+    sources.resize(start.back());
+    std::vector<uint32_t> cursor(start.begin(), start.end() - 1);
+    for (const auto& [a, b] : list) {
+        sources[cursor[a]++] = b;
+        if (a != b) sources[cursor[b]++] = a;
+    }
+}
+
+void FMM::m2lPass(ThreadPool& pool) {
+    m_locals.assign(static_cast<size_t>(m_cells.size()) * m_termCount, 0.0);
+
+    if (pool.getThreadCount() > 1) {
+        pool.parallelFor(m_cells.size(), 64, [&](size_t begin, size_t end, size_t) {
+            double D[MAX_TERMS];
+            for (size_t a = begin; a < end; ++a) {
+                double* La = &m_locals[a * m_termCount];
+                for (uint32_t s = m_m2lStart[a]; s < m_m2lStart[a + 1]; ++s) {
+                    const uint32_t b = m_m2lSources[s];
+                    derivatives(m_cells[a].com - m_cells[b].com, D);
+                    const double* Mb = &m_multipoles[static_cast<size_t>(b) * m_termCount];
+                    for (const M2LTerm& t : m_m2lTerms) {
+                        La[t.local] += t.multipoleSign * D[t.derivative] * Mb[t.multipole];
+                    }
+                }
+            }
+        });
+        return;
+    }
+
+    double D[MAX_TERMS];
+    for (const auto& [a, b] : m_m2lList) {
+        derivatives(m_cells[a].com - m_cells[b].com, D);
+        double* La = &m_locals[static_cast<size_t>(a) * m_termCount];
+        double* Lb = &m_locals[static_cast<size_t>(b) * m_termCount];
+        const double* Ma = &m_multipoles[static_cast<size_t>(a) * m_termCount];
+        const double* Mb = &m_multipoles[static_cast<size_t>(b) * m_termCount];
+        // the b <- a translation reuses D(r_a - r_b) since D^m(-r) = (-1)^|m| D^m(r)
+        for (const M2LTerm& t : m_m2lTerms) {
+            La[t.local] += t.multipoleSign * D[t.derivative] * Mb[t.multipole];
+            Lb[t.local] += t.localSign * D[t.derivative] * Ma[t.multipole];
+        }
+    }
+}
+
+void FMM::downwardPass(float G, ThreadPool& pool) {
+    double pw[MAX_TERMS];
+    // L2L: parents come first, so a forward sweep is a pre-order
+    for (size_t c = 0; c < m_cells.size(); ++c) {
+        const Cell& cell = m_cells[c];
+        const double* L = &m_locals[c * m_termCount];
+        for (uint32_t ch = cell.firstChild; ch < cell.firstChild + cell.childCount; ++ch) {
+            double* Lc = &m_locals[static_cast<size_t>(ch) * m_termCount];
+            powers(m_cells[ch].com - cell.com, pw);
+            for (const ShiftTerm& s : m_shiftTerms) {
+                Lc[s.low] += L[s.high] * pw[s.power];
+            }
+        }
+    }
+
+    // L2P: a = G * grad(sum m / r), leaves own disjoint body ranges
+    const size_t gradCount = m_gradTerms.size() / 3;
+    pool.parallelFor(m_cells.size(), 256, [&](size_t begin, size_t end, size_t) {
+        double pw[MAX_TERMS];
+        for (size_t c = begin; c < end; ++c) {
+            const Cell& cell = m_cells[c];
+            if (cell.childCount > 0) continue;
+            const double* L = &m_locals[c * m_termCount];
+            for (uint32_t k = cell.begin; k < cell.begin + cell.count; ++k) {
+                powers(m_pos[k] - cell.com, pw);
+                double acc[3] = {0.0, 0.0, 0.0};
+                for (size_t t = 0; t < gradCount; ++t) {
+                    acc[0] += L[m_gradTerms[3 * t + 0]] * pw[t];
+                    acc[1] += L[m_gradTerms[3 * t + 1]] * pw[t];
+                    acc[2] += L[m_gradTerms[3 * t + 2]] * pw[t];
+                }
+                m_acc[k] += G * glm::vec3(float(acc[0]), float(acc[1]), float(acc[2]));
+            }
+        }
+    });
+}
+
+void FMM::p2pPass(float G, std::vector<std::pair<uint32_t, uint32_t>>& contacts, ThreadPool& pool) {
+    size_t pairCount = 0;
+    for (const auto& [a, b] : m_p2pList) {
+        const size_t countA = m_cells[a].count;
+        pairCount += a == b ? countA * (countA - 1) / 2 : countA * m_cells[b].count;
+    }
+    m_stats.p2pCount = pairCount;
+
+    if (pool.getThreadCount() > 1) {
+        // one-sided: a cell only writes its own bodies, each overlap is recorded by the lower body index
+        m_threadContacts.resize(pool.getThreadCount());
+        for (auto& local : m_threadContacts) local.clear();
+        pool.parallelFor(m_cells.size(), 16, [&](size_t begin, size_t end, size_t thread) {
+            std::vector<std::pair<uint32_t, uint32_t>>& local = m_threadContacts[thread];
+            for (size_t a = begin; a < end; ++a) {
+                const Cell& A = m_cells[a];
+                for (uint32_t s = m_p2pStart[a]; s < m_p2pStart[a + 1]; ++s) {
+                    const Cell& B = m_cells[m_p2pSources[s]];
+                    for (uint32_t i = A.begin; i < A.begin + A.count; ++i) {
+                        glm::vec3 acc(0.0f);
+                        for (uint32_t j = B.begin; j < B.begin + B.count; ++j) {
+                            if (j == i) continue;
+                            glm::vec3 diff = m_pos[j] - m_pos[i];
+                            float dist2 = glm::dot(diff, diff);
+                            float rSum = m_radius[i] + m_radius[j];
+                            if (dist2 < rSum * rSum && m_order[i] < m_order[j]) local.emplace_back(m_order[i], m_order[j]);
+                            if (dist2 == 0.0f) continue;
+                            float invDist = 1.0f / std::sqrt(dist2);
+                            acc += G * m_mass[j] * invDist * invDist * invDist * diff;
+                        }
+                        m_acc[i] += acc;
+                    }
+                }
+            }
+        });
+        for (const auto& local : m_threadContacts) contacts.insert(contacts.end(), local.begin(), local.end());
+        std::sort(contacts.begin(), contacts.end());
+        return;
+    }
+
+    auto interact = [&](uint32_t i, uint32_t j) {
+        glm::vec3 diff = m_pos[j] - m_pos[i];
+        float dist2 = glm::dot(diff, diff);
+        float rSum = m_radius[i] + m_radius[j];
+        if (dist2 < rSum * rSum) {
+            uint32_t pi = m_order[i];
+            uint32_t pj = m_order[j];
+            contacts.emplace_back(std::min(pi, pj), std::max(pi, pj));
+        }
+        if (dist2 == 0.0f) return; // same rule as Physics::computeGravity
+        float invDist = 1.0f / std::sqrt(dist2);
+        glm::vec3 f = G * invDist * invDist * invDist * diff;
+        m_acc[i] += m_mass[j] * f;
+        m_acc[j] -= m_mass[i] * f;
+    };
+
+    for (const auto& [a, b] : m_p2pList) {
+        const Cell& A = m_cells[a];
+        const Cell& B = m_cells[b];
+        if (a == b) {
+            for (uint32_t i = A.begin; i < A.begin + A.count; ++i) {
+                for (uint32_t j = i + 1; j < A.begin + A.count; ++j) interact(i, j);
+            }
+        } else {
+            for (uint32_t i = A.begin; i < A.begin + A.count; ++i) {
+                for (uint32_t j = B.begin; j < B.begin + B.count; ++j) interact(i, j);
+            }
+        }
+    }
+
+    std::sort(contacts.begin(), contacts.end());
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct BodyStore;
+class ThreadPool;
+
+struct FmmStats {
+    size_t cellCount = 0;
+    size_t leafCount = 0;
+    size_t m2lCount = 0;  // cell-cell far field interactions
+    size_t p2pCount = 0;  // body pairs evaluated in the near field
+
+    double buildMs = 0.0;
+    double upwardMs = 0.0;    // P2M + M2M
+    double traversalMs = 0.0; // building the M2L and P2P lists
+    double m2lMs = 0.0;
+    double downwardMs = 0.0;  // L2L + L2P
+    double p2pMs = 0.0;
+};
+
+// Fast multipole method with Cartesian Taylor expansions on an adaptive octree.
+// Cells are paired with a dual tree traversal; expansions are truncated at total order p.
+class FMM {
+private:
+    struct Cell {
+        glm::vec3 center{0.0f}; // geometric center of the octree cube
+        float halfSize = 0.0f;
+
+        glm::vec3 com{0.0f};    // expansion center
+        float radius = 0.0f;    // bounds all bodies around com
+        float mass = 0.0f;
+        float maxBodyRadius = 0.0f;
+
+        uint32_t firstChild = 0;
+        uint32_t childCount = 0;
+
+        uint32_t begin = 0;
+        uint32_t count = 0;
+    };
+
+    // k >= l, power = k - l
+    struct ShiftTerm {
+        uint32_t high;
+        uint32_t low;
+        uint32_t power;
+    };
+
+    struct M2LTerm {
+        uint32_t local;
+        uint32_t multipole;
+        uint32_t derivative;
+        double multipoleSign; // (-1)^|multipole|, target <- source
+        double localSign;     // (-1)^|local|, source <- target
+    };
+
+    std::vector<Cell> m_cells;
+    std::vector<uint32_t> m_order;
+    std::vector<glm::vec3> m_pos;
+    std::vector<float> m_mass;
+    std::vector<float> m_radius;
+    std::vector<glm::vec3> m_acc;
+    std::vector<glm::vec3> m_scratchPos;
+    std::vector<float> m_scratchMass;
+    std::vector<float> m_scratchRadius;
+    std::vector<uint32_t> m_scratchOrder;
+
+    // m_termCount coefficients per cell: M_k = sum m (x - com)^k / k!
+    // and L_n = d^n/dx^n (sum m / r) evaluated at com
+    std::vector<double> m_multipoles;
+    std::vector<double> m_locals;
+
+    std::vector<std::pair<uint32_t, uint32_t>> m_m2lList;
+    std::vector<std::pair<uint32_t, uint32_t>> m_p2pList;
+
+    // With more than one thread both lists are also kept per target cell (CSR), so every cell is written
+    // by a single thread at the cost of evaluating each pair from both sides
+    std::vector<uint32_t> m_m2lStart;
+    std::vector<uint32_t> m_m2lSources;
+    std::vector<uint32_t> m_p2pStart;
+    std::vector<uint32_t> m_p2pSources;
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> m_threadContacts;
+
+    // multi-index tables for the current order
+    uint32_t m_termCount = 0;
+    std::vector<glm::ivec3> m_terms;
+    std::vector<int32_t> m_termIndex;   // (a, b, c) -> term, -1 when a+b+c > p
+    std::vector<uint32_t> m_parent;     // term - e_axis
+    std::vector<uint8_t> m_parentAxis;
+    std::vector<int32_t> m_minusOne;    // 3 per term: term - e_i, -1 when out of range
+    std::vector<int32_t> m_minusTwo;    // 3 per term: term - 2 e_i
+    std::vector<double> m_factorial;    // k!
+    std::vector<ShiftTerm> m_shiftTerms;
+    std::vector<M2LTerm> m_m2lTerms;
+    std::vector<uint32_t> m_gradTerms;  // for each term l with |l| < p: index of l + e_x, l + e_y, l + e_z
+
+    uint32_t m_expansionOrder = 4;
+    float m_theta = 0.5f;
+    uint32_t m_leafCapacity = 32;
+    uint32_t m_maxDepth = 32;
+
+    FmmStats m_stats;
+
+public:
+    // highest supported expansion order, keeps the per-call scratch arrays on the stack
+    static constexpr uint32_t MAX_EXPANSION_ORDER = 12;
+
+    FMM();
+    ~FMM() = default;
+
+    // Adds G*m/r^2 accelerations to the body accelerations and collects overlapping pairs (i < j) found in the near field
+    void computeAccelerations(BodyStore& bodies, float G, std::vector<std::pair<uint32_t, uint32_t>>& contacts,
+                              ThreadPool& pool);
+
+    void setExpansionOrder(uint32_t order);
+    uint32_t getExpansionOrder() const { return m_expansionOrder; }
+    void setTheta(float theta) { m_theta = theta; }
+    float getTheta() const { return m_theta; }
+    void setLeafCapacity(uint32_t capacity) { m_leafCapacity = capacity > 0 ? capacity : 1; }
+    uint32_t getLeafCapacity() const { return m_leafCapacity; }
+
+    const FmmStats& getStats() const { return m_stats; }
+
+private:
+    void buildTables();
+    void build(const BodyStore& bodies);
+    void buildCell(uint32_t cellIdx, uint32_t depth);
+
+    void upwardPass();
+    void traverse(uint32_t a, uint32_t b);
+    void m2lPass(ThreadPool& pool);
+    void downwardPass(float G, ThreadPool& pool);
+    void p2pPass(float G, std::vector<std::pair<uint32_t, uint32_t>>& contacts, ThreadPool& pool);
+    void groupByTarget(const std::vector<std::pair<uint32_t, uint32_t>>& list,
+                       std::vector<uint32_t>& start, std::vector<uint32_t>& sources) const;
+
+    void powers(const glm::vec3& d, double* out) const;
+    void derivatives(const glm::vec3& r, double* out) const;
+};
@@ -0,0 +1,649 @@
+#include "GravityKernels.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define PHOTON_X86 1
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        // MSVC accepts any intrinsic without per-function target flags
+        #define PHOTON_TARGET_AVX2
+        #define PHOTON_TARGET_AVX512
+    #else
+        #define PHOTON_TARGET_AVX2 __attribute__((target("avx2,fma")))
+        #define PHOTON_TARGET_AVX512 __attribute__((target("avx512f")))
+    #endif
+#else
+    #define PHOTON_X86 0
+#endif
+
+SimdLevel detectSimdLevel() {
+#if PHOTON_X86
+    #if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    const bool fma = info[2] & (1 << 12);
+    const bool osxsave = info[2] & (1 << 27);
+    if (!osxsave) return SimdLevel::Scalar;
+    __cpuidex(info, 7, 0);
+    const bool avx2 = info[1] & (1 << 5);
+    const bool avx512f = info[1] & (1 << 16);
+    // the OS must save the ymm/zmm state on context switches
+    const unsigned long long xcr0 = _xgetbv(0);
+    if (avx512f && (xcr0 & 0xE6) == 0xE6) return SimdLevel::AVX512;
+    if (avx2 && fma && (xcr0 & 0x6) == 0x6) return SimdLevel::AVX2;
+    #else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SimdLevel::AVX2;
+    #endif
+#endif
+    return SimdLevel::Scalar;
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar: return "Scalar";
+        case SimdLevel::AVX2: return "AVX2";
+        case SimdLevel::AVX512: return "AVX-512";
+    }
+    return "Unknown";
+}
+
+namespace {
+    // Reference pair interaction, also used for the remainder lanes of the SIMD rows
+    inline void pairScalar(const GravityInput& in, GravityOutput& out, size_t i, size_t j,
+                           float xi, float yi, float zi, float mi, float ri,
+                           float& axi, float& ayi, float& azi, float& wi) {
+        float dx = in.px[j] - xi;
+        float dy = in.py[j] - yi;
+        float dz = in.pz[j] - zi;
+        float r2 = dx * dx + dy * dy + dz * dz;
+        if (out.contacts) {
+            float rs = ri + in.radius[j];
+            if (r2 < rs * rs) out.contacts->emplace_back(static_cast<uint32_t>(i), static_cast<uint32_t>(j));
+        }
+        if (r2 == 0.0f) return;
+
+        float inv = 1.0f / std::sqrt(r2);
+        float s = in.G * inv * inv * inv;
+        float si = s * in.mass[j];
+        float sj = s * mi;
+        axi += si * dx; ayi += si * dy; azi += si * dz;
+        wi += in.mass[j] * inv;
+        out.ax[j] -= sj * dx; out.ay[j] -= sj * dy; out.az[j] -= sj * dz;
+    }
+
+    void tileScalar(const GravityInput& in, GravityOutput& out,
+                    size_t iBegin, size_t iEnd, size_t jBegin, size_t jEnd) {
+        for (size_t i = iBegin; i < iEnd; ++i) {
+            const float xi = in.px[i], yi = in.py[i], zi = in.pz[i];
+            const float mi = in.mass[i], ri = in.radius[i];
+            float axi = 0.0f, ayi = 0.0f, azi = 0.0f, wi = 0.0f;
+            for (size_t j = std::max(jBegin, i + 1); j < jEnd; ++j) {
+                pairScalar(in, out, i, j, xi, yi, zi, mi, ri, axi, ayi, azi, wi);
+            }
+            out.ax[i] += axi; out.ay[i] += ayi; out.az[i] += azi;
+            if (out.potential) *out.potential -= double(in.G) * mi * wi;
+        }
+    }
+
+    // Kahan step on one lane of a compensated sum
+    inline void kahanAdd(float& sum, float& comp, float term) {
+        float y = term - comp;
+        float t = sum + y;
+        comp = (t - sum) - y;
+        sum = t;
+    }
+
+    // compensated fold of the lanes, the lane compensations go in first
+    inline float kahanFold(const float* sum, const float* comp, size_t lanes) {
+        float total = 0.0f, c = 0.0f;
+        for (size_t lane = 0; lane < lanes; ++lane) kahanAdd(total, c, sum[lane] - comp[lane]);
+        return total;
+    }
+
+    constexpr size_t MIXED_LANES = 16;
+
+    // Mixed precision row i over j in [jBegin, n), lane j % 8 of the running sums
+    void mixedRowScalar(const MixedGravityInput& in, GravityOutput& out, size_t i, size_t jBegin,
+                        float (&sum)[3][MIXED_LANES], float (&comp)[3][MIXED_LANES], float& w) {
+        const double xi = in.px[i], yi = in.py[i], zi = in.pz[i];
+        const float ri = in.radius[i];
+        for (size_t j = jBegin; j < in.count; ++j) {
+            const size_t lane = j % 8;
+            float dx = float(in.px[j] - xi);
+            float dy = float(in.py[j] - yi);
+            float dz = float(in.pz[j] - zi);
+            float r2 = dx * dx + dy * dy + dz * dz;
+            if (out.contacts && j > i) {
+                float rs = ri + in.radius[j];
+                if (r2 < rs * rs) out.contacts->emplace_back(static_cast<uint32_t>(i), static_cast<uint32_t>(j));
+            }
+            // also drops i itself
+            float inv = r2 > 0.0f ? 1.0f / std::sqrt(r2) : 0.0f;
+            float s = in.G * in.mass[j] * inv * inv * inv;
+            w += in.mass[j] * inv;
+            kahanAdd(sum[0][lane], comp[0][lane], s * dx);
+            kahanAdd(sum[1][lane], comp[1][lane], s * dy);
+            kahanAdd(sum[2][lane], comp[2][lane], s * dz);
+        }
+    }
+
+    void batchedScalar(const BatchedGravityInput& in, BatchedGravityOutput& out, size_t laneBegin, size_t laneEnd) {
+        const size_t n = in.bodies;
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = i + 1; j < n; ++j) {
+                const size_t oi = i * in.stride, oj = j * in.stride;
+                for (size_t k = laneBegin; k < laneEnd; ++k) {
+                    float dx = in.px[oj + k] - in.px[oi + k];
+                    float dy = in.py[oj + k] - in.py[oi + k];
+                    float dz = in.pz[oj + k] - in.pz[oi + k];
+                    float r2 = dx * dx + dy * dy + dz * dz;
+                    if (out.contacts) {
+                        float rs = in.radius[oi + k] + in.radius[oj + k];
+                        if (r2 < rs * rs) out.contacts->push_back({static_cast<uint32_t>(k), static_cast<uint32_t>(i), static_cast<uint32_t>(j)});
+                    }
+                    if (r2 == 0.0f) continue;
+                    float inv = 1.0f / std::sqrt(r2);
+                    float s = in.G * inv * inv * inv;
+                    float si = s * in.mass[oj + k];
+                    float sj = s * in.mass[oi + k];
+                    out.ax[oi + k] += si * dx; out.ay[oi + k] += si * dy; out.az[oi + k] += si * dz;
+                    out.ax[oj + k] -= sj * dx; out.ay[oj + k] -= sj * dy; out.az[oj + k] -= sj * dz;
+                }
+            }
+        }
+    }
+
+    void mixedRowsScalar(const MixedGravityInput& in, GravityOutput& out, size_t rowBegin, size_t rowEnd) {
+        for (size_t i = rowBegin; i < rowEnd; ++i) {
+            float sum[3][MIXED_LANES] = {};
+            float comp[3][MIXED_LANES] = {};
+            float w = 0.0f;
+            mixedRowScalar(in, out, i, 0, sum, comp, w);
+            out.ax[i] += kahanFold(sum[0], comp[0], 8);
+            out.ay[i] += kahanFold(sum[1], comp[1], 8);
+            out.az[i] += kahanFold(sum[2], comp[2], 8);
+            // full rows see every pair twice
+            if (out.potential) *out.potential -= 0.5 * double(in.G) * in.mass[i] * w;
+        }
+    }
+
+#if PHOTON_X86
+    PHOTON_TARGET_AVX2
+    inline float hsum256(__m256 v) {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_movehdup_ps(s));
+        return _mm_cvtss_f32(s);
+    }
+
+    PHOTON_TARGET_AVX2
+    void tileAVX2(const GravityInput& in, GravityOutput& out,
+                  size_t iBegin, size_t iEnd, size_t jBegin, size_t jEnd) {
+        const __m256 G = _mm256_set1_ps(in.G);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 threeHalves = _mm256_set1_ps(1.5f);
+        const __m256 zero = _mm256_setzero_ps();
+
+        for (size_t i = iBegin; i < iEnd; ++i) {
+            size_t j = std::max(jBegin, i + 1);
+            if (j >= jEnd) continue;
+
+            const float xs = in.px[i], ys = in.py[i], zs = in.pz[i];
+            const float ms = in.mass[i], rs = in.radius[i];
+            const __m256 xi = _mm256_set1_ps(xs);
+            const __m256 yi = _mm256_set1_ps(ys);
+            const __m256 zi = _mm256_set1_ps(zs);
+            const __m256 mi = _mm256_set1_ps(ms);
+            const __m256 ri = _mm256_set1_ps(rs);
+            __m256 accX = zero, accY = zero, accZ = zero, accW = zero;
+
+            for (; j + 8 <= jEnd; j += 8) {
+                __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(in.px + j), xi);
+                __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(in.py + j), yi);
+                __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(in.pz + j), zi);
+                __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+
+                if (out.contacts) {
+                    __m256 rSum = _mm256_add_ps(_mm256_loadu_ps(in.radius + j), ri);
+                    unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(
+                        _mm256_cmp_ps(r2, _mm256_mul_ps(rSum, rSum), _CMP_LT_OQ)));
+                    while (mask) {
+                        out.contacts->emplace_back(static_cast<uint32_t>(i), static_cast<uint32_t>(j + std::countr_zero(mask)));
+                        mask &= mask - 1;
+                    }
+                }
+
+                // 12-bit estimate refined by one Newton-Raphson step: y' = y (1.5 - 0.5 r2 y^2)
+                __m256 y = _mm256_rsqrt_ps(r2);
+                __m256 inv = _mm256_mul_ps(y, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(y, y), threeHalves));
+                inv = _mm256_andnot_ps(_mm256_cmp_ps(r2, zero, _CMP_EQ_OQ), inv);
+                __m256 s = _mm256_mul_ps(G, _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+
+                __m256 mj = _mm256_loadu_ps(in.mass + j);
+                __m256 si = _mm256_mul_ps(s, mj);
+                accX = _mm256_fmadd_ps(si, dx, accX);
+                accY = _mm256_fmadd_ps(si, dy, accY);
+                accZ = _mm256_fmadd_ps(si, dz, accZ);
+                if (out.potential) accW = _mm256_fmadd_ps(mj, inv, accW);
+
+                __m256 sj = _mm256_mul_ps(s, mi);
+                _mm256_storeu_ps(out.ax + j, _mm256_fnmadd_ps(sj, dx, _mm256_loadu_ps(out.ax + j)));
+                _mm256_storeu_ps(out.ay + j, _mm256_fnmadd_ps(sj, dy, _mm256_loadu_ps(out.ay + j)));
+                _mm256_storeu_ps(out.az + j, _mm256_fnmadd_ps(sj, dz, _mm256_loadu_ps(out.az + j)));
+            }
+
+            float axi = hsum256(accX), ayi = hsum256(accY), azi = hsum256(accZ), wi = hsum256(accW);
+            for (; j < jEnd; ++j) {
+                pairScalar(in, out, i, j, xs, ys, zs, ms, rs, axi, ayi, azi, wi);
+            }
+            out.ax[i] += axi; out.ay[i] += ayi; out.az[i] += azi;
+            if (out.potential) *out.potential -= double(in.G) * ms * wi;
+        }
+    }
+
+    // GCC builds the unmasked forms of these on _mm512_undefined_*(), which -Wmaybe-uninitialized flags at -O2.
+    // The zero-masked forms are the same instructions on a zero source.
+    PHOTON_TARGET_AVX512
+    inline __m512 rsqrt16(__m512 x) {
+        return _mm512_maskz_rsqrt14_ps(0xFFFF, x);
+    }
+
+    // Same pairing as _mm512_reduce_add_ps, so the sums don't change
+    PHOTON_TARGET_AVX512
+    inline float hsum512(__m512 v) {
+        const __m512d d = _mm512_castps_pd(v);
+        const __m256 s = _mm256_add_ps(_mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, d, 1)),
+                                       _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, d, 0)));
+        __m128 t = _mm_add_ps(_mm256_extractf128_ps(s, 1), _mm256_castps256_ps128(s));
+        t = _mm_add_ps(t, _mm_movehl_ps(t, t));
+        return _mm_cvtss_f32(_mm_add_ss(t, _mm_movehdup_ps(t)));
+    }
+
+    PHOTON_TARGET_AVX512
+    void tileAVX512(const GravityInput& in, GravityOutput& out,
+                    size_t iBegin, size_t iEnd, size_t jBegin, size_t jEnd) {
+        const __m512 G = _mm512_set1_ps(in.G);
+        const __m512 half = _mm512_set1_ps(0.5f);
+        const __m512 threeHalves = _mm512_set1_ps(1.5f);
+        const __m512 zero = _mm512_setzero_ps();
+
+        for (size_t i = iBegin; i < iEnd; ++i) {
+            size_t j = std::max(jBegin, i + 1);
+            if (j >= jEnd) continue;
+
+            const __m512 xi = _mm512_set1_ps(in.px[i]);
+            const __m512 yi = _mm512_set1_ps(in.py[i]);
+            const __m512 zi = _mm512_set1_ps(in.pz[i]);
+            const __m512 mi = _mm512_set1_ps(in.mass[i]);
+            const __m512 ri = _mm512_set1_ps(in.radius[i]);
+            __m512 accX = zero, accY = zero, accZ = zero, accW = zero;
+
+            // the remainder is handled with a lane mask instead of a scalar loop
+            for (; j < jEnd; j += 16) {
+                const size_t left = jEnd - j;
+                const __mmask16 lanes = left >= 16 ? __mmask16(0xFFFF) : __mmask16((1u << left) - 1u);
+
+                __m512 dx = _mm512_sub_ps(_mm512_maskz_loadu_ps(lanes, in.px + j), xi);
+                __m512 dy = _mm512_sub_ps(_mm512_maskz_loadu_ps(lanes, in.py + j), yi);
+                __m512 dz = _mm512_sub_ps(_mm512_maskz_loadu_ps(lanes, in.pz + j), zi);
+                __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+
+                if (out.contacts) {
+                    __m512 rSum = _mm512_add_ps(_mm512_maskz_loadu_ps(lanes, in.radius + j), ri);
+                    unsigned mask = _mm512_mask_cmp_ps_mask(lanes, r2, _mm512_mul_ps(rSum, rSum), _CMP_LT_OQ);
+                    while (mask) {
+                        out.contacts->emplace_back(static_cast<uint32_t>(i), static_cast<uint32_t>(j + std::countr_zero(mask)));
+                        mask &= mask - 1;
+                    }
+                }
+
+                // 14-bit estimate refined by one Newton-Raphson step
+                __m512 y = rsqrt16(r2);
+                __m512 inv = _mm512_mul_ps(y, _mm512_fnmadd_ps(_mm512_mul_ps(half, r2), _mm512_mul_ps(y, y), threeHalves));
+                const __mmask16 valid = _mm512_mask_cmp_ps_mask(lanes, r2, zero, _CMP_NEQ_OQ);
+                __m512 s = _mm512_maskz_mul_ps(valid, G, _mm512_mul_ps(inv, _mm512_mul_ps(inv, inv)));
+
+                __m512 mj = _mm512_maskz_loadu_ps(lanes, in.mass + j);
+                __m512 si = _mm512_mul_ps(s, mj);
+                accX = _mm512_fmadd_ps(si, dx, accX);
+                accY = _mm512_fmadd_ps(si, dy, accY);
+                accZ = _mm512_fmadd_ps(si, dz, accZ);
+                // inv is not finite in the invalid lanes, leave the sum alone there
+                if (out.potential) accW = _mm512_mask3_fmadd_ps(mj, inv, accW, valid);
+
+                __m512 sj = _mm512_mul_ps(s, mi);
+                _mm512_mask_storeu_ps(out.ax + j, lanes, _mm512_fnmadd_ps(sj, dx, _mm512_maskz_loadu_ps(lanes, out.ax + j)));
+                _mm512_mask_storeu_ps(out.ay + j, lanes, _mm512_fnmadd_ps(sj, dy, _mm512_maskz_loadu_ps(lanes, out.ay + j)));
+                _mm512_mask_storeu_ps(out.az + j, lanes, _mm512_fnmadd_ps(sj, dz, _mm512_maskz_loadu_ps(lanes, out.az + j)));
+            }
+
+            out.ax[i] += hsum512(accX);
+            out.ay[i] += hsum512(accY);
+            out.az[i] += hsum512(accZ);
+            if (out.potential) *out.potential -= double(in.G) * in.mass[i] * hsum512(accW);
+        }
+    }
+    PHOTON_TARGET_AVX2
+    void batchedAVX2(const BatchedGravityInput& in, BatchedGravityOutput& out, size_t laneBegin, size_t laneEnd) {
+        const __m256 G = _mm256_set1_ps(in.G);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 threeHalves = _mm256_set1_ps(1.5f);
+        const __m256 zero = _mm256_setzero_ps();
+        const size_t n = in.bodies;
+
+        for (size_t k = laneBegin; k < laneEnd; k += 8) {
+            for (size_t i = 0; i < n; ++i) {
+                const size_t oi = i * in.stride + k;
+                const __m256 xi = _mm256_loadu_ps(in.px + oi);
+                const __m256 yi = _mm256_loadu_ps(in.py + oi);
+                const __m256 zi = _mm256_loadu_ps(in.pz + oi);
+                const __m256 mi = _mm256_loadu_ps(in.mass + oi);
+                const __m256 ri = _mm256_loadu_ps(in.radius + oi);
+                __m256 accX = zero, accY = zero, accZ = zero;
+
+                for (size_t j = i + 1; j < n; ++j) {
+                    const size_t oj = j * in.stride + k;
+                    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(in.px + oj), xi);
+                    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(in.py + oj), yi);
+                    __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(in.pz + oj), zi);
+                    __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+
+                    if (out.contacts) {
+                        __m256 rSum = _mm256_add_ps(_mm256_loadu_ps(in.radius + oj), ri);
+                        unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(
+                            _mm256_cmp_ps(r2, _mm256_mul_ps(rSum, rSum), _CMP_LT_OQ)));
+                        while (mask) {
+                            out.contacts->push_back({static_cast<uint32_t>(k + std::countr_zero(mask)), static_cast<uint32_t>(i), static_cast<uint32_t>(j)});
+                            mask &= mask - 1;
+                        }
+                    }
+
+                    __m256 y = _mm256_rsqrt_ps(r2);
+                    __m256 inv = _mm256_mul_ps(y, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(y, y), threeHalves));
+                    inv = _mm256_andnot_ps(_mm256_cmp_ps(r2, zero, _CMP_EQ_OQ), inv);
+                    __m256 s = _mm256_mul_ps(G, _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+
+                    __m256 si = _mm256_mul_ps(s, _mm256_loadu_ps(in.mass + oj));
+                    accX = _mm256_fmadd_ps(si, dx, accX);
+                    accY = _mm256_fmadd_ps(si, dy, accY);
+                    accZ = _mm256_fmadd_ps(si, dz, accZ);
+
+                    __m256 sj = _mm256_mul_ps(s, mi);
+                    _mm256_storeu_ps(out.ax + oj, _mm256_fnmadd_ps(sj, dx, _mm256_loadu_ps(out.ax + oj)));
+                    _mm256_storeu_ps(out.ay + oj, _mm256_fnmadd_ps(sj, dy, _mm256_loadu_ps(out.ay + oj)));
+                    _mm256_storeu_ps(out.az + oj, _mm256_fnmadd_ps(sj, dz, _mm256_loadu_ps(out.az + oj)));
+                }
+                _mm256_storeu_ps(out.ax + oi, _mm256_add_ps(_mm256_loadu_ps(out.ax + oi), accX));
+                _mm256_storeu_ps(out.ay + oi, _mm256_add_ps(_mm256_loadu_ps(out.ay + oi), accY));
+                _mm256_storeu_ps(out.az + oi, _mm256_add_ps(_mm256_loadu_ps(out.az + oi), accZ));
+            }
+        }
+    }
+
+    PHOTON_TARGET_AVX512
+    void batchedAVX512(const BatchedGravityInput& in, BatchedGravityOutput& out, size_t laneBegin, size_t laneEnd) {
+        const __m512 G = _mm512_set1_ps(in.G);
+        const __m512 half = _mm512_set1_ps(0.5f);
+        const __m512 threeHalves = _mm512_set1_ps(1.5f);
+        const __m512 zero = _mm512_setzero_ps();
+        const size_t n = in.bodies;
+
+        for (size_t k = laneBegin; k < laneEnd; k += 16) {
+            for (size_t i = 0; i < n; ++i) {
+                const size_t oi = i * in.stride + k;
+                const __m512 xi = _mm512_loadu_ps(in.px + oi);
+                const __m512 yi = _mm512_loadu_ps(in.py + oi);
+                const __m512 zi = _mm512_loadu_ps(in.pz + oi);
+                const __m512 mi = _mm512_loadu_ps(in.mass + oi);
+                const __m512 ri = _mm512_loadu_ps(in.radius + oi);
+                __m512 accX = zero, accY = zero, accZ = zero;
+
+                for (size_t j = i + 1; j < n; ++j) {
+                    const size_t oj = j * in.stride + k;
+                    __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(in.px + oj), xi);
+                    __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(in.py + oj), yi);
+                    __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(in.pz + oj), zi);
+                    __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+
+                    if (out.contacts) {
+                        __m512 rSum = _mm512_add_ps(_mm512_loadu_ps(in.radius + oj), ri);
+                        unsigned mask = _mm512_cmp_ps_mask(r2, _mm512_mul_ps(rSum, rSum), _CMP_LT_OQ);
+                        while (mask) {
+                            out.contacts->push_back({static_cast<uint32_t>(k + std::countr_zero(mask)), static_cast<uint32_t>(i), static_cast<uint32_t>(j)});
+                            mask &= mask - 1;
+                        }
+                    }
+
+                    __m512 y = rsqrt16(r2);
+                    __m512 inv = _mm512_mul_ps(y, _mm512_fnmadd_ps(_mm512_mul_ps(half, r2), _mm512_mul_ps(y, y), threeHalves));
+                    const __mmask16 valid = _mm512_cmp_ps_mask(r2, zero, _CMP_NEQ_OQ);
+                    __m512 s = _mm512_maskz_mul_ps(valid, G, _mm512_mul_ps(inv, _mm512_mul_ps(inv, inv)));
+
+                    __m512 si = _mm512_mul_ps(s, _mm512_loadu_ps(in.mass + oj));
+                    accX = _mm512_fmadd_ps(si, dx, accX);
+                    accY = _mm512_fmadd_ps(si, dy, accY);
+                    accZ = _mm512_fmadd_ps(si, dz, accZ);
+
+                    __m512 sj = _mm512_mul_ps(s, mi);
+                    _mm512_storeu_ps(out.ax + oj, _mm512_fnmadd_ps(sj, dx, _mm512_loadu_ps(out.ax + oj)));
+                    _mm512_storeu_ps(out.ay + oj, _mm512_fnmadd_ps(sj, dy, _mm512_loadu_ps(out.ay + oj)));
+                    _mm512_storeu_ps(out.az + oj, _mm512_fnmadd_ps(sj, dz, _mm512_loadu_ps(out.az + oj)));
+                }
+                _mm512_storeu_ps(out.ax + oi, _mm512_add_ps(_mm512_loadu_ps(out.ax + oi), accX));
+                _mm512_storeu_ps(out.ay + oi, _mm512_add_ps(_mm512_loadu_ps(out.ay + oi), accY));
+                _mm512_storeu_ps(out.az + oi, _mm512_add_ps(_mm512_loadu_ps(out.az + oi), accZ));
+            }
+        }
+    }
+
+    // rounds (p[j..j+7] - origin) from double to float
+    PHOTON_TARGET_AVX2
+    inline __m256 separation8(const double* p, __m256d origin) {
+        __m128 lo = _mm256_cvtpd_ps(_mm256_sub_pd(_mm256_loadu_pd(p), origin));
+        __m128 hi = _mm256_cvtpd_ps(_mm256_sub_pd(_mm256_loadu_pd(p + 4), origin));
+        return _mm256_set_m128(hi, lo);
+    }
+
+    PHOTON_TARGET_AVX2
+    inline void kahanAdd8(__m256& sum, __m256& comp, __m256 term) {
+        __m256 y = _mm256_sub_ps(term, comp);
+        __m256 t = _mm256_add_ps(sum, y);
+        comp = _mm256_sub_ps(_mm256_sub_ps(t, sum), y);
+        sum = t;
+    }
+
+    PHOTON_TARGET_AVX2
+    void mixedRowsAVX2(const MixedGravityInput& in, GravityOutput& out, size_t rowBegin, size_t rowEnd) {
+        const __m256 G = _mm256_set1_ps(in.G);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 threeHalves = _mm256_set1_ps(1.5f);
+        const __m256 zero = _mm256_setzero_ps();
+        const size_t n = in.count;
+
+        for (size_t i = rowBegin; i < rowEnd; ++i) {
+            const __m256d xi = _mm256_set1_pd(in.px[i]);
+            const __m256d yi = _mm256_set1_pd(in.py[i]);
+            const __m256d zi = _mm256_set1_pd(in.pz[i]);
+            const __m256 ri = _mm256_set1_ps(in.radius[i]);
+            __m256 sumX = zero, sumY = zero, sumZ = zero;
+            __m256 compX = zero, compY = zero, compZ = zero;
+            __m256 accW = zero;
+
+            size_t j = 0;
+            for (; j + 8 <= n; j += 8) {
+                __m256 dx = separation8(in.px + j, xi);
+                __m256 dy = separation8(in.py + j, yi);
+                __m256 dz = separation8(in.pz + j, zi);
+                __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+
+                if (out.contacts && j + 8 > i + 1) {
+                    __m256 rSum = _mm256_add_ps(_mm256_loadu_ps(in.radius + j), ri);
+                    unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(
+                        _mm256_cmp_ps(r2, _mm256_mul_ps(rSum, rSum), _CMP_LT_OQ)));
+                    while (mask) {
+                        const size_t other = j + std::countr_zero(mask);
+                        if (other > i) out.contacts->emplace_back(static_cast<uint32_t>(i), static_cast<uint32_t>(other));
+                        mask &= mask - 1;
+                    }
+                }
+
+                __m256 y = _mm256_rsqrt_ps(r2);
+                __m256 inv = _mm256_mul_ps(y, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(y, y), threeHalves));
+                inv = _mm256_andnot_ps(_mm256_cmp_ps(r2, zero, _CMP_EQ_OQ), inv);
+                __m256 mj = _mm256_loadu_ps(in.mass + j);
+                __m256 s = _mm256_mul_ps(_mm256_mul_ps(G, mj), _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+                if (out.potential) accW = _mm256_fmadd_ps(mj, inv, accW);
+
+                kahanAdd8(sumX, compX, _mm256_mul_ps(s, dx));
+                kahanAdd8(sumY, compY, _mm256_mul_ps(s, dy));
+                kahanAdd8(sumZ, compZ, _mm256_mul_ps(s, dz));
+            }
+
+            float sum[3][MIXED_LANES], comp[3][MIXED_LANES];
+            _mm256_storeu_ps(sum[0], sumX); _mm256_storeu_ps(comp[0], compX);
+            _mm256_storeu_ps(sum[1], sumY); _mm256_storeu_ps(comp[1], compY);
+            _mm256_storeu_ps(sum[2], sumZ); _mm256_storeu_ps(comp[2], compZ);
+            float w = hsum256(accW);
+            mixedRowScalar(in, out, i, j, sum, comp, w);
+            out.ax[i] += kahanFold(sum[0], comp[0], 8);
+            out.ay[i] += kahanFold(sum[1], comp[1], 8);
+            out.az[i] += kahanFold(sum[2], comp[2], 8);
+            if (out.potential) *out.potential -= 0.5 * double(in.G) * in.mass[i] * w;
+        }
+    }
+
+    PHOTON_TARGET_AVX512
+    inline __m512 separation16(const double* p, __m512d origin, __mmask16 lanes) {
+        // zero-masked forms for the same -Wmaybe-uninitialized reason as rsqrt16
+        __m256 lo = _mm512_maskz_cvtpd_ps(0xFF, _mm512_sub_pd(_mm512_maskz_loadu_pd(__mmask8(lanes), p), origin));
+        __m256 hi = _mm512_maskz_cvtpd_ps(0xFF, _mm512_sub_pd(_mm512_maskz_loadu_pd(__mmask8(lanes >> 8), p + 8), origin));
+        __m512d merged = _mm512_maskz_insertf64x4(0xFF, _mm512_castpd256_pd512(_mm256_castps_pd(lo)), _mm256_castps_pd(hi), 1);
+        return _mm512_castpd_ps(merged);
+    }
+
+    PHOTON_TARGET_AVX512
+    inline void kahanAdd16(__m512& sum, __m512& comp, __m512 term) {
+        __m512 y = _mm512_sub_ps(term, comp);
+        __m512 t = _mm512_add_ps(sum, y);
+        comp = _mm512_sub_ps(_mm512_sub_ps(t, sum), y);
+        sum = t;
+    }
+
+    PHOTON_TARGET_AVX512
+    void mixedRowsAVX512(const MixedGravityInput& in, GravityOutput& out, size_t rowBegin, size_t rowEnd) {
+        const __m512 G = _mm512_set1_ps(in.G);
+        const __m512 half = _mm512_set1_ps(0.5f);
+        const __m512 threeHalves = _mm512_set1_ps(1.5f);
+        const __m512 zero = _mm512_setzero_ps();
+        const size_t n = in.count;
+
+        for (size_t i = rowBegin; i < rowEnd; ++i) {
+            const __m512d xi = _mm512_set1_pd(in.px[i]);
+            const __m512d yi = _mm512_set1_pd(in.py[i]);
+            const __m512d zi = _mm512_set1_pd(in.pz[i]);
+            const __m512 ri = _mm512_set1_ps(in.radius[i]);
+            __m512 sumX = zero, sumY = zero, sumZ = zero;
+            __m512 compX = zero, compY = zero, compZ = zero;
+            __m512 accW = zero;
+
+            for (size_t j = 0; j < n; j += 16) {
+                const size_t left = n - j;
+                const __mmask16 lanes = left >= 16 ? __mmask16(0xFFFF) : __mmask16((1u << left) - 1u);
+
+                __m512 dx = separation16(in.px + j, xi, lanes);
+                __m512 dy = separation16(in.py + j, yi, lanes);
+                __m512 dz = separation16(in.pz + j, zi, lanes);
+                __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+
+                if (out.contacts && j + 16 > i + 1) {
+                    __m512 rSum = _mm512_add_ps(_mm512_maskz_loadu_ps(lanes, in.radius + j), ri);
+                    unsigned mask = _mm512_mask_cmp_ps_mask(lanes, r2, _mm512_mul_ps(rSum, rSum), _CMP_LT_OQ);
+                    while (mask) {
+                        const size_t other = j + std::countr_zero(mask);
+                        if (other > i) out.contacts->emplace_back(static_cast<uint32_t>(i), static_cast<uint32_t>(other));
+                        mask &= mask - 1;
+                    }
+                }
+
+                __m512 y = rsqrt16(r2);
+                __m512 inv = _mm512_mul_ps(y, _mm512_fnmadd_ps(_mm512_mul_ps(half, r2), _mm512_mul_ps(y, y), threeHalves));
+                // lanes past the end are cleared by the lanes mask of the compare, not by their separation
+                const __mmask16 valid = _mm512_mask_cmp_ps_mask(lanes, r2, zero, _CMP_NEQ_OQ);
+                __m512 mj = _mm512_maskz_loadu_ps(lanes, in.mass + j);
+                __m512 s = _mm512_maskz_mul_ps(valid, _mm512_mul_ps(G, mj), _mm512_mul_ps(inv, _mm512_mul_ps(inv, inv)));
+                if (out.potential) accW = _mm512_mask3_fmadd_ps(mj, inv, accW, valid);
+
+                kahanAdd16(sumX, compX, _mm512_mul_ps(s, dx));
+                kahanAdd16(sumY, compY, _mm512_mul_ps(s, dy));
+                kahanAdd16(sumZ, compZ, _mm512_mul_ps(s, dz));
+            }
+
+            float sum[3][MIXED_LANES], comp[3][MIXED_LANES];
+            _mm512_storeu_ps(sum[0], sumX); _mm512_storeu_ps(comp[0], compX);
+            _mm512_storeu_ps(sum[1], sumY); _mm512_storeu_ps(comp[1], compY);
+            _mm512_storeu_ps(sum[2], sumZ); _mm512_storeu_ps(comp[2], compZ);
+            out.ax[i] += kahanFold(sum[0], comp[0], 16);
+            out.ay[i] += kahanFold(sum[1], comp[1], 16);
+            out.az[i] += kahanFold(sum[2], comp[2], 16);
+            if (out.potential) *out.potential -= 0.5 * double(in.G) * in.mass[i] * hsum512(accW);
+        }
+    }
+#endif
+}
+
+void directGravityTile(const GravityInput& in, GravityOutput& out,
+                       size_t iBegin, size_t iEnd, size_t jBegin, size_t jEnd, SimdLevel level) {
+#if PHOTON_X86
+    switch (level) {
+        case SimdLevel::AVX512: tileAVX512(in, out, iBegin, iEnd, jBegin, jEnd); return;
+        case SimdLevel::AVX2: tileAVX2(in, out, iBegin, iEnd, jBegin, jEnd); return;
+        case SimdLevel::Scalar: break;
+    }
+#endif
+    (void)level;
+    tileScalar(in, out, iBegin, iEnd, jBegin, jEnd);
+}
+
+void directGravityRows(const GravityInput& in, GravityOutput& out, size_t rowBegin, size_t rowEnd, SimdLevel level) {
+    const size_t n = in.count;
+    for (size_t iBlock = rowBegin; iBlock < rowEnd; iBlock += GRAVITY_TILE) {
+        const size_t iEnd = std::min(iBlock + GRAVITY_TILE, rowEnd);
+        for (size_t jBlock = iBlock; jBlock < n; jBlock += GRAVITY_TILE) {
+            directGravityTile(in, out, iBlock, iEnd, jBlock, std::min(jBlock + GRAVITY_TILE, n), level);
+        }
+    }
+}
+
+void directGravity(const GravityInput& in, GravityOutput& out, SimdLevel level) {
+    directGravityRows(in, out, 0, in.count, level);
+}
+
+void directGravityMixedRows(const MixedGravityInput& in, GravityOutput& out, size_t rowBegin, size_t rowEnd, SimdLevel level) {
+#if PHOTON_X86
+    switch (level) {
+        case SimdLevel::AVX512: mixedRowsAVX512(in, out, rowBegin, rowEnd); return;
+        case SimdLevel::AVX2: mixedRowsAVX2(in, out, rowBegin, rowEnd); return;
+        case SimdLevel::Scalar: break;
+    }
+#endif
+    (void)level;
+    mixedRowsScalar(in, out, rowBegin, rowEnd);
+}
+
+void batchedGravity(const BatchedGravityInput& in, BatchedGravityOutput& out, size_t laneBegin, size_t laneEnd, SimdLevel level) {
+#if PHOTON_X86
+    switch (level) {
+        case SimdLevel::AVX512: batchedAVX512(in, out, laneBegin, laneEnd); return;
+        case SimdLevel::AVX2: batchedAVX2(in, out, laneBegin, laneEnd); return;
+        case SimdLevel::Scalar: break;
+    }
+#endif
+    (void)level;
+    batchedScalar(in, out, laneBegin, laneEnd);
+}
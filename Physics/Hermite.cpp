@@ -0,0 +1,173 @@
+#include "Hermite.hpp"
+
+#include "BodyStore.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    inline double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+uint32_t Hermite::levelFor(double step, float dt) const {
+    if (!(step < dt)) return 0; // also catches NaN from a body with no neighbours
+    double level = std::ceil(std::log2(dt / step));
+    return static_cast<uint32_t>(std::min<double>(level, MAX_LEVEL));
+}
+
+void Hermite::initialize(const BodyStore& bodies, float dt, float G, ThreadPool& pool) {
+    const size_t n = bodies.size();
+    m_pos.resize(n);
+    m_vel.resize(n);
+    m_acc.resize(n);
+    m_jerk.resize(n);
+    m_predPos.resize(n);
+    m_predVel.resize(n);
+    m_level.resize(n);
+    m_time.resize(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        m_pos[i] = bodies.posD(i);
+        m_vel[i] = bodies.velD(i);
+        m_predPos[i] = m_pos[i];
+        m_predVel[i] = m_vel[i];
+    }
+
+    m_active.resize(n);
+    for (size_t i = 0; i < n; ++i) m_active[i] = static_cast<uint32_t>(i);
+    evaluate(G, pool);
+
+    for (size_t i = 0; i < n; ++i) {
+        m_acc[i] = m_newAcc[i];
+        m_jerk[i] = m_newJerk[i];
+        // without higher derivatives yet, a / j is the only time scale we have
+        double a = glm::length(m_acc[i]);
+        double j = glm::length(m_jerk[i]);
+        m_level[i] = static_cast<uint8_t>(levelFor(j > 0.0 ? m_etaStart * a / j : dt, dt));
+    }
+    m_initialized = true;
+}
+
+void Hermite::evaluate(float G, ThreadPool& pool) {
+    const size_t n = m_predPos.size();
+    m_newAcc.resize(m_active.size());
+    m_newJerk.resize(m_active.size());
+
+    pool.parallelFor(m_active.size(), 8, [&](size_t begin, size_t end, size_t) {
+        for (size_t k = begin; k < end; ++k) {
+            const uint32_t i = m_active[k];
+            const glm::dvec3 pi = m_predPos[i];
+            const glm::dvec3 vi = m_predVel[i];
+            glm::dvec3 acc(0.0);
+            glm::dvec3 jerk(0.0);
+            for (size_t j = 0; j < n; ++j) {
+                glm::dvec3 dr = m_predPos[j] - pi;
+                double r2 = glm::dot(dr, dr);
+                if (r2 == 0.0) continue; // also skips i itself
+                glm::dvec3 dv = m_predVel[j] - vi;
+                double invR2 = 1.0 / r2;
+                double f = double(G) * m_mass[j] * invR2 * std::sqrt(invR2);
+                acc += f * dr;
+                jerk += f * (dv - (3.0 * glm::dot(dr, dv) * invR2) * dr);
+            }
+            m_newAcc[k] = acc;
+            m_newJerk[k] = jerk;
+        }
+    });
+    m_stats.pairEvaluations += m_active.size() * (n - 1);
+}
+
+void Hermite::advance(BodyStore& bodies, float dt, float G, bool reuse, ThreadPool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    m_stats = HermiteStats{};
+    const size_t n = bodies.size();
+    if (n == 0) return;
+
+    m_mass.assign(bodies.mass.begin(), bodies.mass.end());
+    if (!reuse || !m_initialized || m_pos.size() != n) initialize(bodies, dt, G, pool);
+    std::fill(m_time.begin(), m_time.end(), 0);
+
+    const uint64_t frameEnd = uint64_t(1) << MAX_LEVEL;
+    const double tick = double(dt) / double(frameEnd);
+    double forceMs = 0.0;
+
+    uint64_t now = 0;
+    while (now < frameEnd) {
+        uint64_t next = frameEnd;
+        for (size_t i = 0; i < n; ++i) {
+            next = std::min(next, m_time[i] + (uint64_t(1) << (MAX_LEVEL - m_level[i])));
+        }
+        m_active.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (m_time[i] + (uint64_t(1) << (MAX_LEVEL - m_level[i])) == next) m_active.push_back(static_cast<uint32_t>(i));
+        }
+
+        // predict everyone to the block time
+        pool.parallelFor(n, 4096, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; ++i) {
+                const double h = double(next - m_time[i]) * tick;
+                m_predPos[i] = m_pos[i] + h * (m_vel[i] + (0.5 * h) * (m_acc[i] + (h / 3.0) * m_jerk[i]));
+                m_predVel[i] = m_vel[i] + h * (m_acc[i] + (0.5 * h) * m_jerk[i]);
+            }
+        });
+
+        auto forceStart = std::chrono::steady_clock::now();
+        evaluate(G, pool);
+        forceMs += elapsedMs(forceStart);
+
+        // correct the active block and pick its next step
+        pool.parallelFor(m_active.size(), 256, [&](size_t begin, size_t end, size_t) {
+            for (size_t k = begin; k < end; ++k) {
+                const uint32_t i = m_active[k];
+                const double h = double(next - m_time[i]) * tick;
+                const glm::dvec3 a0 = m_acc[i], a1 = m_newAcc[k];
+                const glm::dvec3 j0 = m_jerk[i], j1 = m_newJerk[k];
+
+                // second and third derivatives of a from the Hermite interpolant
+                const glm::dvec3 a2 = (-6.0 * (a0 - a1) - h * (4.0 * j0 + 2.0 * j1)) / (h * h);
+                const glm::dvec3 a3 = (12.0 * (a0 - a1) + 6.0 * h * (j0 + j1)) / (h * h * h);
+                const double h2 = h * h;
+                m_pos[i] = m_predPos[i] + (h2 * h2 / 24.0) * a2 + (h2 * h2 * h / 120.0) * a3;
+                m_vel[i] = m_predVel[i] + (h2 * h / 6.0) * a2 + (h2 * h2 / 24.0) * a3;
+                m_acc[i] = a1;
+                m_jerk[i] = j1;
+                m_time[i] = next;
+
+                // Aarseth criterion with a2 moved to the end of the step
+                const glm::dvec3 a2End = a2 + h * a3;
+                const double la = glm::length(a1), lj = glm::length(j1);
+                const double l2 = glm::length(a2End), l3 = glm::length(a3);
+                const double step = std::sqrt(m_eta * (la * l2 + lj * lj) / (lj * l3 + l2 * l2));
+
+                uint32_t level = levelFor(step, dt);
+                if (level < m_level[i]) {
+                    // coarsen one level at a time, and only where the coarser block lines up
+                    const uint32_t coarser = m_level[i] - 1u;
+                    level = next % (uint64_t(1) << (MAX_LEVEL - coarser)) == 0 ? coarser : m_level[i];
+                }
+                m_level[i] = static_cast<uint8_t>(level);
+            }
+        });
+
+        m_stats.substeps++;
+        m_stats.activeBodies += m_active.size();
+        now = next;
+    }
+
+    m_stats.levelCounts.assign(MAX_LEVEL + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        bodies.setPosD(i, m_pos[i]);
+        bodies.setVelD(i, m_vel[i]);
+        bodies.ax[i] = float(m_acc[i].x);
+        bodies.ay[i] = float(m_acc[i].y);
+        bodies.az[i] = float(m_acc[i].z);
+        m_stats.levelCounts[m_level[i]]++;
+        m_stats.maxLevel = std::max<uint32_t>(m_stats.maxLevel, m_level[i]);
+    }
+    m_stats.forceMs = forceMs;
+    m_stats.totalMs = elapsedMs(start);
+}
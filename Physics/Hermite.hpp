@@ -0,0 +1,65 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+struct BodyStore;
+class ThreadPool;
+
+struct HermiteStats {
+    size_t substeps = 0;        // block steps taken during the last advance
+    size_t activeBodies = 0;    // sum of the active block sizes, i.e. bodies that got forces
+    size_t pairEvaluations = 0;
+    uint32_t maxLevel = 0;      // deepest level in use, the smallest step is dt / 2^maxLevel
+    std::vector<size_t> levelCounts;
+
+    double forceMs = 0.0;
+    double totalMs = 0.0;
+};
+
+// Fourth order Hermite predictor-corrector with individual block timesteps. A body on level k steps
+// dt / 2^k; on every substep only the bodies due at that time (the active block) get new accelerations
+// and jerks, everyone else is just predicted. All bodies are synchronised again at the end of advance.
+// Forces are direct sums, the gravity solver setting does not apply.
+class Hermite {
+private:
+    // substep times are integers in units of dt / 2^MAX_LEVEL
+    static constexpr uint32_t MAX_LEVEL = 24;
+
+    std::vector<glm::dvec3> m_pos, m_vel, m_acc, m_jerk;
+    std::vector<glm::dvec3> m_predPos, m_predVel;
+    std::vector<float> m_mass;
+    std::vector<uint8_t> m_level;
+    std::vector<uint64_t> m_time; // last time each body was corrected
+    std::vector<uint32_t> m_active;
+    std::vector<glm::dvec3> m_newAcc, m_newJerk;
+
+    double m_eta = 0.02;        // accuracy parameter of the Aarseth step criterion
+    double m_etaStart = 0.01;   // for the first step, which only has a and j
+    bool m_initialized = false;
+
+    HermiteStats m_stats;
+
+public:
+    Hermite() = default;
+    ~Hermite() = default;
+
+    // Advances all bodies by dt. With reuse the accelerations, jerks and levels from the previous call are
+    // kept, otherwise they are recomputed from the store (after edits, collisions or a change in body count).
+    void advance(BodyStore& bodies, float dt, float G, bool reuse, ThreadPool& pool);
+    // Drops the kept state, the next advance starts from the store even with reuse
+    void reset() { m_initialized = false; }
+
+    void setEta(double eta) { m_eta = eta; }
+    double getEta() const { return m_eta; }
+
+    const HermiteStats& getStats() const { return m_stats; }
+
+private:
+    void initialize(const BodyStore& bodies, float dt, float G, ThreadPool& pool);
+    // acceleration and jerk on the active bodies from every body at its predicted state
+    void evaluate(float G, ThreadPool& pool);
+    uint32_t levelFor(double step, float dt) const;
+};
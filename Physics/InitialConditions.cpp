@@ -0,0 +1,309 @@
+#include "InitialConditions.hpp"
+
+#include "CounterRng.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    constexpr double PI = 3.14159265358979323846;
+    constexpr size_t GENERATOR_GRAIN = 2048;
+
+    glm::dvec3 isotropic(CounterRng& rng) {
+        const double z = rng.uniform(-1.0, 1.0);
+        const double phi = 2.0 * PI * rng.uniform();
+        const double s = std::sqrt(std::max(0.0, 1.0 - z * z));
+        return {s * std::cos(phi), s * std::sin(phi), z};
+    }
+
+    // Orthonormal e1, e2 spanning the plane with normal n
+    void planeBasis(const glm::vec3& normal, glm::dvec3& e1, glm::dvec3& e2, glm::dvec3& n) {
+        n = glm::normalize(glm::dvec3(normal));
+        const glm::dvec3 helper = std::abs(n.x) < 0.9 ? glm::dvec3(1.0, 0.0, 0.0) : glm::dvec3(0.0, 1.0, 0.0);
+        e1 = glm::normalize(glm::cross(helper, n));
+        e2 = glm::cross(n, e1);
+    }
+
+    // Moves [first, end) so its centre of mass sits at the placement and moves with it. The sums run in index
+    // order, so they don't depend on the thread count either.
+    void place(BodyBatch& batch, size_t first, const SystemPlacement& placement, bool recenter) {
+        glm::dvec3 com(0.0), comVel(0.0);
+        if (recenter) {
+            double mass = 0.0;
+            for (size_t i = first; i < batch.size(); ++i) {
+                com += double(batch.mass[i]) * glm::dvec3(batch.pos[i]);
+                comVel += double(batch.mass[i]) * glm::dvec3(batch.vel[i]);
+                mass += batch.mass[i];
+            }
+            if (mass > 0.0) {
+                com = com / mass;
+                comVel = comVel / mass;
+            }
+        }
+        const glm::vec3 shift = placement.center - glm::vec3(com);
+        const glm::vec3 boost = placement.velocity - glm::vec3(comVel);
+        for (size_t i = first; i < batch.size(); ++i) {
+            batch.pos[i] += shift;
+            batch.vel[i] += boost;
+        }
+    }
+
+    // Central body of the Keplerian generators at index 0
+    void addCentralBody(BodyBatch& batch, float mass, float radius) {
+        batch.pos[0] = glm::vec3(0.0f);
+        batch.vel[0] = glm::vec3(0.0f);
+        batch.mass[0] = mass;
+        batch.radius[0] = radius;
+    }
+
+    // Dimensionless King model: psi(r) in units of sigma^2, r in units of r0, and the enclosed mass
+    // mu(r) = -r^2 dpsi/dr, from integrating Poisson's equation outwards until psi reaches 0 at the tidal radius
+    struct KingProfile {
+        std::vector<double> r, psi, mu;
+    };
+
+    double kingDensity(double psi) {
+        if (psi <= 0.0) return 0.0;
+        return std::exp(psi) * std::erf(std::sqrt(psi)) - std::sqrt(4.0 * psi / PI) * (1.0 + 2.0 * psi / 3.0);
+    }
+
+    KingProfile solveKing(double W0) {
+        KingProfile profile;
+        const double rho0 = kingDensity(W0);
+        // psi'' = -2 psi' / r - 9 rho(psi) / rho(W0)
+        auto derivative = [&](double r, double psi, double dpsi, double& ddpsi) {
+            ddpsi = -2.0 * dpsi / r - 9.0 * kingDensity(psi) / rho0;
+        };
+
+        // series solution near the centre
+        double r = 1e-4;
+        double psi = W0 - 1.5 * r * r;
+        double dpsi = -3.0 * r;
+        profile.r.push_back(0.0);
+        profile.psi.push_back(W0);
+        profile.mu.push_back(0.0);
+
+        while (psi > 0.0 && r < 1e4) {
+            // RK4 with a step proportional to r, the profile spans several decades
+            const double h = 0.002 * std::max(r, 0.01);
+            double k1, k2, k3, k4;
+            derivative(r, psi, dpsi, k1);
+            derivative(r + 0.5 * h, psi + 0.5 * h * dpsi, dpsi + 0.5 * h * k1, k2);
+            derivative(r + 0.5 * h, psi + 0.5 * h * (dpsi + 0.5 * h * k1), dpsi + 0.5 * h * k2, k3);
+            derivative(r + h, psi + h * (dpsi + 0.5 * h * k2), dpsi + h * k3, k4);
+            const double nextPsi = psi + h * (dpsi + h * (k1 + k2 + k3) / 6.0);
+            const double nextDpsi = dpsi + h * (k1 + 2.0 * k2 + 2.0 * k3 + k4) / 6.0;
+
+            if (nextPsi <= 0.0) {
+                // tidal radius, interpolated
+                const double t = psi / (psi - nextPsi);
+                const double rt = r + t * h;
+                const double dpsiT = dpsi + t * (nextDpsi - dpsi);
+                profile.r.push_back(rt);
+                profile.psi.push_back(0.0);
+                profile.mu.push_back(-rt * rt * dpsiT);
+                break;
+            }
+            r += h;
+            psi = nextPsi;
+            dpsi = nextDpsi;
+            profile.r.push_back(r);
+            profile.psi.push_back(psi);
+            profile.mu.push_back(-r * r * dpsi);
+        }
+        return profile;
+    }
+
+    // Speed in units of sigma from the King distribution at potential psi: p(s) ~ s^2 (exp(psi - s^2 / 2) - 1)
+    double kingSpeed(double psi, CounterRng& rng) {
+        if (psi <= 0.0) return 0.0;
+        const double sMax = std::sqrt(2.0 * psi);
+        auto density = [psi](double s) { return s * s * (std::exp(psi - 0.5 * s * s) - 1.0); };
+        double peak = 0.0;
+        for (int k = 1; k < 32; ++k) peak = std::max(peak, density(sMax * k / 32.0));
+        peak *= 1.1;
+        for (;;) {
+            const double s = sMax * rng.uniform();
+            if (rng.uniform() * peak <= density(s)) return s;
+        }
+    }
+
+    // Inverse CDF of a power law dN/dx ~ x^-slope on [lo, hi]
+    double powerLaw(double u, double lo, double hi, double slope) {
+        if (std::abs(slope - 1.0) < 1e-6) return lo * std::pow(hi / lo, u);
+        const double e = 1.0 - slope;
+        const double a = std::pow(lo, e), b = std::pow(hi, e);
+        return std::pow(a + u * (b - a), 1.0 / e);
+    }
+}
+
+void BodyBatch::append(const BodyBatch& other) {
+    pos.insert(pos.end(), other.pos.begin(), other.pos.end());
+    vel.insert(vel.end(), other.vel.begin(), other.vel.end());
+    mass.insert(mass.end(), other.mass.begin(), other.mass.end());
+    radius.insert(radius.end(), other.radius.begin(), other.radius.end());
+}
+
+BodyBatch generatePlummer(const PlummerParams& params, float G, ThreadPool& pool) {
+    BodyBatch batch;
+    batch.resize(params.count);
+    if (params.count == 0) return batch;
+
+    const double a = params.scaleRadius;
+    const double M = params.totalMass;
+    const float m = static_cast<float>(M / params.count);
+
+    pool.parallelFor(params.count, GENERATOR_GRAIN, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            CounterRng rng(params.placement.seed, i);
+
+            // radius from the inverted cumulative mass M(r) = M r^3 / (r^2 + a^2)^3/2
+            double r;
+            do {
+                r = a / std::sqrt(std::pow(rng.uniformOpen(), -2.0 / 3.0) - 1.0);
+            } while (r > params.maxRadius * a);
+
+            // speed as a fraction q of the local escape speed, g(q) = q^2 (1 - q^2)^7/2 peaks below 0.1
+            double q, g;
+            do {
+                q = rng.uniform();
+                g = 0.1 * rng.uniform();
+            } while (g > q * q * std::pow(1.0 - q * q, 3.5));
+            const double escape = std::sqrt(2.0 * G * M / std::sqrt(r * r + a * a));
+
+            batch.pos[i] = glm::vec3(r * isotropic(rng));
+            batch.vel[i] = glm::vec3(q * escape * isotropic(rng));
+            batch.mass[i] = m;
+            batch.radius[i] = params.placement.bodyRadius;
+        }
+    });
+    place(batch, 0, params.placement, true);
+    return batch;
+}
+
+BodyBatch generateKing(const KingParams& params, float G, ThreadPool& pool) {
+    BodyBatch batch;
+    batch.resize(params.count);
+    if (params.count == 0) return batch;
+
+    const KingProfile profile = solveKing(std::clamp<double>(params.W0, 0.5, 15.0));
+    const double muTidal = profile.mu.back();
+    const double r0 = params.coreRadius;
+    // total mass fixes the velocity scale: G M = sigma^2 r0 mu(r_t)
+    const double sigma = std::sqrt(G * double(params.totalMass) / (r0 * muTidal));
+    const float m = static_cast<float>(double(params.totalMass) / params.count);
+
+    pool.parallelFor(params.count, GENERATOR_GRAIN, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            CounterRng rng(params.placement.seed, i);
+
+            // radius by inverting the tabulated enclosed mass
+            const double target = rng.uniform() * muTidal;
+            const size_t k = std::clamp<size_t>(
+                std::lower_bound(profile.mu.begin(), profile.mu.end(), target) - profile.mu.begin(), 1, profile.mu.size() - 1);
+            const double t = (target - profile.mu[k - 1]) / std::max(profile.mu[k] - profile.mu[k - 1], 1e-300);
+            const double r = profile.r[k - 1] + t * (profile.r[k] - profile.r[k - 1]);
+            const double psi = profile.psi[k - 1] + t * (profile.psi[k] - profile.psi[k - 1]);
+
+            batch.pos[i] = glm::vec3(r * r0 * isotropic(rng));
+            batch.vel[i] = glm::vec3(kingSpeed(psi, rng) * sigma * isotropic(rng));
+            batch.mass[i] = m;
+            batch.radius[i] = params.placement.bodyRadius;
+        }
+    });
+    place(batch, 0, params.placement, true);
+    return batch;
+}
+
+BodyBatch generateKeplerianDisk(const KeplerianDiskParams& params, float G, ThreadPool& pool) {
+    const size_t first = params.addCentralBody ? 1 : 0;
+    BodyBatch batch;
+    batch.resize(first + params.count);
+    if (params.addCentralBody) addCentralBody(batch, params.centralMass, 0.1f * params.innerRadius);
+
+    glm::dvec3 e1, e2, n;
+    planeBasis(params.normal, e1, e2, n);
+    const float m = params.count ? params.diskMass / params.count : 0.0f;
+
+    pool.parallelFor(params.count, GENERATOR_GRAIN, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            CounterRng rng(params.placement.seed, i);
+
+            // surface density r^-p makes the radial density r^(1-p)
+            const double u = rng.uniform();
+            const double r = powerLaw(u, params.innerRadius, params.outerRadius, params.densityIndex - 1.0);
+            const double phi = 2.0 * PI * rng.uniform();
+            const double z = params.aspectRatio * r * rng.normal();
+
+            // the disk mass inside r pulls as if it sat in the centre, fine for light disks
+            const double enclosed = params.centralMass + params.diskMass * u;
+            const double vc = std::sqrt(G * enclosed / r);
+            const glm::dvec3 radial = std::cos(phi) * e1 + std::sin(phi) * e2;
+            const glm::dvec3 tangential = -std::sin(phi) * e1 + std::cos(phi) * e2;
+            const glm::dvec3 kick = params.dispersion * vc * (rng.normal() * radial + rng.normal() * tangential + rng.normal() * n);
+
+            batch.pos[first + i] = glm::vec3(r * radial + z * n);
+            batch.vel[first + i] = glm::vec3(vc * tangential + kick);
+            batch.mass[first + i] = m;
+            batch.radius[first + i] = params.placement.bodyRadius;
+        }
+    });
+    place(batch, 0, params.placement, false);
+    return batch;
+}
+
+BodyBatch generateAsteroidBelt(const AsteroidBeltParams& params, float G, ThreadPool& pool) {
+    BodyBatch batch;
+    batch.resize(1 + params.count);
+    addCentralBody(batch, params.centralMass, 0.1f * params.innerRadius);
+
+    glm::dvec3 e1, e2, n;
+    planeBasis(params.normal, e1, e2, n);
+    const double mu = G * double(params.centralMass);
+
+    pool.parallelFor(params.count, GENERATOR_GRAIN, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            CounterRng rng(params.placement.seed, i);
+
+            const double a = rng.uniform(params.innerRadius, params.outerRadius);
+            const double e = params.maxEccentricity * rng.uniform();
+            const double inc = params.maxInclination * rng.uniform();
+            const double node = 2.0 * PI * rng.uniform();
+            const double peri = 2.0 * PI * rng.uniform();
+            const double meanAnomaly = 2.0 * PI * rng.uniform();
+            const double m = powerLaw(rng.uniform(), params.minMass, params.maxMass, params.massSlope);
+
+            // Kepler's equation by Newton iteration, converges in a few steps for e < 0.9
+            double E = meanAnomaly + e * std::sin(meanAnomaly);
+            for (int k = 0; k < 8; ++k) E -= (E - e * std::sin(E) - meanAnomaly) / (1.0 - e * std::cos(E));
+
+            // position and velocity in the orbital plane, x towards periapsis
+            const double cosE = std::cos(E), sinE = std::sin(E);
+            const double b = std::sqrt(1.0 - e * e);
+            const double meanMotion = std::sqrt(mu / (a * a * a));
+            const double rate = meanMotion / (1.0 - e * cosE);
+            const double x = a * (cosE - e), y = a * b * sinE;
+            const double vx = -a * rate * sinE, vy = a * rate * b * cosE;
+
+            // rotate by argument of periapsis, inclination and ascending node into the belt frame
+            auto orient = [&](double px, double py) {
+                const double cw = std::cos(peri), sw = std::sin(peri);
+                const double ci = std::cos(inc), si = std::sin(inc);
+                const double cn = std::cos(node), sn = std::sin(node);
+                const double qx = cw * px - sw * py, qy = sw * px + cw * py;
+                const double ox = cn * qx - sn * ci * qy;
+                const double oy = sn * qx + cn * ci * qy;
+                const double oz = si * qy;
+                return ox * e1 + oy * e2 + oz * n;
+            };
+
+            batch.pos[1 + i] = glm::vec3(orient(x, y));
+            batch.vel[1 + i] = glm::vec3(orient(vx, vy));
+            batch.mass[1 + i] = static_cast<float>(m);
+            batch.radius[1 + i] = params.placement.bodyRadius * static_cast<float>(std::cbrt(m / params.minMass));
+        }
+    });
+    place(batch, 0, params.placement, false);
+    return batch;
+}
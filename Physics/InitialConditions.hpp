@@ -0,0 +1,83 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// Bodies ready for Physics::addPlanets, one entry per body in every array
+struct BodyBatch {
+    std::vector<glm::vec3> pos, vel;
+    std::vector<float> mass, radius;
+
+    size_t size() const { return pos.size(); }
+    void resize(size_t n) { pos.resize(n); vel.resize(n); mass.resize(n); radius.resize(n); }
+    void append(const BodyBatch& other);
+};
+
+// Common to every generator: where the system sits, how it moves and how big its bodies are
+struct SystemPlacement {
+    glm::vec3 center{0.0f};
+    glm::vec3 velocity{0.0f};
+    float bodyRadius = 0.01f;
+    uint64_t seed = 1;
+};
+
+// Plummer sphere in virial equilibrium (Aarseth, Henon & Wielen 1974), equal masses
+struct PlummerParams {
+    size_t count = 10000;
+    float totalMass = 1000.0f;
+    float scaleRadius = 10.0f;
+    float maxRadius = 10.0f; // in scale radii, the few bodies drawn further out are redrawn
+    SystemPlacement placement;
+};
+
+// Lowered isothermal King (1966) model, equal masses. W0 sets the concentration, 3 is loose and 9 is dense.
+struct KingParams {
+    size_t count = 10000;
+    float totalMass = 1000.0f;
+    float coreRadius = 5.0f; // King radius r0
+    float W0 = 6.0f;
+    SystemPlacement placement;
+};
+
+// Thin disk of test particles on circular orbits around a central mass, surface density ~ r^-densityIndex
+struct KeplerianDiskParams {
+    size_t count = 10000;
+    float centralMass = 10000.0f;
+    float diskMass = 100.0f;
+    float innerRadius = 5.0f;
+    float outerRadius = 50.0f;
+    float densityIndex = 1.0f;
+    float aspectRatio = 0.02f;    // scale height over radius
+    float dispersion = 0.01f;     // random velocity over circular velocity
+    bool addCentralBody = true;   // body 0 is the central mass
+    glm::vec3 normal{0.0f, 1.0f, 0.0f};
+    SystemPlacement placement;
+};
+
+// Belt of small bodies on Keplerian orbits with uniform semi-major axes, eccentricities and inclinations around
+// a central mass, which is body 0. Masses follow dN/dm ~ m^-massSlope between minMass and maxMass, radii scale
+// with the cube root of mass.
+struct AsteroidBeltParams {
+    size_t count = 10000;
+    float centralMass = 10000.0f;
+    float innerRadius = 30.0f;
+    float outerRadius = 40.0f;
+    float maxEccentricity = 0.15f;
+    float maxInclination = 0.1f; // radians
+    float minMass = 1e-4f;
+    float maxMass = 1e-2f;
+    float massSlope = 2.0f;
+    glm::vec3 normal{0.0f, 1.0f, 0.0f};
+    SystemPlacement placement;
+};
+
+// Generators run on the pool. Body i only ever draws from random stream i, so the output is the same for any
+// thread count.
+BodyBatch generatePlummer(const PlummerParams& params, float G, ThreadPool& pool);
+BodyBatch generateKing(const KingParams& params, float G, ThreadPool& pool);
+BodyBatch generateKeplerianDisk(const KeplerianDiskParams& params, float G, ThreadPool& pool);
+BodyBatch generateAsteroidBelt(const AsteroidBeltParams& params, float G, ThreadPool& pool);
@@ -0,0 +1,126 @@
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#ifndef _WIN32
+namespace {
+    void advise(const std::byte* data, size_t mapped, size_t offset, size_t size, int advice) {
+        if (!data || offset >= mapped) return;
+        // madvise wants a page aligned start
+        const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t begin = offset / page * page;
+        madvise(const_cast<std::byte*>(data) + begin, std::min(size + (offset - begin), mapped - begin), advice);
+    }
+}
+#endif
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open " + path);
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw std::runtime_error("Failed to read the size of " + path);
+    }
+    m_file = file;
+    m_size = static_cast<size_t>(size.QuadPart);
+    if (m_size == 0) return;
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) {
+        close();
+        throw std::runtime_error("Failed to map " + path);
+    }
+    m_data = static_cast<const std::byte*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data) {
+        close();
+        throw std::runtime_error("Failed to map " + path);
+    }
+#else
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0) throw std::runtime_error("Failed to open " + path);
+    struct stat info;
+    if (fstat(m_fd, &info) != 0) {
+        close();
+        throw std::runtime_error("Failed to read the size of " + path);
+    }
+    m_size = static_cast<size_t>(info.st_size);
+    if (m_size == 0) return;
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+        close();
+        throw std::runtime_error("Failed to map " + path);
+    }
+    m_data = static_cast<const std::byte*>(data);
+#endif
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this == &other) return *this;
+    close();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+    m_file = std::exchange(other.m_file, nullptr);
+    m_mapping = std::exchange(other.m_mapping, nullptr);
+#else
+    m_fd = std::exchange(other.m_fd, -1);
+#endif
+    return *this;
+}
+
+void MappedFile::willNeed(size_t offset, size_t size) const {
+#ifndef _WIN32
+    advise(m_data, m_size, offset, size, MADV_WILLNEED);
+#else
+    (void)offset;
+    (void)size;
+#endif
+}
+
+void MappedFile::sequential(size_t offset, size_t size) const {
+#ifndef _WIN32
+    advise(m_data, m_size, offset, size, MADV_SEQUENTIAL);
+#else
+    (void)offset;
+    (void)size;
+#endif
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapping) CloseHandle(m_mapping);
+    if (m_file) CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    if (m_data) munmap(const_cast<std::byte*>(m_data), m_size);
+    if (m_fd >= 0) ::close(m_fd);
+    m_fd = -1;
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
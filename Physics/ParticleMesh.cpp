@@ -0,0 +1,410 @@
+#include "ParticleMesh.hpp"
+
+#include "BodyStore.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    constexpr double PI = 3.14159265358979323846;
+    constexpr uint32_t SHORT_RANGE_TABLE = 1024;
+
+    inline double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    inline uint32_t wrapIndex(int64_t i, uint32_t n) {
+        int64_t m = i % int64_t(n);
+        return static_cast<uint32_t>(m < 0 ? m + n : m);
+    }
+
+    // cloud-in-cell stencil of one body: the 8 surrounding grid points and their weights
+    struct CicStencil {
+        uint32_t lo[3];
+        uint32_t hi[3];
+        float w[3]; // weight of the hi side per axis
+    };
+
+    inline CicStencil cicStencil(const glm::vec3& p, const glm::vec3& boxMin, float invCell, uint32_t n) {
+        CicStencil s;
+        for (int axis = 0; axis < 3; ++axis) {
+            // grid points sit at cell centers
+            float u = (p[axis] - boxMin[axis]) * invCell - 0.5f;
+            float base = std::floor(u);
+            s.w[axis] = u - base;
+            s.lo[axis] = wrapIndex(static_cast<int64_t>(base), n);
+            s.hi[axis] = s.lo[axis] + 1 == n ? 0 : s.lo[axis] + 1;
+        }
+        return s;
+    }
+}
+
+void ParticleMesh::setGridSize(uint32_t n) {
+    uint32_t size = MIN_GRID_SIZE;
+    while (size < n && size < MAX_GRID_SIZE) size <<= 1;
+    m_gridSize = size;
+}
+
+void ParticleMesh::fitBox(const BodyStore& bodies) {
+    glm::vec3 lo = bodies.pos(0), hi = bodies.pos(0);
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        lo = glm::min(lo, bodies.pos(i));
+        hi = glm::max(hi, bodies.pos(i));
+    }
+    glm::vec3 extent = hi - lo;
+    // room to move before bodies start wrapping
+    m_boxSize = std::max(extent.x, std::max(extent.y, extent.z)) * 1.2f + 1e-3f;
+    m_boxMin = 0.5f * (lo + hi) - glm::vec3(0.5f * m_boxSize);
+}
+
+void ParticleMesh::buildFFTTables() {
+    const uint32_t n = m_gridSize;
+    if (m_bitReverse.size() == n) return;
+
+    m_twiddles.resize(n / 2);
+    for (uint32_t k = 0; k < n / 2; ++k) {
+        m_twiddles[k] = std::polar(1.0, -2.0 * PI * k / n);
+    }
+    uint32_t bits = 0;
+    while ((1u << bits) < n) bits++;
+    m_bitReverse.resize(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < bits; ++b) r |= ((i >> b) & 1u) << (bits - 1 - b);
+        m_bitReverse[i] = r;
+    }
+}
+
+void ParticleMesh::computeAccelerations(BodyStore& bodies, float G, ThreadPool& pool) {
+    m_stats = ParticleMeshStats{};
+    if (bodies.size() < 2) return;
+    if (m_boxSize <= 0.0f) fitBox(bodies);
+
+    buildFFTTables();
+    const size_t cells = static_cast<size_t>(m_gridSize) * m_gridSize * m_gridSize;
+    m_density.resize(cells);
+    m_spectrum.resize(cells);
+    for (auto& grid : m_gridAcc) grid.resize(cells);
+    m_stats.gridSize = m_gridSize;
+    m_stats.cellSize = m_boxSize / m_gridSize;
+
+    auto start = std::chrono::steady_clock::now();
+    assignMass(bodies, pool);
+    m_stats.assignMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    solvePotential(G, pool);
+    m_stats.fftMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    computeGradient(pool);
+    m_stats.gradientMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    interpolate(bodies, pool);
+    m_stats.interpolateMs = elapsedMs(start);
+
+    if (m_shortRange) {
+        start = std::chrono::steady_clock::now();
+        addShortRange(bodies, G, pool);
+        m_stats.shortRangeMs = elapsedMs(start);
+    }
+}
+
+void ParticleMesh::assignMass(const BodyStore& bodies, ThreadPool& pool) {
+    const uint32_t n = m_gridSize;
+    const size_t cells = m_density.size();
+    const float cell = m_boxSize / n;
+    const float invCell = 1.0f / cell;
+    const float invVolume = invCell * invCell * invCell;
+
+    // Bodies are binned by the z plane of their lower stencil corner into slabs of two planes. A slab's bodies
+    // write to its own planes and the first plane of the next slab, so the even slabs can deposit side by side,
+    // then the odd ones, straight into m_density. The grid size is a power of two of at least 8, the slab count
+    // is even. Memory stays one grid whatever the thread count, and the sums don't depend on it either.
+    const uint32_t slabs = n / 2;
+    const size_t count = bodies.size();
+    m_bodySlab.resize(count);
+    pool.parallelFor(count, 4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            m_bodySlab[i] = cicStencil(bodies.pos(i), m_boxMin, invCell, n).lo[2] / 2;
+        }
+    });
+    m_slabStart.assign(slabs + 1, 0);
+    for (size_t i = 0; i < count; ++i) m_slabStart[m_bodySlab[i] + 1]++;
+    for (uint32_t z = 0; z < slabs; ++z) m_slabStart[z + 1] += m_slabStart[z];
+    m_slabBodies.resize(count);
+    std::vector<uint32_t> cursor(m_slabStart.begin(), m_slabStart.end() - 1);
+    for (size_t i = 0; i < count; ++i) m_slabBodies[cursor[m_bodySlab[i]]++] = static_cast<uint32_t>(i);
+
+    pool.parallelFor(cells, 1 << 14, [&](size_t begin, size_t end, size_t) {
+        std::fill(m_density.begin() + begin, m_density.begin() + end, 0.0f);
+    });
+
+    for (uint32_t parity = 0; parity < 2; ++parity) {
+        pool.run(slabs / 2, [&](size_t task, size_t) {
+            const uint32_t slab = static_cast<uint32_t>(task) * 2 + parity;
+            for (uint32_t k = m_slabStart[slab]; k < m_slabStart[slab + 1]; ++k) {
+                const uint32_t i = m_slabBodies[k];
+                const CicStencil s = cicStencil(bodies.pos(i), m_boxMin, invCell, n);
+                const float rho = bodies.mass[i] * invVolume;
+                for (int c = 0; c < 8; ++c) {
+                    const bool hx = c & 1, hy = c & 2, hz = c & 4;
+                    const float w = (hx ? s.w[0] : 1.0f - s.w[0]) * (hy ? s.w[1] : 1.0f - s.w[1]) * (hz ? s.w[2] : 1.0f - s.w[2]);
+                    m_density[cellIndex(hx ? s.hi[0] : s.lo[0], hy ? s.hi[1] : s.lo[1], hz ? s.hi[2] : s.lo[2])] += rho * w;
+                }
+            }
+        });
+    }
+}
+
+void ParticleMesh::fft3d(bool inverse, ThreadPool& pool) {
+    const uint32_t n = m_gridSize;
+    const size_t lines = static_cast<size_t>(n) * n;
+    const size_t strides[3] = {1, n, static_cast<size_t>(n) * n};
+
+    for (int axis = 0; axis < 3; ++axis) {
+        const size_t stride = strides[axis];
+        pool.parallelFor(lines, 16, [&](size_t begin, size_t end, size_t) {
+            std::vector<std::complex<double>> line(n);
+            for (size_t l = begin; l < end; ++l) {
+                // the two coordinates not on this axis pick the line
+                const size_t a = l % n, b = l / n;
+                size_t first;
+                if (axis == 0) first = (b * n + a) * n;
+                else if (axis == 1) first = b * n * n + a;
+                else first = b * n + a;
+
+                for (uint32_t k = 0; k < n; ++k) line[m_bitReverse[k]] = m_spectrum[first + k * stride];
+
+                // iterative radix-2 butterflies
+                for (uint32_t len = 2; len <= n; len <<= 1) {
+                    const uint32_t half = len / 2;
+                    const uint32_t step = n / len;
+                    for (uint32_t i = 0; i < n; i += len) {
+                        for (uint32_t k = 0; k < half; ++k) {
+                            std::complex<double> w = m_twiddles[k * step];
+                            if (inverse) w = std::conj(w);
+                            std::complex<double> u = line[i + k];
+                            std::complex<double> v = line[i + k + half] * w;
+                            line[i + k] = u + v;
+                            line[i + k + half] = u - v;
+                        }
+                    }
+                }
+
+                for (uint32_t k = 0; k < n; ++k) m_spectrum[first + k * stride] = line[k];
+            }
+        });
+    }
+}
+
+void ParticleMesh::solvePotential(float G, ThreadPool& pool) {
+    const uint32_t n = m_gridSize;
+    const size_t cells = m_density.size();
+    const double cell = double(m_boxSize) / n;
+    const double rs = m_splitScale * cell;
+    const double kUnit = 2.0 * PI / m_boxSize;
+
+    pool.parallelFor(cells, 1 << 14, [&](size_t begin, size_t end, size_t) {
+        for (size_t c = begin; c < end; ++c) m_spectrum[c] = m_density[c];
+    });
+    fft3d(false, pool);
+
+    // phi_k = -4 pi G rho_k / k^2, times the long range filter, divided by the CIC window of assignment and interpolation
+    pool.parallelFor(n, 1, [&](size_t begin, size_t end, size_t) {
+        for (size_t z = begin; z < end; ++z) {
+            for (uint32_t y = 0; y < n; ++y) {
+                for (uint32_t x = 0; x < n; ++x) {
+                    const int32_t fx = x <= n / 2 ? int32_t(x) : int32_t(x) - int32_t(n);
+                    const int32_t fy = y <= n / 2 ? int32_t(y) : int32_t(y) - int32_t(n);
+                    const int32_t fz = z <= n / 2 ? int32_t(z) : int32_t(z) - int32_t(n);
+                    const size_t c = cellIndex(x, y, static_cast<uint32_t>(z));
+                    if (fx == 0 && fy == 0 && fz == 0) {
+                        // the mean density has no force in a periodic box
+                        m_spectrum[c] = 0.0;
+                        continue;
+                    }
+
+                    const double kx = kUnit * fx, ky = kUnit * fy, kz = kUnit * fz;
+                    const double k2 = kx * kx + ky * ky + kz * kz;
+                    double green = -4.0 * PI * G / k2;
+                    if (m_shortRange) green *= std::exp(-k2 * rs * rs);
+
+                    auto sinc = [](double t) { return t == 0.0 ? 1.0 : std::sin(t) / t; };
+                    const double window = sinc(PI * fx / n) * sinc(PI * fy / n) * sinc(PI * fz / n);
+                    const double w2 = window * window;
+                    m_spectrum[c] *= green / (w2 * w2);
+                }
+            }
+        }
+    });
+
+    fft3d(true, pool);
+    const double norm = 1.0 / double(cells);
+    pool.parallelFor(cells, 1 << 14, [&](size_t begin, size_t end, size_t) {
+        for (size_t c = begin; c < end; ++c) m_density[c] = float(m_spectrum[c].real() * norm);
+    });
+}
+
+void ParticleMesh::computeGradient(ThreadPool& pool) {
+    const uint32_t n = m_gridSize;
+    const float invCell = n / m_boxSize;
+    const float* phi = m_density.data();
+
+    // periodic neighbours at offsets -2, -1, +1, +2 of every grid coordinate
+    std::vector<uint32_t> neighbour[4];
+    const int offsets[4] = {-2, -1, 1, 2};
+    for (int o = 0; o < 4; ++o) {
+        neighbour[o].resize(n);
+        for (uint32_t k = 0; k < n; ++k) neighbour[o][k] = wrapIndex(int64_t(k) + offsets[o], n);
+    }
+
+    // a = -grad phi, fourth order central differences
+    pool.parallelFor(n, 1, [&](size_t begin, size_t end, size_t) {
+        for (size_t zi = begin; zi < end; ++zi) {
+            const uint32_t z = static_cast<uint32_t>(zi);
+            for (uint32_t y = 0; y < n; ++y) {
+                for (uint32_t x = 0; x < n; ++x) {
+                    const size_t c = cellIndex(x, y, z);
+                    auto diff = [&](size_t m2, size_t m1, size_t p1, size_t p2) {
+                        return (2.0f / 3.0f) * (phi[p1] - phi[m1]) - (1.0f / 12.0f) * (phi[p2] - phi[m2]);
+                    };
+                    float dx = diff(cellIndex(neighbour[0][x], y, z), cellIndex(neighbour[1][x], y, z),
+                                    cellIndex(neighbour[2][x], y, z), cellIndex(neighbour[3][x], y, z));
+                    float dy = diff(cellIndex(x, neighbour[0][y], z), cellIndex(x, neighbour[1][y], z),
+                                    cellIndex(x, neighbour[2][y], z), cellIndex(x, neighbour[3][y], z));
+                    float dz = diff(cellIndex(x, y, neighbour[0][z]), cellIndex(x, y, neighbour[1][z]),
+                                    cellIndex(x, y, neighbour[2][z]), cellIndex(x, y, neighbour[3][z]));
+                    m_gridAcc[0][c] = -dx * invCell;
+                    m_gridAcc[1][c] = -dy * invCell;
+                    m_gridAcc[2][c] = -dz * invCell;
+                }
+            }
+        }
+    });
+}
+
+void ParticleMesh::interpolate(BodyStore& bodies, ThreadPool& pool) {
+    const uint32_t n = m_gridSize;
+    const float invCell = n / m_boxSize;
+
+    pool.parallelFor(bodies.size(), 1024, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            const CicStencil s = cicStencil(bodies.pos(i), m_boxMin, invCell, n);
+            glm::vec3 acc(0.0f);
+            for (int c = 0; c < 8; ++c) {
+                const bool hx = c & 1, hy = c & 2, hz = c & 4;
+                const float w = (hx ? s.w[0] : 1.0f - s.w[0]) * (hy ? s.w[1] : 1.0f - s.w[1]) * (hz ? s.w[2] : 1.0f - s.w[2]);
+                const size_t cell = cellIndex(hx ? s.hi[0] : s.lo[0], hy ? s.hi[1] : s.lo[1], hz ? s.hi[2] : s.lo[2]);
+                acc += w * glm::vec3(m_gridAcc[0][cell], m_gridAcc[1][cell], m_gridAcc[2][cell]);
+            }
+            bodies.addAcc(i, acc);
+        }
+    });
+}
+
+void ParticleMesh::addShortRange(BodyStore& bodies, float G, ThreadPool& pool) {
+    const size_t count = bodies.size();
+    const float L = m_boxSize;
+    const float rs = m_splitScale * L / m_gridSize;
+    const float cutoff = m_cutoffScale * rs;
+    const float cutoff2 = cutoff * cutoff;
+
+    // chaining mesh with cells at least as wide as the cutoff; below 3 per side the neighbour stencil would wrap onto itself
+    uint32_t m = static_cast<uint32_t>(std::floor(L / cutoff));
+    if (m < 3) m = 1;
+    const float invChain = m / L;
+    auto chainCell = [&](const glm::vec3& p, uint32_t axisCell[3]) {
+        for (int axis = 0; axis < 3; ++axis) {
+            axisCell[axis] = wrapIndex(static_cast<int64_t>(std::floor((p[axis] - m_boxMin[axis]) * invChain)), m);
+        }
+    };
+
+    const size_t chainCells = static_cast<size_t>(m) * m * m;
+    m_chainStart.assign(chainCells + 1, 0);
+    std::vector<uint32_t> cellOf(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t c[3];
+        chainCell(bodies.pos(i), c);
+        cellOf[i] = (c[2] * m + c[1]) * m + c[0];
+        m_chainStart[cellOf[i] + 1]++;
+    }
+    for (size_t c = 0; c < chainCells; ++c) m_chainStart[c + 1] += m_chainStart[c];
+    m_chainBodies.resize(count);
+    std::vector<uint32_t> cursor(m_chainStart.begin(), m_chainStart.end() - 1);
+    for (size_t i = 0; i < count; ++i) m_chainBodies[cursor[cellOf[i]]++] = static_cast<uint32_t>(i);
+
+    // Newtonian force minus what the smoothed mesh already carries: erfc(u) + 2u / sqrt(pi) exp(-u^2) with u = r / 2 r_s,
+    // tabulated over r^2 / cutoff^2 since erfc and exp per pair would dominate the whole solve
+    if (m_shortTable.size() != SHORT_RANGE_TABLE + 2) m_shortTable.resize(SHORT_RANGE_TABLE + 2);
+    for (uint32_t k = 0; k < SHORT_RANGE_TABLE + 2; ++k) {
+        const double r = cutoff * std::sqrt(double(k) / SHORT_RANGE_TABLE);
+        const double u = r / (2.0 * rs);
+        m_shortTable[k] = float(std::erfc(u) + 2.0 * u / std::sqrt(PI) * std::exp(-u * u));
+    }
+    const float tableScale = SHORT_RANGE_TABLE / cutoff2;
+
+    m_threadPairs.assign(pool.getThreadCount(), 0);
+    const int reach = m == 1 ? 0 : 1;
+
+    // one sided: each body sums its own neighbours, so threads never write to the same body
+    pool.parallelFor(count, 256, [&](size_t begin, size_t end, size_t thread) {
+        size_t pairs = 0;
+        for (size_t i = begin; i < end; ++i) {
+            const glm::vec3 pi = bodies.pos(i);
+            uint32_t c[3];
+            chainCell(pi, c);
+            glm::vec3 acc(0.0f);
+
+            for (int dz = -reach; dz <= reach; ++dz)
+            for (int dy = -reach; dy <= reach; ++dy)
+            for (int dx = -reach; dx <= reach; ++dx) {
+                const uint32_t nx = wrapIndex(int64_t(c[0]) + dx, m);
+                const uint32_t ny = wrapIndex(int64_t(c[1]) + dy, m);
+                const uint32_t nz = wrapIndex(int64_t(c[2]) + dz, m);
+                const uint32_t cell = (nz * m + ny) * m + nx;
+                for (uint32_t s = m_chainStart[cell]; s < m_chainStart[cell + 1]; ++s) {
+                    const uint32_t j = m_chainBodies[s];
+                    glm::vec3 d = bodies.pos(j) - pi;
+                    // nearest periodic image
+                    d -= L * glm::vec3(std::round(d.x / L), std::round(d.y / L), std::round(d.z / L));
+                    const float r2 = glm::dot(d, d);
+                    if (r2 == 0.0f || r2 >= cutoff2) continue;
+
+                    const float t = r2 * tableScale;
+                    const uint32_t k = static_cast<uint32_t>(t);
+                    const float factor = m_shortTable[k] + (t - float(k)) * (m_shortTable[k + 1] - m_shortTable[k]);
+                    const float invR = 1.0f / std::sqrt(r2);
+                    acc += (G * bodies.mass[j] * factor * invR * invR * invR) * d;
+                    pairs++;
+                }
+            }
+            bodies.addAcc(i, acc);
+        }
+        m_threadPairs[thread] += pairs;
+    });
+
+    for (size_t pairs : m_threadPairs) m_stats.shortRangePairs += pairs;
+}
+
+bool ParticleMesh::wrapPositions(BodyStore& bodies) const {
+    if (m_boxSize <= 0.0f) return false;
+    bool moved = false;
+    const double L = m_boxSize;
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        glm::dvec3 p = bodies.posD(i);
+        glm::dvec3 wrapped = p;
+        for (int axis = 0; axis < 3; ++axis) {
+            double offset = p[axis] - m_boxMin[axis];
+            if (offset >= 0.0 && offset < L) continue;
+            wrapped[axis] = m_boxMin[axis] + (offset - L * std::floor(offset / L));
+        }
+        if (wrapped == p) continue;
+        bodies.setPosD(i, wrapped);
+        moved = true;
+    }
+    return moved;
+}
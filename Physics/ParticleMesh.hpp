@@ -0,0 +1,95 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+struct BodyStore;
+class ThreadPool;
+
+struct ParticleMeshStats {
+    uint32_t gridSize = 0;
+    float cellSize = 0.0f;
+    size_t shortRangePairs = 0;
+
+    double assignMs = 0.0;      // cloud-in-cell mass assignment
+    double fftMs = 0.0;         // forward transform, Green's function and inverse transform
+    double gradientMs = 0.0;
+    double interpolateMs = 0.0;
+    double shortRangeMs = 0.0;
+};
+
+// Particle-mesh gravity in a periodic cube. Mass goes onto an N^3 grid with cloud-in-cell weights, the
+// Poisson equation is solved with a 3D FFT, and the mesh accelerations are interpolated back with the
+// same weights. With the short range correction on, the mesh only carries the Gaussian-smoothed long
+// range part and pairs closer than a few cells are summed directly with the complementary kernel
+// (the TreePM split of Bagla 2002 / GADGET-2, with a chaining mesh in place of the tree).
+class ParticleMesh {
+private:
+    uint32_t m_gridSize = 64; // power of two
+    glm::vec3 m_boxMin{0.0f};
+    float m_boxSize = 0.0f;   // 0 fits the box around the bodies on the next call
+    bool m_shortRange = true;
+    float m_splitScale = 1.25f; // r_s in cells
+    float m_cutoffScale = 4.5f; // short range cutoff in units of r_s
+
+    std::vector<float> m_density;                 // N^3, also reused for the potential
+    // mass assignment order, bodies grouped by z slab
+    std::vector<uint32_t> m_bodySlab;
+    std::vector<uint32_t> m_slabStart;
+    std::vector<uint32_t> m_slabBodies;
+    std::vector<std::complex<double>> m_spectrum; // N^3
+    std::vector<float> m_gridAcc[3];
+
+    // FFT tables for the current grid size
+    std::vector<std::complex<double>> m_twiddles;
+    std::vector<uint32_t> m_bitReverse;
+
+    // chaining mesh for the short range pairs
+    std::vector<uint32_t> m_chainStart;
+    std::vector<uint32_t> m_chainBodies;
+    std::vector<size_t> m_threadPairs;
+    std::vector<float> m_shortTable; // short range force factor against r^2 / cutoff^2
+
+    ParticleMeshStats m_stats;
+
+public:
+    // setGridSize rounds up to a power of two in this range
+    static constexpr uint32_t MIN_GRID_SIZE = 8;
+    static constexpr uint32_t MAX_GRID_SIZE = 1024;
+
+    ParticleMesh() = default;
+    ~ParticleMesh() = default;
+
+    // Adds the periodic accelerations of all bodies
+    void computeAccelerations(BodyStore& bodies, float G, ThreadPool& pool);
+
+    // Maps positions that left the box back in from the opposite face, true if any body moved
+    bool wrapPositions(BodyStore& bodies) const;
+
+    void setGridSize(uint32_t n);
+    uint32_t getGridSize() const { return m_gridSize; }
+    void setBox(const glm::vec3& boxMin, float size) { m_boxMin = boxMin; m_boxSize = size; }
+    glm::vec3 getBoxMin() const { return m_boxMin; }
+    float getBoxSize() const { return m_boxSize; }
+    void setShortRange(bool enabled) { m_shortRange = enabled; }
+    bool getShortRange() const { return m_shortRange; }
+
+    const ParticleMeshStats& getStats() const { return m_stats; }
+
+private:
+    void fitBox(const BodyStore& bodies);
+    void buildFFTTables();
+    void assignMass(const BodyStore& bodies, ThreadPool& pool);
+    void solvePotential(float G, ThreadPool& pool);
+    void fft3d(bool inverse, ThreadPool& pool);
+    void computeGradient(ThreadPool& pool);
+    void interpolate(BodyStore& bodies, ThreadPool& pool);
+    void addShortRange(BodyStore& bodies, float G, ThreadPool& pool);
+
+    size_t cellIndex(uint32_t x, uint32_t y, uint32_t z) const {
+        return (static_cast<size_t>(z) * m_gridSize + y) * m_gridSize + x;
+    }
+};
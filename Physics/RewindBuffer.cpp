@@ -0,0 +1,225 @@
+#include "RewindBuffer.hpp"
+
+#include "BlockCodec.hpp"
+#include "physics.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+namespace {
+    // XOR of the column with base into byte planes (plane b holds byte b of every word), base becomes the column
+    template<typename Word>
+    void encodeColumn(const std::byte* column, std::byte* base, size_t count, bool keyframe, std::byte* planes) {
+        for (size_t i = 0; i < count; ++i) {
+            Word word, previous;
+            std::memcpy(&word, column + i * sizeof(Word), sizeof(Word));
+            std::memcpy(&previous, base + i * sizeof(Word), sizeof(Word));
+            std::memcpy(base + i * sizeof(Word), &word, sizeof(Word));
+            const Word delta = keyframe ? word : Word(word ^ previous);
+            for (size_t b = 0; b < sizeof(Word); ++b) planes[b * count + i] = static_cast<std::byte>(delta >> (8 * b));
+        }
+    }
+
+    // Inverse of encodeColumn: applies the planes to state, a keyframe replaces it
+    template<typename Word>
+    void decodeColumn(const std::byte* planes, size_t count, bool keyframe, std::byte* state) {
+        for (size_t i = 0; i < count; ++i) {
+            Word delta = 0;
+            for (size_t b = 0; b < sizeof(Word); ++b) delta |= Word(static_cast<uint8_t>(planes[b * count + i])) << (8 * b);
+            Word word = 0;
+            if (!keyframe) std::memcpy(&word, state + i * sizeof(Word), sizeof(Word));
+            word ^= delta;
+            std::memcpy(state + i * sizeof(Word), &word, sizeof(Word));
+        }
+    }
+}
+
+RewindBuffer::RewindBuffer(const RewindSettings& settings)
+    : m_settings(settings) {
+    m_settings.keyframeInterval = std::max(m_settings.keyframeInterval, 1u);
+}
+
+void RewindBuffer::setSettings(const RewindSettings& settings) {
+    m_settings = settings;
+    m_settings.keyframeInterval = std::max(m_settings.keyframeInterval, 1u);
+    // a smaller budget applies from the next capture on
+    if (!enabled()) clear();
+}
+
+void RewindBuffer::clear() {
+    m_entries.clear();
+    m_head = 0;
+    m_bytes = 0;
+    m_keyframes = 0;
+    m_handles.clear();
+    m_previous.clear();
+}
+
+std::vector<RewindBuffer::Column> RewindBuffer::columns(Physics& physics) const {
+    BodyStore& bodies = physics.getBodies();
+    const size_t n = bodies.size();
+    std::vector<Column> columns;
+    for (AlignedVector<float>* column : {&bodies.px, &bodies.py, &bodies.pz, &bodies.vx, &bodies.vy, &bodies.vz,
+                                         &bodies.ax, &bodies.ay, &bodies.az, &bodies.mass, &bodies.radius}) {
+        columns.push_back({reinterpret_cast<std::byte*>(column->data()), n, sizeof(float)});
+    }
+    static_assert(sizeof(RotationState) % sizeof(float) == 0);
+    columns.push_back({reinterpret_cast<std::byte*>(bodies.rotation.data()), n * sizeof(RotationState) / sizeof(float), sizeof(float)});
+    if (bodies.highPrecision) {
+        for (AlignedVector<double>* column : {&bodies.dpx, &bodies.dpy, &bodies.dpz, &bodies.dvx, &bodies.dvy, &bodies.dvz}) {
+            columns.push_back({reinterpret_cast<std::byte*>(column->data()), n, sizeof(double)});
+        }
+    }
+    return columns;
+}
+
+void RewindBuffer::capture(Physics& physics, uint64_t step, double time) {
+    if (!enabled()) return;
+    const auto start = std::chrono::steady_clock::now();
+
+    // the future of a rewind is overwritten by the steps taken from there
+    while (!m_entries.empty() && m_entries.size() > m_head + 1) {
+        m_bytes -= m_entries.back().data.size();
+        if (m_entries.back().keyframe) m_keyframes--;
+        m_entries.pop_back();
+    }
+
+    const BodyStore& bodies = physics.getBodies();
+    const std::vector<Handle>& handles = physics.getHandles().handles();
+    if (bodies.highPrecision != m_highPrecision || handles != m_handles
+        || (!m_entries.empty() && step <= m_entries.back().step)) {
+        clear();
+        m_handles = handles;
+        m_highPrecision = bodies.highPrecision;
+    }
+
+    const std::vector<Column> columns = this->columns(physics);
+    if (m_previous.empty()) {
+        m_columnBegin.resize(columns.size());
+        size_t size = 0;
+        for (size_t c = 0; c < columns.size(); ++c) {
+            m_columnBegin[c] = size;
+            size += columns[c].count * columns[c].wordSize;
+        }
+        m_previous.assign(size, std::byte{0});
+        m_planes.resize(columns.size());
+        m_compressed.resize(columns.size());
+    }
+
+    // steps since the last keyframe, at most keyframeInterval to look at
+    size_t sinceKeyframe = 0;
+    for (auto it = m_entries.rbegin(); it != m_entries.rend() && !it->keyframe; ++it) sinceKeyframe++;
+    const bool keyframe = m_entries.empty() || sinceKeyframe + 1 >= m_settings.keyframeInterval;
+
+    // columns are independent, one task each
+    physics.getThreadPool().run(columns.size(), [&](size_t c, size_t) {
+        const Column& column = columns[c];
+        const size_t bytes = column.count * column.wordSize;
+        std::vector<std::byte>& planes = m_planes[c];
+        planes.resize(bytes);
+        std::byte* base = m_previous.data() + m_columnBegin[c];
+        if (column.wordSize == sizeof(double)) encodeColumn<uint64_t>(column.data, base, column.count, keyframe, planes.data());
+        else encodeColumn<uint32_t>(column.data, base, column.count, keyframe, planes.data());
+
+        std::vector<std::byte>& compressed = m_compressed[c];
+        compressed.resize(BlockCodec::bound(bytes));
+        compressed.resize(BlockCodec::compress(planes.data(), bytes, compressed.data()));
+    });
+
+    Entry& entry = m_entries.emplace_back();
+    entry.step = step;
+    entry.time = time;
+    entry.keyframe = keyframe;
+    entry.forcesValid = physics.forcesReusable();
+    size_t size = 0;
+    for (const std::vector<std::byte>& compressed : m_compressed) size += compressed.size();
+    entry.data.reserve(size);
+    for (const std::vector<std::byte>& compressed : m_compressed) {
+        entry.data.insert(entry.data.end(), compressed.begin(), compressed.end());
+        entry.columnEnd.push_back(entry.data.size());
+    }
+    m_bytes += entry.data.size();
+    if (keyframe) m_keyframes++;
+    m_head = m_entries.size() - 1;
+
+    enforceBudget();
+    m_captureMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void RewindBuffer::enforceBudget() {
+    // the newest keyframe and its deltas stay whatever the budget, a rewind needs a keyframe to start from
+    while (m_keyframes > 1 && m_bytes + m_previous.size() > m_settings.budgetBytes) {
+        do {
+            m_bytes -= m_entries.front().data.size();
+            m_entries.pop_front();
+            m_head--;
+        } while (!m_entries.front().keyframe);
+        m_keyframes--;
+    }
+}
+
+bool RewindBuffer::rewind(uint64_t step, Physics& physics, double& time) {
+    if (m_entries.empty()) return false;
+    if (physics.getBodies().highPrecision != m_highPrecision || physics.getHandles().handles() != m_handles) return false;
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), step,
+                               [](const Entry& entry, uint64_t s) { return entry.step < s; });
+    if (it == m_entries.end() || it->step != step) return false;
+    const size_t target = static_cast<size_t>(it - m_entries.begin());
+    size_t key = target;
+    while (!m_entries[key].keyframe) key--;
+
+    // each column replays its own chain from the keyframe into m_previous, the bodies are only written once
+    // every column decoded
+    const std::vector<Column> columns = this->columns(physics);
+    std::atomic<bool> ok{true};
+    physics.getThreadPool().run(columns.size(), [&](size_t c, size_t) {
+        const Column& column = columns[c];
+        const size_t bytes = column.count * column.wordSize;
+        std::vector<std::byte>& planes = m_planes[c];
+        planes.resize(bytes);
+        std::byte* state = m_previous.data() + m_columnBegin[c];
+        for (size_t e = key; e <= target; ++e) {
+            const Entry& entry = m_entries[e];
+            const size_t begin = c == 0 ? 0 : entry.columnEnd[c - 1];
+            if (!BlockCodec::decompress(entry.data.data() + begin, entry.columnEnd[c] - begin, planes.data(), bytes)) {
+                ok = false;
+                return;
+            }
+            if (column.wordSize == sizeof(double)) decodeColumn<uint64_t>(planes.data(), column.count, entry.keyframe, state);
+            else decodeColumn<uint32_t>(planes.data(), column.count, entry.keyframe, state);
+        }
+    });
+    if (!ok) {
+        // the base of the next delta is lost with it, start over from the next step
+        clear();
+        return false;
+    }
+    physics.getThreadPool().run(columns.size(), [&](size_t c, size_t) {
+        std::memcpy(columns[c].data, m_previous.data() + m_columnBegin[c], columns[c].count * columns[c].wordSize);
+    });
+
+    const Entry& entry = m_entries[target];
+    physics.restoreHandles(m_handles, entry.forcesValid);
+    time = entry.time;
+    m_head = target;
+    return true;
+}
+
+RewindStats RewindBuffer::getStats() const {
+    RewindStats stats;
+    stats.enabled = enabled();
+    stats.entries = m_entries.size();
+    stats.keyframes = m_keyframes;
+    stats.bytes = m_bytes + m_previous.size();
+    stats.budgetBytes = m_settings.budgetBytes;
+    stats.captureMs = m_captureMs;
+    if (!m_entries.empty()) {
+        stats.firstStep = m_entries.front().step;
+        stats.lastStep = m_entries.back().step;
+        stats.firstTime = m_entries.front().time;
+        stats.lastTime = m_entries.back().time;
+    }
+    return stats;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "SlotMap.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class Physics;
+
+struct RewindSettings {
+    size_t budgetBytes = size_t(256) << 20; // encoded history plus one raw state, 0 turns the buffer off
+    uint32_t keyframeInterval = 64;         // steps from one full state to the next
+};
+
+struct RewindStats {
+    bool enabled = false;
+    uint64_t firstStep = 0, lastStep = 0; // retained range, empty while entries is 0
+    double firstTime = 0.0, lastTime = 0.0;
+    size_t entries = 0;
+    size_t keyframes = 0;
+    size_t bytes = 0; // in use, against budgetBytes
+    size_t budgetBytes = 0;
+    double captureMs = 0.0; // encoding time of the latest step
+};
+
+// Bounded in-memory history of the body state, one entry per step. Every keyframeInterval steps the full state
+// is kept, the steps in between as the XOR with the step before, split into byte planes and compressed: the
+// high bytes of slowly changing floats cancel out, so a delta is mostly zero runs. Deltas are exact, so a
+// rewound run continues like the original one. The oldest keyframe and its deltas go first when the budget is
+// exceeded. Adding or removing bodies starts the history over, the entries only hold body state: solver and
+// integrator settings aren't rewound.
+class RewindBuffer {
+private:
+    struct Entry {
+        uint64_t step = 0;
+        double time = 0.0;
+        bool keyframe = false;
+        bool forcesValid = false;
+        std::vector<std::byte> data;
+        std::vector<size_t> columnEnd; // per column, its end in data
+    };
+
+    // One BodyStore array as seen by the encoder
+    struct Column {
+        std::byte* data;
+        size_t count;
+        uint32_t wordSize; // XOR and byte planes go by word, 4 or 8 bytes
+    };
+
+    RewindSettings m_settings;
+    std::deque<Entry> m_entries;
+    size_t m_head = 0;   // entry the bodies are at, the ones after it are dropped by the next capture
+    size_t m_bytes = 0;  // encoded bytes of m_entries
+    size_t m_keyframes = 0;
+    double m_captureMs = 0.0;
+
+    // what the entries describe, a change starts over
+    std::vector<Handle> m_handles;
+    bool m_highPrecision = false;
+
+    std::vector<std::byte> m_previous;     // raw state of m_entries[m_head], the base of the next delta
+    std::vector<size_t> m_columnBegin;     // per column, its offset in m_previous
+    std::vector<std::vector<std::byte>> m_planes;     // per column, scratch
+    std::vector<std::vector<std::byte>> m_compressed; // per column, scratch
+
+public:
+    explicit RewindBuffer(const RewindSettings& settings = {});
+
+    void setSettings(const RewindSettings& settings);
+    const RewindSettings& getSettings() const { return m_settings; }
+    bool enabled() const { return m_settings.budgetBytes > 0; }
+    bool empty() const { return m_entries.empty(); }
+
+    // After a step: appends the state as of step. Entries after the one last rewound to are dropped first.
+    void capture(Physics& physics, uint64_t step, double time);
+    // Puts the bodies back to a retained step and stores its time in time. False, touching nothing, when the step
+    // isn't retained or bodies were added or removed since it was captured. Data that fails to decode also
+    // returns false with the bodies untouched, but drops the buffer.
+    bool rewind(uint64_t step, Physics& physics, double& time);
+    void clear();
+
+    RewindStats getStats() const;
+
+private:
+    std::vector<Column> columns(Physics& physics) const;
+    // Makes room for an entry of about the size of the newest one
+    void enforceBudget();
+};
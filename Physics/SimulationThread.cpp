@@ -0,0 +1,420 @@
+#include "SimulationThread.hpp"
+
+#include "physics.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    // the rest of the command is filled in field by field, so no member is ever left out of an initializer
+    SimCommand makeCommand(SimCommand::Type type) {
+        SimCommand command;
+        command.type = type;
+        return command;
+    }
+}
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+void SimulationThread::start() {
+    if (m_running) return;
+    m_running = true;
+    m_thread = std::thread(&SimulationThread::loop, this);
+}
+
+void SimulationThread::stop() {
+    m_running = false;
+    if (m_thread.joinable()) m_thread.join();
+    // the simulation thread is gone, close the file from here
+    stopRecorder();
+    // and let a forked save finish its file
+    ForkedCheckpointResult result;
+    if (m_checkpointFork.wait(result) && !result.ok) std::cerr << result.message << std::endl;
+}
+
+void SimulationThread::submit(const SimCommand& command) {
+    while (!m_commands.push(command)) std::this_thread::yield();
+}
+
+void SimulationThread::addBody(Handle body, const glm::vec3& pos, const glm::vec3& vel, float mass, float radius) {
+    SimCommand command = makeCommand(SimCommand::Type::AddBody);
+    command.body = body;
+    command.pos = pos;
+    command.vel = vel;
+    command.value = mass;
+    command.radius = radius;
+    submit(command);
+}
+
+void SimulationThread::removeBody(Handle body) {
+    SimCommand command = makeCommand(SimCommand::Type::RemoveBody);
+    command.body = body;
+    submit(command);
+}
+
+void SimulationThread::addBodies(std::vector<Handle> bodies, BodyBatch batch) {
+    SimCommand command = makeCommand(SimCommand::Type::AddBodies);
+    command.bodies = std::make_shared<const std::vector<Handle>>(std::move(bodies));
+    command.batch = std::make_shared<const BodyBatch>(std::move(batch));
+    submit(command);
+}
+
+void SimulationThread::removeBodies(std::vector<Handle> bodies) {
+    SimCommand command = makeCommand(SimCommand::Type::RemoveBodies);
+    command.bodies = std::make_shared<const std::vector<Handle>>(std::move(bodies));
+    submit(command);
+}
+
+void SimulationThread::setMass(Handle body, float mass) {
+    SimCommand command = makeCommand(SimCommand::Type::SetMass);
+    command.body = body;
+    command.value = mass;
+    submit(command);
+}
+
+void SimulationThread::setVelocity(Handle body, const glm::vec3& vel) {
+    SimCommand command = makeCommand(SimCommand::Type::SetVelocity);
+    command.body = body;
+    command.vel = vel;
+    submit(command);
+}
+
+void SimulationThread::setPaused(bool paused) {
+    SimCommand command = makeCommand(SimCommand::Type::SetPaused);
+    command.value = paused ? 1.0f : 0.0f;
+    submit(command);
+}
+
+void SimulationThread::setFixedTimestep(float dt) {
+    SimCommand command = makeCommand(SimCommand::Type::SetTimestep);
+    command.value = dt;
+    submit(command);
+}
+
+void SimulationThread::setTimeScale(float scale) {
+    SimCommand command = makeCommand(SimCommand::Type::SetTimeScale);
+    command.value = scale;
+    submit(command);
+}
+
+void SimulationThread::setDiagnosticsEnabled(bool enabled) {
+    SimCommand command = makeCommand(SimCommand::Type::SetDiagnostics);
+    command.value = enabled ? 1.0f : 0.0f;
+    submit(command);
+}
+
+void SimulationThread::saveCheckpoint(std::string path, std::vector<std::byte> metadata, bool fork) {
+    SimCommand command = makeCommand(SimCommand::Type::SaveCheckpoint);
+    CheckpointRequest request;
+    request.path = std::move(path);
+    request.metadata = std::move(metadata);
+    request.fork = fork;
+    command.checkpoint = std::make_shared<const CheckpointRequest>(std::move(request));
+    submit(command);
+}
+
+void SimulationThread::loadCheckpoint(std::shared_ptr<const MappedCheckpoint> checkpoint, bool verify) {
+    SimCommand command = makeCommand(SimCommand::Type::LoadCheckpoint);
+    CheckpointRequest request;
+    request.mapped = std::move(checkpoint);
+    request.verify = verify;
+    command.checkpoint = std::make_shared<const CheckpointRequest>(std::move(request));
+    submit(command);
+}
+
+void SimulationThread::startRecording(RecordingSettings settings, std::vector<std::byte> metadata) {
+    SimCommand command = makeCommand(SimCommand::Type::StartRecording);
+    command.recording = std::make_shared<const RecordingRequest>(RecordingRequest{std::move(settings), std::move(metadata)});
+    submit(command);
+}
+
+void SimulationThread::stopRecording() {
+    submit(makeCommand(SimCommand::Type::StopRecording));
+}
+
+void SimulationThread::setRewind(RewindSettings settings) {
+    SimCommand command = makeCommand(SimCommand::Type::SetRewind);
+    command.rewind = std::make_shared<const RewindSettings>(settings);
+    submit(command);
+}
+
+void SimulationThread::rewindTo(uint64_t step) {
+    SimCommand command = makeCommand(SimCommand::Type::RewindTo);
+    command.step = step;
+    submit(command);
+}
+
+void SimulationThread::startRecorder(const RecordingRequest& request) {
+    stopRecorder();
+    try {
+        m_recorder = std::make_unique<TrajectoryRecorder>(request.settings, m_physics.getHandles().handles(),
+                                                          request.metadata, m_fixedDt, m_step);
+        m_recorder->capture(m_physics.getBodies(), m_physics.getHandles(), m_step, m_simTime);
+    } catch (const std::runtime_error& error) {
+        std::cerr << error.what() << std::endl;
+        m_recordingStats = RecordingStats{.failed = true, .path = request.settings.path, .error = error.what()};
+    }
+}
+
+void SimulationThread::stopRecorder() {
+    if (!m_recorder) return;
+    // waits for the writer to drain the ring and close the file
+    m_recorder->finish();
+    m_recordingStats = m_recorder->getStats();
+    m_recorder.reset();
+}
+
+void SimulationThread::applyCheckpoint(const SimCommand& command) {
+    using Clock = std::chrono::steady_clock;
+    const CheckpointRequest& request = *command.checkpoint;
+    const bool load = command.type == SimCommand::Type::LoadCheckpoint;
+    const auto start = Clock::now();
+
+    CheckpointStatus& status = m_checkpointStatus;
+    status.serial++;
+    status.loaded = load;
+    status.pending = false;
+    try {
+        if (!load && request.fork && CheckpointFork::supported()) {
+            m_checkpointFork.start(request.path, m_physics, {m_step, m_simTime, m_fixedDt, m_timeScale}, request.metadata);
+            status.pending = true;
+            status.message = "Writing " + std::to_string(m_physics.getPlanetCount()) + " bodies to " + request.path
+                              + " in the background";
+        } else if (!load) {
+            writeCheckpoint(request.path, m_physics, {m_step, m_simTime, m_fixedDt, m_timeScale}, request.metadata);
+            status.message = "Saved " + std::to_string(m_physics.getPlanetCount()) + " bodies to " + request.path;
+        } else {
+            const MappedCheckpoint& checkpoint = *request.mapped;
+            if (request.verify && !checkpoint.verifyChecksum()) throw std::runtime_error("Checkpoint: checksum mismatch");
+            // throws before touching the bodies, if at all
+            restoreCheckpoint(checkpoint, m_physics);
+            // the recorded handles mean other bodies from here on
+            stopRecorder();
+            m_rewind.clear();
+            const CheckpointClock& clock = checkpoint.header().clock;
+            m_step = clock.step;
+            m_simTime = clock.simTime;
+            m_fixedDt = clock.dt;
+            m_timeScale = clock.timeScale;
+            status.message = "Loaded " + std::to_string(checkpoint.bodyCount()) + " bodies at step " + std::to_string(m_step);
+        }
+        status.ok = true;
+    } catch (const std::runtime_error& error) {
+        std::cerr << error.what() << std::endl;
+        status.ok = false;
+        status.message = error.what();
+    }
+    if (load) {
+        status.loads++;
+        status.loadOk = status.ok;
+    }
+    status.ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+bool SimulationThread::pollCheckpointFork() {
+    ForkedCheckpointResult result;
+    if (!m_checkpointFork.poll(result)) return false;
+    if (!result.ok) std::cerr << result.message << std::endl;
+    CheckpointStatus& status = m_checkpointStatus;
+    status.serial++;
+    status.loaded = false;
+    status.pending = false;
+    status.ok = result.ok;
+    status.message = result.message;
+    status.ms = result.ms;
+    return true;
+}
+
+bool SimulationThread::applyCommands() {
+    BodyStore& bodies = m_physics.getBodies();
+    bool applied = false;
+    bool bodiesChanged = false;
+
+    SimCommand command;
+    while (m_commands.pop(command)) {
+        applied = true;
+        const uint32_t index = m_physics.indexOf(command.body);
+        switch (command.type) {
+            case SimCommand::Type::AddBody:
+                bodiesChanged |= m_physics.addPlanet(command.body, command.pos, command.vel, command.value, command.radius);
+                break;
+            case SimCommand::Type::AddBodies: {
+                const BodyBatch& batch = *command.batch;
+                bodiesChanged |= m_physics.addPlanets(*command.bodies, batch.pos, batch.vel, batch.mass, batch.radius) > 0;
+                break;
+            }
+            case SimCommand::Type::RemoveBody:
+                bodiesChanged |= m_physics.removeBody(command.body);
+                break;
+            case SimCommand::Type::RemoveBodies:
+                bodiesChanged |= m_physics.removeBodies(*command.bodies) > 0;
+                break;
+            case SimCommand::Type::SetMass:
+                if (index == Handle::INVALID) break;
+                bodies.mass[index] = command.value;
+                bodiesChanged = true;
+                break;
+            case SimCommand::Type::SetVelocity:
+                if (index == Handle::INVALID) break;
+                bodies.setVel(index, command.vel);
+                bodiesChanged = true;
+                break;
+            case SimCommand::Type::SetPaused:
+                m_paused = command.value != 0.0f;
+                break;
+            case SimCommand::Type::SetTimestep:
+                if (command.value > 0.0f) m_fixedDt = command.value;
+                break;
+            case SimCommand::Type::SetTimeScale:
+                m_timeScale = std::max(command.value, 1e-3f);
+                break;
+            case SimCommand::Type::SetDiagnostics:
+                m_physics.setDiagnosticsEnabled(command.value != 0.0f);
+                break;
+            case SimCommand::Type::SaveCheckpoint:
+                // edits queued before the save are part of it, and their forces aren't computed yet
+                if (bodiesChanged) m_physics.invalidateForces();
+                bodiesChanged = false;
+                applyCheckpoint(command);
+                break;
+            case SimCommand::Type::LoadCheckpoint:
+                // earlier edits are overwritten, keep the forces that came with the file
+                bodiesChanged = false;
+                applyCheckpoint(command);
+                break;
+            case SimCommand::Type::StartRecording:
+                startRecorder(*command.recording);
+                break;
+            case SimCommand::Type::StopRecording:
+                stopRecorder();
+                break;
+            case SimCommand::Type::SetRewind:
+                m_rewind.setSettings(*command.rewind);
+                // the current state, so the history reaches back to where it was turned on
+                if (m_rewind.empty()) m_rewind.capture(m_physics, m_step, m_simTime);
+                break;
+            case SimCommand::Type::RewindTo:
+                // edits queued before it are overwritten, or kept with fresh forces when the step isn't retained
+                if (bodiesChanged) m_physics.invalidateForces();
+                bodiesChanged = false;
+                m_paused = true;
+                if (command.step != m_step && m_rewind.rewind(command.step, m_physics, m_simTime)) {
+                    // a recording's frames must keep moving forward in time
+                    stopRecorder();
+                    m_step = command.step;
+                }
+                break;
+        }
+    }
+    // once per batch rather than per edit
+    if (bodiesChanged) m_physics.invalidateForces();
+    return applied;
+}
+
+void SimulationThread::loop() {
+    using Clock = std::chrono::steady_clock;
+
+    capturePrevious();
+    publish();
+    auto last = Clock::now();
+    double accumulator = 0.0;
+
+    while (m_running) {
+        bool edited = applyCommands();
+        edited |= pollCheckpointFork();
+        const float dt = m_fixedDt;
+        const double scale = m_timeScale;
+        const auto now = Clock::now();
+        const double elapsed = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        if (m_paused) {
+            accumulator = 0.0;
+            if (edited) {
+                capturePrevious();
+                publish();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+
+        // a wake-up never owes more than m_maxSubsteps steps, past that the simulation slows down instead
+        accumulator += std::min(elapsed * scale, double(dt) * m_maxSubsteps);
+        const uint32_t steps = static_cast<uint32_t>(accumulator / dt);
+        if (steps == 0) {
+            if (edited) {
+                capturePrevious();
+                publish();
+            }
+            // wake up at least every few ms so commands don't wait for a slow step rate
+            std::this_thread::sleep_for(std::chrono::duration<double>(std::min((dt - accumulator) / scale, 0.005)));
+            continue;
+        }
+
+        for (uint32_t step = 0; step < steps; ++step) {
+            if (step + 1 == steps) capturePrevious();
+            const auto stepStart = Clock::now();
+            m_physics.update(dt);
+            m_stepMs = std::chrono::duration<double, std::milli>(Clock::now() - stepStart).count();
+            m_step++;
+            m_simTime += dt;
+            m_rewind.capture(m_physics, m_step, m_simTime);
+            if (m_recorder && m_recorder->wantsStep(m_step)) {
+                m_recorder->capture(m_physics.getBodies(), m_physics.getHandles(), m_step, m_simTime);
+            }
+        }
+        accumulator -= steps * double(dt);
+        publish();
+    }
+}
+
+void SimulationThread::capturePrevious() {
+    const BodyStore& bodies = m_physics.getBodies();
+    m_prevPos.resize(bodies.size());
+    m_prevRot.resize(bodies.size());
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        m_prevPos[i] = bodies.pos(i);
+        m_prevRot[i] = bodies.rotation[i].rot;
+    }
+}
+
+void SimulationThread::publish() {
+    const BodyStore& bodies = m_physics.getBodies();
+    const size_t n = bodies.size();
+    SimSnapshot& snapshot = m_snapshots.back();
+
+    snapshot.handles = m_physics.getHandles().handles();
+    snapshot.pos.resize(n);
+    snapshot.rot.resize(n);
+    snapshot.vel.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        snapshot.pos[i] = bodies.pos(i);
+        snapshot.vel[i] = bodies.vel(i);
+        snapshot.rot[i] = bodies.rotation[i].rot;
+    }
+    snapshot.prevPos = m_prevPos;
+    snapshot.prevRot = m_prevRot;
+    snapshot.mass.assign(bodies.mass.begin(), bodies.mass.end());
+
+    snapshot.maxJump = m_physics.getSolver() == GravitySolver::ParticleMesh
+        ? 0.5f * m_physics.getParticleMesh().getBoxSize()
+        : std::numeric_limits<float>::infinity();
+    snapshot.step = m_step;
+    snapshot.simTime = m_simTime;
+    snapshot.stepMs = m_stepMs;
+    snapshot.paused = m_paused;
+    snapshot.fixedDt = m_fixedDt;
+    snapshot.timeScale = m_timeScale;
+    snapshot.diagnosticsEnabled = m_physics.getDiagnosticsEnabled();
+    snapshot.diagnostics = m_physics.getDiagnostics();
+    snapshot.checkpoint = m_checkpointStatus;
+    snapshot.recording = m_recorder ? m_recorder->getStats() : m_recordingStats;
+    snapshot.rewind = m_rewind.getStats();
+    snapshot.stepPeriod = m_fixedDt / m_timeScale;
+    snapshot.published = std::chrono::steady_clock::now();
+    m_snapshots.publish();
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "Checkpoint.hpp"
+#include "CheckpointFork.hpp"
+#include "CommandQueue.hpp"
+#include "Diagnostics.hpp"
+#include "InitialConditions.hpp"
+#include "RewindBuffer.hpp"
+#include "SlotMap.hpp"
+#include "TrajectoryRecorder.hpp"
+#include "TripleBuffer.hpp"
+
+#include "glm/glm.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Physics;
+
+// Outcome of the latest checkpoint save or load
+struct CheckpointStatus {
+    uint32_t serial = 0; // counts finished saves and loads, so a reader can tell a new result from an old one
+    bool ok = true;
+    bool loaded = false; // the result is of a load rather than a save
+    bool pending = false; // a forked save is still writing, its result comes with the next serial
+    std::string message;
+    double ms = 0.0;     // for a forked save, the simulation's pause while pending and the child's run time after
+    // a save finishing right after a load replaces the fields above, the outcome of the latest load is kept here
+    uint32_t loads = 0;  // counts finished loads
+    bool loadOk = true;
+};
+
+// What the render thread sees of the simulation: the states before and after the latest step
+struct SimSnapshot {
+    std::vector<Handle> handles; // body at each index
+    std::vector<glm::vec3> prevPos, pos;
+    std::vector<glm::vec3> prevRot, rot;
+    std::vector<glm::vec3> vel;
+    std::vector<float> mass;
+    float maxJump = 0.0f; // displacement above which a body wrapped through a periodic box
+
+    // settings as of this snapshot
+    bool paused = false;
+    float fixedDt = 0.016f;
+    float timeScale = 1.0f;
+    bool diagnosticsEnabled = false;
+
+    Diagnostics diagnostics;
+    CheckpointStatus checkpoint;
+    RecordingStats recording; // of the running recording, or the last one
+    RewindStats rewind;
+    uint64_t step = 0;
+    double simTime = 0.0;
+    double stepMs = 0.0;     // wall time of the latest physics step
+    double stepPeriod = 0.0; // wall time between steps at the current step size and time scale
+    std::chrono::steady_clock::time_point published;
+};
+
+// SaveCheckpoint writes path with metadata; LoadCheckpoint restores from mapped, a file the caller opened
+struct CheckpointRequest {
+    std::string path;
+    std::vector<std::byte> metadata;
+    std::shared_ptr<const MappedCheckpoint> mapped;
+    bool verify = false; // check the checksum before restoring, which reads the whole file
+    bool fork = false;   // save from a forked process while the simulation goes on, where supported
+};
+
+struct RecordingRequest {
+    RecordingSettings settings;
+    std::vector<std::byte> metadata;
+};
+
+// Edit to the simulation, applied between two steps
+struct SimCommand {
+    enum class Type : uint8_t {
+        AddBody,
+        AddBodies,
+        RemoveBody,
+        RemoveBodies,
+        SetMass,
+        SetVelocity,
+        SetPaused,
+        SetTimestep,
+        SetTimeScale,
+        SetDiagnostics,
+        SaveCheckpoint,
+        LoadCheckpoint,
+        StartRecording,
+        StopRecording,
+        SetRewind,
+        RewindTo
+    };
+
+    Type type = Type::AddBody;
+    Handle body;          // the body to add, remove or edit
+    glm::vec3 pos{0.0f};
+    glm::vec3 vel{0.0f};
+    float value = 0.0f;   // mass, step size, time scale, pause or diagnostics flag
+    float radius = 0.0f;
+    uint64_t step = 0;    // RewindTo
+
+    // AddBodies and RemoveBodies, shared so the queue cells stay small
+    std::shared_ptr<const std::vector<Handle>> bodies;
+    std::shared_ptr<const BodyBatch> batch;
+    std::shared_ptr<const CheckpointRequest> checkpoint;
+    std::shared_ptr<const RecordingRequest> recording;
+    std::shared_ptr<const RewindSettings> rewind;
+};
+
+// Runs Physics on its own thread in fixed steps paced by wall time. Other threads edit it only through
+// commands, which queue up lock-free and are applied in submission order before the next step; the latest
+// state is read back through a triple buffer without locking. A run is the same sequence of steps whatever
+// the render rate or the time scale is.
+class SimulationThread {
+private:
+    Physics& m_physics;
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+    std::atomic<uint32_t> m_maxSubsteps{8}; // per wake-up, beyond that the simulation falls behind wall time
+
+    CommandQueue<SimCommand> m_commands{4096};
+
+    // sim thread only
+    bool m_paused = false;
+    float m_fixedDt = 0.016f;
+    float m_timeScale = 1.0f; // simulated seconds per wall second
+    std::vector<glm::vec3> m_prevPos, m_prevRot;
+    uint64_t m_step = 0;
+    double m_simTime = 0.0;
+    double m_stepMs = 0.0;
+    CheckpointStatus m_checkpointStatus;
+    std::unique_ptr<TrajectoryRecorder> m_recorder;
+    RecordingStats m_recordingStats; // of the last one, once it has stopped
+    CheckpointFork m_checkpointFork;
+    RewindBuffer m_rewind{RewindSettings{.budgetBytes = 0}};
+
+    TripleBuffer<SimSnapshot> m_snapshots;
+
+public:
+    explicit SimulationThread(Physics& physics) : m_physics(physics) {}
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    void start();
+    void stop();
+
+    // Any thread. Only waits when the queue is full, the simulation thread never waits on a submitter.
+    void submit(const SimCommand& command);
+
+    // The handle comes from the caller's SlotMap, physics adopts it
+    void addBody(Handle body, const glm::vec3& pos, const glm::vec3& vel, float mass, float radius);
+    void removeBody(Handle body);
+    // One command for the whole batch, bodies[i] is the handle of batch body i
+    void addBodies(std::vector<Handle> bodies, BodyBatch batch);
+    void removeBodies(std::vector<Handle> bodies);
+    void setMass(Handle body, float mass);
+    void setVelocity(Handle body, const glm::vec3& vel);
+    void setPaused(bool paused);
+    void setFixedTimestep(float dt);
+    void setTimeScale(float scale);
+    void setDiagnosticsEnabled(bool enabled);
+    // Written or restored between two steps on the simulation thread, the result shows up in the snapshot.
+    // A load replaces every body, the caller keeps its handles in step with the file's. With verify the checksum
+    // is checked there first; a mismatch fails the load with the bodies untouched, see CheckpointStatus::loadOk.
+    // With fork (Linux), a child process writes the file and the simulation only stops for the fork.
+    void saveCheckpoint(std::string path, std::vector<std::byte> metadata, bool fork = false);
+    void loadCheckpoint(std::shared_ptr<const MappedCheckpoint> checkpoint, bool verify);
+    // Records from the next command batch on, replacing a running recording. Loading a checkpoint stops it.
+    void startRecording(RecordingSettings settings, std::vector<std::byte> metadata);
+    void stopRecording();
+    // History kept for rewindTo(), budgetBytes 0 turns it off and drops it
+    void setRewind(RewindSettings settings);
+    // Pauses and puts the bodies back to a step in the history, see RewindBuffer. Stops a running recording.
+    void rewindTo(uint64_t step);
+
+    void setMaxSubsteps(uint32_t steps) { m_maxSubsteps = steps; }
+    uint32_t getMaxSubsteps() const { return m_maxSubsteps; }
+
+    // Render thread: newest published state, stays valid until the next call
+    const SimSnapshot& acquireSnapshot() {
+        m_snapshots.acquire();
+        return m_snapshots.front();
+    }
+
+private:
+    void loop();
+    // Applies everything queued so far, returns whether there was anything
+    bool applyCommands();
+    void applyCheckpoint(const SimCommand& command);
+    // Picks up a forked save that has finished, returns whether one had
+    bool pollCheckpointFork();
+    void startRecorder(const RecordingRequest& request);
+    void stopRecorder();
+    void capturePrevious();
+    void publish();
+};
@@ -0,0 +1,93 @@
+#include "SlotMap.hpp"
+
+#include <algorithm>
+
+Handle SlotMap::create() {
+    uint32_t slot;
+    if (!m_free.empty()) {
+        slot = m_free.back();
+        m_free.pop_back();
+    } else {
+        slot = static_cast<uint32_t>(m_slots.size());
+        m_slots.emplace_back();
+    }
+    m_slots[slot].dense = static_cast<uint32_t>(m_handles.size());
+    Handle handle{slot, m_slots[slot].generation};
+    m_handles.push_back(handle);
+    return handle;
+}
+
+bool SlotMap::insert(Handle handle) {
+    if (!handle.valid()) return false;
+    m_adopting = true;
+    if (handle.slot >= m_slots.size()) m_slots.resize(handle.slot + 1);
+    Slot& slot = m_slots[handle.slot];
+    if (slot.dense != Handle::INVALID) return false;
+    slot.dense = static_cast<uint32_t>(m_handles.size());
+    slot.generation = handle.generation;
+    m_handles.push_back(handle);
+    return true;
+}
+
+uint32_t SlotMap::erase(Handle handle) {
+    const uint32_t index = indexOf(handle);
+    if (index == Handle::INVALID) return Handle::INVALID;
+
+    // the last element takes over the hole
+    const Handle last = m_handles.back();
+    m_handles[index] = last;
+    m_slots[last.slot].dense = index;
+    m_handles.pop_back();
+
+    Slot& slot = m_slots[handle.slot];
+    slot.dense = Handle::INVALID;
+    slot.generation++;
+    if (!m_adopting) m_free.push_back(handle.slot);
+    return index;
+}
+
+bool SlotMap::assign(const std::vector<Handle>& handles) {
+    clear();
+    m_free.clear();
+    size_t slotCount = m_slots.size();
+    for (const Handle& handle : handles) {
+        if (!handle.valid()) return false;
+        slotCount = std::max<size_t>(slotCount, size_t(handle.slot) + 1);
+    }
+    m_slots.resize(slotCount);
+    m_handles.reserve(handles.size());
+
+    for (const Handle& handle : handles) {
+        Slot& slot = m_slots[handle.slot];
+        if (slot.dense != Handle::INVALID) {
+            clear();
+            return false;
+        }
+        slot.dense = static_cast<uint32_t>(m_handles.size());
+        slot.generation = handle.generation;
+        m_handles.push_back(handle);
+    }
+    if (!m_adopting) {
+        // lowest slot at the back, so create() refills from the start
+        for (size_t s = slotCount; s > 0; --s) {
+            if (m_slots[s - 1].dense == Handle::INVALID) m_free.push_back(static_cast<uint32_t>(s - 1));
+        }
+    }
+    return true;
+}
+
+void SlotMap::reserve(size_t n) {
+    m_slots.reserve(n);
+    m_handles.reserve(n);
+}
+
+void SlotMap::clear() {
+    // bump every live generation so handles from before the clear stay invalid
+    for (uint32_t s = 0; s < m_slots.size(); ++s) {
+        if (m_slots[s].dense == Handle::INVALID) continue;
+        m_slots[s].dense = Handle::INVALID;
+        m_slots[s].generation++;
+        if (!m_adopting) m_free.push_back(s);
+    }
+    m_handles.clear();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Stable reference to an entity. The generation tells a handle apart from older ones that used the same
+// slot, so a handle to a removed entity stays invalid even after the slot is reused.
+struct Handle {
+    static constexpr uint32_t INVALID = UINT32_MAX;
+
+    uint32_t slot = INVALID;
+    uint32_t generation = 0;
+
+    bool valid() const { return slot != INVALID; }
+    bool operator==(const Handle& other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+// Handle to dense index indirection. The data itself lives in the owner's dense arrays, which mirror every
+// removal here with a swap-and-pop: the last element moves into the hole, so removing k entities costs O(k)
+// and the arrays stay packed for the passes that stream over them.
+//
+// A map either issues handles with create() or adopts handles issued by another map with insert(), not both.
+// Adopting keeps two owners (the scene and physics) on one set of handles without a round trip between them.
+class SlotMap {
+private:
+    struct Slot {
+        uint32_t dense = Handle::INVALID; // INVALID while the slot is free
+        uint32_t generation = 0;
+    };
+
+    std::vector<Slot> m_slots;
+    std::vector<Handle> m_handles;  // per dense index
+    std::vector<uint32_t> m_free;   // free slots, used by create()
+    bool m_adopting = false;        // insert() was used, slots are recycled by the issuing map
+
+public:
+    // New handle for dense index size()
+    Handle create();
+    // Adopts a handle from another map at dense index size(). False when the handle's slot is already in use.
+    bool insert(Handle handle);
+
+    // Frees the handle and moves the last dense element into its index. Returns that index, or INVALID for a
+    // stale handle. The owner does the same swap-and-pop on its arrays.
+    uint32_t erase(Handle handle);
+
+    // Replaces the contents with handles[i] at dense index i, e.g. from a checkpoint. Other slots become free.
+    // False, leaving the map empty, when a handle is invalid or two share a slot.
+    bool assign(const std::vector<Handle>& handles);
+
+    bool contains(Handle handle) const { return indexOf(handle) != Handle::INVALID; }
+    // Dense index of handle, INVALID when it is stale
+    uint32_t indexOf(Handle handle) const {
+        if (handle.slot >= m_slots.size()) return Handle::INVALID;
+        const Slot& slot = m_slots[handle.slot];
+        return slot.generation == handle.generation ? slot.dense : Handle::INVALID;
+    }
+    Handle handleAt(uint32_t index) const { return m_handles[index]; }
+    const std::vector<Handle>& handles() const { return m_handles; }
+
+    size_t size() const { return m_handles.size(); }
+    bool empty() const { return m_handles.empty(); }
+    void reserve(size_t n);
+    void clear();
+};
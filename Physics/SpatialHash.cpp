@@ -0,0 +1,138 @@
+#include "SpatialHash.hpp"
+
+#include "BodyStore.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    // the 13 neighbours "after" a cell; together with the cell itself every neighbouring pair is visited once
+    constexpr int HALF_STENCIL[13][3] = {
+        { 1, 0, 0},
+        {-1, 1, 0}, { 0, 1, 0}, { 1, 1, 0},
+        {-1,-1, 1}, { 0,-1, 1}, { 1,-1, 1},
+        {-1, 0, 1}, { 0, 0, 1}, { 1, 0, 1},
+        {-1, 1, 1}, { 0, 1, 1}, { 1, 1, 1}
+    };
+
+    // keeps far away bodies from overflowing the cell coordinates
+    constexpr float MAX_CELL_COORD = float(1 << 30);
+
+    inline int32_t cellCoord(float scaled) {
+        return static_cast<int32_t>(std::clamp(std::floor(scaled), -MAX_CELL_COORD, MAX_CELL_COORD));
+    }
+
+    inline double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+uint32_t SpatialHash::bucketOf(const glm::ivec3& cell) const {
+    uint32_t h = static_cast<uint32_t>(cell.x) * 73856093u
+               ^ static_cast<uint32_t>(cell.y) * 19349663u
+               ^ static_cast<uint32_t>(cell.z) * 83492791u;
+    return h & m_bucketMask;
+}
+
+void SpatialHash::build(const BodyStore& bodies, ThreadPool& pool) {
+    const size_t n = bodies.size();
+
+    uint32_t bucketCount = 1;
+    while (bucketCount < 2 * n) bucketCount <<= 1;
+    m_bucketMask = bucketCount - 1;
+
+    m_cell.resize(n);
+    m_bucket.resize(n);
+    const float invCell = 1.0f / m_cellSize;
+    pool.parallelFor(n, 4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            m_cell[i] = glm::ivec3(cellCoord(bodies.px[i] * invCell),
+                                   cellCoord(bodies.py[i] * invCell),
+                                   cellCoord(bodies.pz[i] * invCell));
+            m_bucket[i] = bucketOf(m_cell[i]);
+        }
+    });
+
+    // counting sort by bucket
+    m_bucketStart.assign(bucketCount + 1, 0);
+    for (size_t i = 0; i < n; ++i) m_bucketStart[m_bucket[i] + 1]++;
+    size_t occupied = 0;
+    for (uint32_t b = 0; b < bucketCount; ++b) {
+        if (m_bucketStart[b + 1] > 0) occupied++;
+        m_bucketStart[b + 1] += m_bucketStart[b];
+    }
+    m_sorted.resize(n);
+    std::vector<uint32_t> cursor(m_bucketStart.begin(), m_bucketStart.end() - 1);
+    for (size_t i = 0; i < n; ++i) m_sorted[cursor[m_bucket[i]]++] = static_cast<uint32_t>(i);
+
+    m_stats.bucketCount = bucketCount;
+    m_stats.occupiedBuckets = occupied;
+}
+
+void SpatialHash::findOverlaps(const BodyStore& bodies, std::vector<std::pair<uint32_t, uint32_t>>& pairs, ThreadPool& pool) {
+    m_stats = SpatialHashStats{};
+    pairs.clear();
+    const size_t n = bodies.size();
+    if (n < 2) return;
+
+    float maxRadius = 0.0f;
+    for (float r : bodies.radius) maxRadius = std::max(maxRadius, r);
+    if (maxRadius <= 0.0f) return;
+    m_cellSize = 2.0f * maxRadius * m_cellScale;
+    m_stats.cellSize = m_cellSize;
+
+    auto start = std::chrono::steady_clock::now();
+    build(bodies, pool);
+    m_stats.buildMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    const size_t threads = pool.getThreadCount();
+    m_threadPairs.resize(threads);
+    m_threadTests.assign(threads, 0);
+    for (auto& local : m_threadPairs) local.clear();
+
+    pool.parallelFor(n, 1024, [&](size_t begin, size_t end, size_t thread) {
+        std::vector<std::pair<uint32_t, uint32_t>>& local = m_threadPairs[thread];
+        size_t tests = 0;
+
+        auto test = [&](uint32_t i, uint32_t j) {
+            float dx = bodies.px[j] - bodies.px[i];
+            float dy = bodies.py[j] - bodies.py[i];
+            float dz = bodies.pz[j] - bodies.pz[i];
+            float rSum = bodies.radius[i] + bodies.radius[j];
+            tests++;
+            if (dx * dx + dy * dy + dz * dz < rSum * rSum) local.emplace_back(std::min(i, j), std::max(i, j));
+        };
+
+        for (size_t bi = begin; bi < end; ++bi) {
+            const uint32_t i = static_cast<uint32_t>(bi);
+            const glm::ivec3 cell = m_cell[i];
+
+            // own cell, other buckets' cells that collide in the hash are filtered out by coordinate
+            for (uint32_t s = m_bucketStart[m_bucket[i]]; s < m_bucketStart[m_bucket[i] + 1]; ++s) {
+                const uint32_t j = m_sorted[s];
+                if (j > i && m_cell[j] == cell) test(i, j);
+            }
+            for (const auto& offset : HALF_STENCIL) {
+                const glm::ivec3 neighbour = cell + glm::ivec3(offset[0], offset[1], offset[2]);
+                const uint32_t bucket = bucketOf(neighbour);
+                for (uint32_t s = m_bucketStart[bucket]; s < m_bucketStart[bucket + 1]; ++s) {
+                    const uint32_t j = m_sorted[s];
+                    if (m_cell[j] == neighbour) test(i, j);
+                }
+            }
+        }
+        m_threadTests[thread] += tests;
+    });
+
+    for (size_t t = 0; t < threads; ++t) {
+        pairs.insert(pairs.end(), m_threadPairs[t].begin(), m_threadPairs[t].end());
+        m_stats.pairsTested += m_threadTests[t];
+    }
+    // resolve in index order, like the direct loop does
+    std::sort(pairs.begin(), pairs.end());
+    m_stats.pairCount = pairs.size();
+    m_stats.queryMs = elapsedMs(start);
+}
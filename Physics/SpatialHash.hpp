@@ -0,0 +1,57 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct BodyStore;
+class ThreadPool;
+
+struct SpatialHashStats {
+    float cellSize = 0.0f;
+    size_t bucketCount = 0;
+    size_t occupiedBuckets = 0;
+    size_t pairsTested = 0; // narrow phase sphere tests
+    size_t pairCount = 0;   // overlapping pairs found
+
+    double buildMs = 0.0;
+    double queryMs = 0.0;
+};
+
+// Uniform grid broad phase. Cells are at least as wide as the largest body, so two overlapping bodies
+// always sit in the same or neighbouring cells. Cells are hashed into a table of about 2 buckets per
+// body, which keeps memory O(N) no matter how far the bodies spread out.
+class SpatialHash {
+private:
+    float m_cellSize = 0.0f;
+    float m_cellScale = 1.0f; // cell size as a multiple of the largest diameter
+    uint32_t m_bucketMask = 0;
+
+    std::vector<glm::ivec3> m_cell;       // per body
+    std::vector<uint32_t> m_bucket;       // per body
+    std::vector<uint32_t> m_bucketStart;  // bucketCount + 1 offsets into m_sorted
+    std::vector<uint32_t> m_sorted;       // body indices grouped by bucket
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> m_threadPairs;
+    std::vector<size_t> m_threadTests;
+
+    SpatialHashStats m_stats;
+
+public:
+    SpatialHash() = default;
+    ~SpatialHash() = default;
+
+    // Rebuilds the grid from the current positions and returns every overlapping pair (i < j), sorted
+    void findOverlaps(const BodyStore& bodies, std::vector<std::pair<uint32_t, uint32_t>>& pairs, ThreadPool& pool);
+
+    // >= 1. Larger cells mean fewer buckets to visit but more pairs to test.
+    void setCellScale(float scale) { m_cellScale = scale < 1.0f ? 1.0f : scale; }
+    float getCellScale() const { return m_cellScale; }
+
+    const SpatialHashStats& getStats() const { return m_stats; }
+
+private:
+    void build(const BodyStore& bodies, ThreadPool& pool);
+    uint32_t bucketOf(const glm::ivec3& cell) const;
+};
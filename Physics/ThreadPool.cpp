@@ -0,0 +1,142 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    start(threadCount);
+}
+
+ThreadPool::~ThreadPool() {
+    stop();
+}
+
+void ThreadPool::setThreadCount(size_t threadCount) {
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    if (threadCount == m_threadCount) return;
+    stop();
+    start(threadCount);
+}
+
+void ThreadPool::start(size_t threadCount) {
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    m_threadCount = threadCount;
+    m_stop = false;
+
+    m_queues.clear();
+    for (size_t t = 0; t < threadCount; ++t) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t t = 1; t < threadCount; ++t) {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this, t);
+    }
+}
+
+void ThreadPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) worker.join();
+    m_workers.clear();
+}
+
+void ThreadPool::run(size_t taskCount, const std::function<void(size_t, size_t)>& job) {
+    if (taskCount == 0) return;
+    if (m_threadCount == 1 || taskCount == 1) {
+        for (size_t t = 0; t < taskCount; ++t) job(t, 0);
+        return;
+    }
+
+    m_job = &job;
+    m_remaining.store(taskCount, std::memory_order_relaxed);
+
+    // contiguous runs per thread keep neighbouring tasks (and their data) on one core until someone steals
+    for (size_t q = 0; q < m_threadCount; ++q) {
+        size_t begin = taskCount * q / m_threadCount;
+        size_t end = taskCount * (q + 1) / m_threadCount;
+        std::lock_guard<std::mutex> lock(m_queues[q]->mutex);
+        for (size_t t = begin; t < end; ++t) m_queues[q]->tasks.push_back(static_cast<uint32_t>(t));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    drain(0);
+    while (m_remaining.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+    m_job = nullptr;
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t, size_t)>& fn) {
+    if (count == 0) return;
+    grain = std::max<size_t>(grain, 1);
+    // a few chunks per thread so stealing can even out uneven chunks
+    size_t chunks = std::min((count + grain - 1) / grain, m_threadCount * 4);
+    chunks = std::max<size_t>(chunks, 1);
+    run(chunks, [&](size_t chunk, size_t thread) {
+        fn(count * chunk / chunks, count * (chunk + 1) / chunks, thread);
+    });
+}
+
+void ThreadPool::workerLoop(size_t self) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+            if (m_stop) return;
+            seen = m_generation;
+        }
+        drain(self);
+    }
+}
+
+void ThreadPool::drain(size_t self) {
+    uint32_t task;
+    while (pop(self, task) || steal(self, task)) {
+        (*m_job)(task, self);
+        m_remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+bool ThreadPool::pop(size_t self, uint32_t& task) {
+    Queue& q = *m_queues[self];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) return false;
+    task = q.tasks.back();
+    q.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(size_t self, uint32_t& task) {
+    for (size_t offset = 1; offset < m_threadCount; ++offset) {
+        Queue& q = *m_queues[(self + offset) % m_threadCount];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) continue;
+        task = q.tasks.front();
+        q.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+std::vector<size_t> balancedTriangleSplit(size_t n, size_t parts) {
+    parts = std::max<size_t>(parts, 1);
+    std::vector<size_t> bounds(parts + 1, n);
+    bounds[0] = 0;
+    // rows [0, r) hold P(r) = r (2n - r - 1) / 2 pairs, invert P(r) = k * total / parts
+    const double total = 0.5 * double(n) * double(n - (n > 0 ? 1 : 0));
+    for (size_t k = 1; k < parts; ++k) {
+        double target = total * double(k) / double(parts);
+        double b = 2.0 * double(n) - 1.0;
+        double r = 0.5 * (b - std::sqrt(std::max(0.0, b * b - 8.0 * target)));
+        bounds[k] = std::clamp<size_t>(static_cast<size_t>(std::llround(r)), bounds[k - 1], n);
+    }
+    return bounds;
+}
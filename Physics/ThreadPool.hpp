@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent work-stealing pool. Every thread owns a deque of task indices: the owner pops from the back,
+// idle threads steal from the front of the others. The thread calling run() takes part as thread 0, so a
+// pool of N threads spawns N - 1 workers once and reuses them for every batch.
+class ThreadPool {
+private:
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<uint32_t> tasks;
+    };
+
+    std::vector<std::thread> m_workers;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake;
+    uint64_t m_generation = 0;
+    bool m_stop = false;
+
+    const std::function<void(size_t, size_t)>* m_job = nullptr;
+    std::atomic<size_t> m_remaining{0};
+
+    size_t m_threadCount = 1;
+
+public:
+    // 0 picks std::thread::hardware_concurrency()
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void setThreadCount(size_t threadCount);
+    size_t getThreadCount() const { return m_threadCount; }
+
+    // Calls job(task, thread) for every task in [0, taskCount) and blocks until all of them finished.
+    // thread is in [0, getThreadCount()) and identifies per-thread scratch space.
+    void run(size_t taskCount, const std::function<void(size_t, size_t)>& job);
+
+    // Splits [0, count) into chunks of at least grain elements and calls fn(begin, end, thread) for each
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t, size_t)>& fn);
+
+private:
+    void start(size_t threadCount);
+    void stop();
+    void workerLoop(size_t self);
+    void drain(size_t self);
+    bool pop(size_t self, uint32_t& task);
+    bool steal(size_t self, uint32_t& task);
+};
+
+// Row boundaries that split the upper triangle i < j of an n x n pair matrix into parts chunks of
+// roughly equal pair counts. Returns parts + 1 boundaries, the first is 0 and the last is n.
+std::vector<size_t> balancedTriangleSplit(size_t n, size_t parts);
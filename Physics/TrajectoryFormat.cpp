@@ -0,0 +1,123 @@
+#include "TrajectoryFormat.hpp"
+
+#include "BlockCodec.hpp"
+#include "Checksum.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+    inline uint32_t zigzag(int32_t v) { return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31); }
+    inline int32_t unzigzag(uint32_t v) { return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1); }
+}
+
+TrajectoryBlock encodeTrajectoryBlock(const float* x, const float* y, const float* z, size_t stride,
+                                      uint32_t frames, uint32_t bodies, uint32_t bits,
+                                      std::vector<std::byte>& out, TrajectoryScratch& scratch) {
+    const float* axes[3] = {x, y, z};
+    bits = std::clamp(bits, TRAJECTORY_MIN_BITS, TRAJECTORY_MAX_BITS);
+    const size_t count = size_t(frames) * bodies;
+
+    // one grid for all three axes keeps the error isotropic
+    float lo[3], hi[3];
+    float extent = 0.0f;
+    for (int a = 0; a < 3; ++a) {
+        lo[a] = std::numeric_limits<float>::max();
+        hi[a] = std::numeric_limits<float>::lowest();
+        for (uint32_t f = 0; f < frames; ++f) {
+            const float* row = axes[a] + f * stride;
+            for (uint32_t b = 0; b < bodies; ++b) {
+                if (!std::isfinite(row[b])) continue;
+                lo[a] = std::min(lo[a], row[b]);
+                hi[a] = std::max(hi[a], row[b]);
+            }
+        }
+        if (lo[a] > hi[a]) lo[a] = hi[a] = 0.0f;
+        extent = std::max(extent, hi[a] - lo[a]);
+    }
+
+    TrajectoryBlock block;
+    const uint32_t absent = (1u << bits) - 1;
+    const uint32_t maxLevel = absent - 1;
+    block.quantum = extent > 0.0f && std::isfinite(extent) ? extent / float(maxLevel) : 1.0f;
+    const float inverse = 1.0f / block.quantum;
+
+    scratch.values.resize(3 * count);
+    for (int a = 0; a < 3; ++a) {
+        block.origin[a] = lo[a];
+        uint32_t* values = scratch.values.data() + a * count;
+        for (uint32_t f = 0; f < frames; ++f) {
+            const float* row = axes[a] + f * stride;
+            uint32_t* level = values + size_t(f) * bodies;
+            for (uint32_t b = 0; b < bodies; ++b) {
+                if (!std::isfinite(row[b])) {
+                    level[b] = absent;
+                    continue;
+                }
+                const float v = (row[b] - lo[a]) * inverse;
+                level[b] = std::min(static_cast<uint32_t>(std::lround(std::max(v, 0.0f))), maxLevel);
+            }
+        }
+        // backwards, so every frame still sees its predecessor's level
+        for (uint32_t f = frames; f-- > 1;) {
+            uint32_t* level = values + size_t(f) * bodies;
+            const uint32_t* previous = level - bodies;
+            for (uint32_t b = 0; b < bodies; ++b) {
+                level[b] = zigzag(static_cast<int32_t>(level[b] - previous[b]));
+            }
+        }
+    }
+
+    // byte planes: small deltas leave the upper planes all zero
+    const size_t total = scratch.values.size();
+    scratch.planes.resize(total * 4);
+    for (size_t i = 0; i < total; ++i) {
+        const uint32_t v = scratch.values[i];
+        scratch.planes[i] = static_cast<std::byte>(v);
+        scratch.planes[total + i] = static_cast<std::byte>(v >> 8);
+        scratch.planes[2 * total + i] = static_cast<std::byte>(v >> 16);
+        scratch.planes[3 * total + i] = static_cast<std::byte>(v >> 24);
+    }
+
+    block.offset = out.size();
+    block.rawSize = static_cast<uint32_t>(scratch.planes.size());
+    out.resize(out.size() + BlockCodec::bound(scratch.planes.size()));
+    block.compressedSize = static_cast<uint32_t>(
+        BlockCodec::compress(scratch.planes.data(), scratch.planes.size(), out.data() + block.offset));
+    out.resize(block.offset + block.compressedSize);
+    block.checksum = Checksum64::of(out.data() + block.offset, block.compressedSize);
+    return block;
+}
+
+bool decodeTrajectoryBlock(const TrajectoryBlock& block, const std::byte* payload, uint32_t frames,
+                           uint32_t bodies, uint32_t bits, float* out, TrajectoryScratch& scratch) {
+    const size_t count = size_t(frames) * bodies;
+    const size_t total = 3 * count;
+    if (block.rawSize != total * 4) return false;
+    const uint32_t absent = (1u << std::clamp(bits, TRAJECTORY_MIN_BITS, TRAJECTORY_MAX_BITS)) - 1;
+
+    scratch.planes.resize(block.rawSize);
+    if (!BlockCodec::decompress(payload, block.compressedSize, scratch.planes.data(), block.rawSize)) return false;
+
+    const std::byte* planes = scratch.planes.data();
+    for (int a = 0; a < 3; ++a) {
+        const size_t base = a * count;
+        float* axis = out + base;
+        // running level per body, rebuilt from the deltas frame by frame
+        scratch.values.assign(bodies, 0);
+        for (uint32_t f = 0; f < frames; ++f) {
+            float* row = axis + size_t(f) * bodies;
+            for (uint32_t b = 0; b < bodies; ++b) {
+                const size_t i = base + size_t(f) * bodies + b;
+                const uint32_t v = static_cast<uint32_t>(planes[i]) | static_cast<uint32_t>(planes[total + i]) << 8
+                    | static_cast<uint32_t>(planes[2 * total + i]) << 16 | static_cast<uint32_t>(planes[3 * total + i]) << 24;
+                scratch.values[b] = f == 0 ? v : scratch.values[b] + static_cast<uint32_t>(unzigzag(v));
+                row[b] = scratch.values[b] == absent ? std::numeric_limits<float>::quiet_NaN()
+                                                     : block.origin[a] + float(scratch.values[b]) * block.quantum;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Trajectory recording of body positions. Layout, little-endian throughout:
+//
+//   TrajectoryHeader, padded to TRAJECTORY_ALIGNMENT
+//   Handle per recorded body, then the caller's metadata (the scene's objects)
+//   chunks, each on a TRAJECTORY_ALIGNMENT boundary
+//   TrajectoryChunk per chunk (the index), found through the header
+//
+// A chunk covers up to framesPerChunk consecutive frames of every recorded body:
+//
+//   TrajectoryFrame per frame, TrajectoryBlock per block of bodiesPerBlock bodies, the block payloads
+//
+// so one body at one time costs the index lookup, one block table and one block payload. A payload is the
+// block's positions quantized to quantizationBits on a grid fitted around the block over the chunk, the first
+// frame absolute and the rest zigzagged deltas from the frame before, split into byte planes and compressed
+// with BlockCodec. Bodies that barely move between frames become long runs of zero bytes. The top level marks
+// a body that was absent from a frame (removed, or not finite), which decodes to NaN.
+static_assert(std::endian::native == std::endian::little, "trajectories are written in native byte order");
+
+constexpr char TRAJECTORY_MAGIC[8] = {'P', 'H', 'O', 'T', 'O', 'N', 'T', 'R'};
+constexpr uint32_t TRAJECTORY_VERSION = 1;
+constexpr size_t TRAJECTORY_ALIGNMENT = 4096;
+constexpr uint32_t TRAJECTORY_MIN_BITS = 8;
+constexpr uint32_t TRAJECTORY_MAX_BITS = 24; // a float has no more to give
+
+struct TrajectoryHeader {
+    char magic[8];
+    uint32_t version = TRAJECTORY_VERSION;
+    uint32_t headerSize = sizeof(TrajectoryHeader);
+    uint64_t fileSize = 0;
+    uint64_t indexChecksum = 0; // XXH64 of the chunk index, every block has its own
+
+    uint64_t bodyCount = 0;
+    uint64_t frameCount = 0;
+    uint64_t chunkCount = 0;
+    uint32_t sampleEvery = 1;     // steps between frames, frames dropped under backpressure leave wider gaps
+    uint32_t framesPerChunk = 0;
+    uint32_t bodiesPerBlock = 0;
+    uint32_t quantizationBits = 0;
+    float dt = 0.0f;
+    uint32_t reserved = 0;
+
+    uint64_t handlesOffset = 0;
+    uint64_t metadataOffset = 0;
+    uint64_t metadataSize = 0;
+    uint64_t indexOffset = 0;
+
+    uint64_t firstStep = 0;
+    uint64_t lastStep = 0;
+    double firstTime = 0.0;
+    double lastTime = 0.0;
+};
+static_assert(sizeof(TrajectoryHeader) <= TRAJECTORY_ALIGNMENT);
+
+struct TrajectoryFrame {
+    uint64_t step = 0;
+    double time = 0.0;
+};
+
+struct TrajectoryBlock {
+    uint64_t offset = 0;     // of the payload, from the start of the chunk
+    uint32_t compressedSize = 0;
+    uint32_t rawSize = 0;
+    float origin[3] = {};    // position of quantized 0
+    float quantum = 1.0f;    // grid spacing, levels run to 2^bits - 2
+    uint64_t checksum = 0;   // XXH64 of the payload
+};
+
+struct TrajectoryChunk {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint64_t firstStep = 0;
+    uint64_t lastStep = 0;
+    double firstTime = 0.0;
+    double lastTime = 0.0;
+    uint32_t frameCount = 0;
+    uint32_t blockCount = 0;
+};
+
+// Reused buffers, so encoding and decoding don't allocate once warmed up
+struct TrajectoryScratch {
+    std::vector<uint32_t> values;
+    std::vector<std::byte> planes;
+};
+
+// Encodes frames x bodies positions, where x, y and z hold frame f of body b at [f * stride + b], and appends
+// the payload to out. The returned block's offset is the payload's position in out.
+TrajectoryBlock encodeTrajectoryBlock(const float* x, const float* y, const float* z, size_t stride,
+                                      uint32_t frames, uint32_t bodies, uint32_t bits,
+                                      std::vector<std::byte>& out, TrajectoryScratch& scratch);
+
+// Decodes a payload into out, 3 * frames * bodies floats laid out [axis][frame][body], NaN for absent bodies.
+// bits is the header's quantizationBits. False when the payload doesn't decompress to the block's size.
+bool decodeTrajectoryBlock(const TrajectoryBlock& block, const std::byte* payload, uint32_t frames,
+                           uint32_t bodies, uint32_t bits, float* out, TrajectoryScratch& scratch);
@@ -0,0 +1,89 @@
+#include "TrajectoryReader.hpp"
+
+#include "Checksum.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+TrajectoryReader::TrajectoryReader(const std::string& path)
+    : m_file(path) {
+    if (m_file.size() < TRAJECTORY_ALIGNMENT) throw std::runtime_error("Trajectory: file too small: " + path);
+    m_header = reinterpret_cast<const TrajectoryHeader*>(m_file.data());
+
+    const TrajectoryHeader& header = *m_header;
+    if (std::memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic)) != 0)
+        throw std::runtime_error("Trajectory: not a trajectory recording: " + path);
+    if (header.version != TRAJECTORY_VERSION)
+        throw std::runtime_error("Trajectory: unsupported version " + std::to_string(header.version) + ": " + path);
+    // an unfinished recording still has the zeroed placeholder, caught by the magic above
+    const uint64_t size = header.fileSize;
+    if (header.headerSize != sizeof(TrajectoryHeader) || size > m_file.size() || header.bodiesPerBlock == 0
+        || header.quantizationBits < TRAJECTORY_MIN_BITS || header.quantizationBits > TRAJECTORY_MAX_BITS
+        || header.handlesOffset > size || header.bodyCount > (size - header.handlesOffset) / sizeof(Handle)
+        || header.metadataOffset > size || header.metadataSize > size - header.metadataOffset
+        || header.indexOffset > size || header.chunkCount > (size - header.indexOffset) / sizeof(TrajectoryChunk))
+        throw std::runtime_error("Trajectory: corrupt header: " + path);
+
+    m_index = {reinterpret_cast<const TrajectoryChunk*>(m_file.data() + header.indexOffset),
+               static_cast<size_t>(header.chunkCount)};
+    if (Checksum64::of(m_index.data(), m_index.size_bytes()) != header.indexChecksum)
+        throw std::runtime_error("Trajectory: chunk index checksum mismatch: " + path);
+
+    const uint64_t blockCount = (header.bodyCount + header.bodiesPerBlock - 1) / header.bodiesPerBlock;
+    for (const TrajectoryChunk& chunk : m_index) {
+        const uint64_t tables = chunk.frameCount * sizeof(TrajectoryFrame) + chunk.blockCount * sizeof(TrajectoryBlock);
+        if (chunk.offset > size || chunk.size > size - chunk.offset || tables > chunk.size
+            || chunk.blockCount != blockCount || chunk.frameCount == 0)
+            throw std::runtime_error("Trajectory: chunk out of bounds: " + path);
+    }
+}
+
+std::span<const Handle> TrajectoryReader::handles() const {
+    return {reinterpret_cast<const Handle*>(m_file.data() + m_header->handlesOffset), static_cast<size_t>(m_header->bodyCount)};
+}
+
+std::span<const std::byte> TrajectoryReader::metadata() const {
+    return {m_file.data() + m_header->metadataOffset, static_cast<size_t>(m_header->metadataSize)};
+}
+
+std::span<const TrajectoryFrame> TrajectoryReader::frames(size_t chunk) const {
+    const TrajectoryChunk& entry = m_index[chunk];
+    return {reinterpret_cast<const TrajectoryFrame*>(m_file.data() + entry.offset), entry.frameCount};
+}
+
+std::span<const TrajectoryBlock> TrajectoryReader::blocks(size_t chunk) const {
+    const TrajectoryChunk& entry = m_index[chunk];
+    const std::byte* table = m_file.data() + entry.offset + entry.frameCount * sizeof(TrajectoryFrame);
+    return {reinterpret_cast<const TrajectoryBlock*>(table), entry.blockCount};
+}
+
+uint32_t TrajectoryReader::blockSize(size_t block) const {
+    return static_cast<uint32_t>(std::min<uint64_t>(m_header->bodiesPerBlock, m_header->bodyCount - blockBegin(block)));
+}
+
+std::pair<size_t, uint32_t> TrajectoryReader::findFrame(double time) const {
+    if (m_index.empty()) return {0, 0};
+    // first chunk ending after time, or the last one
+    auto it = std::upper_bound(m_index.begin(), m_index.end(), time,
+                               [](double t, const TrajectoryChunk& chunk) { return t < chunk.lastTime; });
+    const size_t chunk = std::min(static_cast<size_t>(it - m_index.begin()), m_index.size() - 1);
+    std::span<const TrajectoryFrame> frames = this->frames(chunk);
+    auto frame = std::upper_bound(frames.begin(), frames.end(), time,
+                                  [](double t, const TrajectoryFrame& f) { return t < f.time; });
+    if (frame == frames.begin()) {
+        // before this chunk's first frame: the last frame of the chunk before, if any
+        if (chunk == 0) return {0, 0};
+        return {chunk - 1, m_index[chunk - 1].frameCount - 1};
+    }
+    return {chunk, static_cast<uint32_t>(frame - frames.begin() - 1)};
+}
+
+bool TrajectoryReader::decodeBlock(size_t chunk, size_t block, float* out, TrajectoryScratch& scratch, bool verify) const {
+    const TrajectoryChunk& entry = m_index[chunk];
+    const TrajectoryBlock& info = blocks(chunk)[block];
+    if (info.offset > entry.size || info.compressedSize > entry.size - info.offset) return false;
+    const std::byte* payload = m_file.data() + entry.offset + info.offset;
+    if (verify && Checksum64::of(payload, info.compressedSize) != info.checksum) return false;
+    return decodeTrajectoryBlock(info, payload, entry.frameCount, blockSize(block), m_header->quantizationBits, out, scratch);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "MappedFile.hpp"
+#include "SlotMap.hpp"
+#include "TrajectoryFormat.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <utility>
+
+// A recorded trajectory mapped into memory. Opening checks the header and the chunk index, O(chunks); the
+// chunks themselves are only touched when a block is decoded. Throws std::runtime_error on a bad file.
+class TrajectoryReader {
+private:
+    MappedFile m_file;
+    const TrajectoryHeader* m_header = nullptr;
+    std::span<const TrajectoryChunk> m_index;
+
+public:
+    explicit TrajectoryReader(const std::string& path);
+
+    const TrajectoryHeader& header() const { return *m_header; }
+    std::span<const Handle> handles() const;
+    std::span<const std::byte> metadata() const;
+    std::span<const TrajectoryChunk> chunks() const { return m_index; }
+
+    std::span<const TrajectoryFrame> frames(size_t chunk) const;
+    std::span<const TrajectoryBlock> blocks(size_t chunk) const;
+    // Bodies [blockBegin(block), blockBegin(block) + blockSize(block)) of handles()
+    size_t blockBegin(size_t block) const { return block * m_header->bodiesPerBlock; }
+    uint32_t blockSize(size_t block) const;
+
+    // Chunk and frame of the latest frame at or before time, the very first frame for earlier times
+    std::pair<size_t, uint32_t> findFrame(double time) const;
+
+    // Decodes one block of a chunk into out, 3 * frameCount * blockSize floats (see decodeTrajectoryBlock).
+    // False when the payload is out of bounds, fails its checksum (with verify) or doesn't decode.
+    bool decodeBlock(size_t chunk, size_t block, float* out, TrajectoryScratch& scratch, bool verify) const;
+};
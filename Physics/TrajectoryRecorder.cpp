@@ -0,0 +1,220 @@
+#include "TrajectoryRecorder.hpp"
+
+#include "BodyStore.hpp"
+#include "Checksum.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+TrajectoryRecorder::TrajectoryRecorder(const RecordingSettings& settings, const std::vector<Handle>& handles,
+                                       std::span<const std::byte> metadata, float dt, uint64_t startStep)
+    : m_settings(settings), m_startStep(startStep) {
+    m_settings.sampleEvery = std::max(m_settings.sampleEvery, 1u);
+    m_settings.bodyStride = std::max(m_settings.bodyStride, 1u);
+    m_settings.bodiesPerBlock = std::max(m_settings.bodiesPerBlock, 1u);
+    m_settings.quantizationBits = std::clamp(m_settings.quantizationBits, TRAJECTORY_MIN_BITS, TRAJECTORY_MAX_BITS);
+
+    for (size_t i = 0; i < handles.size(); i += m_settings.bodyStride) {
+        if (m_settings.maxBodies > 0 && m_bodies.size() == m_settings.maxBodies) break;
+        m_bodies.push_back(handles[i]);
+    }
+    if (m_bodies.empty()) throw std::runtime_error("Nothing to record: no bodies selected");
+
+    // at least two chunks in the ring, so the simulation fills one while the writer drains the other
+    const size_t frameBytes = 3 * sizeof(float) * m_bodies.size();
+    uint32_t chunkFrames = std::max(m_settings.framesPerChunk, 1u);
+    size_t chunks = m_settings.ringBytes / (size_t(chunkFrames) * frameBytes);
+    if (chunks < 2) {
+        chunkFrames = static_cast<uint32_t>(std::max<size_t>(m_settings.ringBytes / (2 * frameBytes), 1));
+        chunks = 2;
+    }
+    chunks = std::min<size_t>(chunks, 16);
+    m_settings.framesPerChunk = chunkFrames;
+    m_capacity = static_cast<uint32_t>(chunks * chunkFrames);
+    m_ring.resize(size_t(m_capacity) * 3 * m_bodies.size());
+    m_frames.resize(m_capacity);
+
+    m_writer = std::make_unique<AlignedFileWriter>(m_settings.path);
+    std::memcpy(m_header.magic, TRAJECTORY_MAGIC, sizeof(m_header.magic));
+    m_header.bodyCount = m_bodies.size();
+    m_header.sampleEvery = m_settings.sampleEvery;
+    m_header.framesPerChunk = m_settings.framesPerChunk;
+    m_header.bodiesPerBlock = m_settings.bodiesPerBlock;
+    m_header.quantizationBits = m_settings.quantizationBits;
+    m_header.dt = dt;
+
+    // header placeholder, patched in by finish()
+    const std::vector<std::byte> zeros(TRAJECTORY_ALIGNMENT);
+    m_writer->write(zeros.data(), zeros.size());
+    m_header.handlesOffset = m_writer->offset();
+    m_writer->write(m_bodies.data(), m_bodies.size() * sizeof(Handle));
+    m_writer->pad(TRAJECTORY_ALIGNMENT);
+    m_header.metadataOffset = m_writer->offset();
+    m_header.metadataSize = metadata.size();
+    m_writer->write(metadata.data(), metadata.size());
+
+    m_started = std::chrono::steady_clock::now();
+    m_thread = std::thread(&TrajectoryRecorder::writerLoop, this);
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+    finish();
+}
+
+void TrajectoryRecorder::capture(const BodyStore& bodies, const SlotMap& handles, uint64_t step, double time) {
+    if (m_failed.load(std::memory_order_relaxed) || m_stopping.load(std::memory_order_relaxed)) return;
+    const uint64_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) >= m_capacity) {
+        m_dropped++;
+        return;
+    }
+
+    const size_t m = m_bodies.size();
+    const uint32_t slot = static_cast<uint32_t>(head % m_capacity);
+    float* x = m_ring.data() + size_t(slot) * 3 * m;
+    float* y = x + m;
+    float* z = y + m;
+    for (size_t k = 0; k < m; ++k) {
+        const uint32_t i = handles.indexOf(m_bodies[k]);
+        if (i == Handle::INVALID) {
+            x[k] = y[k] = z[k] = std::numeric_limits<float>::quiet_NaN();
+            continue;
+        }
+        x[k] = bodies.px[i];
+        y[k] = bodies.py[i];
+        z[k] = bodies.pz[i];
+    }
+    m_frames[slot] = {step, time};
+    m_head.store(head + 1, std::memory_order_release);
+
+    if ((head + 1) % m_settings.framesPerChunk == 0) {
+        m_wake.fetch_add(1, std::memory_order_release);
+        m_wake.notify_one();
+    }
+}
+
+void TrajectoryRecorder::finish() {
+    if (!m_thread.joinable()) return;
+    m_stopping.store(true, std::memory_order_release);
+    m_wake.fetch_add(1, std::memory_order_release);
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void TrajectoryRecorder::writerLoop() {
+    const uint32_t chunkFrames = m_settings.framesPerChunk;
+    try {
+        while (true) {
+            const uint32_t wake = m_wake.load(std::memory_order_acquire);
+            const bool stopping = m_stopping.load(std::memory_order_acquire);
+            const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+            const uint64_t head = m_head.load(std::memory_order_acquire);
+            if (head - tail >= chunkFrames) {
+                writeChunk(tail, chunkFrames);
+                continue;
+            }
+            if (stopping) {
+                // the simulation no longer captures, the rest is one short chunk
+                if (head > tail) writeChunk(tail, static_cast<uint32_t>(head - tail));
+                break;
+            }
+            m_wake.wait(wake, std::memory_order_acquire);
+        }
+        writeIndex();
+    } catch (const std::runtime_error& error) {
+        {
+            std::lock_guard<std::mutex> lock(m_errorMutex);
+            m_error = error.what();
+        }
+        m_failed.store(true, std::memory_order_release);
+        // drops the partial file
+        m_writer.reset();
+    }
+}
+
+void TrajectoryRecorder::writeChunk(uint64_t first, uint32_t frames) {
+    const auto start = std::chrono::steady_clock::now();
+    const size_t m = m_bodies.size();
+    const size_t frameStride = 3 * m;
+    const uint32_t slot = static_cast<uint32_t>(first % m_capacity);
+    const float* base = m_ring.data() + size_t(slot) * frameStride;
+
+    m_blocks.clear();
+    m_payload.clear();
+    for (size_t b0 = 0; b0 < m; b0 += m_settings.bodiesPerBlock) {
+        const uint32_t count = static_cast<uint32_t>(std::min<size_t>(m_settings.bodiesPerBlock, m - b0));
+        m_blocks.push_back(encodeTrajectoryBlock(base + b0, base + m + b0, base + 2 * m + b0, frameStride, frames,
+                                                 count, m_settings.quantizationBits, m_payload, m_scratch));
+    }
+
+    m_writer->pad(TRAJECTORY_ALIGNMENT);
+    TrajectoryChunk chunk;
+    chunk.offset = m_writer->offset();
+    chunk.frameCount = frames;
+    chunk.blockCount = static_cast<uint32_t>(m_blocks.size());
+    chunk.firstStep = m_frames[slot].step;
+    chunk.firstTime = m_frames[slot].time;
+    chunk.lastStep = m_frames[slot + frames - 1].step;
+    chunk.lastTime = m_frames[slot + frames - 1].time;
+
+    const uint64_t tables = frames * sizeof(TrajectoryFrame) + m_blocks.size() * sizeof(TrajectoryBlock);
+    for (TrajectoryBlock& block : m_blocks) block.offset += tables;
+    m_writer->write(m_frames.data() + slot, frames * sizeof(TrajectoryFrame));
+    m_writer->write(m_blocks.data(), m_blocks.size() * sizeof(TrajectoryBlock));
+    m_writer->write(m_payload.data(), m_payload.size());
+    chunk.size = m_writer->offset() - chunk.offset;
+
+    if (m_index.empty()) {
+        m_header.firstStep = chunk.firstStep;
+        m_header.firstTime = chunk.firstTime;
+    }
+    m_header.lastStep = chunk.lastStep;
+    m_header.lastTime = chunk.lastTime;
+    m_header.frameCount += frames;
+    m_index.push_back(chunk);
+
+    // the frames are encoded, hand the slots back
+    m_tail.store(first + frames, std::memory_order_release);
+    m_writtenBytes.store(m_writer->offset(), std::memory_order_relaxed);
+    m_busyNs.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count()), std::memory_order_relaxed);
+}
+
+void TrajectoryRecorder::writeIndex() {
+    m_writer->pad(TRAJECTORY_ALIGNMENT);
+    m_header.indexOffset = m_writer->offset();
+    m_header.chunkCount = m_index.size();
+    m_header.indexChecksum = Checksum64::of(m_index.data(), m_index.size() * sizeof(TrajectoryChunk));
+    m_writer->write(m_index.data(), m_index.size() * sizeof(TrajectoryChunk));
+    m_header.fileSize = m_writer->offset();
+    m_writer->patch(0, &m_header, sizeof(m_header));
+    m_writer->finish();
+    m_writtenBytes.store(m_header.fileSize, std::memory_order_relaxed);
+}
+
+RecordingStats TrajectoryRecorder::getStats() const {
+    RecordingStats stats;
+    stats.failed = m_failed.load(std::memory_order_acquire);
+    stats.active = !stats.failed && !m_stopping.load(std::memory_order_relaxed);
+    stats.path = m_settings.path;
+    if (stats.failed) {
+        std::lock_guard<std::mutex> lock(m_errorMutex);
+        stats.error = m_error;
+    }
+
+    const uint64_t head = m_head.load(std::memory_order_relaxed);
+    const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    stats.bodyCount = m_bodies.size();
+    stats.framesCaptured = head;
+    stats.framesDropped = m_dropped;
+    stats.framesWritten = tail;
+    stats.ringUsed = static_cast<uint32_t>(head - std::min(tail, head));
+    stats.ringCapacity = m_capacity;
+    stats.rawBytes = tail * 3 * sizeof(float) * m_bodies.size();
+    stats.writtenBytes = m_writtenBytes.load(std::memory_order_relaxed);
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_started).count();
+    stats.writerBusy = elapsed > 0.0 ? std::min(m_busyNs.load(std::memory_order_relaxed) * 1e-9 / elapsed, 1.0) : 0.0;
+    return stats;
+}
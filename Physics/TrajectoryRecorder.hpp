@@ -0,0 +1,110 @@
+#pragma once
+
+#include "AlignedFileWriter.hpp"
+#include "SlotMap.hpp"
+#include "TrajectoryFormat.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BodyStore;
+
+struct RecordingSettings {
+    std::string path;
+    uint32_t sampleEvery = 1;       // steps between frames
+    uint32_t bodyStride = 1;        // every bodyStride-th body present at the start
+    uint32_t maxBodies = 0;         // 0 records all of them
+    uint32_t quantizationBits = 20; // per axis, across a block's extent over a chunk
+    uint32_t framesPerChunk = 64;
+    uint32_t bodiesPerBlock = 4096;
+    size_t ringBytes = size_t(256) << 20; // frames waiting for the writer
+};
+
+struct RecordingStats {
+    bool active = false;
+    bool failed = false;
+    std::string path;
+    std::string error;
+
+    uint64_t bodyCount = 0;
+    uint64_t framesCaptured = 0;
+    uint64_t framesDropped = 0; // the ring was full, the writer is behind
+    uint64_t framesWritten = 0;
+    uint32_t ringUsed = 0;      // frames
+    uint32_t ringCapacity = 0;
+    uint64_t rawBytes = 0;      // positions as floats
+    uint64_t writtenBytes = 0;
+    double writerBusy = 0.0;    // fraction of the time the writer thread spent encoding and writing
+};
+
+// Records positions of a fixed set of bodies to a trajectory file (see TrajectoryFormat.hpp). The simulation
+// thread copies each sampled step into a ring of frames and never waits: when the ring is full the frame is
+// dropped and counted. A writer thread encodes whole chunks straight out of the ring and streams them to disk.
+// Bodies removed after the start are recorded as absent, bodies added later aren't recorded.
+class TrajectoryRecorder {
+private:
+    RecordingSettings m_settings;
+    std::vector<Handle> m_bodies;
+    uint64_t m_startStep = 0;
+
+    // ring of m_capacity frames, each x[M] y[M] z[M]; chunks never wrap, m_capacity is a multiple of a chunk
+    std::vector<float> m_ring;
+    std::vector<TrajectoryFrame> m_frames;
+    uint32_t m_capacity = 0;
+    std::atomic<uint64_t> m_head{0}; // frames captured, simulation thread
+    std::atomic<uint64_t> m_tail{0}; // frames written, writer thread
+    std::atomic<bool> m_stopping{false};
+    std::atomic<uint32_t> m_wake{0}; // bumped when a chunk fills up or on finish, the writer waits on it
+
+    // simulation thread
+    uint64_t m_dropped = 0;
+
+    // writer thread
+    std::unique_ptr<AlignedFileWriter> m_writer;
+    TrajectoryHeader m_header{};
+    std::vector<TrajectoryChunk> m_index;
+    std::vector<TrajectoryBlock> m_blocks;
+    std::vector<std::byte> m_payload;
+    TrajectoryScratch m_scratch;
+    std::atomic<uint64_t> m_writtenBytes{0};
+    std::atomic<uint64_t> m_busyNs{0};
+    std::chrono::steady_clock::time_point m_started;
+
+    std::atomic<bool> m_failed{false};
+    mutable std::mutex m_errorMutex;
+    std::string m_error;
+
+    std::thread m_thread;
+
+public:
+    // Opens the file and starts the writer. The first frame is the state at startStep, which the caller
+    // captures right away. Throws std::runtime_error when the file can't be created.
+    TrajectoryRecorder(const RecordingSettings& settings, const std::vector<Handle>& handles,
+                       std::span<const std::byte> metadata, float dt, uint64_t startStep);
+    // Finishes the file
+    ~TrajectoryRecorder();
+
+    TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+    bool wantsStep(uint64_t step) const { return (step - m_startStep) % m_settings.sampleEvery == 0; }
+    // Simulation thread: copies the recorded bodies into the ring, or drops the frame when it is full
+    void capture(const BodyStore& bodies, const SlotMap& handles, uint64_t step, double time);
+    // Writes what is left in the ring and the index, then closes the file. Blocks until the writer is done.
+    void finish();
+
+    RecordingStats getStats() const;
+
+private:
+    void writerLoop();
+    void writeChunk(uint64_t first, uint32_t frames);
+    void writeIndex();
+};
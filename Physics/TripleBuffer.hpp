@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer, single consumer handoff of the latest value. The writer fills back() and
+// publishes it, the reader picks up whatever was published last; neither ever waits on the other and
+// intermediate values the reader was too slow to see are simply overwritten.
+template <typename T>
+class TripleBuffer {
+private:
+    static constexpr uint8_t INDEX_MASK = 3;
+    static constexpr uint8_t FRESH = 4; // the middle slot holds a value the reader hasn't taken yet
+
+    T m_slots[3]{};
+    uint8_t m_back = 0;  // writer only
+    uint8_t m_front = 2; // reader only
+    alignas(64) std::atomic<uint8_t> m_middle{1};
+
+public:
+    // Writer side
+    T& back() { return m_slots[m_back]; }
+    void publish() {
+        uint8_t old = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel);
+        m_back = old & INDEX_MASK;
+    }
+
+    // Reader side. Returns true when front() now holds a newer value.
+    bool acquire() {
+        if (!(m_middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        uint8_t old = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = old & INDEX_MASK;
+        return true;
+    }
+    const T& front() const { return m_slots[m_front]; }
+};
@@ -1,13 +1,111 @@
 #include "physics.hpp"
 
-Physics::Physics() {
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace {
+    // bodies per chunk for the streaming passes (reset, reduction, integration)
+    constexpr size_t STREAM_GRAIN = 4096;
+    // below this many contacts the wave scheduling costs more than it saves
+    constexpr size_t PARALLEL_CONTACTS = 256;
+
+    // Yoshida (1990): three velocity Verlet steps of w1, w0, w1 cancel the third order error
+    const double YOSHIDA_W1 = 1.0 / (2.0 - std::cbrt(2.0));
+    const double YOSHIDA_W0 = -std::cbrt(2.0) / (2.0 - std::cbrt(2.0));
+}
+
+Physics::Physics(size_t threadCount)
+    : m_pool(threadCount) {
 }
 
 Physics::~Physics() {
-    m_planets.clear();
+    m_bodies.clear();
+}
+
+Handle Physics::addPlanet(const glm::vec3& pos, const glm::vec3& vel, float mass, float r) {
+    pushPlanet(pos, vel, mass, r);
+    return m_handles.create();
+}
+
+bool Physics::addPlanet(Handle handle, const glm::vec3& pos, const glm::vec3& vel, float mass, float r) {
+    if (!m_handles.insert(handle)) return false;
+    pushPlanet(pos, vel, mass, r);
+    return true;
+}
+
+bool Physics::removeBody(Handle handle) {
+    const uint32_t index = m_handles.erase(handle);
+    if (index == Handle::INVALID) return false;
+    m_bodies.swapRemove(index);
+    invalidateForces();
+    return true;
+}
+
+size_t Physics::removeBodies(const std::vector<Handle>& handles) {
+    size_t removed = 0;
+    for (const Handle& handle : handles) removed += removeBody(handle) ? 1 : 0;
+    return removed;
+}
+
+void Physics::clearBodies() {
+    m_bodies.clear();
+    m_handles.clear();
+    invalidateForces();
+}
+
+bool Physics::restoreHandles(const std::vector<Handle>& handles, bool forcesValid) {
+    if (handles.size() != m_bodies.size() || !m_handles.assign(handles)) return false;
+    invalidateForces();
+    m_forcesValid = forcesValid && m_integrator != Integrator::HermiteBlock;
+    m_forcesCount = m_bodies.size();
+    return true;
+}
+
+std::vector<Handle> Physics::addPlanets(std::span<const glm::vec3> pos, std::span<const glm::vec3> vel,
+                                        std::span<const float> mass, std::span<const float> r) {
+    appendPlanets(pos, vel, mass, r, nullptr);
+    std::vector<Handle> handles(pos.size());
+    for (Handle& handle : handles) handle = m_handles.create();
+    return handles;
+}
+
+size_t Physics::addPlanets(std::span<const Handle> handles, std::span<const glm::vec3> pos, std::span<const glm::vec3> vel,
+                           std::span<const float> mass, std::span<const float> r) {
+    std::vector<uint32_t> picks;
+    picks.reserve(handles.size());
+    for (size_t k = 0; k < handles.size(); ++k) {
+        if (m_handles.insert(handles[k])) picks.push_back(static_cast<uint32_t>(k));
+    }
+    appendPlanets(pos, vel, mass, r, &picks);
+    return picks.size();
+}
+
+void Physics::appendPlanets(std::span<const glm::vec3> pos, std::span<const glm::vec3> vel, std::span<const float> mass,
+                            std::span<const float> r, const std::vector<uint32_t>* picks) {
+    const size_t count = picks ? picks->size() : pos.size();
+    const size_t first = m_bodies.size();
+    m_bodies.resize(first + count);
+    m_handles.reserve(first + count);
+
+    m_pool.parallelFor(count, STREAM_GRAIN, [&](size_t begin, size_t end, size_t) {
+        for (size_t k = begin; k < end; ++k) {
+            const size_t src = picks ? (*picks)[k] : k;
+            const size_t i = first + k;
+            m_bodies.setPos(i, pos[src]);
+            m_bodies.setVel(i, vel[src]);
+            m_bodies.ax[i] = m_bodies.ay[i] = m_bodies.az[i] = 0.0f;
+            m_bodies.mass[i] = mass[src];
+            m_bodies.radius[i] = r[src];
+            // same spin setup as addPlanet
+            m_bodies.rotation[i] = {glm::vec3(0.0f), 2.0f/5.0f * mass[src] * r[src] * r[src] * glm::vec3(1.0f),
+                                    glm::vec3(0.0f, 9.0f, 0.0f), glm::vec3(0.0f)};
+        }
+    });
+    invalidateForces();
 }
 
-void Physics::addPlanet(const glm::vec3& pos, const glm::vec3& vel, float mass, float r) {
+void Physics::pushPlanet(const glm::vec3& pos, const glm::vec3& vel, float mass, float r) {
     Planet p;
     p.pos = pos;
     p.vel = vel;
@@ -20,78 +118,535 @@ void Physics::addPlanet(const glm::vec3& pos, const glm::vec3& vel, float mass,
 
     p.mass = mass;
     p.r = r;
-    m_planets.push_back(p);
+    m_bodies.push(p);
+    invalidateForces();
 }
 
 
 void Physics::update(float dt) {
-    // Reset accelerations
-    for (auto& planet : m_planets) {
-        planet.acc = glm::vec3(0.0f);
+    // a body added or removed behind our back also means the stored accelerations are stale
+    const bool reuse = m_forcesValid && m_forcesCount == m_bodies.size();
+    const bool measure = m_diagnosticsEnabled;
+    m_contactsMoved = false;
+    if (measure) {
+        m_scratch.resize(m_pool.getThreadCount());
+        for (ThreadScratch& scratch : m_scratch) {
+            scratch.kinetic = 0.0;
+            scratch.momentum = glm::dvec3(0.0);
+            scratch.angularMomentum = glm::dvec3(0.0);
+        }
+    }
+
+    switch (m_integrator) {
+        case Integrator::SemiImplicitEuler:
+            computeForces(dt, true);
+            integrate(dt);
+            m_forcesValid = false;
+            break;
+        case Integrator::LeapfrogKDK:
+            if (!reuse) computeForces(dt, false);
+            kick(0.5f * dt);
+            drift(dt);
+            computeForces(dt, true);
+            kick(0.5f * dt, measure);
+            // accelerations from before a penetration correction don't match the corrected positions
+            m_forcesValid = !m_contactsMoved;
+            break;
+        case Integrator::VelocityVerlet: {
+            if (!reuse) computeForces(dt, false);
+            const float halfDt2 = 0.5f * dt * dt;
+            m_prevAx = m_bodies.ax;
+            m_prevAy = m_bodies.ay;
+            m_prevAz = m_bodies.az;
+            // x += v dt + a dt^2 / 2
+            m_pool.parallelFor(m_bodies.size(), STREAM_GRAIN, [&](size_t begin, size_t end, size_t) {
+                BodyStore& b = m_bodies;
+                if (b.highPrecision) {
+                    for (size_t i = begin; i < end; ++i) {
+                        b.dpx[i] += b.dvx[i] * dt + double(b.ax[i] * halfDt2);
+                        b.dpy[i] += b.dvy[i] * dt + double(b.ay[i] * halfDt2);
+                        b.dpz[i] += b.dvz[i] * dt + double(b.az[i] * halfDt2);
+                    }
+                    b.syncMirror(begin, end);
+                    return;
+                }
+                for (size_t i = begin; i < end; ++i) {
+                    b.px[i] += b.vx[i] * dt + b.ax[i] * halfDt2;
+                    b.py[i] += b.vy[i] * dt + b.ay[i] * halfDt2;
+                    b.pz[i] += b.vz[i] * dt + b.az[i] * halfDt2;
+                }
+            });
+            computeForces(dt, true);
+            // v += (a(t) + a(t + dt)) dt / 2
+            m_pool.parallelFor(m_bodies.size(), STREAM_GRAIN, [&](size_t begin, size_t end, size_t thread) {
+                BodyStore& b = m_bodies;
+                const float h = 0.5f * dt;
+                if (b.highPrecision) {
+                    for (size_t i = begin; i < end; ++i) {
+                        b.dvx[i] += double((m_prevAx[i] + b.ax[i]) * h);
+                        b.dvy[i] += double((m_prevAy[i] + b.ay[i]) * h);
+                        b.dvz[i] += double((m_prevAz[i] + b.az[i]) * h);
+                    }
+                    b.syncMirror(begin, end);
+                } else {
+                    for (size_t i = begin; i < end; ++i) {
+                        b.vx[i] += (m_prevAx[i] + b.ax[i]) * h;
+                        b.vy[i] += (m_prevAy[i] + b.ay[i]) * h;
+                        b.vz[i] += (m_prevAz[i] + b.az[i]) * h;
+                    }
+                }
+                if (measure) measureMotion(begin, end, thread);
+            });
+            m_forcesValid = !m_contactsMoved;
+            break;
+        }
+        case Integrator::Yoshida4: {
+            const float w1 = float(YOSHIDA_W1) * dt;
+            const float w0 = float(YOSHIDA_W0) * dt;
+            if (!reuse) computeForces(dt, false);
+            kick(0.5f * w1);
+            drift(w1);
+            computeForces(dt, false);
+            kick(0.5f * (w1 + w0));
+            drift(w0);
+            computeForces(dt, false);
+            kick(0.5f * (w0 + w1));
+            drift(w1);
+            computeForces(dt, true);
+            kick(0.5f * w1, measure);
+            m_forcesValid = !m_contactsMoved;
+            break;
+        }
+        case Integrator::HermiteBlock:
+            m_hermite.advance(m_bodies, dt, G, reuse, m_pool);
+            m_contacts.clear();
+            findAndResolveContacts(dt);
+            m_hasPotential = false;
+            if (measure) {
+                m_pool.parallelFor(m_bodies.size(), STREAM_GRAIN, [&](size_t begin, size_t end, size_t thread) {
+                    measureMotion(begin, end, thread);
+                });
+            }
+            // an impulse invalidates the jerks and the double precision state kept by the integrator
+            m_forcesValid = m_contacts.empty();
+            break;
+    }
+    m_forcesCount = m_bodies.size();
+
+    integrateRotation(dt);
+    // the mesh forces are periodic, keep the bodies in the box with them. A wrap leaves the integrator
+    // state behind but not the system, so the diagnostics keep their reference
+    if (m_solver == GravitySolver::ParticleMesh && m_particleMesh.wrapPositions(m_bodies)) {
+        m_forcesValid = false;
+        m_hermite.reset();
     }
+    if (measure) updateDiagnostics();
+}
+
+void Physics::computeForces(float dt, bool collide) {
+    const size_t n = m_bodies.size();
+
+    // Reset accelerations
+    m_pool.parallelFor(n, STREAM_GRAIN, [this](size_t begin, size_t end, size_t) {
+        std::fill(m_bodies.ax.begin() + begin, m_bodies.ax.begin() + end, 0.0f);
+        std::fill(m_bodies.ay.begin() + begin, m_bodies.ay.begin() + end, 0.0f);
+        std::fill(m_bodies.az.begin() + begin, m_bodies.az.begin() + end, 0.0f);
+    });
+
+    // the pass that ends a step also sums the potential, if the solver can
+    m_collectPotential = m_diagnosticsEnabled && collide;
+    m_hasPotential = false;
+    m_potential = 0.0;
 
     // Compute gravitational forces
-    for (size_t i = 0; i < m_planets.size(); ++i) {
-        for (size_t j = i + 1; j < m_planets.size(); ++j) {
-            resolveCollision(m_planets[i], m_planets[j]);
-            computeGravity(m_planets[i], m_planets[j]);
+    const bool solverContacts = collide && m_broadPhase == BroadPhase::Solver;
+    switch (m_solver) {
+        case GravitySolver::Direct:
+            if (m_pool.getThreadCount() > 1 || m_bodies.highPrecision) {
+                // same pair math as computeGravity, contacts are resolved after the force pass
+                computeDirect(SimdLevel::Scalar, solverContacts);
+                break;
+            }
+            m_contacts.clear();
+            for (size_t i = 0; i < n; ++i) {
+                for (size_t j = i + 1; j < n; ++j) {
+                    if (solverContacts && resolveCollision(i, j)) m_contactsMoved = true;
+                    computeGravity(i, j);
+                }
+            }
+            m_hasPotential = m_collectPotential;
+            break;
+        case GravitySolver::BarnesHut:
+            m_barnesHut.computeAccelerations(m_bodies, G, m_pool, m_collectPotential ? &m_potential : nullptr);
+            m_hasPotential = m_collectPotential;
+            // the octree doubles as the collision broad phase
+            if (solverContacts) m_barnesHut.findOverlaps(m_bodies, m_contacts, m_pool);
+            break;
+        case GravitySolver::FMM:
+            m_fmm.computeAccelerations(m_bodies, G, m_contacts, m_pool);
+            break;
+        case GravitySolver::DirectSIMD:
+            computeDirect(m_simdLevel, solverContacts);
+            break;
+        case GravitySolver::ParticleMesh:
+            m_particleMesh.computeAccelerations(m_bodies, G, m_pool);
+            break;
+    }
+
+    if (collide) findAndResolveContacts(dt);
+}
+
+void Physics::findAndResolveContacts(float dt) {
+    // Narrow phase only runs on the candidate pairs
+    switch (m_broadPhase) {
+        case BroadPhase::Solver:
+            // Hermite and the mesh have no pair pass to find contacts in
+            if (m_integrator == Integrator::HermiteBlock || m_solver == GravitySolver::ParticleMesh) {
+                m_spatialHash.findOverlaps(m_bodies, m_contacts, m_pool);
+            }
+            break;
+        case BroadPhase::SpatialHash:
+            m_spatialHash.findOverlaps(m_bodies, m_contacts, m_pool);
+            break;
+        case BroadPhase::AABBTree:
+            m_aabbTree.findOverlaps(m_bodies, dt, m_contacts, m_pool);
+            break;
+    }
+    resolveContacts();
+}
+
+void Physics::computeDirect(SimdLevel level, bool collectContacts) {
+    const size_t n = m_bodies.size();
+    const size_t threads = m_pool.getThreadCount();
+    GravityInput in{
+        m_bodies.px.data(), m_bodies.py.data(), m_bodies.pz.data(),
+        m_bodies.mass.data(), m_bodies.radius.data(), n, G
+    };
+    m_contacts.clear();
+    m_scratch.resize(threads);
+    for (auto& scratch : m_scratch) {
+        scratch.contacts.clear();
+        scratch.potential = 0.0;
+    }
+    m_hasPotential = m_collectPotential;
+
+    if (m_bodies.highPrecision) {
+        // full rows, so threads never share an output and no reduction is needed
+        MixedGravityInput mixed{
+            m_bodies.dpx.data(), m_bodies.dpy.data(), m_bodies.dpz.data(),
+            m_bodies.mass.data(), m_bodies.radius.data(), n, G
+        };
+        m_pool.parallelFor(n, 64, [&](size_t begin, size_t end, size_t thread) {
+            GravityOutput out{m_bodies.ax.data(), m_bodies.ay.data(), m_bodies.az.data(),
+                              collectContacts ? &m_scratch[thread].contacts : nullptr,
+                              m_collectPotential ? &m_scratch[thread].potential : nullptr};
+            directGravityMixedRows(mixed, out, begin, end, level);
+        });
+        for (const auto& scratch : m_scratch) {
+            m_contacts.insert(m_contacts.end(), scratch.contacts.begin(), scratch.contacts.end());
+            m_potential += scratch.potential;
         }
+        std::sort(m_contacts.begin(), m_contacts.end());
+        return;
+    }
+
+    if (threads == 1) {
+        GravityOutput out{m_bodies.ax.data(), m_bodies.ay.data(), m_bodies.az.data(),
+                          collectContacts ? &m_contacts : nullptr, m_collectPotential ? &m_potential : nullptr};
+        directGravity(in, out, level);
+        // tiles emit pairs block by block, resolve them in index order like the direct loop
+        std::sort(m_contacts.begin(), m_contacts.end());
+        return;
     }
 
-    // Update velocities and positions
-    for (auto& planet : m_planets) {
-        integrate(planet, dt);
+    // Thread 0 accumulates straight into the store, the others into private buffers reduced below.
+    for (size_t t = 1; t < threads; ++t) {
+        m_scratch[t].ax.resize(n);
+        m_scratch[t].ay.resize(n);
+        m_scratch[t].az.resize(n);
+    }
+    m_pool.parallelFor(n, STREAM_GRAIN, [&](size_t begin, size_t end, size_t) {
+        for (size_t t = 1; t < threads; ++t) {
+            std::fill(m_scratch[t].ax.begin() + begin, m_scratch[t].ax.begin() + end, 0.0f);
+            std::fill(m_scratch[t].ay.begin() + begin, m_scratch[t].ay.begin() + end, 0.0f);
+            std::fill(m_scratch[t].az.begin() + begin, m_scratch[t].az.begin() + end, 0.0f);
+        }
+    });
+
+    // Row i has n - 1 - i pairs, so equal row counts would leave the last threads idle.
+    // Several balanced chunks per thread leave room for stealing when a core gets preempted.
+    const std::vector<size_t> rows = balancedTriangleSplit(n, threads * 4);
+    m_pool.run(rows.size() - 1, [&](size_t task, size_t thread) {
+        ThreadScratch& scratch = m_scratch[thread];
+        auto* contacts = collectContacts ? &scratch.contacts : nullptr;
+        double* potential = m_collectPotential ? &scratch.potential : nullptr;
+        GravityOutput out = thread == 0
+            ? GravityOutput{m_bodies.ax.data(), m_bodies.ay.data(), m_bodies.az.data(), contacts, potential}
+            : GravityOutput{scratch.ax.data(), scratch.ay.data(), scratch.az.data(), contacts, potential};
+        directGravityRows(in, out, rows[task], rows[task + 1], level);
+    });
+
+    m_pool.parallelFor(n, STREAM_GRAIN, [&](size_t begin, size_t end, size_t) {
+        for (size_t t = 1; t < threads; ++t) {
+            for (size_t i = begin; i < end; ++i) {
+                m_bodies.ax[i] += m_scratch[t].ax[i];
+                m_bodies.ay[i] += m_scratch[t].ay[i];
+                m_bodies.az[i] += m_scratch[t].az[i];
+            }
+        }
+    });
+
+    for (const auto& scratch : m_scratch) {
+        m_contacts.insert(m_contacts.end(), scratch.contacts.begin(), scratch.contacts.end());
+        m_potential += scratch.potential;
     }
+    std::sort(m_contacts.begin(), m_contacts.end());
 }
 
-void Physics::computeGravity(Planet& p1, Planet& p2) {
-    const float G = 6.67430e-6f; // Gravitational constant
+void Physics::setSimdLevel(SimdLevel level) {
+    m_simdLevel = static_cast<SimdLevel>(std::min(static_cast<uint8_t>(level), static_cast<uint8_t>(detectSimdLevel())));
+}
+
+void Physics::computeGravity(size_t i, size_t j) {
+    BodyStore& b = m_bodies;
 
-    glm::vec3 direction = p2.pos - p1.pos;
-    float distance = glm::length(direction);
-    if (distance == 0.0f) return; // Prevent division by zero
+    float dx = b.px[j] - b.px[i];
+    float dy = b.py[j] - b.py[i];
+    float dz = b.pz[j] - b.pz[i];
+    float dist2 = dx * dx + dy * dy + dz * dz;
+    if (dist2 == 0.0f) return; // Prevent division by zero
 
-    glm::vec3 forceDir = glm::normalize(direction);
-    float forceMagnitude = (G * p1.mass * p2.mass) / (distance * distance);
-    glm::vec3 force = forceDir * forceMagnitude;
+    // G * m / r^2 along the unit direction, for each side
+    float invDist = 1.0f / std::sqrt(dist2);
+    float s = G * invDist * invDist * invDist;
+    float si = s * b.mass[j];
+    float sj = s * b.mass[i];
 
     // Update accelerations
-    p1.acc += force / p1.mass;
-    p2.acc -= force / p2.mass; // Equal and opposite force
+    b.ax[i] += si * dx; b.ay[i] += si * dy; b.az[i] += si * dz;
+    b.ax[j] -= sj * dx; b.ay[j] -= sj * dy; b.az[j] -= sj * dz; // Equal and opposite force
+
+    if (m_collectPotential) m_potential -= double(G * b.mass[i] * b.mass[j] * invDist);
 }
 
-void Physics::resolveCollision(Planet& p1, Planet& p2) {
-    glm::vec3 dir = p2.pos - p1.pos;
+bool Physics::resolveCollision(size_t i, size_t j) {
+    BodyStore& b = m_bodies;
+    const float r1 = b.radius[i];
+    const float r2 = b.radius[j];
+
+    glm::vec3 dir = b.pos(j) - b.pos(i);
     float dist = glm::length(dir);
-    if (dist >= (p1.r + p2.r)) return;
+    if (dist >= (r1 + r2)) return false;
     if (dist == 0.0f) dir = glm::vec3(1.0f, 0.0f, 0.0f);
-    else dir = glm::normalize(dir);
+    else dir = dir / dist;
 
-    float rel_vel = glm::dot(p2.vel - p1.vel, dir);
-    if (rel_vel > 0) return;
+    float rel_vel = glm::dot(b.vel(j) - b.vel(i), dir);
+    if (rel_vel > 0) return false;
 
-    float impulse = -(1 + e) * rel_vel / (1 / p1.mass + 1 / p2.mass);
+    const float invM1 = 1 / b.mass[i];
+    const float invM2 = 1 / b.mass[j];
+    float impulse = -(1 + e) * rel_vel / (invM1 + invM2);
 
     // penetration dcorrection
-    float penetration = (p1.r + p2.r) - dist;
+    float penetration = (r1 + r2) - dist;
+    bool moved = false;
     if (penetration > 0.0f) {
         const float percent = 0.8f;
         const float slop = 0.01f;
-        float correctionMag = std::max(penetration - slop, 0.0f) / (1/p1.mass + 1/p2.mass);
+        float correctionMag = std::max(penetration - slop, 0.0f) / (invM1 + invM2);
         glm::vec3 correction = correctionMag * percent * dir;
 
-        p1.pos -= (1/p1.mass) * correction;
-        p2.pos += (1/p2.mass) * correction;
+        b.addPos(i, -invM1 * correction);
+        b.addPos(j, invM2 * correction);
+        moved = correctionMag > 0.0f;
     }
 
-    p1.vel -= (impulse / p1.mass) * dir;
-    p2.vel += (impulse / p2.mass) * dir;
+    b.addVel(i, -(impulse * invM1) * dir);
+    b.addVel(j, (impulse * invM2) * dir);
+    return moved;
 }
 
-void Physics::integrate(Planet& p, float dt) {
-    p.vel += p.acc * dt;
-    p.pos += p.vel * dt;
+void Physics::resolveContacts() {
+    if (m_pool.getThreadCount() == 1 || m_contacts.size() < PARALLEL_CONTACTS) {
+        for (const auto& [i, j] : m_contacts) {
+            if (resolveCollision(i, j)) m_contactsMoved = true;
+        }
+        return;
+    }
+
+    // Each contact goes one wave after the latest earlier contact of either of its bodies. A wave then
+    // never touches a body twice, and every body still sees its contacts in the serial order, so the
+    // result is identical to the loop above.
+    m_contactWave.assign(m_bodies.size(), 0);
+    std::vector<uint32_t> wave(m_contacts.size());
+    uint32_t waveCount = 0;
+    for (size_t c = 0; c < m_contacts.size(); ++c) {
+        const auto [i, j] = m_contacts[c];
+        uint32_t w = std::max(m_contactWave[i], m_contactWave[j]);
+        wave[c] = w;
+        m_contactWave[i] = m_contactWave[j] = w + 1;
+        waveCount = std::max(waveCount, w + 1);
+    }
+
+    m_waveStart.assign(waveCount + 1, 0);
+    for (uint32_t w : wave) m_waveStart[w + 1]++;
+    for (uint32_t w = 0; w < waveCount; ++w) m_waveStart[w + 1] += m_waveStart[w];
+    m_waveOrder.resize(m_contacts.size());
+    std::vector<uint32_t> cursor(m_waveStart.begin(), m_waveStart.end() - 1);
+    for (size_t c = 0; c < m_contacts.size(); ++c) m_waveOrder[cursor[wave[c]]++] = static_cast<uint32_t>(c);
+
+    std::atomic<bool> moved{false};
+    for (uint32_t w = 0; w < waveCount; ++w) {
+        const size_t begin = m_waveStart[w];
+        const size_t count = m_waveStart[w + 1] - begin;
+        m_pool.parallelFor(count, 64, [&](size_t b, size_t e, size_t) {
+            for (size_t k = b; k < e; ++k) {
+                const auto [i, j] = m_contacts[m_waveOrder[begin + k]];
+                if (resolveCollision(i, j)) moved.store(true, std::memory_order_relaxed);
+            }
+        });
+    }
+    if (moved) m_contactsMoved = true;
+}
+
+void Physics::integrate(float dt) {
+    // Euler has forces at the start of the step only, so that is the state the diagnostics describe
+    const bool measure = m_diagnosticsEnabled;
+    if (m_bodies.highPrecision) {
+        if (measure) {
+            m_pool.parallelFor(m_bodies.size(), STREAM_GRAIN, [&](size_t begin, size_t end, size_t thread) {
+                measureMotion(begin, end, thread);
+            });
+        }
+        kick(dt);
+        drift(dt);
+        return;
+    }
+
+    const size_t n = m_bodies.size();
+    float* px = m_bodies.px.data();
+    float* py = m_bodies.py.data();
+    float* pz = m_bodies.pz.data();
+    float* vx = m_bodies.vx.data();
+    float* vy = m_bodies.vy.data();
+    float* vz = m_bodies.vz.data();
+    const float* ax = m_bodies.ax.data();
+    const float* ay = m_bodies.ay.data();
+    const float* az = m_bodies.az.data();
+
+    // one streaming pass over the hot arrays, no aliasing between components
+    m_pool.parallelFor(n, STREAM_GRAIN, [&](size_t begin, size_t end, size_t thread) {
+        if (measure) measureMotion(begin, end, thread);
+        for (size_t i = begin; i < end; ++i) {
+            vx[i] += ax[i] * dt;
+            vy[i] += ay[i] * dt;
+            vz[i] += az[i] * dt;
+            px[i] += vx[i] * dt;
+            py[i] += vy[i] * dt;
+            pz[i] += vz[i] * dt;
+        }
+    });
+}
+
+void Physics::kick(float h, bool measure) {
+    m_pool.parallelFor(m_bodies.size(), STREAM_GRAIN, [&](size_t begin, size_t end, size_t thread) {
+        BodyStore& b = m_bodies;
+        if (b.highPrecision) {
+            for (size_t i = begin; i < end; ++i) {
+                b.dvx[i] += double(b.ax[i] * h);
+                b.dvy[i] += double(b.ay[i] * h);
+                b.dvz[i] += double(b.az[i] * h);
+            }
+            b.syncMirror(begin, end);
+        } else {
+            for (size_t i = begin; i < end; ++i) {
+                b.vx[i] += b.ax[i] * h;
+                b.vy[i] += b.ay[i] * h;
+                b.vz[i] += b.az[i] * h;
+            }
+        }
+        // the chunk is still in cache
+        if (measure) measureMotion(begin, end, thread);
+    });
+}
+
+void Physics::drift(float h) {
+    m_pool.parallelFor(m_bodies.size(), STREAM_GRAIN, [&](size_t begin, size_t end, size_t) {
+        BodyStore& b = m_bodies;
+        if (b.highPrecision) {
+            for (size_t i = begin; i < end; ++i) {
+                b.dpx[i] += b.dvx[i] * h;
+                b.dpy[i] += b.dvy[i] * h;
+                b.dpz[i] += b.dvz[i] * h;
+            }
+            b.syncMirror(begin, end);
+            return;
+        }
+        for (size_t i = begin; i < end; ++i) {
+            b.px[i] += b.vx[i] * h;
+            b.py[i] += b.vy[i] * h;
+            b.pz[i] += b.vz[i] * h;
+        }
+    });
+}
+
+void Physics::integrateRotation(float dt) {
+    m_pool.parallelFor(m_bodies.size(), STREAM_GRAIN, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            RotationState& r = m_bodies.rotation[i];
+            r.angVel += r.torque / r.inertia * dt;
+            r.rot += r.angVel * dt;
+        }
+    });
+}
+
+void Physics::measureMotion(size_t begin, size_t end, size_t thread) {
+    const BodyStore& b = m_bodies;
+    double kinetic = 0.0;
+    glm::dvec3 momentum(0.0);
+    glm::dvec3 angularMomentum(0.0);
+    for (size_t i = begin; i < end; ++i) {
+        const glm::dvec3 v = b.velD(i);
+        const glm::dvec3 p = double(b.mass[i]) * v;
+        kinetic += 0.5 * glm::dot(p, v);
+        momentum += p;
+        angularMomentum += glm::cross(b.posD(i), p);
+    }
+    ThreadScratch& scratch = m_scratch[thread];
+    scratch.kinetic += kinetic;
+    scratch.momentum += momentum;
+    scratch.angularMomentum += angularMomentum;
+}
+
+void Physics::updateDiagnostics() {
+    Diagnostics& d = m_diagnostics;
+    d.kinetic = 0.0;
+    d.momentum = glm::dvec3(0.0);
+    d.angularMomentum = glm::dvec3(0.0);
+    for (const ThreadScratch& scratch : m_scratch) {
+        d.kinetic += scratch.kinetic;
+        d.momentum += scratch.momentum;
+        d.angularMomentum += scratch.angularMomentum;
+    }
+    // a total with and one without the potential can't be compared
+    const bool reset = m_diagnosticsReset || !d.valid || d.hasPotential != m_hasPotential;
+    d.hasPotential = m_hasPotential;
+    d.potential = m_hasPotential ? m_potential : 0.0;
+    d.total = d.kinetic + d.potential;
+
+    if (reset) {
+        d.referenceEnergy = d.total;
+        d.referenceMomentum = d.momentum;
+        d.referenceAngularMomentum = d.angularMomentum;
+        d.steps = 0;
+        m_diagnosticsReset = false;
+    } else {
+        d.steps++;
+    }
+    d.valid = true;
 
-    p.angVel += p.torque / p.inertia * dt;
-    p.rot += p.angVel * dt;
+    const double referenceL = glm::length(d.referenceAngularMomentum);
+    d.energyDrift = d.referenceEnergy != 0.0 ? (d.total - d.referenceEnergy) / std::abs(d.referenceEnergy) : 0.0;
+    d.momentumDrift = glm::length(d.momentum - d.referenceMomentum);
+    d.angularMomentumDrift = referenceL > 0.0 ? glm::length(d.angularMomentum - d.referenceAngularMomentum) / referenceL : 0.0;
 }
@@ -2,37 +2,195 @@
 
 #include "glm/glm.hpp"
 
+#include "BodyStore.hpp"
+#include "AABBTree.hpp"
+#include "BarnesHut.hpp"
+#include "Diagnostics.hpp"
+#include "FMM.hpp"
+#include "GravityKernels.hpp"
+#include "Hermite.hpp"
+#include "ParticleMesh.hpp"
+#include "SlotMap.hpp"
+#include "SpatialHash.hpp"
+#include "ThreadPool.hpp"
+
+#include <cstdint>
+#include <span>
+#include <utility>
 #include <vector>
 
-struct Planet {
-    glm::vec3 pos;
-    glm::vec3 vel;
-    glm::vec3 acc;
+enum class GravitySolver : uint8_t {
+    Direct = 0,
+    BarnesHut = 1,
+    FMM = 2,
+    DirectSIMD = 3,  // all pairs, vectorized and tiled
+    ParticleMesh = 4 // periodic box, FFT mesh plus optional short range pairs (TreePM)
+};
+
+enum class Integrator : uint8_t {
+    SemiImplicitEuler = 0, // first order, one force evaluation
+    LeapfrogKDK = 1,       // second order symplectic, one force evaluation (end-of-step forces are reused)
+    VelocityVerlet = 2,    // second order symplectic, one force evaluation, position form
+    Yoshida4 = 3,          // fourth order symplectic, three force evaluations
+    HermiteBlock = 4       // fourth order Hermite with per-body block steps, direct forces (see Hermite)
+};
 
-    glm::vec3 torque;
-    glm::vec3 inertia;
-    glm::vec3 angVel;
-    glm::vec3 rot;
+enum class Precision : uint8_t {
+    Single = 0, // float everywhere
+    Mixed = 1   // double position and velocity, float forces from double separations with compensated sums
+};
 
-    float mass;
-    float r;
+// Where the pairs handed to resolveCollision come from
+enum class BroadPhase : uint8_t {
+    Solver = 0,     // found alongside gravity (every pair for Direct, the tree or near field otherwise)
+    SpatialHash = 1, // uniform hash grid, independent of the gravity solver
+    AABBTree = 2     // dynamic BVH, for radii spanning orders of magnitude
 };
 
 class Physics {
+public:
+    static constexpr float G = 6.67430e-6f; // Gravitational constant
+
 private:
-    std::vector<Planet> m_planets;
+    // Per-thread accumulators for passes that write to both bodies of a pair
+    struct ThreadScratch {
+        AlignedVector<float> ax, ay, az;
+        std::vector<std::pair<uint32_t, uint32_t>> contacts;
+        double potential = 0.0;
+        double kinetic = 0.0;
+        glm::dvec3 momentum{0.0};
+        glm::dvec3 angularMomentum{0.0};
+    };
+
+    BodyStore m_bodies;
+    SlotMap m_handles; // dense index of every body, kept in step with m_bodies
     float e = 0.8f; // Coefficient of restitution for collisions (elasticity a.k.a bounciness)
 
+    GravitySolver m_solver = GravitySolver::Direct;
+    BarnesHut m_barnesHut;
+    FMM m_fmm;
+    ParticleMesh m_particleMesh;
+    SimdLevel m_simdLevel = detectSimdLevel();
+    std::vector<std::pair<uint32_t, uint32_t>> m_contacts;
+
+    Integrator m_integrator = Integrator::LeapfrogKDK;
+    // accelerations in the store belong to the current positions, so the next step can skip its first evaluation
+    bool m_forcesValid = false;
+    size_t m_forcesCount = 0;
+    bool m_contactsMoved = false; // a penetration correction moved bodies after this step's last force pass
+    AlignedVector<float> m_prevAx, m_prevAy, m_prevAz; // velocity Verlet needs a(t) next to a(t + dt)
+    Hermite m_hermite;
+
+    bool m_diagnosticsEnabled = false;
+    bool m_diagnosticsReset = true; // take a new reference on the next measurement
+    bool m_collectPotential = false; // set for the force pass that ends a step
+    bool m_hasPotential = false;     // whether that pass produced one
+    double m_potential = 0.0;
+    Diagnostics m_diagnostics;
+
+    BroadPhase m_broadPhase = BroadPhase::SpatialHash;
+    SpatialHash m_spatialHash;
+    AABBTree m_aabbTree;
+
+    ThreadPool m_pool;
+    std::vector<ThreadScratch> m_scratch;
+    std::vector<uint32_t> m_contactWave; // per body, last wave that touched it
+    std::vector<uint32_t> m_waveStart;
+    std::vector<uint32_t> m_waveOrder;
+
 public:
-    Physics();
+    // threadCount sizes the pool from the start, 0 picks std::thread::hardware_concurrency()
+    explicit Physics(size_t threadCount = 0);
     ~Physics();
 
-    void addPlanet(const glm::vec3& pos, const glm::vec3& vel, float mass, float r);
-    std::vector<Planet>* getPlanets() { return &m_planets; }
+    Handle addPlanet(const glm::vec3& pos, const glm::vec3& vel, float mass, float r);
+    // Adds under a handle issued by another SlotMap (the scene's), false if it is already in use
+    bool addPlanet(Handle handle, const glm::vec3& pos, const glm::vec3& vel, float mass, float r);
+    // Bulk versions, all spans the same length. Bodies are written in parallel, the first returns the new handles
+    // in order, the second skips bodies whose handle is already in use and returns how many it added.
+    std::vector<Handle> addPlanets(std::span<const glm::vec3> pos, std::span<const glm::vec3> vel,
+                                   std::span<const float> mass, std::span<const float> r);
+    size_t addPlanets(std::span<const Handle> handles, std::span<const glm::vec3> pos, std::span<const glm::vec3> vel,
+                      std::span<const float> mass, std::span<const float> r);
+    // Swap-and-pop, O(1) per body. Indices of other bodies can change, handles don't.
+    bool removeBody(Handle handle);
+    size_t removeBodies(const std::vector<Handle>& handles);
+    void clearBodies();
+    uint32_t indexOf(Handle handle) const { return m_handles.indexOf(handle); }
+    // For a store filled directly through getBodies() (a checkpoint restore): takes handles[i] for body i and,
+    // with forcesValid, trusts the accelerations in the store for the next step unless the integrator can't
+    // (see forcesReusable). False on a size mismatch.
+    bool restoreHandles(const std::vector<Handle>& handles, bool forcesValid);
+    const SlotMap& getHandles() const { return m_handles; }
+    BodyStore& getBodies() { return m_bodies; }
+    const BodyStore& getBodies() const { return m_bodies; }
+    Planet getPlanet(size_t idx) const { return m_bodies.get(idx); }
+    void setPlanet(size_t idx, const Planet& planet) { m_bodies.set(idx, planet); invalidateForces(); }
+    size_t getPlanetCount() const { return m_bodies.size(); }
     void update(float dt);
 
+    void setIntegrator(Integrator integrator) { if (integrator != m_integrator) invalidateForces(); m_integrator = integrator; }
+    Integrator getIntegrator() const { return m_integrator; }
+    // Call after editing positions or masses through getBodies(), otherwise the next step starts from stale forces.
+    // Also restarts the diagnostics reference, the edit is not drift.
+    void invalidateForces() { m_forcesValid = false; m_diagnosticsReset = true; m_hermite.reset(); }
+    Hermite& getHermite() { return m_hermite; }
+    // The stored accelerations belong to the current positions and the next step will reuse them
+    bool hasValidForces() const { return m_forcesValid && m_forcesCount == m_bodies.size(); }
+    // Whether a copy of the store (checkpoint, rewind frame) may carry the accelerations over. Hermite keeps
+    // per-body jerks and time steps outside the store, it restarts from fresh forces.
+    bool forcesReusable() const { return hasValidForces() && m_integrator != Integrator::HermiteBlock; }
+    void setRestitution(float restitution) { e = restitution; }
+    float getRestitution() const { return e; }
+    // In Mixed mode Direct and DirectSIMD both run directGravityMixedRows. The tree solvers read the float mirror,
+    // their approximation error is far above its rounding anyway.
+    void setPrecision(Precision precision) { m_bodies.setHighPrecision(precision == Precision::Mixed); invalidateForces(); }
+    Precision getPrecision() const { return m_bodies.highPrecision ? Precision::Mixed : Precision::Single; }
+
+    void setSolver(GravitySolver solver) { m_solver = solver; invalidateForces(); }
+    GravitySolver getSolver() const { return m_solver; }
+    BarnesHut& getBarnesHut() { return m_barnesHut; }
+    FMM& getFMM() { return m_fmm; }
+    ParticleMesh& getParticleMesh() { return m_particleMesh; }
+    void setBroadPhase(BroadPhase broadPhase) { m_broadPhase = broadPhase; }
+    BroadPhase getBroadPhase() const { return m_broadPhase; }
+    SpatialHash& getSpatialHash() { return m_spatialHash; }
+    AABBTree& getAABBTree() { return m_aabbTree; }
+    // Clamped to what the CPU supports
+    void setSimdLevel(SimdLevel level);
+    SimdLevel getSimdLevel() const { return m_simdLevel; }
+    // 0 uses every hardware thread. Workers persist between steps.
+    void setThreadCount(size_t threadCount) { m_pool.setThreadCount(threadCount); }
+    size_t getThreadCount() const { return m_pool.getThreadCount(); }
+    // idle between steps, for bulk work on the physics thread
+    ThreadPool& getThreadPool() { return m_pool; }
+
+    // Energy, momentum and angular momentum measured along with every step while enabled
+    void setDiagnosticsEnabled(bool enabled) { m_diagnosticsEnabled = enabled; m_diagnosticsReset = true; }
+    bool getDiagnosticsEnabled() const { return m_diagnosticsEnabled; }
+    void resetDiagnostics() { m_diagnosticsReset = true; }
+    const Diagnostics& getDiagnostics() const { return m_diagnostics; }
+
 private:
-    void computeGravity(Planet& p1, Planet& p2);
-    void integrate(Planet& p, float dt);
-    void resolveCollision(Planet& p1, Planet& p2);
+    // Resets and recomputes accelerations; with collide the contacts found on the way are resolved too
+    void computeForces(float dt, bool collide);
+    // Broad phase (when it is not the solver's) and contact resolution
+    void findAndResolveContacts(float dt);
+    void computeGravity(size_t i, size_t j);
+    void computeDirect(SimdLevel level, bool collectContacts);
+    void pushPlanet(const glm::vec3& pos, const glm::vec3& vel, float mass, float r);
+    // Appends source[picks[k]] for every k, or every source body when picks is null
+    void appendPlanets(std::span<const glm::vec3> pos, std::span<const glm::vec3> vel, std::span<const float> mass,
+                       std::span<const float> r, const std::vector<uint32_t>* picks);
+    void integrate(float dt);
+    // with measure, the kinetic energy and momenta after the kick are summed on the way
+    void kick(float h, bool measure = false);
+    void drift(float h);
+    void integrateRotation(float dt);
+    // adds the kinetic energy and momenta of [begin, end) to the thread's scratch
+    void measureMotion(size_t begin, size_t end, size_t thread);
+    void updateDiagnostics();
+    // true when the penetration correction moved the pair
+    bool resolveCollision(size_t i, size_t j);
+    void resolveContacts();
 };
\ No newline at end of file
@@ -10,6 +10,7 @@ Renderer::~Renderer() {}
 void Renderer::cleanup() {
     m_pbrRenderSystem.cleanup();
     m_cubeMapRenderSystem.cleanup();
+    m_particleRenderSystem.cleanup();
 
     glDeleteFramebuffers(1, &m_mainFrame.fbo);
     glDeleteTextures(1, &m_mainFrame.colorBuffer);
@@ -44,6 +45,7 @@ void Renderer::render() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     m_pbrRenderSystem.render(m_renderInfo);
+    m_particleRenderSystem.render(m_renderInfo);
     m_cubeMapRenderSystem.render(m_renderInfo);
     renderLight();
 }
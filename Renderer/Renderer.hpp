@@ -6,6 +6,7 @@
 
 #include "systems/PBR_RS.hpp"
 #include "systems/CubeMap_RS.hpp"
+#include "systems/Particle_RS.hpp"
 
 #include <vector>
 
@@ -25,6 +26,7 @@ private:
 
     PBR_RS m_pbrRenderSystem;
     CubeMap_RS m_cubeMapRenderSystem;
+    Particle_RS m_particleRenderSystem;
 
 public:
     Renderer();
@@ -36,6 +38,10 @@ public:
         m_pbrRenderSystem.setRenderables(renderables);
     }
 
+    void setParticles(const std::vector<glm::vec3>* positions) {
+        m_particleRenderSystem.setParticles(positions);
+    }
+
     void setSkyBox(SkyBox* skyBox) {
         m_cubeMapRenderSystem.setSkyBox(skyBox);
     }
@@ -43,6 +49,7 @@ public:
     void initFrameBuffer(uint32_t width, uint32_t height);
     void initPBRShaders(GLuint shaderProg) { m_pbrRenderSystem.init(shaderProg); }
     void initCubeMapShaders(GLuint shaderProg) { m_cubeMapRenderSystem.init(shaderProg); }
+    void initParticleShaders(GLuint shaderProg) { m_particleRenderSystem.init(shaderProg); }
     void setLightShaderProgram(GLuint shaderProg) { m_lightShaderProgram = shaderProg; }
 
     GLuint getMainFrameColor() const { return m_mainFrame.colorBuffer; }
@@ -0,0 +1,50 @@
+#include "Particle_RS.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+Particle_RS::Particle_RS() {}
+Particle_RS::~Particle_RS() {}
+
+void Particle_RS::cleanup() {
+    if (m_vbo) glDeleteBuffers(1, &m_vbo);
+    if (m_vao) glDeleteVertexArrays(1, &m_vao);
+    m_vbo = 0;
+    m_vao = 0;
+    m_capacity = 0;
+}
+
+void Particle_RS::init(GLuint shaderProgram) {
+    m_shaderProgram = shaderProgram;
+    if (m_vao) return;
+
+    glGenVertexArrays(1, &m_vao);
+    glGenBuffers(1, &m_vbo);
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+    glBindVertexArray(0);
+}
+
+void Particle_RS::render(RenderInfo& renderInfo) {
+    if (!m_positions || m_positions->empty() || !m_vao) return;
+    const size_t count = m_positions->size();
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    if (count > m_capacity) {
+        m_capacity = count + count / 2;
+    }
+    // orphan last frame's storage so the upload doesn't wait for draws still reading it
+    glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(glm::vec3), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::vec3), m_positions->data());
+
+    glUseProgram(m_shaderProgram);
+    glUniformMatrix4fv(glGetUniformLocation(m_shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(renderInfo.viewMatrix));
+    glUniformMatrix4fv(glGetUniformLocation(m_shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(renderInfo.projectionMatrix));
+    glUniform3fv(glGetUniformLocation(m_shaderProgram, "color"), 1, glm::value_ptr(m_color));
+    glUniform1f(glGetUniformLocation(m_shaderProgram, "pointSize"), m_pointSize);
+
+    glBindVertexArray(m_vao);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(count));
+    glBindVertexArray(0);
+}
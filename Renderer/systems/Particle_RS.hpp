@@ -0,0 +1,34 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "GLFW/glfw3.h"
+#include "glm/glm.hpp"
+
+#include "RenderStructs.hpp"
+
+#include <vector>
+
+// Draws bodies without a mesh as point sprites, all of them in one draw call from a streamed vertex buffer
+class Particle_RS {
+private:
+    GLuint m_shaderProgram = 0;
+    GLuint m_vao = 0;
+    GLuint m_vbo = 0;
+    size_t m_capacity = 0; // in points
+    const std::vector<glm::vec3>* m_positions = nullptr;
+
+    glm::vec3 m_color{0.9f, 0.85f, 0.7f};
+    float m_pointSize = 40.0f; // in pixels at unit distance
+
+public:
+    Particle_RS();
+    ~Particle_RS();
+
+    void cleanup();
+
+    void init(GLuint shaderProgram);
+
+    void setParticles(const std::vector<glm::vec3>* positions) { m_positions = positions; }
+
+    void render(RenderInfo& renderInfo);
+};
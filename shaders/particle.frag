@@ -0,0 +1,12 @@
+#version 450 core
+
+uniform vec3 color;
+
+out vec4 FragColor;
+
+void main() {
+    vec2 uv = gl_PointCoord * 2.0 - 1.0; // [-1,1]
+    float r2 = dot(uv, uv);
+    if (r2 > 1.0) discard;               // circular mask
+    FragColor = vec4(color * (1.0 - 0.5 * r2), 1.0);
+}
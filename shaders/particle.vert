@@ -0,0 +1,14 @@
+#version 450 core
+
+layout(location = 0) in vec3 pos;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float pointSize;
+
+void main() {
+    vec4 viewPos = view * vec4(pos, 1.0);
+    gl_Position = projection * viewPos;
+    // shrink with distance, but never below a pixel
+    gl_PointSize = max(pointSize / max(-viewPos.z, 0.1), 1.0);
+}